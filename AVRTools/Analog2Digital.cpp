@@ -24,25 +24,179 @@
 #include "Analog2Digital.h"
 
 #include <avr/io.h>
-#include <util/delay.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay_basic.h>
 
+#include "Profiler.h"
+#include "SleepUtils.h"
 
 
-enum A2DPrescalar
-{
-    kA2dPrescaleDiv2 =      0x00,    // 0x01,0x00    -> clk/2    = 8 MHz, 6 MHz, 4 Mhz
-    kA2dPrescaleDiv4 =      0x02,    // 0x02         -> clk/4    = 4 MHz, 3 MHz, 2 MHz
-    kA2dPrescaleDiv8 =      0x03,    // 0x03         -> clk/8    = 2 MHz, 1.5 MHz, 1 MHz
-    kA2dPrescaleDiv16 =     0x04,    // 0x04         -> clk/16   = 1 MHz, 750 KHz, 500 KHz
-    kA2dPrescaleDiv32 =     0x05,    // 0x05         -> clk/32   = 500 KHz, 375 KHz, 250 KHz
-    kA2dPrescaleDiv64 =     0x06,    // 0x06         -> clk/64   = 250 KHz, 187.5 KHz, 125 KHz
-    kA2dPrescaleDiv128 =    0x07     // 0x07         -> clk/128  = 125 KHz, 93.75 KHz, 62.5 KHz
-};
-
 
 namespace
 {
+#if defined(__AVR_ATmega2560__)
+    const uint8_t kNbrA2DChannels = 16;
+#else  // ATmega328p
+    const uint8_t kNbrA2DChannels = 8;
+#endif
+
     int8_t  sCurrentChannel;
+    bool    sEightBitMode;
+
+    // Per channel settle configuration; the default is the traditional 125 us delay
+    uint8_t     sSettleDelay[ kNbrA2DChannels ] =
+    {
+        125, 125, 125, 125, 125, 125, 125, 125,
+#if defined(__AVR_ATmega2560__)
+        125, 125, 125, 125, 125, 125, 125, 125
+#endif
+    };
+    uint16_t    sSettleDiscardFirst;
+
+    // Set when the current channel was preselected by readA2D( channel, nextChannel )
+    bool        sPreselected;
+
+    // Scan state:  shared with the ADC ISR
+    const int8_t*               sScanChannels;
+    volatile uint16_t*          sScanResults;
+    uint8_t                     sScanNbrChannels;
+    volatile uint8_t            sScanIndex;
+    volatile uint16_t           sScanCount;
+    bool                        sScanContinuous;
+
+    // Set when the next conversion of the scan only settles a kA2dSettleDiscardFirst channel
+    bool                        sScanDiscard;
+
+    // Scan oversampling, averaging, and filtering
+    uint8_t                     sScanLog2Samples;
+    uint8_t                     sScanShift;
+    uint8_t                     sScanFilterShift;
+    uint32_t*                   sScanFilterState;
+    uint16_t                    sScanSampleCount;
+    uint32_t                    sScanAccumulator;
+
+    // Acquisition state:  shared with the ADC ISR
+    A2DSampleBuffer*            sAcquisitionBuffer;
+    volatile uint16_t           sAcquisitionOverflows;
+
+    // What the ADC ISR is doing
+    enum
+    {
+        kA2dInterruptIdle,
+        kA2dInterruptScan,
+        kA2dInterruptAcquireTimer0,
+        kA2dInterruptAcquireTimer1
+    };
+
+    volatile uint8_t            sInterruptMode;
+
+
+    bool isValidA2DChannel( int8_t channel )
+    {
+#if defined(__AVR_ATmega2560__)
+        return ( channel >= 0 && channel <= 15 );
+#else  // ATmega328p
+        return ( channel >= 0 && channel <= 7 );
+#endif
+    }
+
+
+    void selectA2DChannel( int8_t channel )
+    {
+#if defined(__AVR_ATmega2560__)
+        // Set MUX5 if channel > 7 (i.e, bit 3 set); otherwise clear it
+        ADCSRB = ( ADCSRB & ~(1<< MUX5) ) | ( ( channel & (1 << 3) ) ? ( 1 << MUX5 ) : 0  );
+#endif
+
+        // Set MUX2-0
+        ADMUX = ( ADMUX & ~0x1f ) | ( channel & 0x07 );
+    }
+
+
+    uint16_t readA2DResult()
+    {
+        if ( sEightBitMode )
+        {
+            // Left-adjusted, so the high byte has the 8 most significant bits
+            return ADCH;
+        }
+
+        // NOTE: must read ADCL before ADCH
+        return  ADCL | ( static_cast<uint16_t>(ADCH) << 8 );
+    }
+
+
+    void waitForA2DConversion()
+    {
+#ifdef LOW_POWER_WAITS
+        if ( sInterruptMode == kA2dInterruptIdle )
+        {
+            // Let the conversion complete interrupt wake us (the ISR ignores it when idle)
+            ADCSRA |= ( 1 << ADIE );
+            sleepWhile( []{ return ADCSRA & ( 1 << ADSC ); }, SLEEP_MODE_IDLE );
+            // Write ADIF as zero so we don't clear it by accident
+            ADCSRA &= ~( ( 1 << ADIE ) | ( 1 << ADIF ) );
+            return;
+        }
+#endif
+
+        // ADSC is cleared when the conversion finishes
+        while ( ADCSRA & ( 1 << ADSC ) )
+            ;
+    }
+
+
+    // Start a single conversion and wait for it to finish
+    void convertA2D()
+    {
+#if defined( LOW_POWER_WAITS ) && defined( LOW_POWER_A2D_NOISE_REDUCTION )
+        if ( sInterruptMode == kA2dInterruptIdle && ( SREG & ( 1 << SREG_I ) ) )
+        {
+            // In ADC noise reduction mode the conversion starts by itself once the CPU halts
+            ADCSRA = ( ADCSRA & ~( 1 << ADIF ) ) | ( 1 << ADIE );
+            set_sleep_mode( SLEEP_MODE_ADC );
+            cli();
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+
+            // Some other interrupt may have woken us before the conversion finished
+            waitForA2DConversion();
+            return;
+        }
+#endif
+
+        ADCSRA |= ( 1 << ADSC );
+        waitForA2DConversion();
+    }
+
+
+    bool isSettleDiscardFirst( int8_t channel )
+    {
+        return sSettleDiscardFirst & ( 1U << channel );
+    }
+
+
+    void settleA2DChannel( int8_t channel )
+    {
+        if ( isSettleDiscardFirst( channel ) )
+        {
+            // Throw away one conversion
+            convertA2D();
+        }
+        else
+        {
+            // Need to let ADC system restablize:  one computed delay (4 cycles per loop), rather than a loop
+            // of 1 us delays whose own overhead would stretch the delay
+            uint16_t loops = static_cast<uint16_t>( sSettleDelay[ channel ] ) * ( F_CPU / 1000000UL ) / 4;
+            if ( loops )
+            {
+                _delay_loop_2( loops );
+            }
+        }
+    }
 };
 
 
@@ -86,9 +240,49 @@ void initA2D( uint8_t ref )
     ADCSRA |= (1 << ADEN);
 
     sCurrentChannel = 0;
+    sEightBitMode = false;
+    sPreselected = false;
+}
+
+
+void setA2DConversionMode( A2DConversionMode mode )
+{
+    if ( mode == kA2dMode8BitFast )
+    {
+        // Desired ADC clock is about 1 MHz
+#if F_CPU == 8000000
+        // 8 MHz / 8 = 1 MHz
+        setA2DPrescaler( kA2dPrescaleDiv8 );
+#else
+        // 16 MHz / 16 = 1 MHz; 12 MHz / 16 = 750 KHz
+        setA2DPrescaler( kA2dPrescaleDiv16 );
+#endif
+        ADMUX |= ( 1 << ADLAR );
+        sEightBitMode = true;
+    }
+    else
+    {
+        // Same prescaler as initA2D()
+#if F_CPU == 8000000
+        setA2DPrescaler( kA2dPrescaleDiv64 );
+#else
+        setA2DPrescaler( kA2dPrescaleDiv128 );
+#endif
+        ADMUX &= ~( 1 << ADLAR );
+        sEightBitMode = false;
+    }
+}
+
+
+
+void setA2DPrescaler( A2DPrescalar prescale )
+{
+    // Write ADIF as zero so we don't clear it by accident
+    ADCSRA = ( ADCSRA & ~( ( 1 << ADIF ) | 0x07 ) ) | prescale;
 }
 
 
+
 void turnOffA2D()
 {
     // Clear (turn off) ADC
@@ -101,56 +295,451 @@ void setA2DVoltageReference( A2DVoltageReference ref )
 {
     ADMUX = ( ADMUX & ~0xc0 ) | ( ref << 6 );
 
-    // Need to let ADC system restablize
-    _delay_us( 125 );
+    // Need to let ADC system restablize:  the next read settles according to its channel's settings
+    sCurrentChannel = -1;
+    sPreselected = false;
 }
 
 
 int readA2D( int8_t channel )
 {
-    // Differentiate between ATmega328p and ATmega2560
-#if defined(__AVR_ATmega2560__)
-
-    if ( channel < 0 || channel > 15 )
+    if ( !isValidA2DChannel( channel ) )
     {
         // Not a valid ADC channel
         return 0;
     }
 
+    if ( sPreselected )
+    {
+        // A preselected channel has had time to settle, but a discarded conversion may still be running
+        waitForA2DConversion();
+        sPreselected = false;
+    }
+
     if ( sCurrentChannel != channel )
     {
-        // Set MUX5 if channel > 7 (i.e, bit 3 set); otherwise clear it
-        ADCSRB = ( ADCSRB & ~(1<< MUX5) ) | ( ( channel & (1 << 3) ) ? ( 1 << MUX5 ) : 0  );
+        selectA2DChannel( channel );
+        settleA2DChannel( channel );
+
+        sCurrentChannel = channel;
     }
 
-#else  // ATmega328p
+    // Run an A2D conversion
+    convertA2D();
+
+    return readA2DResult();
+}
+
+
+
+int readA2D( int8_t channel, int8_t nextChannel )
+{
+    int result = readA2D( channel );
 
-    if ( channel < 0 || channel > 7 )
+    if ( isValidA2DChannel( nextChannel ) && nextChannel != channel )
     {
-        // Not a valid ADC channel
-        return 0;
+        // Switching the MUX now doesn't affect the result, which is latched in ADCH/ADCL
+        // until the next conversion completes
+        selectA2DChannel( nextChannel );
+        sCurrentChannel = nextChannel;
+        sPreselected = true;
+
+        if ( isSettleDiscardFirst( nextChannel ) )
+        {
+            // Start the conversion to be discarded; it runs while the caller makes use of this result
+            ADCSRA |= ( 1 << ADSC );
+        }
     }
 
-#endif
+    return result;
+}
 
-    if ( sCurrentChannel != channel )
+
+
+void setA2DChannelSettle( int8_t channel, A2DSettleMode mode, uint8_t delayMicroseconds )
+{
+    if ( isValidA2DChannel( channel ) )
     {
-        // Set MUX2-0
-        ADMUX = ( ADMUX & ~0x1f ) | ( channel & 0x07 );
+        if ( mode == kA2dSettleDiscardFirst )
+        {
+            sSettleDiscardFirst |= ( 1U << channel );
+        }
+        else
+        {
+            sSettleDiscardFirst &= ~( 1U << channel );
+            sSettleDelay[ channel ] = delayMicroseconds;
+        }
+    }
+}
+
+
+
+
+bool startA2DScan( const int8_t* channels, uint8_t nbrChannels, volatile uint16_t* results, bool continuous )
+{
+    stopA2DScan();
+    stopA2DAcquisition();
+
+    if ( !channels || !results || !nbrChannels )
+    {
+        return false;
+    }
+
+    for ( uint8_t i = 0; i < nbrChannels; ++i )
+    {
+        if ( !isValidA2DChannel( channels[i] ) )
+        {
+            return false;
+        }
+    }
 
-        // Need to let ADC system restablize
-        _delay_us( 125 );
+    sScanChannels = channels;
+    sScanResults = results;
+    sScanNbrChannels = nbrChannels;
+    sScanContinuous = continuous;
+    sScanIndex = 0;
+    sScanCount = 0;
+    sScanSampleCount = 0;
+    sScanAccumulator = 0;
+    sInterruptMode = kA2dInterruptScan;
 
+    // Let any conversion started by readA2D( channel, nextChannel ) finish
+    waitForA2DConversion();
+    sPreselected = false;
+
+    // The scan leaves the MUX pointing anywhere
+    sCurrentChannel = -1;
+
+    selectA2DChannel( channels[0] );
+    sScanDiscard = isSettleDiscardFirst( channels[0] );
+
+    // Clear any stale interrupt flag (by writing a one to it), enable the interrupt, and start the first conversion
+    ADCSRA |= ( 1 << ADIF ) | ( 1 << ADIE ) | ( 1 << ADSC );
+
+    return true;
+}
+
+
+
+void stopA2DScan()
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( sInterruptMode == kA2dInterruptScan )
+        {
+            // Write ADIF as zero so we don't clear it by accident (cleared when ADIE set again)
+            ADCSRA &= ~( ( 1 << ADIE ) | ( 1 << ADIF ) );
+            sInterruptMode = kA2dInterruptIdle;
+        }
+    }
+}
+
+
+
+bool isA2DScanRunning()
+{
+    return ( sInterruptMode == kA2dInterruptScan );
+}
+
+
+
+uint16_t getA2DScanCount()
+{
+    uint16_t count;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        count = sScanCount;
+    }
+    return count;
+}
+
+
+
+uint16_t getA2DScanResult( uint8_t index )
+{
+    uint16_t result = 0;
+    if ( sScanResults && index < sScanNbrChannels )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            result = sScanResults[ index ];
+        }
+    }
+    return result;
+}
+
+
+
+
+namespace
+{
+
+    bool startAcquisition( int8_t channel, A2DSampleBuffer* buffer, uint8_t triggerSource, uint8_t mode )
+    {
+        if ( !buffer || !isValidA2DChannel( channel ) )
+        {
+            return false;
+        }
+
+        sAcquisitionBuffer = buffer;
+        sAcquisitionOverflows = 0;
+        sInterruptMode = mode;
+
+        // Let any conversion started by readA2D( channel, nextChannel ) finish
+        waitForA2DConversion();
+        sPreselected = false;
+
+        selectA2DChannel( channel );
         sCurrentChannel = channel;
+
+        // Select the trigger source (ADTS2-0), leaving the rest of ADCSRB (e.g., MUX5) alone
+        ADCSRB = ( ADCSRB & ~( ( 1 << ADTS2 ) | ( 1 << ADTS1 ) | ( 1 << ADTS0 ) ) ) | triggerSource;
+
+        // Clear any stale interrupt flag (by writing a one to it), enable the interrupt and auto-triggering
+        ADCSRA |= ( 1 << ADIF ) | ( 1 << ADIE ) | ( 1 << ADATE );
+
+        return true;
     }
 
-    // Start A2D conversion
-    ADCSRA |= ( 1 << ADSC );
+};
+
 
-    // ADSC is cleared when the conversion finishes
-    while ( ADCSRA & ( 1 << ADSC ) )
-        ;
 
-    // NOTE: must read ADCL before ADCH
-    return  ADCL | ( static_cast<uint16_t>(ADCH) << 8 );
+bool startA2DAcquisition( int8_t channel, uint16_t samplesPerSecond, A2DSampleBuffer* buffer )
+{
+    stopA2DScan();
+    stopA2DAcquisition();
+
+    if ( !samplesPerSecond )
+    {
+        return false;
+    }
+
+    // Each conversion takes 13.5 ADC clocks when auto-triggered; make sure it finishes before the next trigger
+    // (ADPS2-0 = 0 also means divide by 2)
+    uint8_t adcDivisorLog2 = ADCSRA & 0x07;
+    uint32_t adcClock = F_CPU >> ( adcDivisorLog2 ? adcDivisorLog2 : 1 );
+    if ( static_cast<uint32_t>( samplesPerSecond ) * 14 > adcClock )
+    {
+        return false;
+    }
+
+    // Find the smallest Timer1 prescaler that lets the period fit in 16 bits
+    const uint16_t kPrescalers[] = { 1, 8, 64, 256, 1024 };
+    uint8_t cs = 0;
+    uint32_t ticks;
+    do
+    {
+        ticks = F_CPU / ( static_cast<uint32_t>( kPrescalers[cs] ) * samplesPerSecond );
+        ++cs;
+    }
+    while ( ticks > 65536UL && cs < 5 );
+
+    if ( ticks > 65536UL )
+    {
+        return false;
+    }
+
+    // Timer1 in CTC mode (WGM = 4) with TOP = OCR1A; compare match B at count 0 provides the trigger
+    TCCR1B = 0;
+    TCCR1A = 0;
+    TCNT1 = 0;
+    OCR1A = ticks - 1;
+    OCR1B = 0;
+    TIFR1 = ( 1 << OCF1B );
+
+    // Trigger source:  Timer/Counter1 compare match B (ADTS = 101)
+    if ( !startAcquisition( channel, buffer, ( 1 << ADTS2 ) | ( 1 << ADTS0 ), kA2dInterruptAcquireTimer1 ) )
+    {
+        return false;
+    }
+
+    // Start Timer1 (CS12-10 = cs)
+    TCCR1B = ( 1 << WGM12 ) | cs;
+
+    return true;
+}
+
+
+
+bool startA2DAcquisitionTimer0( int8_t channel, A2DSampleBuffer* buffer )
+{
+    stopA2DScan();
+    stopA2DAcquisition();
+
+    // Trigger source:  Timer/Counter0 overflow (ADTS = 100)
+    return startAcquisition( channel, buffer, ( 1 << ADTS2 ), kA2dInterruptAcquireTimer0 );
+}
+
+
+
+void stopA2DAcquisition()
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( sInterruptMode == kA2dInterruptAcquireTimer0 || sInterruptMode == kA2dInterruptAcquireTimer1 )
+        {
+            if ( sInterruptMode == kA2dInterruptAcquireTimer1 )
+            {
+                // Stop Timer1
+                TCCR1B = 0;
+            }
+
+            // Write ADIF as zero so we don't clear it by accident
+            ADCSRA &= ~( ( 1 << ADIE ) | ( 1 << ADATE ) | ( 1 << ADIF ) );
+            ADCSRB &= ~( ( 1 << ADTS2 ) | ( 1 << ADTS1 ) | ( 1 << ADTS0 ) );
+            sInterruptMode = kA2dInterruptIdle;
+        }
+    }
+}
+
+
+
+uint16_t getA2DAcquisitionOverflows()
+{
+    uint16_t count;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        count = sAcquisitionOverflows;
+    }
+    return count;
+}
+
+
+
+
+void setA2DScanOversampling( uint8_t extraBits )
+{
+    if ( extraBits > 4 )
+    {
+        extraBits = 4;
+    }
+
+    // Accumulate 4^n samples and shift right n bits
+    sScanLog2Samples = 2 * extraBits;
+    sScanShift = extraBits;
+}
+
+
+
+void setA2DScanAveraging( uint8_t log2Samples )
+{
+    if ( log2Samples > 8 )
+    {
+        log2Samples = 8;
+    }
+
+    // Accumulate 2^n samples and shift right n bits
+    sScanLog2Samples = log2Samples;
+    sScanShift = log2Samples;
+}
+
+
+
+void setA2DScanFilter( uint8_t shift, uint32_t* filterState )
+{
+    if ( shift > 8 )
+    {
+        shift = 8;
+    }
+
+    sScanFilterShift = filterState ? shift : 0;
+    sScanFilterState = filterState;
+}
+
+
+
+
+ISR( ADC_vect )
+{
+    PROFILE_PROBE( kProfileA2D );
+
+    uint16_t result = readA2DResult();
+
+    if ( sInterruptMode == kA2dInterruptIdle )
+    {
+        // Only enabled to wake the CPU from sleep during a single conversion (see SleepUtils.h)
+        return;
+    }
+
+    if ( sInterruptMode != kA2dInterruptScan )
+    {
+        if ( sInterruptMode == kA2dInterruptAcquireTimer1 )
+        {
+            // Auto-triggering needs a rising edge on OCF1B, and nothing else clears it
+            TIFR1 = ( 1 << OCF1B );
+        }
+
+        if ( sAcquisitionBuffer->push( result ) && sAcquisitionOverflows != 0xFFFF )
+        {
+            ++sAcquisitionOverflows;
+        }
+        return;
+    }
+
+    if ( sScanDiscard )
+    {
+        // Throw away the first conversion after switching to this channel
+        sScanDiscard = false;
+        ADCSRA |= ( 1 << ADSC );
+        return;
+    }
+
+    // Accumulate as many conversions of this channel as oversampling or averaging calls for
+    sScanAccumulator += result;
+    if ( ++sScanSampleCount < ( 1U << sScanLog2Samples ) )
+    {
+        ADCSRA |= ( 1 << ADSC );
+        return;
+    }
+    result = sScanAccumulator >> sScanShift;
+    sScanAccumulator = 0;
+    sScanSampleCount = 0;
+
+    uint8_t index = sScanIndex;
+
+    if ( sScanFilterShift )
+    {
+        // y += ( x - y ) / 2^k, with y held as a fixed-point value with k fractional bits
+        uint32_t state = sScanFilterState[ index ];
+        if ( sScanCount == 0 )
+        {
+            // Prime the filter with the first value
+            state = static_cast<uint32_t>( result ) << sScanFilterShift;
+        }
+        else
+        {
+            state = state - ( state >> sScanFilterShift ) + result;
+        }
+        sScanFilterState[ index ] = state;
+
+        // On a constant input the integer part settles exactly on the input
+        result = state >> sScanFilterShift;
+    }
+
+    sScanResults[ index ] = result;
+
+    if ( ++index >= sScanNbrChannels )
+    {
+        index = 0;
+        ++sScanCount;
+
+        if ( !sScanContinuous )
+        {
+            // Single pass is done
+            ADCSRA &= ~( 1 << ADIE );
+            sInterruptMode = kA2dInterruptIdle;
+            return;
+        }
+    }
+    // Switch channels (if the next one is different) and immediately start the next conversion
+    int8_t channel = sScanChannels[ index ];
+    if ( channel != sScanChannels[ sScanIndex ] )
+    {
+        selectA2DChannel( channel );
+        sScanDiscard = isSettleDiscardFirst( channel );
+    }
+    sScanIndex = index;
+
+    ADCSRA |= ( 1 << ADSC );
 }
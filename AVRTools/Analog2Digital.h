@@ -27,6 +27,24 @@
  *
  * To use these functions, include Analog2Digital.h in your source code and link against Analog2Digital.cpp.
  *
+ * In addition to reading individual channels on demand with readA2D(), you can start an interrupt-driven
+ * scan of a list of channels with startA2DScan().  The ADC conversion-complete interrupt then moves from
+ * channel to channel on its own, writing the results into an array you provide, so your code can read the
+ * latest values without waiting for any conversions.  Scans can also oversample and decimate to obtain
+ * more than 10 bits of resolution (setA2DScanOversampling()), average (setA2DScanAveraging()), and apply a
+ * simple low-pass filter (setA2DScanFilter()), all with integer arithmetic performed in the interrupt.
+ *
+ * For sampling a single channel at a fixed rate, startA2DAcquisition() uses the ADC's auto-trigger
+ * capability to start conversions from a timer event, free of software jitter, and pushes the samples
+ * into a ring buffer of type A2DSampleBuffer.  The size of this buffer defaults to 64 samples; you can
+ * change this by defining the macro \c A2D_SAMPLE_BUFFER_SIZE prior to including Analog2Digital.h (best done
+ * with a compiler option, e.g., \c -DA2D_SAMPLE_BUFFER_SIZE=128).
+ *
+ * By default conversions have 10-bit resolution and the ADC clock is kept between 50 and 200 KHz as the datasheet
+ * requires for full accuracy, which limits conversions to about 9600 per second.  When 8 bits of resolution is
+ * enough, setA2DConversionMode( kA2dMode8BitFast ) runs the ADC clock at about 1 MHz and reads only the
+ * left-adjusted high byte of each result, allowing several times as many conversions per second.
+ *
  */
 
 
@@ -36,6 +54,24 @@
 #include <stdint.h>
 
 #include "GpioPinMacros.h"
+#include "RingBufferT.h"
+
+
+
+#ifndef A2D_SAMPLE_BUFFER_SIZE
+#define A2D_SAMPLE_BUFFER_SIZE      64
+#endif
+
+#if A2D_SAMPLE_BUFFER_SIZE < 1 || A2D_SAMPLE_BUFFER_SIZE > 16384
+#error "A2D_SAMPLE_BUFFER_SIZE must be between 1 and 16384"
+#endif
+
+
+/*! \brief The type of ring buffer into which startA2DAcquisition() and startA2DAcquisitionTimer0() store samples.
+ *
+ */
+
+typedef RingBufferT< uint16_t, uint16_t, A2D_SAMPLE_BUFFER_SIZE > A2DSampleBuffer;
 
 
 #if defined(__AVR_ATmega2560__)
@@ -65,6 +101,48 @@ enum A2DVoltageReference
 #endif
 
 
+/*! \brief Constants representing the prescaler that divides the CPU clock to obtain the ADC clock.
+ *
+ * The comments list the resulting ADC clock at CPU clocks of 16 MHz, 12 MHz, and 8 MHz.
+ */
+
+enum A2DPrescalar
+{
+    kA2dPrescaleDiv2 =      0x00,    //!< clk/2    = 8 MHz, 6 MHz, 4 Mhz  \hideinitializer
+    kA2dPrescaleDiv4 =      0x02,    //!< clk/4    = 4 MHz, 3 MHz, 2 MHz  \hideinitializer
+    kA2dPrescaleDiv8 =      0x03,    //!< clk/8    = 2 MHz, 1.5 MHz, 1 MHz  \hideinitializer
+    kA2dPrescaleDiv16 =     0x04,    //!< clk/16   = 1 MHz, 750 KHz, 500 KHz  \hideinitializer
+    kA2dPrescaleDiv32 =     0x05,    //!< clk/32   = 500 KHz, 375 KHz, 250 KHz  \hideinitializer
+    kA2dPrescaleDiv64 =     0x06,    //!< clk/64   = 250 KHz, 187.5 KHz, 125 KHz  \hideinitializer
+    kA2dPrescaleDiv128 =    0x07     //!< clk/128  = 125 KHz, 93.75 KHz, 62.5 KHz  \hideinitializer
+};
+
+
+
+/*! \brief Constants representing the trade-off between conversion speed and resolution.
+ *
+ */
+
+enum A2DConversionMode
+{
+    kA2dMode10Bit,          //!< 10-bit results (0 to 1023), ADC clock 50-200 KHz (the default) \hideinitializer
+    kA2dMode8BitFast        //!< 8-bit results (0 to 255) read from ADCH only, ADC clock about 1 MHz \hideinitializer
+};
+
+
+
+/*! \brief Constants representing how the ADC is allowed to settle after switching to a channel.
+ *
+ */
+
+enum A2DSettleMode
+{
+    kA2dSettleDelay,            //!< Wait a fixed time before converting (the default, 125 microseconds) \hideinitializer
+    kA2dSettleDiscardFirst      //!< Perform one conversion and discard the result instead of waiting \hideinitializer
+};
+
+
+
 /*
     The following macro is not intended for end-user use; it is needed to support the pin naming
     macros in conjunction with the C/C++ preprocessor's re-scanning rules.
@@ -78,13 +156,13 @@ enum A2DVoltageReference
 /*!
  * \brief Read the analog value of the pin.
  *
- * This function returns a number between 0 and 1023 that corresponds to voltage between
- * 0 and a maximum reference value.  The reference value is set using one of the
+ * This function returns a number between 0 and 1023 (between 0 and 255 in kA2dMode8BitFast mode) that
+ * corresponds to voltage between 0 and a maximum reference value.  The reference value is set using one of the
  * setA2DVoltageReferenceXXX() functions.
  *
  * \arg \c pinName a pin name macro generated by GpioPinAnalog().
  *
- * \returns an value between 0 and 1023.
+ * \returns an value between 0 and 1023 (between 0 and 255 in kA2dMode8BitFast mode).
  *
  * \note Before calling this function must fist initialize the analog-to-digital sub-system
  * by calling initA2D().
@@ -102,13 +180,13 @@ int readA2D( int8_t channel );
 /*!
  * \brief Read the analog value of the pin.
  *
- * This function returns a number between 0 and 1023 that corresponds to voltage between
- * 0 and a maximum reference value.  The reference value is set using one of the
+ * This function returns a number between 0 and 1023 (between 0 and 255 in kA2dMode8BitFast mode) that
+ * corresponds to voltage between 0 and a maximum reference value.  The reference value is set using one of the
  * setA2DVoltageReferenceXXX() functions.
  *
  * \arg \c pinVar a pin variable that has analog-to-digital capabilities (i.e., initialized with makeGpioVarFromGpioPinAnalog()).
  *
- * \returns an value between 0 and 1023.
+ * \returns an value between 0 and 1023 (between 0 and 255 in kA2dMode8BitFast mode).
  *
  * \note Before calling this function must fist initialize the analog-to-digital sub-system
  * by calling initA2D().
@@ -136,6 +214,39 @@ void initA2D( uint8_t ref = kA2dReferenceAVCC );
 
 
 
+/*!
+ * \brief Choose between 10-bit conversions and faster 8-bit conversions.
+ *
+ * In kA2dMode10Bit mode (the default set by initA2D()), the ADC clock is kept in the 50-200 KHz range the
+ * datasheet requires for full 10-bit accuracy.  In kA2dMode8BitFast mode, results are left-adjusted (ADLAR set)
+ * so only ADCH needs to be read, and the ADC clock is raised to about 1 MHz; this allows up to about
+ * 76000 conversions per second at 16 MHz with 8 bits of accuracy.  The mode affects readA2D(),
+ * readGpioPinAnalog(), readGpioPinAnalogV(), scans, and acquisitions alike.
+ *
+ * \arg \c mode the conversion mode; pass one of the constants from enum A2DConversionMode.
+ *
+ * \note Call this function after initA2D() (which sets kA2dMode10Bit), and not while a scan or
+ * acquisition is running.
+ */
+
+void setA2DConversionMode( A2DConversionMode mode );
+
+
+
+/*!
+ * \brief Set the ADC prescaler directly, for finer control over the speed/accuracy trade-off than
+ * setA2DConversionMode() provides.  The prescaler divides the CPU clock to obtain the ADC clock; each
+ * conversion takes 13 ADC clocks (25 for the first conversion after initA2D()).
+ *
+ * \arg \c prescale the prescaler; pass one of the constants from enum A2DPrescalar.
+ *
+ * \note Call this function after initA2D() or setA2DConversionMode(), both of which set the prescaler.
+ */
+
+void setA2DPrescaler( A2DPrescalar prescale );
+
+
+
 /*!
  * \brief Turn off the analog-to-digital system.
  *
@@ -148,7 +259,8 @@ void turnOffA2D();
  * \brief Set the voltage reference for the analog-to-digital system.
  *
  * After your have initialized the analog-to-digital system with initA2D(), you can
- * use this function to change the voltage reference.
+ * use this function to change the voltage reference.  The next reading of any channel
+ * lets the ADC settle as configured for that channel (see setA2DChannelSettle()).
  *
  * \arg \c ref provides the voltage reference to be used for analog-to-digital conversions.  Pass
  * one of the constants from enum A2DVoltageReference.
@@ -215,7 +327,7 @@ inline void setA2DVoltageReference256V()
  *
  * \arg \c channel is an ADC channel number (between 0 and 7 on ATmega328; between 0 and 15 on ATMega2560).
  *
- * \returns a number between 0 and 1023.
+ * \returns a number between 0 and 1023 (between 0 and 255 in kA2dMode8BitFast mode).
  *
  * \note Generally users will not call this function but instead call readPinAnalog() passing it a
  * pin name macro generated by Analog().
@@ -225,4 +337,253 @@ inline void setA2DVoltageReference256V()
 
 int readA2D( int8_t channel );
 
+
+
+
+/*!
+ * \brief Read an analog voltage value and preselect the channel to be read next.
+ *
+ * This works like readA2D( int8_t channel ), but as soon as the conversion of \c channel finishes, the
+ * MUX is switched to \c nextChannel before the result is read, so the input starts settling right away.
+ * When the next call reads \c nextChannel, the time since this call counts as its settling time, so no
+ * settle delay is added; if \c nextChannel is set to kA2dSettleDiscardFirst, the discarded conversion is
+ * started immediately and runs in the background.  Reading many channels round-robin this way avoids
+ * nearly all of the settling overhead.
+ *
+ * \note If \c nextChannel is set to kA2dSettleDelay, it gets only as much settling time as elapses before
+ * it is read:  if you read it immediately, it doesn't settle at all.  Either do the work between the reads,
+ * or set the channel to kA2dSettleDiscardFirst.
+ *
+ * \arg \c channel is an ADC channel number (between 0 and 7 on ATmega328; between 0 and 15 on ATMega2560).
+ * \arg \c nextChannel the ADC channel number to be read next (the preselection is ignored if invalid).
+ *
+ * \returns a number between 0 and 1023 (between 0 and 255 in kA2dMode8BitFast mode).
+ */
+
+int readA2D( int8_t channel, int8_t nextChannel );
+
+
+
+/*!
+ * \brief Configure how the ADC is allowed to settle after switching to a channel (or after changing the
+ * voltage reference).
+ *
+ * High-impedance sources need time to charge the ADC's sample-and-hold capacitor after the MUX switches
+ * to them, which is why readA2D() waits 125 microseconds by default.  For low-impedance sources (less than
+ * 10 KOhm), you can shorten or eliminate the delay, or instead have a dummy conversion performed and
+ * its result discarded (which takes 13 ADC clocks, 104 microseconds with the default ADC clock, or 13
+ * microseconds in kA2dMode8BitFast mode).
+ *
+ * \arg \c channel is an ADC channel number (between 0 and 7 on ATmega328; between 0 and 15 on ATMega2560).
+ * \arg \c mode how to let the channel settle;  pass one of the constants from enum A2DSettleMode.
+ * \arg \c delayMicroseconds the delay for kA2dSettleDelay mode (0 means no delay at all); ignored
+ * for kA2dSettleDiscardFirst.  The delay is a minimum:  the call adds a few cycles of overhead.
+ *
+ * \note The settings persist across calls to initA2D().  Scans (see startA2DScan()) honor kA2dSettleDiscardFirst,
+ * but cannot wait in the interrupt function, so they ignore settle delays.
+ */
+
+void setA2DChannelSettle( int8_t channel, A2DSettleMode mode, uint8_t delayMicroseconds = 125 );
+
+
+
+
+/*!
+ * \brief Start an interrupt-driven scan of a list of analog-to-digital channels.
+ *
+ * Each channel in the list is converted in turn by the ADC conversion-complete interrupt, which
+ * stores the result in the corresponding element of the results array and immediately starts the
+ * conversion of the next channel.  Every time the scan completes a pass through the list, the scan count
+ * (see getA2DScanCount()) is incremented.  No program time is spent waiting on conversions.
+ *
+ * \arg \c channels an array of ADC channel numbers to scan (between 0 and 7 on ATmega328; between 0 and 15
+ *  on ATMega2560).  This array is used in place (not copied) and must remain valid while the scan runs.
+ * \arg \c nbrChannels the number of channels in the array.
+ * \arg \c results an array of at least nbrChannels elements in which the results (between 0 and 1023, or
+ * between 0 and 255 in kA2dMode8BitFast mode; wider with setA2DScanOversampling()) are stored.
+ * This array must remain valid while the scan runs; read it with getA2DScanResult().
+ * \arg \c continuous if true (the default) the scan repeats until you call stopA2DScan(); if false, the
+ * scan stops after one pass through the list.
+ *
+ * \returns true if the scan started, false if the arguments are invalid (e.g., an invalid channel number).
+ *
+ * \note Before calling this function must fist initialize the analog-to-digital sub-system by calling initA2D().
+ * Interrupts must be enabled for the scan to run.  Do not call readA2D() while a scan is running.
+ *
+ * \note Conversions in a scan do not wait for the ADC to settle after switching channels (settle delays
+ * set by setA2DChannelSettle() only apply to readA2D()), so sources connected to scanned channels should have
+ * low impedance (10 KOhm or less).  For a channel set to kA2dSettleDiscardFirst, the scan does perform and
+ * discard one conversion each time it switches to the channel.
+ */
+
+bool startA2DScan( const int8_t* channels, uint8_t nbrChannels, volatile uint16_t* results, bool continuous = true );
+
+
+
+/*!
+ * \brief Stop a scan started by startA2DScan().  The conversion in progress (if any) completes but its
+ * result is discarded.
+ */
+
+void stopA2DScan();
+
+
+
+/*!
+ * \brief Determine if a scan started by startA2DScan() is still running.
+ *
+ * \returns true if the scan is running.
+ */
+
+bool isA2DScanRunning();
+
+
+
+/*!
+ * \brief Get the number of complete passes through the channel list made by the current (or last) scan.
+ * Comparing this with a previous value tells you if the results have been refreshed.  The count wraps
+ * around to zero after 65535.
+ *
+ * \returns the number of complete passes through the channel list since startA2DScan() was called.
+ */
+
+uint16_t getA2DScanCount();
+
+
+
+/*!
+ * \brief Read one of the results of the current (or last) scan.  This reads the element of the results
+ * array passed to startA2DScan() atomically, so the interrupt cannot change it midway through the read.
+ *
+ * \arg \c index the position in the channel list of the channel whose result you want.
+ *
+ * \returns the most recent result for that channel (between 0 and 1023, or between 0 and 255 in
+ * kA2dMode8BitFast mode), or 0 if no scan has been
+ * set up or the index is out of range.
+ */
+
+uint16_t getA2DScanResult( uint8_t index );
+
+
+
+
+/*!
+ * \brief Obtain extra bits of resolution from scans by oversampling and decimation.
+ *
+ * Each output of a scan accumulates 4^extraBits consecutive conversions of the same channel and shifts the sum
+ * right by extraBits, giving a result with 10 + extraBits bits of resolution (e.g., between 0 and 4095 for
+ * 2 extra bits).  This requires some noise (at least 1 LSB) to be present on the input.  Oversampling
+ * divides the scan rate by 4^extraBits.
+ *
+ * \arg \c extraBits the extra bits of resolution desired, between 0 (no oversampling, the default)
+ * and 4 (14-bit results from 256 conversions); larger values are reduced to 4.
+ *
+ * \note This setting replaces any setting made with setA2DScanAveraging().  It takes effect the next time
+ * startA2DScan() is called.
+ */
+
+void setA2DScanOversampling( uint8_t extraBits );
+
+
+
+/*!
+ * \brief Reduce noise in scans by averaging.
+ *
+ * Each output of a scan is the average of 2^log2Samples consecutive conversions of the same channel, keeping
+ * the usual result range (between 0 and 1023).  Averaging divides the scan rate by 2^log2Samples.
+ *
+ * \arg \c log2Samples the base-2 logarithm of the number of conversions to average, between 0 (no averaging,
+ * the default) and 8 (256 conversions); larger values are reduced to 8.
+ *
+ * \note This setting replaces any setting made with setA2DScanOversampling().  It takes effect the next time
+ * startA2DScan() is called.
+ */
+
+void setA2DScanAveraging( uint8_t log2Samples );
+
+
+
+/*!
+ * \brief Apply a first-order low-pass (IIR, exponential moving average) filter to scan results.
+ *
+ * Each new output y of a channel is computed from the new (oversampled or averaged) value x as
+ * y += ( x - y ) / 2^shift, using shifts and fixed-point state with \c shift fractional bits so no
+ * floating point or division is needed and the output settles exactly on a constant input.  The filter is
+ * primed with the first value from each channel.  Larger shifts filter more heavily; the time constant is
+ * about 2^shift scan passes.
+ *
+ * \arg \c shift the filter strength, between 1 and 8 (0 turns the filter off); larger values are reduced to 8.
+ * \arg \c filterState an array of at least as many elements as channels in the scan, to hold the filter
+ * state; it must remain valid while the scan runs.  Pass 0 (or a shift of 0) to turn the filter off.
+ *
+ * \note This setting takes effect the next time startA2DScan() is called.
+ */
+
+void setA2DScanFilter( uint8_t shift, uint32_t* filterState );
+
+
+
+
+/*!
+ * \brief Start sampling an analog-to-digital channel at a fixed rate using Timer1.
+ *
+ * Timer1 is configured in CTC mode to produce a compare match B event at the requested rate, and the ADC
+ * is set to auto-trigger a conversion on each event, so the sampling instants have no software jitter.
+ * The ADC conversion-complete interrupt pushes each sample (between 0 and 1023, or between 0 and 255
+ * in kA2dMode8BitFast mode) into the ring buffer.  If the
+ * ring buffer is full the sample is discarded and an overflow is counted (see getA2DAcquisitionOverflows()).
+ *
+ * \arg \c channel the ADC channel number to sample (between 0 and 7 on ATmega328; between 0 and 15 on ATMega2560).
+ * \arg \c samplesPerSecond the sampling rate.  This must be low enough for each conversion to complete
+ * before the next is triggered (about 9000 samples per second with the default ADC clock).
+ * \arg \c buffer the ring buffer to receive the samples; it must remain valid while the acquisition runs.
+ *
+ * \returns true if the acquisition started, false if the arguments are invalid or the rate is too high.
+ *
+ * \note This takes over Timer1, so it is incompatible with PWM on the pins controlled by Timer1 or any
+ * other use of Timer1.  Before calling this function must fist initialize the analog-to-digital sub-system
+ * by calling initA2D().  Interrupts must be enabled.  Do not call readA2D() or startA2DScan() while an
+ * acquisition is running.
+ */
+
+bool startA2DAcquisition( int8_t channel, uint16_t samplesPerSecond, A2DSampleBuffer* buffer );
+
+
+
+/*!
+ * \brief Start sampling an analog-to-digital channel at a fixed rate triggered by Timer0 overflows.
+ *
+ * This works the same way as startA2DAcquisition() except that it auto-triggers conversions from the Timer0
+ * overflows that drive the system clock (see SystemClock.h), leaving Timer1 free.  The sampling rate is fixed
+ * by the system clock:  F_CPU / 16384 (about 976 samples per second at 16 MHz).
+ *
+ * \arg \c channel the ADC channel number to sample (between 0 and 7 on ATmega328; between 0 and 15 on ATMega2560).
+ * \arg \c buffer the ring buffer to receive the samples; it must remain valid while the acquisition runs.
+ *
+ * \returns true if the acquisition started, false if the arguments are invalid.
+ *
+ * \note The system clock must be running (by calling initSystemClock() from SystemClock.h).
+ */
+
+bool startA2DAcquisitionTimer0( int8_t channel, A2DSampleBuffer* buffer );
+
+
+
+/*!
+ * \brief Stop an acquisition started by startA2DAcquisition() or startA2DAcquisitionTimer0().
+ * If Timer1 was used, it is stopped.  Samples already in the ring buffer are left there.
+ */
+
+void stopA2DAcquisition();
+
+
+
+/*!
+ * \brief Get the number of samples discarded because the ring buffer was full.
+ *
+ * \returns the number of samples lost since the acquisition started (saturates at 65535).
+ */
+
+uint16_t getA2DAcquisitionOverflows();
+
 #endif
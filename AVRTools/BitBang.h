@@ -0,0 +1,641 @@
+/*
+    BitBang.h - Software (bit-banged) serial output, SPI, and I2C on any GPIO pins,
+    for AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides software implementations of a transmit-only serial port (SoftUartTx), an SPI
+ * master (SoftSpi), and an I2C master (SoftI2cMaster) on any GPIO pins, for boards that have run out of
+ * hardware USARTs or need extra buses.
+ *
+ * The pins are selected at compile time with GpioPinT (see GpioPinT.h), so each pin operation is a single
+ * instruction, and all timing is computed at compile time from \c F_CPU:
+ * - SoftUartTx times its bits with \c __builtin_avr_delay_cycles(), which avr-gcc expands into a delay
+ * exact to the cycle, less the cycles the bit loop itself takes.  It works up to 115200 baud at 8 MHz and above.
+ * - SoftSpi runs as fast as the code allows (about 1 MHz at 16 MHz) unless a half-period is given.
+ * - SoftI2cMaster times half-periods with delayQuartersOfMicroSeconds() (see SimpleDelays.h), so link against
+ * SimpleDelays.S (as must SoftSpi with a non-zero half-period).  It supports clock stretching.
+ *
+ * This file is header-only; SoftUartTx derives from Writer, so using it requires linking against Writer.cpp.
+ */
+
+
+
+#ifndef BitBang_h
+#define BitBang_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <util/atomic.h>
+
+#include "GpioPinT.h"
+#include "SimpleDelays.h"
+#include "Writer.h"
+
+
+
+/*!
+ * \brief A stand-in for a GPIO pin that isn't connected (for example, MISO for a display that is only written).
+ * Writes do nothing and reads return 0.
+ */
+
+struct GpioNoPin
+{
+    static void setModeOutput()         {}      //!< Does nothing
+    static void setModeInput()          {}      //!< Does nothing
+    static void setHigh()               {}      //!< Does nothing
+    static void setLow()                {}      //!< Does nothing
+    static void write( bool )           {}      //!< Does nothing
+    static bool read()                  { return false; }   //!< \returns false
+};
+
+
+
+
+
+/*!
+ * \brief This template class is a transmit-only software serial port (8 data bits, no parity, 1 stop bit)
+ * on any GPIO pin.  It derives from Writer, so it has all the Writer print functions.
+ *
+ * Interrupts are disabled while each byte is sent (10 bit times, about 87 microseconds at 115200 baud), so the
+ * timing is never disturbed; interrupts that arrive meanwhile are serviced between bytes.
+ *
+ * ~~~C
+ * SoftUartTx< GpioPinT< GpioPortD, 3 >, 115200 > gSoftSerial;
+ *
+ * gSoftSerial.start();
+ * gSoftSerial.println( "Hello" );
+ * ~~~
+ *
+ * \tparam TX_PIN the GPIO pin to transmit on (a GpioPinT).
+ * \tparam BAUD the baud rate.
+ */
+
+template< typename TX_PIN, unsigned long BAUD > class SoftUartTx : public Writer
+{
+    // The bit loop takes about this many cycles besides the delay (avr-gcc -Os)
+    static const uint16_t kLoopCycles   = 7;
+
+    static const uint32_t kBitCycles    = ( F_CPU + BAUD / 2 ) / BAUD;
+
+    static_assert( kBitCycles >= 2 * kLoopCycles, "BAUD is too high for F_CPU" );
+    static_assert( kBitCycles <= 0xFFFF, "BAUD is too low for F_CPU" );
+
+public:
+
+    /*!
+     * \brief Make the GPIO pin an output at the idle (high) level.  Call this before sending anything.
+     */
+    void start()
+    {
+        TX_PIN::setHigh();
+        TX_PIN::setModeOutput();
+    }
+
+
+    /*!
+     * \brief Send a single byte.  The function returns after the stop bit has been sent.
+     *
+     * \arg \c c the byte to send.
+     */
+    static void sendByte( uint8_t c )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            // Start bit
+            TX_PIN::setLow();
+            __builtin_avr_delay_cycles( kBitCycles - kLoopCycles );
+
+            // Data bits, least significant first
+            for ( uint8_t i = 0; i < 8; ++i )
+            {
+                if ( c & 0x01 )
+                {
+                    TX_PIN::setHigh();
+                }
+                else
+                {
+                    TX_PIN::setLow();
+                }
+                c >>= 1;
+                __builtin_avr_delay_cycles( kBitCycles - kLoopCycles );
+            }
+
+            // Stop bit
+            TX_PIN::setHigh();
+            __builtin_avr_delay_cycles( kBitCycles );
+        }
+    }
+
+
+    /*!
+     * \brief Write a single character.
+     *
+     * \arg \c c the character to be written.
+     *
+     * \returns the number of bytes written.
+     */
+    virtual size_t write( char c )
+    {
+        sendByte( c );
+        return 1;
+    }
+
+
+    /*!
+     * \brief Write a null-terminated string.
+     *
+     * \arg \c str the string to be written.
+     *
+     * \returns the number of bytes written.
+     */
+    virtual size_t write( const char* str )
+    {
+        size_t n = 0;
+        while ( *str )
+        {
+            sendByte( *str++ );
+            ++n;
+        }
+        return n;
+    }
+
+
+    /*!
+     * \brief Write a given number of characters from a buffer.
+     *
+     * \arg \c buffer the buffer of characters to write.
+     * \arg \c size the number of characters to write
+     *
+     * \returns the number of bytes written.
+     */
+    virtual size_t write( const char* buffer, size_t size )
+    {
+        return write( reinterpret_cast<const uint8_t*>( buffer ), size );
+    }
+
+
+    /*!
+     * \brief Write a given number of bytes from a buffer.
+     *
+     * \arg \c buffer the buffer of bytes to write.
+     * \arg \c size the number of bytes to write
+     *
+     * \returns the number of bytes written.
+     */
+    virtual size_t write( const uint8_t* buffer, size_t size )
+    {
+        for ( size_t i = 0; i < size; ++i )
+        {
+            sendByte( buffer[i] );
+        }
+        return size;
+    }
+
+
+    /*!
+     * \brief Does nothing:  every write returns only after its last stop bit.
+     */
+    virtual void flush()
+    {}
+};
+
+
+
+
+
+/*!
+ * \brief This template class is a software SPI master on any GPIO pins.  All its functions are static.
+ *
+ * The chip select pins are up to you (GpioPinT::setLow() and GpioPinT::setHigh() make good ones).
+ *
+ * \tparam SCK the clock pin (a GpioPinT).
+ * \tparam MOSI the data output pin (a GpioPinT, or GpioNoPin if not needed).
+ * \tparam MISO the data input pin (a GpioPinT, or GpioNoPin if not needed).
+ * \tparam MODE the SPI mode, 0 to 3 (bit 1 is the clock polarity CPOL, bit 0 the clock phase CPHA).
+ * \tparam HALF_PERIOD_QUARTER_US half the clock period in quarter microseconds, or 0 to run as fast as possible;
+ * values below 7 (13 at 8 MHz) all give the minimum delay of delayQuartersOfMicroSeconds().
+ */
+
+template< typename SCK, typename MOSI, typename MISO, uint8_t MODE = 0, uint16_t HALF_PERIOD_QUARTER_US = 0 >
+class SoftSpi
+{
+    static_assert( MODE <= 3, "The SPI MODE must be between 0 and 3" );
+
+    static const bool kIdleHigh         = MODE & 0x02;
+    static const bool kSampleTrailing   = MODE & 0x01;
+
+    static void halfPeriod()
+    {
+        if ( HALF_PERIOD_QUARTER_US )
+        {
+            delayQuartersOfMicroSeconds( HALF_PERIOD_QUARTER_US );
+        }
+    }
+
+public:
+
+    /*!
+     * \brief Set up the GPIO pins (SCK idle, MOSI low, MISO input).  Call this before any transfers.
+     */
+    static void start()
+    {
+        SCK::write( kIdleHigh );
+        SCK::setModeOutput();
+        MOSI::setLow();
+        MOSI::setModeOutput();
+        MISO::setModeInput();
+    }
+
+
+    /*!
+     * \brief Return the GPIO pins to inputs.
+     */
+    static void stop()
+    {
+        SCK::setModeInput();
+        MOSI::setModeInput();
+    }
+
+
+    /*!
+     * \brief Send and receive a byte, most significant bit first.
+     *
+     * \arg \c out the byte to send.
+     *
+     * \returns the byte received.
+     */
+    static uint8_t transfer( uint8_t out )
+    {
+        uint8_t in = 0;
+        for ( uint8_t i = 0; i < 8; ++i )
+        {
+            if ( !kSampleTrailing )
+            {
+                MOSI::write( out & 0x80 );
+            }
+            halfPeriod();
+
+            // Leading edge
+            SCK::write( !kIdleHigh );
+            if ( kSampleTrailing )
+            {
+                MOSI::write( out & 0x80 );
+            }
+            else
+            {
+                in = ( in << 1 ) | MISO::read();
+            }
+            halfPeriod();
+
+            // Trailing edge
+            SCK::write( kIdleHigh );
+            if ( kSampleTrailing )
+            {
+                in = ( in << 1 ) | MISO::read();
+            }
+
+            out <<= 1;
+        }
+        return in;
+    }
+
+
+    /*!
+     * \brief Send and receive a buffer of bytes, in place.
+     *
+     * \arg \c buffer the bytes to send; they are replaced by the bytes received.
+     * \arg \c size the number of bytes.
+     */
+    static void transfer( uint8_t* buffer, size_t size )
+    {
+        for ( size_t i = 0; i < size; ++i )
+        {
+            buffer[i] = transfer( buffer[i] );
+        }
+    }
+
+
+    /*!
+     * \brief Send a buffer of bytes, ignoring the bytes received.
+     *
+     * \arg \c buffer the bytes to send.
+     * \arg \c size the number of bytes.
+     */
+    static void write( const uint8_t* buffer, size_t size )
+    {
+        for ( size_t i = 0; i < size; ++i )
+        {
+            transfer( buffer[i] );
+        }
+    }
+};
+
+
+
+
+
+/*!
+ * \brief This enum lists the errors reported by SoftI2cMaster.
+ */
+
+enum SoftI2cErrors
+{
+    kSoftI2cErrAddressNack      = -1,       //!< No device acknowledged the address
+    kSoftI2cErrTimedOut         = -2        //!< A device held the clock low (stretched it) too long
+};
+
+
+
+/*!
+ * \brief This template class is a software I2C master on any two GPIO pins.  All its functions are static.
+ *
+ * The lines are driven open-drain (low, or released as inputs), so they need external pull-up resistors
+ * as for any I2C bus.  Devices may stretch the clock for up to about 20 ms at 16 MHz.
+ *
+ * \tparam SDA the data pin (a GpioPinT).
+ * \tparam SCL the clock pin (a GpioPinT).
+ * \tparam HALF_PERIOD_QUARTER_US half the clock period in quarter microseconds; the default of 20 gives
+ * about 90 kHz (just under the standard 100 kHz, allowing for the code).  The smallest useful value is 7 (13 at 8 MHz).
+ */
+
+template< typename SDA, typename SCL, uint16_t HALF_PERIOD_QUARTER_US = 20 > class SoftI2cMaster
+{
+    static void halfPeriod()
+    { delayQuartersOfMicroSeconds( HALF_PERIOD_QUARTER_US ); }
+
+    // Driving a line low is making it an output (its PORT bit stays 0); releasing it is making it an input
+    static void sdaLow()                { SDA::setModeOutput(); }
+    static void sdaRelease()            { SDA::setModeInput(); }
+    static void sclLow()                { SCL::setModeOutput(); }
+
+    static bool sclRelease()
+    {
+        SCL::setModeInput();
+
+        // Wait while a device stretches the clock
+        uint16_t timeout = 0xFFFF;
+        while ( !SCL::read() )
+        {
+            if ( !--timeout )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+
+    /*!
+     * \brief Release both lines.  Call this before using the bus.
+     */
+    static void start()
+    {
+        sdaRelease();
+        SCL::setModeInput();
+    }
+
+
+    /*!
+     * \brief Send a start (or, if the bus is already in use, a repeated start) condition.
+     *
+     * \returns true if successful; false if a device held the clock low too long.
+     */
+    static bool sendStart()
+    {
+        sdaRelease();
+        halfPeriod();
+        if ( !sclRelease() )
+        {
+            return false;
+        }
+        halfPeriod();
+        sdaLow();
+        halfPeriod();
+        sclLow();
+        return true;
+    }
+
+
+    /*!
+     * \brief Send a stop condition, releasing the bus.
+     *
+     * \returns true if successful; false if a device held the clock low too long.
+     */
+    static bool sendStop()
+    {
+        sdaLow();
+        halfPeriod();
+        bool ok = sclRelease();
+        halfPeriod();
+        sdaRelease();
+        halfPeriod();
+        return ok;
+    }
+
+
+    /*!
+     * \brief Send a byte (after a start condition) and get the acknowledgement.
+     *
+     * \arg \c c the byte to send.
+     *
+     * \returns 1 if the device acknowledged the byte, 0 if it did not, or kSoftI2cErrTimedOut.
+     */
+    static int sendByte( uint8_t c )
+    {
+        for ( uint8_t i = 0; i < 8; ++i )
+        {
+            if ( c & 0x80 )
+            {
+                sdaRelease();
+            }
+            else
+            {
+                sdaLow();
+            }
+            c <<= 1;
+            halfPeriod();
+            if ( !sclRelease() )
+            {
+                return kSoftI2cErrTimedOut;
+            }
+            halfPeriod();
+            sclLow();
+        }
+
+        // Acknowledgement
+        sdaRelease();
+        halfPeriod();
+        if ( !sclRelease() )
+        {
+            return kSoftI2cErrTimedOut;
+        }
+        bool ack = !SDA::read();
+        halfPeriod();
+        sclLow();
+        return ack;
+    }
+
+
+    /*!
+     * \brief Receive a byte and send an acknowledgement (or not, after the last byte of a read).
+     *
+     * \arg \c ack true to acknowledge the byte (more bytes to follow), false otherwise (last byte).
+     *
+     * \returns the byte received (0 to 255), or kSoftI2cErrTimedOut.
+     */
+    static int receiveByte( bool ack )
+    {
+        uint8_t c = 0;
+        sdaRelease();
+        for ( uint8_t i = 0; i < 8; ++i )
+        {
+            halfPeriod();
+            if ( !sclRelease() )
+            {
+                return kSoftI2cErrTimedOut;
+            }
+            c = ( c << 1 ) | SDA::read();
+            halfPeriod();
+            sclLow();
+        }
+
+        // Acknowledgement
+        if ( ack )
+        {
+            sdaLow();
+        }
+        halfPeriod();
+        if ( !sclRelease() )
+        {
+            return kSoftI2cErrTimedOut;
+        }
+        halfPeriod();
+        sclLow();
+        sdaRelease();
+        return c;
+    }
+
+
+    /*!
+     * \brief Write bytes to a device in a single transaction.
+     *
+     * \arg \c address the 7-bit address of the device.
+     * \arg \c data the bytes to write.
+     * \arg \c n the number of bytes to write.
+     * \arg \c sendStopCondition true to release the bus afterwards; false to keep it for a read (with a repeated start).
+     *
+     * \returns the number of bytes written (less than \c n if the device stopped acknowledging them),
+     * or one of the SoftI2cErrors (after which the bus is always released).
+     */
+    static int write( uint8_t address, const uint8_t* data, uint8_t n, bool sendStopCondition = true )
+    {
+        int status = startTransaction( address << 1 );
+        if ( status < 0 )
+        {
+            return status;
+        }
+
+        int count = 0;
+        while ( count < n )
+        {
+            status = sendByte( data[ count ] );
+            if ( status < 0 )
+            {
+                sendStop();
+                return status;
+            }
+            ++count;
+            if ( !status )
+            {
+                // Not acknowledged:  the device won't take any more
+                sendStopCondition = true;
+                break;
+            }
+        }
+
+        if ( sendStopCondition )
+        {
+            sendStop();
+        }
+        return count;
+    }
+
+
+    /*!
+     * \brief Read bytes from a device in a single transaction.
+     *
+     * \arg \c address the 7-bit address of the device.
+     * \arg \c buffer where to store the bytes read.
+     * \arg \c n the number of bytes to read.
+     *
+     * \returns the number of bytes read, or one of the SoftI2cErrors.
+     */
+    static int read( uint8_t address, uint8_t* buffer, uint8_t n )
+    {
+        int status = startTransaction( ( address << 1 ) | 0x01 );
+        if ( status < 0 )
+        {
+            return status;
+        }
+
+        for ( uint8_t i = 0; i < n; ++i )
+        {
+            status = receiveByte( i < n - 1 );
+            if ( status < 0 )
+            {
+                sendStop();
+                return status;
+            }
+            buffer[i] = status;
+        }
+
+        sendStop();
+        return n;
+    }
+
+
+private:
+
+    static int startTransaction( uint8_t addressByte )
+    {
+        if ( !sendStart() )
+        {
+            sendStop();
+            return kSoftI2cErrTimedOut;
+        }
+
+        int status = sendByte( addressByte );
+        if ( status <= 0 )
+        {
+            sendStop();
+            return status ? status : kSoftI2cErrAddressNack;
+        }
+        return 0;
+    }
+};
+
+
+
+#endif
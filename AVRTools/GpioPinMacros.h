@@ -91,6 +91,8 @@ enum
 
 #define _setGpioPinLow( ddr, port, pin, nbr, adc, ocr, com, tccr )              port &= ~(1<<nbr)
 
+#define _toggleGpioPin( ddr, port, pin, nbr, adc, ocr, com, tccr )              pin = (1<<nbr)
+
 #define _getGpioDDR( ddr, port, pin, nbr, adc, ocr, com, tccr )                 ddr
 
 #define _getGpioPORT( ddr, port, pin, nbr, adc, ocr, com, tccr )                port
@@ -107,6 +109,27 @@ enum
 
 #define _getGpioTCCR( ddr, port, pin, nbr, adc, ocr, com, tccr )                tccr
 
+#define _setGpioPinsModeOutput( ddr, port, pin, nbr, adc, ocr, com, tccr, mask )    ddr |= (mask)
+
+#define _setGpioPinsModeInput( ddr, port, pin, nbr, adc, ocr, com, tccr, mask )     ddr &= ~(mask), port &= ~(mask)
+
+#define _readGpioPinsDigital( ddr, port, pin, nbr, adc, ocr, com, tccr, mask )      ( pin & (mask) )
+
+#define _writeGpioPinsDigital( ddr, port, pin, nbr, adc, ocr, com, tccr, mask, value )  \
+                                        port = ( port & ~(mask) ) | ( (value) & (mask) )
+
+#define _setGpioPinsHigh( ddr, port, pin, nbr, adc, ocr, com, tccr, mask )          port |= (mask)
+
+#define _setGpioPinsLow( ddr, port, pin, nbr, adc, ocr, com, tccr, mask )           port &= ~(mask)
+
+#define _toggleGpioPins( ddr, port, pin, nbr, adc, ocr, com, tccr, mask )           pin = (mask)
+
+#define _getGpioMASK2( ddr, port, pin, nbr, adc, ocr, com, tccr, ... )       ( (1<<nbr) | _getGpioMASK( __VA_ARGS__ ) )
+
+#define _getGpioMASK3( ddr, port, pin, nbr, adc, ocr, com, tccr, ... )       ( (1<<nbr) | _getGpioMASK2( __VA_ARGS__ ) )
+
+#define _getGpioMASK4( ddr, port, pin, nbr, adc, ocr, com, tccr, ... )       ( (1<<nbr) | _getGpioMASK3( __VA_ARGS__ ) )
+
 
 
 
@@ -273,6 +296,21 @@ enum
 
 
 
+
+/*!
+ * \brief Toggle the GPIO pin (i.e., invert the corresponding PORTn bit) by writing a 1 to the corresponding
+ * PINn bit.  This is a single instruction that doesn't read the port, so it is faster than reading and
+ * writing PORTn and is safe to use even if interrupt functions change other pins on the same port.
+ *
+ * \arg \c pinName a GPIO pin name macro generated by either GpioPin(), GpioPinAnalog(), or GpioPinPwm().
+ *
+ * \hideinitializer
+ */
+
+#define toggleGpioPin( pinName )                                                _toggleGpioPin( pinName )
+
+
+
 /*!
  * \brief Get the DDRn corresponding to this GPIO pin.
  *
@@ -386,6 +424,166 @@ enum
 
 
 
+/*
+ * Port-wide operations on several GPIO pins at once.  The pins must all be on the same port:  these take
+ * one GPIO pin name to identify the port and a mask selecting the pins (usually made with getGpioMASK2(),
+ * getGpioMASK3(), or getGpioMASK4(), OR'ed together as needed).  Every selected pin changes with a single
+ * write to the register, so they all change at the same instant.
+ *
+ * Like the single-pin macros, these read, modify, and write the register; if an interrupt function changes
+ * other pins on the same port, wrap them in an ATOMIC_BLOCK.  toggleGpioPins() writes PINn and doesn't have
+ * this problem.
+ */
+
+
+
+/*!
+ * \brief Get the combined mask of two GPIO pins on the same port.
+ *
+ * \arg \c pinName1 a GPIO pin name macro generated by either GpioPin(), GpioPinAnalog(), or GpioPinPwm().
+ * \arg \c pinName2 another GPIO pin name macro on the same port.
+ *
+ * \returns a bit mask with the bits of both GPIO pins set.
+ *
+ * \hideinitializer
+ */
+
+#define getGpioMASK2( pinName1, pinName2 )                                      _getGpioMASK2( pinName1, pinName2 )
+
+
+
+/*!
+ * \brief Get the combined mask of three GPIO pins on the same port.
+ *
+ * \arg \c pinName1 a GPIO pin name macro generated by either GpioPin(), GpioPinAnalog(), or GpioPinPwm().
+ * \arg \c pinName2 another GPIO pin name macro on the same port.
+ * \arg \c pinName3 another GPIO pin name macro on the same port.
+ *
+ * \returns a bit mask with the bits of all three GPIO pins set.
+ *
+ * \hideinitializer
+ */
+
+#define getGpioMASK3( pinName1, pinName2, pinName3 )                            _getGpioMASK3( pinName1, pinName2, pinName3 )
+
+
+
+/*!
+ * \brief Get the combined mask of four GPIO pins on the same port.
+ *
+ * \arg \c pinName1 a GPIO pin name macro generated by either GpioPin(), GpioPinAnalog(), or GpioPinPwm().
+ * \arg \c pinName2 another GPIO pin name macro on the same port.
+ * \arg \c pinName3 another GPIO pin name macro on the same port.
+ * \arg \c pinName4 another GPIO pin name macro on the same port.
+ *
+ * \returns a bit mask with the bits of all four GPIO pins set.
+ *
+ * \hideinitializer
+ */
+
+#define getGpioMASK4( pinName1, pinName2, pinName3, pinName4 )                  _getGpioMASK4( pinName1, pinName2, pinName3, pinName4 )
+
+
+
+/*!
+ * \brief Set the mode of several GPIO pins on the same port to output (i.e., set the corresponding DDRn bits).
+ *
+ * \arg \c pinName a GPIO pin name macro identifying the port.
+ * \arg \c mask the bits of the GPIO pins to set.
+ *
+ * \hideinitializer
+ */
+
+#define setGpioPinsModeOutput( pinName, mask )                                  _setGpioPinsModeOutput( pinName, mask )
+
+
+
+/*!
+ * \brief Set the mode of several GPIO pins on the same port to input (i.e., clear the corresponding DDRn and PORTn bits).
+ *
+ * \arg \c pinName a GPIO pin name macro identifying the port.
+ * \arg \c mask the bits of the GPIO pins to set.
+ *
+ * \hideinitializer
+ */
+
+#define setGpioPinsModeInput( pinName, mask )                                   _setGpioPinsModeInput( pinName, mask )
+
+
+
+/*!
+ * \brief Read several GPIO pins on the same port at the same instant (i.e., the corresponding PINn bits).
+ *
+ * \arg \c pinName a GPIO pin name macro identifying the port.
+ * \arg \c mask the bits of the GPIO pins to read.
+ *
+ * \returns the PINn register with all bits except those in the mask cleared.
+ *
+ * \hideinitializer
+ */
+
+#define readGpioPinsDigital( pinName, mask )                                    _readGpioPinsDigital( pinName, mask )
+
+
+
+/*!
+ * \brief Write values to several GPIO pins on the same port at the same instant.  For example, this writes
+ * a byte to an 8-bit parallel bus on pins 0 to 7 of a port, or a nibble to pins 4 to 7 with
+ * a mask of 0xF0 and a value shifted left by 4.
+ *
+ * \arg \c pinName a GPIO pin name macro identifying the port.
+ * \arg \c mask the bits of the GPIO pins to write; other bits of the PORTn register are unchanged.
+ * \arg \c value the values to write:  each GPIO pin is set or cleared according to its bit in value.
+ *
+ * \hideinitializer
+ */
+
+#define writeGpioPinsDigital( pinName, mask, value )                            _writeGpioPinsDigital( pinName, mask, value )
+
+
+
+/*!
+ * \brief Write a 1 to several GPIO pins on the same port at the same instant (i.e., set the PORTn bits).
+ *
+ * \arg \c pinName a GPIO pin name macro identifying the port.
+ * \arg \c mask the bits of the GPIO pins to set.
+ *
+ * \hideinitializer
+ */
+
+#define setGpioPinsHigh( pinName, mask )                                        _setGpioPinsHigh( pinName, mask )
+
+
+
+/*!
+ * \brief Write a 0 to several GPIO pins on the same port at the same instant (i.e., clear the PORTn bits).
+ *
+ * \arg \c pinName a GPIO pin name macro identifying the port.
+ * \arg \c mask the bits of the GPIO pins to clear.
+ *
+ * \hideinitializer
+ */
+
+#define setGpioPinsLow( pinName, mask )                                         _setGpioPinsLow( pinName, mask )
+
+
+
+/*!
+ * \brief Toggle several GPIO pins on the same port at the same instant, with a single write of the mask to
+ * the PINn register (the hardware inverts the PORTn bits written as 1).  This doesn't read the port, so it is safe
+ * even if interrupt functions change other pins on the same port.
+ *
+ * \arg \c pinName a GPIO pin name macro identifying the port.
+ * \arg \c mask the bits of the GPIO pins to toggle.
+ *
+ * \hideinitializer
+ */
+
+#define toggleGpioPins( pinName, mask )                                         _toggleGpioPins( pinName, mask )
+
+
+
+
 /******************************************/
 
 /*
@@ -419,6 +617,9 @@ typedef volatile uint16_t* Gpio16Ptr;
  * Once you've done this, these variables can be assign and passed to functions as needed.  To use these GPIO pin variables,
  * there are special function analogs of the GPIO pin manipulation macros.  These have the same names as the GPIO pin manipulation macros,
  * except with a "V" appended.
+ *
+ * If the GPIO pin is known at compile time but must be passed to generic code, consider GpioPinT (in GpioPinT.h)
+ * instead:  it is a type rather than a variable, so its operations compile to single instructions.
  */
 
 class GpioPinVariable
@@ -694,4 +895,56 @@ inline void setGpioPinLowV( const GpioPinVariable& pinVar )
 
 
 
+
+/*!
+ * \brief Toggle the GPIO pin (i.e., invert the corresponding PORTn bit) by writing a 1 to the corresponding
+ * PINn bit.  The single write is safe to use even if interrupt functions change other pins on the same port.
+ *
+ * \arg \c pinVar a GPIO pin variable of type GpioPinVariable.
+ *
+ * \hideinitializer
+ */
+
+inline void toggleGpioPinV( const GpioPinVariable& pinVar )
+{
+    *(pinVar.pin()) = ( 1 << pinVar.bitNbr() );
+}
+
+
+
+
+/*!
+ * \brief Write values to several GPIO pins on the same port as a GPIO pin variable, at the same instant.
+ *
+ * \arg \c pinVar a GPIO pin variable of type GpioPinVariable identifying the port.
+ * \arg \c mask the bits of the GPIO pins to write; other bits of the PORTn register are unchanged.
+ * \arg \c value the values to write:  each GPIO pin is set or cleared according to its bit in value.
+ *
+ * \hideinitializer
+ */
+
+inline void writeGpioPinsDigitalV( const GpioPinVariable& pinVar, uint8_t mask, uint8_t value )
+{
+    *(pinVar.port()) = ( *(pinVar.port()) & ~mask ) | ( value & mask );
+}
+
+
+
+/*!
+ * \brief Toggle several GPIO pins on the same port as a GPIO pin variable, at the same instant, with a single
+ * write to the PINn register.
+ *
+ * \arg \c pinVar a GPIO pin variable of type GpioPinVariable identifying the port.
+ * \arg \c mask the bits of the GPIO pins to toggle.
+ *
+ * \hideinitializer
+ */
+
+inline void toggleGpioPinsV( const GpioPinVariable& pinVar, uint8_t mask )
+{
+    *(pinVar.pin()) = mask;
+}
+
+
+
 #endif
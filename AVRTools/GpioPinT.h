@@ -0,0 +1,185 @@
+/*
+    GpioPinT.h - A template type for naming and manipulating GPIO pins
+    at compile time, for AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides GpioPinT, a template type that names a GPIO pin at compile time.
+ *
+ * A GpioPinVariable holds pointers to the registers and a bit number, so every operation on it loads the pointers
+ * and shifts by a variable amount.  A GpioPinT instead carries the port and bit in its type:  all its functions are
+ * static and inline, so they compile to exactly the same single \c sbi, \c cbi, or \c sbic instructions as the
+ * GPIO pin macros.  Because a GpioPinT is a type, it can be passed as a template parameter, letting generic code
+ * (drivers for a display, a chip select, flow control lines, and so on) run at macro speed without macros:
+ *
+ * ~~~C
+ * typedef GpioPinT< GpioPortB, 5 > LedPin;     // PB5, pin 13 on an Arduino Uno
+ *
+ * template< typename CS > void selectChip()
+ * {
+ *     CS::setLow();                            // A single cbi instruction
+ * }
+ *
+ * LedPin::setModeOutput();
+ * LedPin::toggle();
+ * selectChip< GpioPinT< GpioPortB, 2 > >();
+ * ~~~
+ *
+ * The port types GpioPortA, GpioPortB, and so on are defined for every port the microcontroller has.
+ * The comments in ArduinoUnoPins.h and ArduinoMegaPins.h give the port and bit of each Arduino pin.
+ */
+
+
+
+#ifndef GpioPinT_h
+#define GpioPinT_h
+
+#include <stdint.h>
+
+#include <avr/io.h>
+
+#include "GpioPinMacros.h"
+
+
+
+#define _defineGpioPortType( ltr )                                                  \
+    struct GpioPort##ltr                                                            \
+    {                                                                               \
+        static volatile uint8_t& ddr()      { return DDR##ltr; }                    \
+        static volatile uint8_t& port()     { return PORT##ltr; }                   \
+        static volatile uint8_t& pin()      { return PIN##ltr; }                    \
+    };
+
+#ifdef PORTA
+_defineGpioPortType( A )
+#endif
+#ifdef PORTB
+_defineGpioPortType( B )
+#endif
+#ifdef PORTC
+_defineGpioPortType( C )
+#endif
+#ifdef PORTD
+_defineGpioPortType( D )
+#endif
+#ifdef PORTE
+_defineGpioPortType( E )
+#endif
+#ifdef PORTF
+_defineGpioPortType( F )
+#endif
+#ifdef PORTG
+_defineGpioPortType( G )
+#endif
+#ifdef PORTH
+_defineGpioPortType( H )
+#endif
+#ifdef PORTJ
+_defineGpioPortType( J )
+#endif
+#ifdef PORTK
+_defineGpioPortType( K )
+#endif
+#ifdef PORTL
+_defineGpioPortType( L )
+#endif
+
+#undef _defineGpioPortType
+
+
+
+/*!
+ * \brief This template type names a GPIO pin at compile time.  All its functions are static; you never
+ * need to create an object of this type.
+ *
+ * \tparam PORT the port the GPIO pin belongs to (GpioPortA, GpioPortB, ...).
+ * \tparam BIT the bit on that port that corresponds to the GPIO pin (0 to 7).
+ */
+
+template< typename PORT, uint8_t BIT > struct GpioPinT
+{
+    static_assert( BIT < 8, "A GPIO pin bit number must be between 0 and 7" );
+
+    /*! \brief The bit mask of this GPIO pin within the DDR, PORT, and PIN registers. */
+    static const uint8_t kMask = ( 1 << BIT );
+
+    /*! \brief Test if the mode of the GPIO pin is output (i.e., the corresponding DDRn bit is set). */
+    static bool isModeOutput()
+    { return PORT::ddr() & kMask; }
+
+    /*! \brief Test if the mode of the GPIO pin is input (i.e., the corresponding DDRn bit is clear). */
+    static bool isModeInput()
+    { return !( PORT::ddr() & kMask ); }
+
+    /*! \brief Set the mode of the GPIO pin to output (i.e., set the corresponding DDRn bit). */
+    static void setModeOutput()
+    { PORT::ddr() |= kMask; }
+
+    /*! \brief Set the mode of the GPIO pin to input (i.e., clear the corresponding DDRn and PORTn bits). */
+    static void setModeInput()
+    { PORT::ddr() &= ~kMask; PORT::port() &= ~kMask; }
+
+    /*! \brief Set the mode of the GPIO pin to input with pullup (i.e., clear the DDRn bit and set the PORTn bit). */
+    static void setModeInputPullup()
+    { PORT::ddr() &= ~kMask; PORT::port() |= kMask; }
+
+    /*! \brief Read the value of the GPIO pin (i.e., return the value of the corresponding PINn bit). */
+    static bool read()
+    { return PORT::pin() & kMask; }
+
+    /*!
+     * \brief Write a value to the GPIO pin (i.e., set or clear the corresponding PORTn bit).
+     *
+     * \arg \c value the value to be written: false (0) clears the GPIO pin; true (any other value) sets it.
+     */
+    static void write( bool value )
+    {
+        if ( value )
+        {
+            PORT::port() |= kMask;
+        }
+        else
+        {
+            PORT::port() &= ~kMask;
+        }
+    }
+
+    /*! \brief Write a 1 to the GPIO pin (i.e., set the corresponding PORTn bit). */
+    static void setHigh()
+    { PORT::port() |= kMask; }
+
+    /*! \brief Write a 0 to the GPIO pin (i.e., clear the corresponding PORTn bit). */
+    static void setLow()
+    { PORT::port() &= ~kMask; }
+
+    /*! \brief Toggle the GPIO pin with a single write to the PINn register (see toggleGpioPin()). */
+    static void toggle()
+    { PORT::pin() = kMask; }
+
+    /*! \brief Return a GpioPinVariable for this GPIO pin, for use with code that takes one. */
+    static GpioPinVariable variable()
+    { return GpioPinVariable( &PORT::ddr(), &PORT::port(), &PORT::pin(), BIT ); }
+};
+
+
+
+#endif
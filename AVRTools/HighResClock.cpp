@@ -0,0 +1,122 @@
+/*
+    HighResClock.cpp - A high-resolution timebase on a 16-bit timer
+    for AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "HighResClock.h"
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+
+
+namespace
+{
+    // The upper 32 bits of the 48-bit extended count
+    volatile uint32_t gHighResOverflows;
+
+
+    // Call with interrupts disabled.  Returns the overflow count consistent with the 16-bit count in *ticks.
+    uint32_t readExtended( uint16_t* ticks )
+    {
+        uint32_t ovf = gHighResOverflows;
+        uint16_t t = HIGH_RES_CLOCK_TCNT;
+
+        // An overflow that happened before TCNT was read but hasn't been serviced yet
+        if ( ( HIGH_RES_CLOCK_TIFR & ( 1 << TOV1 ) ) && t < 0x8000 )
+        {
+            ++ovf;
+        }
+
+        *ticks = t;
+        return ovf;
+    }
+
+}
+
+
+
+
+ISR( HIGH_RES_CLOCK_OVF_vect )
+{
+    ++gHighResOverflows;
+}
+
+
+
+
+void initHighResClock()
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        // Normal mode (count to 0xFFFF and wrap), no outputs
+        HIGH_RES_CLOCK_TCCRB = 0;
+        HIGH_RES_CLOCK_TCCRA = 0;
+        HIGH_RES_CLOCK_TCNT = 0;
+
+        // Clear a stale overflow (by writing a 1) and enable the overflow interrupt only
+        HIGH_RES_CLOCK_TIFR = ( 1 << TOV1 );
+        HIGH_RES_CLOCK_TIMSK = ( 1 << TOIE1 );
+
+        gHighResOverflows = 0;
+
+        // Start the timer (the CSn2:0 bit positions are the same for all the 16-bit timers)
+#if HIGH_RES_CLOCK_PRESCALER == 1
+        HIGH_RES_CLOCK_TCCRB = ( 1 << CS10 );
+#else
+        HIGH_RES_CLOCK_TCCRB = ( 1 << CS11 );
+#endif
+    }
+}
+
+
+
+
+uint32_t highResTicks32()
+{
+    uint32_t ovf;
+    uint16_t t;
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        ovf = readExtended( &t );
+    }
+
+    return ( ovf << 16 ) | t;
+}
+
+
+
+
+uint64_t highResTicks64()
+{
+    uint32_t ovf;
+    uint16_t t;
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        ovf = readExtended( &t );
+    }
+
+    return ( static_cast<uint64_t>( ovf ) << 16 ) | t;
+}
@@ -0,0 +1,198 @@
+/*
+    HighResClock.h - A high-resolution timebase on a 16-bit timer
+    for AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief Include this file to use a high-resolution timebase for pulse timing and profiling.
+ *
+ * The system clock (SystemClock.h) runs timer0 with a prescaler of 64, so micros() has a resolution of 4 us
+ * at 16 MHz.  The high-resolution clock runs a 16-bit timer with a prescaler of 1 or 8 (62.5 ns or 0.5 us
+ * ticks at 16 MHz) and extends it in software with an overflow counter.  It provides:
+ * - highResTicks(): the raw 16-bit count, read straight from the timer (two instructions, no interrupt
+ * masking), for timing short code sections in hot paths;
+ * - highResTicks32() and highResTicks64(): the extended count;
+ * - highResMicros(): the extended count converted to microseconds.
+ *
+ * The timer is selected at compile time by the macro \c HIGH_RES_CLOCK_TIMER (1, or on the ATmega2560 also 3, 4,
+ * or 5; default 1) and the prescaler by \c HIGH_RES_CLOCK_PRESCALER (1 or 8; default 8).  The extended count
+ * holds 48 bits, so it wraps after 2^48 ticks (about 203 days with a prescaler of 1 at 16 MHz).
+ *
+ * To use these functions, include HighResClock.h in your source code, link against HighResClock.cpp, and call
+ * initHighResClock().
+ *
+ * \note The high-resolution clock takes over the selected timer, so the timer cannot also be used for PWM or for
+ * other purposes (for example, timer1 is used by startA2DAcquisition()).  Linking against HighResClock.cpp installs
+ * an overflow interrupt function for the timer.
+ */
+
+
+
+#ifndef HighResClock_h
+#define HighResClock_h
+
+#include <stdint.h>
+
+#include <avr/io.h>
+
+
+
+#ifndef HIGH_RES_CLOCK_TIMER
+#define HIGH_RES_CLOCK_TIMER        1
+#endif
+
+#ifndef HIGH_RES_CLOCK_PRESCALER
+#define HIGH_RES_CLOCK_PRESCALER    8
+#endif
+
+#if HIGH_RES_CLOCK_PRESCALER != 1 && HIGH_RES_CLOCK_PRESCALER != 8
+#error "HIGH_RES_CLOCK_PRESCALER must be 1 or 8"
+#endif
+
+
+#if HIGH_RES_CLOCK_TIMER == 1
+
+#define HIGH_RES_CLOCK_TCCRA        TCCR1A
+#define HIGH_RES_CLOCK_TCCRB        TCCR1B
+#define HIGH_RES_CLOCK_TCNT         TCNT1
+#define HIGH_RES_CLOCK_TIMSK        TIMSK1
+#define HIGH_RES_CLOCK_TIFR         TIFR1
+#define HIGH_RES_CLOCK_OVF_vect     TIMER1_OVF_vect
+
+#elif HIGH_RES_CLOCK_TIMER == 3 && defined(__AVR_ATmega2560__)
+
+#define HIGH_RES_CLOCK_TCCRA        TCCR3A
+#define HIGH_RES_CLOCK_TCCRB        TCCR3B
+#define HIGH_RES_CLOCK_TCNT         TCNT3
+#define HIGH_RES_CLOCK_TIMSK        TIMSK3
+#define HIGH_RES_CLOCK_TIFR         TIFR3
+#define HIGH_RES_CLOCK_OVF_vect     TIMER3_OVF_vect
+
+#elif HIGH_RES_CLOCK_TIMER == 4 && defined(__AVR_ATmega2560__)
+
+#define HIGH_RES_CLOCK_TCCRA        TCCR4A
+#define HIGH_RES_CLOCK_TCCRB        TCCR4B
+#define HIGH_RES_CLOCK_TCNT         TCNT4
+#define HIGH_RES_CLOCK_TIMSK        TIMSK4
+#define HIGH_RES_CLOCK_TIFR         TIFR4
+#define HIGH_RES_CLOCK_OVF_vect     TIMER4_OVF_vect
+
+#elif HIGH_RES_CLOCK_TIMER == 5 && defined(__AVR_ATmega2560__)
+
+#define HIGH_RES_CLOCK_TCCRA        TCCR5A
+#define HIGH_RES_CLOCK_TCCRB        TCCR5B
+#define HIGH_RES_CLOCK_TCNT         TCNT5
+#define HIGH_RES_CLOCK_TIMSK        TIMSK5
+#define HIGH_RES_CLOCK_TIFR         TIFR5
+#define HIGH_RES_CLOCK_OVF_vect     TIMER5_OVF_vect
+
+#else
+
+#error "HIGH_RES_CLOCK_TIMER must be 1 (or 3, 4, or 5 on the ATmega2560)"
+
+#endif
+
+
+/*!
+ * \brief The number of CPU clock cycles per high-resolution clock tick.
+ *
+ * \hideinitializer
+ */
+
+#define highResClockCyclesPerTick()         ( HIGH_RES_CLOCK_PRESCALER )
+
+
+
+
+/*!
+ * \brief Initialize the high-resolution clock and start counting from zero.
+ */
+
+void initHighResClock();
+
+
+
+/*!
+ * \brief Return the raw 16-bit count of the high-resolution clock.
+ *
+ * This is the cheapest way to time a short code section:  take the difference of two readings (as a uint16_t,
+ * which handles wrap-around) and multiply by highResClockCyclesPerTick() to get CPU cycles.  The interval
+ * must be shorter than 65536 ticks.
+ *
+ * \note Interrupts are not disabled during the read.  This is safe unless an interrupt function accesses the
+ * 16-bit registers of the same timer (which share the timer's TEMP register).
+ *
+ * \returns the raw 16-bit count.
+ */
+
+inline uint16_t highResTicks()
+{
+    return HIGH_RES_CLOCK_TCNT;
+}
+
+
+
+/*!
+ * \brief Return the low 32 bits of the extended count of the high-resolution clock.
+ *
+ * \returns the number of ticks since initHighResClock() (modulo 2^32).
+ */
+
+uint32_t highResTicks32();
+
+
+
+/*!
+ * \brief Return the full (48-bit) extended count of the high-resolution clock.
+ *
+ * \returns the number of ticks since initHighResClock().
+ */
+
+uint64_t highResTicks64();
+
+
+
+/*!
+ * \brief Return the time since initHighResClock() in microseconds, with the full resolution of the extended
+ * count.
+ *
+ * \returns the number of microseconds since initHighResClock().
+ */
+
+inline uint64_t highResMicros()
+{
+    // The condition is a compile-time constant; when the ticks per microsecond is a whole number (8 and 16 MHz)
+    // this reduces to a shift
+    if ( ( F_CPU / 1000000L ) % HIGH_RES_CLOCK_PRESCALER == 0 )
+    {
+        return highResTicks64() / ( ( F_CPU / 1000000L ) / HIGH_RES_CLOCK_PRESCALER );
+    }
+    else
+    {
+        return highResTicks64() * HIGH_RES_CLOCK_PRESCALER / ( F_CPU / 1000000L );
+    }
+}
+
+
+
+
+#endif
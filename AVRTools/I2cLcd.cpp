@@ -44,6 +44,12 @@
 #define MCP23017_ADDRESS            0x20
 
 // MCP23017 registers (assumes IOCON.BANK = 0 [default])
+//
+// We run the MCP23017 with IOCON.SEQOP = 1 ("byte mode").  With IOCON.BANK = 0 the address
+// pointer then toggles between the A and B register of each pair instead of advancing through
+// the register map.  Two-byte reads and writes of an A/B pair behave exactly as in sequential
+// mode, but a long write starting at GPIOB alternates GPIOB, GPIOA, GPIOB, GPIOA, ... which
+// lets us stream a whole sequence of enable pulses to the HD44780U in one I2C transmission.
 
 #define MCP23017_DIGITAL_HIGH       1
 #define MCP23017_DIGITAL_LOW        0
@@ -78,6 +84,8 @@
 #define MCP23017_GPIOB              0x13
 #define MCP23017_OLATB              0x15
 
+#define MCP23017_IOCON_SEQOP        0x20
+
 
 
 
@@ -199,9 +207,13 @@ namespace
         kWordButtonSelect   = 8
     };
 
-    const uint8_t kNumLines     = 2;
+    const uint8_t kNumLines     = I2C_LCD_NBR_ROWS;
+
+    // Long enough for the widest display supported
+    const char* kBlankLine      = "                                        ";
 
-    const char* kBlankLine      = "                ";
+    // Offset to the DDRAM address of the start of each row
+    const uint8_t kRowOffsets[] = { 0x00, 0x40, 0x00 + I2C_LCD_NBR_COLUMNS, 0x40 + I2C_LCD_NBR_COLUMNS };
 
 };
 
@@ -211,14 +223,45 @@ I2cLcd::I2cLcd() :
 mDisplayControl( 0 ),
 mDisplayMode( 0 ),
 mCurrLine( 0 ),
-mI2cStatus( 0 )
+mGpioA( 0 ),
+mGpioB( 0 ),
+mI2cStatus( 0 ),
+mBurstStatus( I2cMaster::kI2cCompletedOk ),
+mBurstLen( 0 ),
+mLcdState( kLcdIdle ),
+mLcdError( 0 ),
+mLcdDelayPending( false ),
+mLcdDelay( 0 ),
+mLcdDeadline( 0 )
 {
+    clearFrame();
+    memset( mFrameSent, ' ', sizeof( mFrameSent ) );
+    memset( mFrameStaleFrom, 0, sizeof( mFrameStaleFrom ) );
 }
 
 
 int I2cLcd::init()
+{
+    int err = initAsync();
+
+    // Run the HD44780U initialization sequence to completion
+    while ( service() )
+        ;
+
+    return ( err ? err : mLcdError );
+}
+
+
+
+
+int I2cLcd::initAsync()
 {
     mI2cStatus = 0;
+    mBurstStatus = I2cMaster::kI2cCompletedOk;
+    mLcdState = kLcdIdle;
+    mLcdError = 0;
+    mGpioA = 0;
+    mGpioB = 0;
 
     int err = initMCP23017();
 
@@ -227,7 +270,7 @@ int I2cLcd::init()
         err = setBacklight( 0x07 );
         if ( !err )
         {
-            err = initHD44780U();
+            initHD44780U();
         }
     }
 
@@ -244,6 +287,13 @@ int I2cLcd::initMCP23017()
     // Pins 8, 9, 10, 11, 12 (GPIO A):  input mode, pullup on
     // Pins 14, 15 (GPIO A):  output mode
 
+    // Put the MCP23017 in byte mode so we can stream enable pulses (see note on registers above)
+    int err = I2cMaster::writeSync( MCP23017_ADDRESS, MCP23017_IOCONA, MCP23017_IOCON_SEQOP );
+    if ( err )
+    {
+        return err;
+    }
+
     // Set input/output modes
     uint8_t modes[2];
     // Pins 8-15, GPIOA, 0b00111111 = 0x3F
@@ -253,7 +303,7 @@ int I2cLcd::initMCP23017()
 
     // Experimentally observed a set-up timing issue: need to make sure this
     // next transmission to MCP23017 completes before proceeding to the next one.
-    int err = I2cMaster::writeSync( MCP23017_ADDRESS, MCP23017_IODIRA, modes, 2 );
+    err = I2cMaster::writeSync( MCP23017_ADDRESS, MCP23017_IODIRA, modes, 2 );
 
     // Set pullups
     uint8_t pullups[2];
@@ -273,7 +323,7 @@ int I2cLcd::initMCP23017()
 
 
 
-int I2cLcd::initHD44780U()
+void I2cLcd::initHD44780U()
 {
 /*
     ** Initialize and configure the HD44780U/LCD **
@@ -302,65 +352,96 @@ int I2cLcd::initHD44780U()
 
     The trick is we have to put the HD44780U in 4-bit mode.  The appropriate start-up
     sequence to do this is described on page 45/46 of the HD44780U datasheet.
+
+    The steps of the sequence are carried out by service(), which replaces the delays
+    the datasheet calls for with deadlines so the CPU is free while the HD44780U works.
 */
 
     // Datasheet says to wait at least 40ms after power rises above 2.7V before sending commands.
-    delayMilliseconds( 50 );
+    mLcdState = kLcdInitFirst8Bit;
+    setLcdDelay( 50000 );
+}
 
-    // Pull RS, R/W, and Enable low to begin commands:  0b00000001 = 0x01
-    uint8_t gpioB = 0x01;
-    uint8_t err = I2cMaster::writeSync( MCP23017_ADDRESS, MCP23017_GPIOB, gpioB );
 
-    if ( !err )
+
+
+int I2cLcd::doLcdStep()
+{
+    int err = 0;
+
+    switch ( mLcdState )
     {
-        // Put the LCD into 4 bit mode; see Hitachi HD44780U datasheet p. 46, fig. 24
-        // HD44780U starts in 8-bit mode
+        case kLcdInitFirst8Bit:
+            // Put the LCD into 4 bit mode; see Hitachi HD44780U datasheet p. 46, fig. 24
+            // HD44780U starts in 8-bit mode
 
-        // First write
-        err = writeFourBitsToLcd( 0x03, gpioB );
-        if ( !err )
-        {
+            // Pull RS, R/W, and Enable low to begin commands:  0b00000001 = 0x01
+            mGpioB = 0x01;
+
+            // First write
+            err = sendFourBitsToLcd( 0x03 );
             // Datasheet says to wait at least 4.1ms
-            delayMicroseconds( 4500 );
+            setLcdDelay( 4500 );
+            mLcdState = kLcdInitSecond8Bit;
+            break;
 
+        case kLcdInitSecond8Bit:
             // Second write
-            err = writeFourBitsToLcd( 0x03, gpioB );
-            if ( !err )
-            {
-                // Datasheet says to wait at least 4.1ms
-                delayMicroseconds( 4500 );
-
-                // Third write
-                err = writeFourBitsToLcd( 0x03, gpioB );
-                if ( !err )
-                {
-                    // Datasheet says to wait at least 100ms
-                    delayMicroseconds( 150 );
-
-                    // Now can enter 4-bit mode
-                    err = writeFourBitsToLcd( 0x02, gpioB );
-                    if ( !err )
-                    {
-                        // Now configure the number of lines, font size, etc.
-                        err = sendCommand( LCD_FUNCTIONSET | LCD_4BITMODE | LCD_2LINE | LCD_5x8DOTS );
-                        if ( !err )
-                        {
-                            // Turn the display on with no cursor or blinking default
-                            mDisplayControl = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
-                            displayOn();
-                            clear();
-
-                            mCurrLine = 0;
-
-                            // Initialize to default text direction
-                            mDisplayMode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
-                            // Set the entry mode
-                            sendCommand( LCD_ENTRYMODESET | mDisplayMode );
-                        }
-                    }
-                }
-            }
-        }
+            err = sendFourBitsToLcd( 0x03 );
+            // Datasheet says to wait at least 4.1ms
+            setLcdDelay( 4500 );
+            mLcdState = kLcdInitThird8Bit;
+            break;
+
+        case kLcdInitThird8Bit:
+            // Third write
+            err = sendFourBitsToLcd( 0x03 );
+            // Datasheet says to wait at least 100us
+            setLcdDelay( 150 );
+            mLcdState = kLcdInit4Bit;
+            break;
+
+        case kLcdInit4Bit:
+            // Now can enter 4-bit mode
+            err = sendFourBitsToLcd( 0x02 );
+            setLcdDelay( 100 );
+            mLcdState = kLcdInitFunctionSet;
+            break;
+
+        case kLcdInitFunctionSet:
+            // Now configure the number of lines, font size, etc.
+            err = queueCommand( LCD_FUNCTIONSET | LCD_4BITMODE | LCD_2LINE | LCD_5x8DOTS );
+            mLcdState = kLcdInitDisplayOn;
+            break;
+
+        case kLcdInitDisplayOn:
+            // Turn the display on with no cursor or blinking default
+            mDisplayControl = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
+            err = queueCommand( LCD_DISPLAYCONTROL | mDisplayControl );
+            mLcdState = kLcdInitClear;
+            break;
+
+        case kLcdInitClear:
+            err = queueCommand( LCD_CLEARDISPLAY );
+            // Takes a while...
+            setLcdDelay( 2000 );
+            mLcdState = kLcdInitEntryMode;
+            break;
+
+        case kLcdInitEntryMode:
+            mCurrLine = 0;
+
+            // Initialize to default text direction
+            mDisplayMode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+            // Set the entry mode
+            err = queueCommand( LCD_ENTRYMODESET | mDisplayMode );
+            mLcdState = kLcdIdle;
+            break;
+
+        case kLcdSlowCommand:
+            // Nothing left to do; the delay has elapsed
+            mLcdState = kLcdIdle;
+            break;
     }
 
     return err;
@@ -369,8 +450,75 @@ int I2cLcd::initHD44780U()
 
 
 
+bool I2cLcd::service()
+{
+    // Perform as many steps as are due without blocking
+    while ( mLcdState != kLcdIdle )
+    {
+        // Delays count from the moment the previous step has been sent to the LCD
+        if ( burstInProgress() )
+        {
+            return true;
+        }
+
+        if ( mBurstStatus != I2cMaster::kI2cCompletedOk )
+        {
+            // The LCD didn't respond; abandon the sequence
+            mLcdError = -static_cast<int>( mBurstStatus );
+            mLcdState = kLcdIdle;
+            break;
+        }
+
+        if ( mLcdDelayPending )
+        {
+            mLcdDeadline = micros() + mLcdDelay;
+            mLcdDelayPending = false;
+        }
+
+        if ( static_cast<long>( micros() - mLcdDeadline ) < 0 )
+        {
+            return true;
+        }
+
+        int err = doLcdStep();
+        if ( err )
+        {
+            mLcdError = err;
+            mLcdState = kLcdIdle;
+        }
+    }
+
+    return false;
+}
+
+
+
 
-int I2cLcd::writeFourBitsToLcd( uint8_t value, uint8_t gpioB )
+void I2cLcd::setLcdDelay( uint16_t us )
+{
+    mLcdDelay = us;
+    mLcdDelayPending = true;
+}
+
+
+
+
+void I2cLcd::startSlowCommand( uint8_t cmd )
+{
+    // Sending the command waits for any sequence already in progress
+    int err = sendCommand( cmd );
+    if ( !err )
+    {
+        mLcdError = 0;
+        mLcdState = kLcdSlowCommand;
+        setLcdDelay( 2000 );
+    }
+}
+
+
+
+
+uint8_t* I2cLcd::encodeFourBits( uint8_t* buffer, uint8_t value, uint8_t gpioB )
 {
     // Use the lower 4 bits of value
     gpioB &= ~( ( 1 << kByteLcdD4 ) | ( 1 << kByteLcdD5 ) | ( 1 << kByteLcdD6 ) | ( 1 << kByteLcdD7 ) );
@@ -382,96 +530,190 @@ int I2cLcd::writeFourBitsToLcd( uint8_t value, uint8_t gpioB )
     // Set enable low
     gpioB &= ~( 1 << kByteLcdEnable );
 
-    int err = I2cMaster::writeSync( MCP23017_ADDRESS, MCP23017_GPIOB, gpioB );
+    //  HD44780U requires us to pulse the enable pin for values to be read; each GPIOB
+    // byte is preceded by GPIOA (the MCP23017 toggles between them), which we leave unchanged.
+    // At I2C speeds each byte lasts well beyond the HD44780U's minimum enable pulse width.
+    *buffer++ = mGpioA;
+    *buffer++ = gpioB | ( 1 << kByteLcdEnable );
+    *buffer++ = mGpioA;
+    *buffer++ = gpioB;
 
-    //  HD44780U requires us to pulse the enable pin for values to be read
-    if ( !err )
-    {
-        delayMicroseconds( 1 );
-        // Set enable high
-        gpioB |= ( 1 <<  kByteLcdEnable );
-        err = I2cMaster::writeSync( MCP23017_ADDRESS, MCP23017_GPIOB, gpioB );
+    return buffer;
+}
 
-        if ( !err )
-        {
-            delayMicroseconds( 1 );
-            // Set enable low
-            gpioB &= ~( 1 <<  kByteLcdEnable );
-            err = I2cMaster::writeSync( MCP23017_ADDRESS, MCP23017_GPIOB, gpioB );
-            delayMicroseconds( 100 );
-        }
-    }
 
-    return err;
+
+
+int I2cLcd::sendFourBitsToLcd( uint8_t value )
+{
+    // Only used during initialization, where the HD44780U needs delays between nibbles
+
+    // Set enable low
+    uint8_t gpioB = mGpioB & ~( 1 << kByteLcdEnable );
+
+    mBurst[0] = gpioB;
+    uint8_t* end = encodeFourBits( &mBurst[1], value, gpioB );
+    mGpioB = *( end - 1 );
+    mBurstLen = end - mBurst;
+
+    return sendBurst();
+}
+
+
+
+
+int I2cLcd::queueCommand( uint8_t cmd )
+{
+    // Only used by doLcdStep(), which knows the burst buffer is free
+    addToBurst( cmd, kWriteFourBitsSendCommand );
+    return sendBurst();
+}
+
+
+
+
+void I2cLcd::waitForBurst()
+{
+    while ( burstInProgress() )
+        ;
 }
 
 
 
 
-int I2cLcd::sendCharOrCmdToLcd( uint8_t value, bool isCommand )
+bool I2cLcd::burstInProgress()
+{
+    return ( mBurstStatus == I2cMaster::kI2cNotStarted || mBurstStatus == I2cMaster::kI2cInProgress );
+}
+
+
+
+
+void I2cLcd::addToBurst( uint8_t value, bool isCommand )
 {
     // Sending characters or command to the LCD involves only GPIOB pins
-    uint8_t gpioB;
-    int err = I2cMaster::readSync( MCP23017_ADDRESS, MCP23017_OLATB, 1, &gpioB );
 
-    if ( !err )
+    uint8_t gpioB = mGpioB;
+
+    // Clear the RW bit to write to the HD44780U
+    gpioB &= ~(1 << kByteLcdRW);
+    if ( isCommand )
     {
-        // Clear the RW bit to write to the HD44780U
-        gpioB &= ~(1 << kByteLcdRW);
-        if ( isCommand )
-        {
-            // Clear the RS bit to send a command
-            gpioB &= ~(1 << kByteLcdRS);
-        }
-        else
-        {
-            // Set the RS bit to send a character
-            gpioB |= (1 << kByteLcdRS);
-        }
+        // Clear the RS bit to send a command
+        gpioB &= ~(1 << kByteLcdRS);
+    }
+    else
+    {
+        // Set the RS bit to send a character
+        gpioB |= (1 << kByteLcdRS);
+    }
 
-        // Send the high bits
-        err = writeFourBitsToLcd( (value >> 4), gpioB );
-        if (!err )
-        {
-            // Send the low bits
-            err = writeFourBitsToLcd( (value & 0b00001111), gpioB );
-        }
+    // Set enable low
+    gpioB &= ~( 1 << kByteLcdEnable );
+
+    uint8_t* p = mBurst + mBurstLen;
+    if ( !mBurstLen )
+    {
+        // The first byte sets up RS before the first enable pulse
+        *p++ = gpioB;
     }
+    else if ( gpioB != mGpioB )
+    {
+        // Switching between commands and characters; set up RS before the next enable pulse
+        *p++ = mGpioA;
+        *p++ = gpioB;
+    }
+
+    // Send the high bits
+    p = encodeFourBits( p, (value >> 4), gpioB );
+    // Send the low bits
+    p = encodeFourBits( p, (value & 0b00001111), gpioB );
+
+    // Remember what the GPIOB latch will hold when this burst completes
+    mGpioB = *( p - 1 );
+    mBurstLen = p - mBurst;
+}
+
+
+
 
+int I2cLcd::sendBurst()
+{
+    int err = I2cMaster::writeAsyncNoCopy( MCP23017_ADDRESS, MCP23017_GPIOB, mBurst, mBurstLen, &mBurstStatus );
+    mBurstLen = 0;
     return err;
 }
 
 
 
 
+int I2cLcd::sendCharOrCmdToLcd( const uint8_t* values, uint8_t nbrValues, bool isCommand )
+{
+    // Let any asynchronous sequence finish first
+    while ( service() )
+        ;
+
+    // The burst buffer is read directly by the TWI interrupt, so wait for the last burst to go out
+    waitForBurst();
+
+    while ( nbrValues-- )
+    {
+        addToBurst( *values++, isCommand );
+    }
+
+    return sendBurst();
+}
+
+
+
+
 
 
 void I2cLcd::clear()
 {
-    sendCommand( LCD_CLEARDISPLAY );    // Clear display, set cursor position to zero
-    delayMilliseconds( 2 );             // Takes a while...
+    clearAsync();
+    while ( service() )
+        ;
+}
+
+
+
+void I2cLcd::clearAsync()
+{
+    startSlowCommand( LCD_CLEARDISPLAY );   // Clear display, set cursor position to zero
+
+    // The LCD is now blank
+    memset( mFrameSent, ' ', sizeof( mFrameSent ) );
+    memset( mFrameStaleFrom, I2C_LCD_NBR_COLUMNS, sizeof( mFrameStaleFrom ) );
 }
 
 
 
 void I2cLcd::home()
 {
-    sendCommand( LCD_RETURNHOME );      // Set cursor position to zero
-    delayMilliseconds( 2 );             // Takes a while...
+    homeAsync();
+    while ( service() )
+        ;
+}
+
+
+
+void I2cLcd::homeAsync()
+{
+    startSlowCommand( LCD_RETURNHOME );     // Set cursor position to zero
 }
 
 
 
 void I2cLcd::setCursor(  uint8_t row, uint8_t col )
 {
-    int row_offsets[] = { 0x00, 0x40 };
     if ( row >= kNumLines )
     {
         // Count rows starting at 0 (in traditional C/C++ fashion)
         row %= kNumLines;
     }
 
-    sendCommand( LCD_SETDDRAMADDR | ( col + row_offsets[row] ) );
+    sendCommand( LCD_SETDDRAMADDR | ( col + kRowOffsets[row] ) );
 }
 
 
@@ -576,14 +818,14 @@ void I2cLcd::displayBottomRow( const char* str )
 void I2cLcd::clearTopRow()
 {
     setCursor( 0, 0 );
-    write( kBlankLine );
+    write( kBlankLine, I2C_LCD_NBR_COLUMNS );
 }
 
 
 void I2cLcd::clearBottomRow()
 {
     setCursor( 1, 0 );
-    write( kBlankLine );
+    write( kBlankLine, I2C_LCD_NBR_COLUMNS );
 }
 
 
@@ -592,7 +834,7 @@ void I2cLcd::clearBottomRow()
 
 size_t I2cLcd::write( uint8_t value )
 {
-    int err = sendCharToDisplay( value );
+    int err = sendCharsToDisplay( &value, 1 );
     return ( err ? 0 : 1 );
 }
 
@@ -601,8 +843,7 @@ size_t I2cLcd::write( uint8_t value )
 
 size_t I2cLcd::write( char value )
 {
-    int err = sendCharToDisplay( static_cast<uint8_t>( value ) );
-    return ( err ? 0 : 1 );
+    return write( static_cast<uint8_t>( value ) );
 }
 
 
@@ -610,17 +851,7 @@ size_t I2cLcd::write( char value )
 
 size_t I2cLcd::write( const char* str )
 {
-    size_t n = 0;
-    if ( str )
-    {
-        int err = 0;
-        while ( *str && !err )
-        {
-            err = sendCharToDisplay( static_cast<uint8_t>( *str++ ) );
-            ++n;
-        }
-    }
-    return n;
+    return ( str ? write( str, strlen( str ) ) : 0 );
 }
 
 
@@ -640,8 +871,14 @@ size_t I2cLcd::write( const uint8_t* buffer, size_t size )
         int err = 0;
         while ( n < size && !err )
         {
-             err = sendCharToDisplay( *buffer++ );
-            ++n;
+            // Send up to a burst's worth of characters in one I2C transmission
+            uint8_t len = ( size - n > I2C_LCD_MAX_BURST_CHARS ) ? I2C_LCD_MAX_BURST_CHARS : size - n;
+            err = sendCharsToDisplay( buffer, len );
+            if ( !err )
+            {
+                buffer += len;
+                n += len;
+            }
         }
     }
     return n;
@@ -650,35 +887,160 @@ size_t I2cLcd::write( const uint8_t* buffer, size_t size )
 
 void I2cLcd::flush()
 {
-    // Do nothing
+    waitForBurst();
+}
+
+
+
+
+void I2cLcd::setFrameText( uint8_t row, uint8_t col, const char* str )
+{
+    if ( row < I2C_LCD_NBR_ROWS && str )
+    {
+        while ( col < I2C_LCD_NBR_COLUMNS && *str )
+        {
+            mFrame[row][col++] = *str++;
+        }
+    }
 }
 
 
 
+void I2cLcd::setFrameRow( uint8_t row, const char* str )
+{
+    if ( row < I2C_LCD_NBR_ROWS )
+    {
+        memset( mFrame[row], ' ', I2C_LCD_NBR_COLUMNS );
+        setFrameText( row, 0, str );
+    }
+}
+
+
+
+void I2cLcd::clearFrame()
+{
+    memset( mFrame, ' ', sizeof( mFrame ) );
+}
+
+
+
+bool I2cLcd::frameCharChanged( uint8_t row, uint8_t col )
+{
+    return ( col >= mFrameStaleFrom[row] || mFrame[row][col] != mFrameSent[row][col] );
+}
+
+
+
+bool I2cLcd::update()
+{
+    // Never block:  the LCD is busy or the burst buffer is still being read by the TWI interrupt
+    if ( service() || burstInProgress() )
+    {
+        return false;
+    }
+
+    bool done = true;
+
+    for ( uint8_t row = 0; row < I2C_LCD_NBR_ROWS && done; ++row )
+    {
+        uint8_t col = 0;
+        while ( col < I2C_LCD_NBR_COLUMNS )
+        {
+            if ( !frameCharChanged( row, col ) )
+            {
+                ++col;
+                continue;
+            }
+
+            // Find the end of this run of changes; bridge single unchanged characters because resending
+            // one character costs less than another cursor command
+            uint8_t end = col + 1;
+            while ( end < I2C_LCD_NBR_COLUMNS
+                    && ( frameCharChanged( row, end )
+                        || ( end + 1 < I2C_LCD_NBR_COLUMNS && frameCharChanged( row, end + 1 ) ) ) )
+            {
+                ++end;
+            }
+
+            // Worst case cost of the cursor command and the characters (including RS set-up bytes)
+            uint16_t cmdBytes = ( mBurstLen ? 2 : 1 ) + kBurstBytesPerChar;
+            uint16_t room = kBurstBufferSize - mBurstLen;
+            if ( room < cmdBytes + 2 + kBurstBytesPerChar )
+            {
+                // Burst is full, leave the rest for the next call
+                done = false;
+                break;
+            }
+            uint8_t len = end - col;
+            uint8_t maxLen = ( room - cmdBytes - 2 ) / kBurstBytesPerChar;
+            if ( len > maxLen )
+            {
+                len = maxLen;
+            }
+
+            addToBurst( LCD_SETDDRAMADDR | ( col + kRowOffsets[row] ), kWriteFourBitsSendCommand );
+            for ( uint8_t i = 0; i < len; ++i )
+            {
+                addToBurst( mFrame[row][col], kWriteFourBitsSendChar );
+                mFrameSent[row][col] = mFrame[row][col];
+                ++col;
+            }
+
+            if ( mFrameStaleFrom[row] < col )
+            {
+                mFrameStaleFrom[row] = col;
+            }
+        }
+
+        if ( done )
+        {
+            mFrameStaleFrom[row] = I2C_LCD_NBR_COLUMNS;
+        }
+    }
+
+    if ( mBurstLen && sendBurst() )
+    {
+        // Couldn't queue the burst (e.g., the I2C queue is full), so resend everything next time
+        memset( mFrameStaleFrom, 0, sizeof( mFrameStaleFrom ) );
+        return false;
+    }
+
+    return done;
+}
+
+
+
+bool I2cLcd::refresh()
+{
+    memset( mFrameStaleFrom, 0, sizeof( mFrameStaleFrom ) );
+    return update();
+}
+
+
 
 int I2cLcd::setBacklight( uint8_t status )
 {
     // Use pins 0, 14, 15; means we have to touch both GPIO A & B
 
-    // First read GPIO A & B (actually read the latches = what we set them)
+    // Start from the cached GPIO A & B latches (= what we set them)
     uint8_t gpio[2];
-    int err = I2cMaster::readSync( MCP23017_ADDRESS, MCP23017_OLATA, 2, gpio );
+    gpio[0] = mGpioA;
+    gpio[1] = mGpioB;
 
-    if ( !err )
-    {
-        // Clear pins 14 & 15 (GPIOA 6 & 7)
-        gpio[0] &= ~( ( 1 << kByteLcdGreen ) | ( 1 << kByteLcdRed ) );
-        // Set pins 14 & 15 (GPIOA 6 & 7) as appropriate
-        gpio[0] |= ( (~(status >> 1) & 0x01) << kByteLcdGreen ) | ( (~status & 0x01) << kByteLcdRed );
+    // Clear pins 14 & 15 (GPIOA 6 & 7)
+    gpio[0] &= ~( ( 1 << kByteLcdGreen ) | ( 1 << kByteLcdRed ) );
+    // Set pins 14 & 15 (GPIOA 6 & 7) as appropriate
+    gpio[0] |= ( (~(status >> 1) & 0x01) << kByteLcdGreen ) | ( (~status & 0x01) << kByteLcdRed );
 
-        // Clear pin 0 (GPIOB 0), set it as needed, and write the new GPIO
-        gpio[1] &= ~0x01;
-        gpio[1] |= ~(status >> 2) & 0x01;
+    // Clear pin 0 (GPIOB 0), set it as needed, and write the new GPIO
+    gpio[1] &= ~0x01;
+    gpio[1] |= ~(status >> 2) & 0x01;
 
-        err = I2cMaster::writeAsync( MCP23017_ADDRESS, MCP23017_GPIOA, gpio, 2, &mI2cStatus );
-    }
+    mGpioA = gpio[0];
+    mGpioB = gpio[1];
 
-    return err;
+    // Messages of equal priority go out in order, so this can't overtake a queued burst
+    return I2cMaster::writeAsync( MCP23017_ADDRESS, MCP23017_GPIOA, gpio, 2, &mI2cStatus );
 }
 
 
@@ -30,6 +30,22 @@
  *
  * To use these features, include I2cLcd.h in your source code and link against I2cLcd.cpp and I2cMaster.cpp.
  *
+ * Characters are sent to the LCD in bursts:  each string (up to \c I2C_LCD_MAX_BURST_CHARS characters at a time)
+ * is encoded, enable pulses and all, into a single multi-byte write to the MCP23017 that is queued asynchronously
+ * with I2cMaster.  The default burst size is 16 characters (one row of the display), which needs a 129 byte buffer.
+ * You can change this by defining the macro \c I2C_LCD_MAX_BURST_CHARS prior to including I2cLcd.h (best done
+ * with a compiler option, e.g., \c -DI2C_LCD_MAX_BURST_CHARS=8).
+ *
+ * The class can also keep a shadow copy of the display contents (a framebuffer).  Write text into the framebuffer
+ * with I2cLcd::setFrameText() or I2cLcd::setFrameRow() and call I2cLcd::update() periodically; only the characters
+ * that differ from what was last sent to the LCD are transmitted.  The dimensions of the framebuffer default to
+ * 2 rows of 16 columns; you can change these by defining the macros \c I2C_LCD_NBR_ROWS and
+ * \c I2C_LCD_NBR_COLUMNS prior to including I2cLcd.h.
+ *
+ * \note The bursts rely on the I2C transfer time of each byte to meet the HD44780U timing (in particular
+ * the 37 microseconds needed to execute each character); this holds for bus speeds up to 400 kHz, so do not
+ * use I2cMaster::setDeviceSpeed() to run the LCD faster than kI2cBusFast.
+ *
  */
 
 
@@ -42,6 +58,32 @@
 
 
 
+#ifndef I2C_LCD_MAX_BURST_CHARS
+#define I2C_LCD_MAX_BURST_CHARS     16
+#endif
+
+#if I2C_LCD_MAX_BURST_CHARS < 1 || I2C_LCD_MAX_BURST_CHARS > 255
+#error "I2C_LCD_MAX_BURST_CHARS must be between 1 and 255"
+#endif
+
+#ifndef I2C_LCD_NBR_ROWS
+#define I2C_LCD_NBR_ROWS            2
+#endif
+
+#ifndef I2C_LCD_NBR_COLUMNS
+#define I2C_LCD_NBR_COLUMNS         16
+#endif
+
+#if I2C_LCD_NBR_ROWS < 1 || I2C_LCD_NBR_ROWS > 4
+#error "I2C_LCD_NBR_ROWS must be between 1 and 4"
+#endif
+
+#if I2C_LCD_NBR_COLUMNS < 1 || I2C_LCD_NBR_COLUMNS > 40
+#error "I2C_LCD_NBR_COLUMNS must be between 1 and 40"
+#endif
+
+
+
 
 /*!
  * \brief This class provides a high-level interface via I2C to an LCD such as those offered by AdaFruit
@@ -98,22 +140,86 @@ public:
      * before calling this function (by calling I2cMaster::start() from I2cMaster.h).
      *
      * The LCD display is initialized in 16-column, 2-row mode.
+     *
+     * This function blocks for the 60 ms or so the HD44780U needs to initialize; use initAsync()
+     * if you can't afford this.  The system clock must be initialized (by calling initSystemClock()
+     * from SystemClock.h).
+     *
+     * \returns an error code corresponding to I2cMaster::I2cSendErrorCodes, or the negative of an
+     * I2cMaster::I2cStatusCodes value if a transmission to the LCD failed (0 means no error).
      */
     int init();
 
 
     /*!
-     * \brief Clear the display (all rows, all columns).
+     * \brief Initialize the I2cLcd object without blocking during the HD44780U's start-up delays.
+     * This configures the MCP23017 and then returns; the rest of the initialization sequence is
+     * carried out by subsequent calls to service().  The LCD is ready for use when busy()
+     * returns false.  Functions that send to the LCD while it is busy wait until it is no longer busy.
+     *
+     * \returns an error code corresponding to I2cMaster::I2cSendErrorCodes (0 means no error).
+     */
+    int initAsync();
+
+
+    /*!
+     * \brief Clear the display (all rows, all columns).  This blocks for the 2 ms the HD44780U
+     * takes to clear the display; use clearAsync() if you can't afford this.
      */
     void clear();
 
 
     /*!
-     * \brief Move the cursor home (the top row, left column).
+     * \brief Clear the display (all rows, all columns) without blocking while the HD44780U
+     * clears the display.  Call service() until busy() returns false before sending anything else.
+     */
+    void clearAsync();
+
+
+    /*!
+     * \brief Move the cursor home (the top row, left column).  This blocks for the 2 ms the HD44780U
+     * takes to execute the command; use homeAsync() if you can't afford this.
      */
     void home();
 
 
+    /*!
+     * \brief Move the cursor home (the top row, left column) without blocking while the HD44780U
+     * executes the command.  Call service() until busy() returns false before sending anything else.
+     */
+    void homeAsync();
+
+
+    /*!
+     * \brief Determine if the LCD is executing an asynchronous sequence started by initAsync(),
+     * clearAsync(), or homeAsync().
+     *
+     * \returns true if the LCD is busy, false if it is ready to accept new output.
+     */
+    bool busy()
+    { return mLcdState != kLcdIdle; }
+
+
+    /*!
+     * \brief Advance any asynchronous sequence started by initAsync(), clearAsync(), or homeAsync().
+     * This never blocks; it performs whatever steps of the sequence are due and returns.  Call it
+     * regularly (e.g., from your main loop) while busy() returns true.
+     *
+     * \returns true if the LCD is still busy, false if it is ready to accept new output.
+     */
+    bool service();
+
+
+    /*!
+     * \brief Report any error that terminated the last asynchronous sequence.
+     *
+     * \returns an error code corresponding to I2cMaster::I2cSendErrorCodes, or the negative of an
+     * I2cMaster::I2cStatusCodes value if a transmission to the LCD failed (0 means no error).
+     */
+    int sequenceError()
+    { return mLcdError; }
+
+
     /*!
      * \brief Display a C-string on the top row.
      *
@@ -288,8 +394,60 @@ public:
 
 
     /*!
-     * \brief This function does nothing.  It simply implements the pure virtual
-     * function Writer::flush().
+     * \brief Write a C-string into the framebuffer at a given row and column.  Text that extends beyond
+     * the end of the row is discarded.  Nothing is sent to the LCD until you call update().
+     *
+     * \arg \c row the row at which to place the text (numbering starts at 0).
+     * \arg \c col the column at which the text starts (numbering starts at 0).
+     * \arg \c str the C-string to place in the framebuffer.
+     */
+    void setFrameText( uint8_t row, uint8_t col, const char* str );
+
+
+    /*!
+     * \brief Replace an entire row of the framebuffer with a C-string, padding the row with blanks.
+     * Nothing is sent to the LCD until you call update().
+     *
+     * \arg \c row the row to replace (numbering starts at 0).
+     * \arg \c str the C-string to place in the framebuffer.
+     */
+    void setFrameRow( uint8_t row, const char* str );
+
+
+    /*!
+     * \brief Fill the framebuffer with blanks.  Nothing is sent to the LCD until you call update().
+     */
+    void clearFrame();
+
+
+    /*!
+     * \brief Send the characters in the framebuffer that differ from those last sent to the LCD.  Each
+     * run of changed characters is sent as a cursor command followed by the characters, all packed into a
+     * single asynchronous I2C burst.  This function never blocks:  if the previous burst is still being
+     * transmitted it returns immediately, and if the changes don't fit in one burst the rest are left for
+     * the next call.  So call update() regularly (e.g., from your main loop) until it returns true.
+     *
+     * Don't mix the framebuffer functions with direct writes to the LCD (e.g., write() or displayTopRow())
+     * without calling refresh() afterwards, because the framebuffer can't know what those wrote.
+     *
+     * \returns true if the LCD now matches the framebuffer (all changes have been queued),
+     * false if changes remain to be sent.
+     */
+    bool update();
+
+
+    /*!
+     * \brief Mark the entire framebuffer as changed and start sending it to the LCD.  Like update(), this
+     * function never blocks; call update() until it returns true to complete the refresh.
+     *
+     * \returns true if the LCD now matches the framebuffer, false if changes remain to be sent.
+     */
+    bool refresh();
+
+
+    /*!
+     * \brief Wait until all characters and commands previously sent to the LCD have been
+     * transmitted.  This implements the pure virtual function Writer::flush().
      */
     virtual void flush();
 
@@ -302,26 +460,71 @@ private:
         kWriteFourBitsSendCommand = 1
     };
 
+    enum
+    {
+        kLcdIdle,
+        kLcdInitFirst8Bit,
+        kLcdInitSecond8Bit,
+        kLcdInitThird8Bit,
+        kLcdInit4Bit,
+        kLcdInitFunctionSet,
+        kLcdInitDisplayOn,
+        kLcdInitClear,
+        kLcdInitEntryMode,
+        kLcdSlowCommand
+    };
+
+    enum
+    {
+        // Each character takes two nibbles; each nibble takes an enable-high and an enable-low
+        // GPIOB byte, each preceded by the (unchanged) GPIOA byte; plus one leading set-up byte
+        kBurstBytesPerChar = 8,
+        kBurstBufferSize = 1 + kBurstBytesPerChar * I2C_LCD_MAX_BURST_CHARS
+    };
+
     int initMCP23017();
-    int initHD44780U();
+    void initHD44780U();
+    void startSlowCommand( uint8_t cmd );
+    void setLcdDelay( uint16_t us );
+    int doLcdStep();
     size_t write( uint8_t value );
-    int writeFourBitsToLcd( uint8_t value, uint8_t gpioB );
-    int sendCharOrCmdToLcd( uint8_t value, bool isCommand );
+    int sendFourBitsToLcd( uint8_t value );
+    int queueCommand( uint8_t cmd );
+    uint8_t* encodeFourBits( uint8_t* buffer, uint8_t value, uint8_t gpioB );
+    int sendCharOrCmdToLcd( const uint8_t* values, uint8_t nbrValues, bool isCommand );
+    void waitForBurst();
+    bool burstInProgress();
+    void addToBurst( uint8_t value, bool isCommand );
+    int sendBurst();
+    bool frameCharChanged( uint8_t row, uint8_t col );
 
     int sendCommand( uint8_t cmd )
     {
-        return sendCharOrCmdToLcd( cmd, kWriteFourBitsSendCommand );
+        return sendCharOrCmdToLcd( &cmd, 1, kWriteFourBitsSendCommand );
     }
 
-    int sendCharToDisplay( uint8_t value )
+    int sendCharsToDisplay( const uint8_t* values, uint8_t nbrValues )
     {
-        return sendCharOrCmdToLcd( value, kWriteFourBitsSendChar );
+        return sendCharOrCmdToLcd( values, nbrValues, kWriteFourBitsSendChar );
     }
 
     uint8_t             mDisplayControl;
     uint8_t             mDisplayMode;
     uint8_t             mCurrLine;
+    uint8_t             mGpioA;
+    uint8_t             mGpioB;
     volatile uint8_t    mI2cStatus;
+    volatile uint8_t    mBurstStatus;
+    uint16_t            mBurstLen;
+    uint8_t             mBurst[ kBurstBufferSize ];
+    char                mFrame[ I2C_LCD_NBR_ROWS ][ I2C_LCD_NBR_COLUMNS ];
+    char                mFrameSent[ I2C_LCD_NBR_ROWS ][ I2C_LCD_NBR_COLUMNS ];
+    uint8_t             mFrameStaleFrom[ I2C_LCD_NBR_ROWS ];
+    uint8_t             mLcdState;
+    int                 mLcdError;
+    bool                mLcdDelayPending;
+    uint16_t            mLcdDelay;
+    unsigned long       mLcdDeadline;
 };
 
 #endif
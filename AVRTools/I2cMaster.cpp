@@ -25,17 +25,26 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <avr/pgmspace.h>
+
 #include <util/atomic.h>
 #include <util/twi.h>
 #include <util/delay.h>
 
 #include "ArduinoPins.h"
+#include "Profiler.h"
+#include "SleepUtils.h"
+#include "Trace.h"
 
+#ifdef I2C_MASTER_TIMEOUTS
+#include "SystemClock.h"
+#endif
 
 
 
 
-#if defined( DEBUG_I2cMasterBuffer ) || defined( DEBUG_I2cMasterDiary )
+
+#ifdef DEBUG_I2cMasterBuffer
 
 #include "USART0.h"
 
@@ -47,21 +56,11 @@ namespace
 #endif
 
 
-#ifdef DEBUG_I2cMasterDiary
-
-#ifndef DEBUG_I2cMasterDiaryBufferSize
-#define DEBUG_I2cMasterDiaryBufferSize         32
-#endif
-
-#if DEBUG_I2cMasterDiaryBufferSize > 255
-#error "DEBUG_I2cMasterDiaryBufferSize exceeds size of a uint8_t"
-#endif
-
-
 
 namespace
 {
 
+    // Events recorded by TRACE_EVENT() (see Trace.h)
     enum
     {
         kSendNextByte               = 1,
@@ -83,18 +82,8 @@ namespace
         kErrorStartStop             = 92
     };
 
-
-    uint8_t     debugContent[ DEBUG_I2cMasterDiaryBufferSize ];
-    uint8_t     debugControl[ DEBUG_I2cMasterDiaryBufferSize ];
-    uint8_t     debugStatus[ DEBUG_I2cMasterDiaryBufferSize ];
-    uint8_t     debugPtr;
-
-    void DebugDiaryEntry( uint8_t content, uint8_t control, uint8_t status );
-
 };
 
-#endif
-
 
 
 
@@ -116,119 +105,135 @@ namespace
 
     const uint8_t kMaxMsgLen    = I2C_MASTER_MAX_TX_MSG_LEN;
     const uint8_t kMaxNbrMsgs   = I2C_MASTER_MAX_TX_MSG_NBR;
+    const uint8_t kMaxNbrSpeeds = I2C_MASTER_MAX_DEVICE_SPEEDS;
 
 
 
-    class BufferI2cTx
+    struct BitRate
     {
-    public:
-
-
-        BufferI2cTx();
+        uint8_t     twbr;
+        uint8_t     twps;
+    };
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wreturn-type"
 
-        uint8_t getCurrentAddress()
+    // SCL frequency = F_CPU / ( 16 + 2 * TWBR * 4^TWPS ); pick the fastest setting not above the request
+    BitRate computeBitRate( uint32_t speed )
+    {
+        if ( speed == I2cMaster::kI2cBusSlow )
         {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-            {
-                return mAddress[ mCurrentMsg ];
-            }
+            speed = 100000UL;
         }
-
-        uint8_t getCurrentTxMode()
+        else if ( speed == I2cMaster::kI2cBusFast )
         {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-            {
-                return mTxMode[ mCurrentMsg ];
-            }
+            speed = 400000UL;
         }
-
-        uint8_t setCurrentTxMode( I2cTxMode mode )
+        else if ( speed == I2cMaster::kI2cBusFastPlus )
         {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-            {
-                mTxMode[ mCurrentMsg ] = static_cast<uint8_t>( mode );
-            }
+            speed = 1000000UL;
         }
 
-        uint8_t* getCurrentRxBufferPtr()
-        {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-            {
-                return mRxBuffer[ mCurrentMsg ];
-            }
-        }
+        BitRate r = { 0, 0 };
 
-        uint8_t getCurrentRxBufferSize()
+        uint32_t cycles = ( F_CPU + speed - 1 ) / speed;
+        if ( cycles > 16 )
         {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+            // Round up so we never exceed the requested speed
+            uint32_t n = ( cycles - 16 + 1 ) / 2;
+            while ( n > 255 && r.twps < 3 )
             {
-                return mRxBufferSize[ mCurrentMsg ];
+                n = ( n + 3 ) / 4;
+                ++r.twps;
             }
+            r.twbr = ( n > 255 ) ? 255 : n;
         }
 
-        volatile uint8_t* getCurrentRxBufferCtr()
-        {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-            {
-                return mRxCounter[ mCurrentMsg ];
-            }
-        }
+        return r;
+    }
 
-        volatile uint8_t* getCurrentStatus()
-        {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-            {
-                return mStatus[ mCurrentMsg ];
-            }
-        }
 
-        int getCurrentByte()
-        {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-            {
-                return mCurrentByte < mTxBufferSize[ mCurrentMsg ]
-                        ? mTxBuffer[ mCurrentMsg ][ mCurrentByte++ ] : -1;
-            }
-        }
+    BitRate         gI2cBusBitRate;
 
-        bool isFull()
-        {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-            {
-                return mNbrMsgs >= kMaxNbrMsgs;
-            }
-        }
+#if I2C_MASTER_MAX_DEVICE_SPEEDS > 0
 
-        bool isNotFull()
+    struct DeviceSpeed
+    {
+        uint8_t     address;
+        BitRate     rate;
+    };
+
+    DeviceSpeed     gI2cDeviceSpeeds[ kMaxNbrSpeeds ];
+    uint8_t         gI2cNbrDeviceSpeeds;
+
+#endif
+
+
+    // Record in the descriptor the bit rate to use for its device
+    void setBitRateFor( I2cMaster::I2cTransaction* t )
+    {
+        BitRate r = gI2cBusBitRate;
+
+#if I2C_MASTER_MAX_DEVICE_SPEEDS > 0
+        for ( uint8_t i = 0; i < gI2cNbrDeviceSpeeds; ++i )
         {
-            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+            if ( gI2cDeviceSpeeds[i].address == t->mAddress )
             {
-                return mNbrMsgs < kMaxNbrMsgs;
+                r = gI2cDeviceSpeeds[i].rate;
+                break;
             }
         }
+#endif
+
+        t->mBitRate = r.twbr;
+        t->mPrescaler = r.twps;
+    }
+
+
 
-#pragma GCC diagnostic pop
+    /*
+     * The transaction queue is a singly-linked list of descriptors kept in priority order, plus a free list.
+     * The head of the queue is the transaction on (or next to go on) the bus.
+     *
+     * Functions that are only called from the TWI ISR don't need atomic protection (the ISR cannot be
+     * interrupted by anything that touches the queue); functions called from the main thread (or from other
+     * ISRs) use a single short ATOMIC_BLOCK each.
+     */
 
-        bool noMessages()
-        { return !static_cast<bool>( mNbrMsgs ); }
+    class BufferI2cTx
+    {
+    public:
 
-        bool messagePending()
-        { return static_cast<bool>( mNbrMsgs ); }
+        BufferI2cTx();
 
+        void setStorage( I2cMaster::I2cTransaction* slots, uint8_t nbrSlots );
 
+        bool hasStorage()
+        { return mNbrSlots; }
 
-        bool doneWithCurrentMessage();
+        I2cMaster::I2cTransaction* allocate();
 
-        uint8_t push( uint8_t address, I2cTxMode txMode, const uint8_t* txdata, uint8_t txLen,
-                        uint8_t* rxData, uint8_t rxLen, volatile uint8_t* rxCnt,
-                        volatile uint8_t* rxStatus );
+        void submit( I2cMaster::I2cTransaction* t );
 
         void clear();
 
 
+        // These only get called from the ISR
+
+        I2cMaster::I2cTransaction* current()
+        { return mHead; }
+
+        void lockCurrentMessage()
+        { mHeadLocked = true; }
+
+        int getCurrentByte();
+
+        void rewindCurrentSegment();
+
+        void rewindCurrentMessage();
+
+        bool nextSegment();
+
+        bool doneWithCurrentMessage();
+
 
 #ifdef DEBUG_I2cMasterBuffer
 
@@ -239,18 +244,12 @@ namespace
 
     private:
 
-        uint8_t             mTxBuffer[ kMaxNbrMsgs ][ kMaxMsgLen ];
-        uint8_t*            mRxBuffer[ kMaxNbrMsgs ];
-        volatile uint8_t*   mRxCounter[ kMaxNbrMsgs ];
-        volatile uint8_t*   mStatus[ kMaxNbrMsgs ];
-        uint8_t             mTxBufferSize[ kMaxNbrMsgs ];
-        uint8_t             mRxBufferSize[ kMaxNbrMsgs ];
-        uint8_t             mTxMode[ kMaxNbrMsgs ];
-        uint8_t             mAddress[ kMaxNbrMsgs ];
+        I2cMaster::I2cTransaction* volatile     mHead;
+        I2cMaster::I2cTransaction* volatile     mFree;
 
-        volatile uint8_t    mCurrentByte;
-        volatile uint8_t    mNbrMsgs;
-        volatile uint8_t    mCurrentMsg;
+        volatile uint16_t   mCurrentByte;
+        volatile bool       mHeadLocked;
+        uint8_t             mNbrSlots;
 
     };
 
@@ -264,131 +263,204 @@ namespace
 
 
 
+namespace
+{
+
+    // Set up the descriptor to execute its current segment
+    void loadSegment( I2cMaster::I2cTransaction* t )
+    {
+        const I2cMaster::I2cSegment* seg = t->mSegments + t->mCurrentSegment;
+
+        uint8_t mode = ( seg->rxLen ? kI2cRead : 0 );
+        if ( seg->txLen || !mode )
+        {
+            // A segment with nothing to read at least writes the address
+            mode |= kI2cWrite;
+        }
+
+        t->mAddress = seg->address;
+        t->mTxMode = mode;
+        t->mPhase = mode;
+        t->mTxBufferSize = 0;
+        t->mTxData = seg->txData;
+        t->mTxDataSize = seg->txLen;
+        t->mTxDataInProgmem = false;
+        t->mRxBuffer = seg->rxData;
+        t->mRxBufferSize = seg->rxLen;
+        t->mRxCounter = &( t->mSegmentRxCounter );
+        t->mSegmentRxCounter = 0;
+        setBitRateFor( t );
+    }
+
+};
+
+
+
+
 BufferI2cTx::BufferI2cTx()
-: mCurrentByte( 0 ), mNbrMsgs( 0 ), mCurrentMsg( 0 )
+: mHead( 0 ), mFree( 0 ), mCurrentByte( 0 ), mHeadLocked( false ), mNbrSlots( 0 )
 {
 }
 
 
-bool BufferI2cTx::doneWithCurrentMessage()
-{
-    bool retVal = false;
 
+void BufferI2cTx::setStorage( I2cMaster::I2cTransaction* slots, uint8_t nbrSlots )
+{
     ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
     {
-        --mNbrMsgs;
-        if ( mNbrMsgs )
+        I2cMaster::I2cTransaction* next = 0;
+        for ( uint8_t i = nbrSlots; i > 0; --i )
         {
-            // Point to the next message
-            ++mCurrentMsg;
-            if ( mCurrentMsg >= kMaxNbrMsgs )
-            {
-                mCurrentMsg -= kMaxNbrMsgs;
-            }
-
-            // We have another msg, so return true;
-            retVal = true;
+            slots[ i - 1 ].mNext = next;
+            next = &slots[ i - 1 ];
         }
 
-        // Else just leave the current message where it is (but it is invalid)
-
-        // No matter what, reset to point to the beginning of the next message's data
+        mFree = next;
+        mHead = 0;
         mCurrentByte = 0;
+        mHeadLocked = false;
+        mNbrSlots = nbrSlots;
     }
-
-    return retVal;
 }
 
 
 
-
-
-uint8_t BufferI2cTx::push( uint8_t address, I2cTxMode txMode, const uint8_t* txData, uint8_t txLen,
-                           uint8_t* rxBuf, uint8_t rxLen, volatile uint8_t* rxCnt,
-                           volatile uint8_t* status )
+I2cMaster::I2cTransaction* BufferI2cTx::allocate()
 {
+    I2cMaster::I2cTransaction* t;
+
     ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
     {
-        if ( mNbrMsgs >= kMaxNbrMsgs )
+        t = mFree;
+        if ( t )
         {
-            // If buffer is full, ignore the push() but return code to indicate a problem
-            return I2cMaster::kI2cErrTxBufferFull;
+            mFree = t->mNext;
         }
+    }
 
-        if ( txLen > kMaxMsgLen )
-        {
-            // If data is too long, ignore the push() but return code to indicate a problem
-            return I2cMaster::kI2cErrMsgTooLong;
-        }
+    return t;
+}
 
-        if ( !status )
-        {
-            // If no status, ignore the push() but return code to indicate a problem
-            return I2cMaster::kI2cErrNullStatusPtr;
-        }
 
-        if ( ( txMode == kI2cWrite || txMode == kI2cWriteRestartRead ) && ( !txData || !txLen ) )
+
+void BufferI2cTx::submit( I2cMaster::I2cTransaction* t )
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        // Start at the front of the queue unless the current message is already on the bus
+        I2cMaster::I2cTransaction* volatile* link = &mHead;
+        if ( mHeadLocked )
         {
-            // If writing and no data provided, ignore the push() but return code to indicate a problem
-            return I2cMaster::kI2cErrWriteWithoutData;
+            link = &( mHead->mNext );
         }
 
-        if ( ( txMode == kI2cRead || txMode == kI2cWriteRestartRead )
-                        && ( !rxBuf || !rxLen || !rxCnt ) )
+        // Go behind everything of equal or higher priority
+        while ( *link && (*link)->mPriority >= t->mPriority )
         {
-            // If reading and no storage provided, ignore the push() but return code to indicate a problem
-            return I2cMaster::kI2cErrReadWithoutStorage;
+            link = &( (*link)->mNext );
         }
 
-        // If we get here, things are okay
+        t->mNext = *link;
+        *link = t;
+    }
+}
 
-        // Figure out the slot
-        uint8_t slot = ( mCurrentMsg + mNbrMsgs ) % kMaxNbrMsgs;
 
-        // Put in the data
-        mAddress[ slot ] = address;
-        mTxMode[ slot ] = static_cast<uint8_t>( txMode );
 
-        mTxBufferSize[ slot ] = txLen;
-        if ( txData && txLen )
-        {
-            memcpy( mTxBuffer[ slot ], txData, txLen );
-        }
-        else
-        {
-            // Just to make sure things are consistent
-            mTxBufferSize[ slot ] = 0;
-        }
+int BufferI2cTx::getCurrentByte()
+{
+    // The bytes held in the slot come first, followed by any data left in the caller's memory
+    uint16_t i = mCurrentByte;
+    if ( i < mHead->mTxBufferSize )
+    {
+        ++mCurrentByte;
+        return mHead->mTxBuffer[ i ];
+    }
+
+    i -= mHead->mTxBufferSize;
+    if ( i < mHead->mTxDataSize )
+    {
+        ++mCurrentByte;
+        return mHead->mTxDataInProgmem ? pgm_read_byte( mHead->mTxData + i ) : mHead->mTxData[ i ];
+    }
+
+    return -1;
+}
 
-        mRxBuffer[ slot ] = rxBuf;
-        mRxBufferSize[ slot ] = rxLen;
-        *rxCnt = 0;
-        mRxCounter[ slot ] = rxCnt;
-        mStatus[ slot ] = status;
-        *status = I2cMaster::kI2cNotStarted;
 
-        if ( !( rxLen && rxBuf && rxCnt ) )
-        {
-            // Just to make sure things are consistent
-            mRxBufferSize[ slot ] = 0;
-        }
 
-        //  We now have one more message in the buffer
-        ++mNbrMsgs;
+void BufferI2cTx::rewindCurrentSegment()
+{
+    // Start the current segment over from the beginning (e.g., after a NACK of the address)
+    mHead->mPhase = mHead->mTxMode;
+    if ( mHead->mRxCounter )
+    {
+        *(mHead->mRxCounter) = 0;
     }
+    mCurrentByte = 0;
+}
+
+
 
-    return I2cMaster::kI2cNoError;
+void BufferI2cTx::rewindCurrentMessage()
+{
+    // Start the whole message over from the beginning (e.g., after losing arbitration)
+    if ( mHead->mNbrSegments )
+    {
+        mHead->mCurrentSegment = 0;
+        loadSegment( mHead );
+    }
+    rewindCurrentSegment();
 }
 
 
 
+bool BufferI2cTx::nextSegment()
+{
+    if ( mHead->mCurrentSegment + 1 < mHead->mNbrSegments )
+    {
+        ++mHead->mCurrentSegment;
+        loadSegment( mHead );
+        mCurrentByte = 0;
+        return true;
+    }
+
+    return false;
+}
+
+
+
+bool BufferI2cTx::doneWithCurrentMessage()
+{
+    // Move the current message onto the free list
+    I2cMaster::I2cTransaction* done = mHead;
+    mHead = done->mNext;
+    done->mNext = mFree;
+    mFree = done;
+
+    // No matter what, reset to point to the beginning of the next message's data
+    mCurrentByte = 0;
+    mHeadLocked = false;
+
+    // Return true if we have another message
+    return mHead;
+}
+
 
 
 void BufferI2cTx::clear()
 {
     ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
     {
-        mNbrMsgs = 0;
+        while ( mHead )
+        {
+            I2cMaster::I2cTransaction* t = mHead;
+            mHead = t->mNext;
+            t->mNext = mFree;
+            mFree = t;
+        }
+        mCurrentByte = 0;
+        mHeadLocked = false;
     }
 }
 
@@ -397,52 +469,31 @@ void BufferI2cTx::clear()
 
 #ifdef DEBUG_I2cMasterBuffer
 
-#if DEBUG_I2cMasterBuffer > 255
-#error "DEBUG_I2cMasterBuffer exceeds size of a uint8_t"
-#endif
-
-
-/*
-    uint8_t             mTxBuffer[ kMaxNbrMsgs ][ kMaxMsgLen ];
-    uint8_t*            mRxBuffer[ kMaxNbrMsgs ];
-    volatile uint8_t*   mRxCounter[ kMaxNbrMsgs ];
-    volatile uint8_t*   mStatus[ kMaxNbrMsgs ];
-    uint8_t             mTxBufferSize[ kMaxNbrMsgs ];
-    uint8_t             mRxBufferSize[ kMaxNbrMsgs ];
-    uint8_t             mTxMode[ kMaxNbrMsgs ];
-    uint8_t             mAddress[ kMaxNbrMsgs ];
-    volatile uint8_t    mCurrentByte;
-    volatile uint8_t    mNbrMsgs;
-    volatile uint8_t    mCurrentMsg;
-*/
-
 void BufferI2cTx::dumpBufferContents()
 {
-    debugSout->print( "Nbr msgs:  " ); debugSout->println( mNbrMsgs );
-    if ( mNbrMsgs )
+    uint8_t i = 0;
+    for ( I2cMaster::I2cTransaction* t = mHead; t; t = t->mNext, ++i )
     {
-        for ( uint8_t i = 0; i < mNbrMsgs ; ++i )
+        debugSout->print( "Msg " ); debugSout->println( i );
+        debugSout->print( "Address: " ); debugSout->println( t->mAddress );
+        debugSout->print( "Tx mode: " ); debugSout->println( t->mTxMode );
+        debugSout->print( "Priority: " ); debugSout->println( t->mPriority );
+        uint8_t n = t->mTxBufferSize;
+        debugSout->print( "Tx Size:    " ); debugSout->println( n );
+        debugSout->print( "Tx Msg:     " );
+        for ( uint8_t j = 0; j < n; ++j )
         {
-            debugSout->print( "Msg " ); debugSout->println( i );
-            debugSout->print( "Address: " ); debugSout->println( mAddress[ (mCurrentMsg + i) % kMaxNbrMsgs ] );
-            debugSout->print( "Tx mode: " ); debugSout->println( mTxMode[ (mCurrentMsg + i) % kMaxNbrMsgs ] );
-            uint8_t n = mTxBufferSize[ (mCurrentMsg + i) % kMaxNbrMsgs ];
-            debugSout->print( "Tx Size:    " ); debugSout->println( n );
-            debugSout->print( "Tx Msg:     " );
-            char* msg = reinterpret_cast<char*>( mTxBuffer[ (mCurrentMsg + i) % kMaxNbrMsgs ] );
-            if ( n && msg )
-            {
-                for ( uint8_t j = 0; j < n; ++j )
-                {
-                    debugSout->print( msg[ j ] );
-                }
-            }
-            debugSout->println( "" );
-            uint8_t m = mRxBufferSize[ (mCurrentMsg + i) % kMaxNbrMsgs ];
-            debugSout->print( "Rx Size:    " ); debugSout->println( m );
-            debugSout->print( "Rx Ptr:     " ); debugSout->println( *mRxCounter[ (mCurrentMsg + i) % kMaxNbrMsgs ] );
+            debugSout->print( static_cast<char>( t->mTxBuffer[ j ] ) );
+        }
+        debugSout->println( "" );
+        debugSout->print( "Tx NoCopy:  " ); debugSout->println( t->mTxDataSize );
+        debugSout->print( "Rx Size:    " ); debugSout->println( t->mRxBufferSize );
+        if ( t->mRxCounter )
+        {
+            debugSout->print( "Rx Ptr:     " ); debugSout->println( *(t->mRxCounter) );
         }
     }
+    debugSout->print( "Nbr msgs:  " ); debugSout->println( i );
 }
 
 
@@ -466,50 +517,280 @@ namespace
     uint8_t         gRetries;
 #endif
 
+#if I2C_MASTER_MAX_TX_MSG_NBR > 0
+    I2cMaster::I2cTransaction   gI2cDefaultSlots[ kMaxNbrMsgs ];
+#endif
+
+#ifdef I2C_MASTER_TIMEOUTS
+
+    // Bumped on every TWI event, so serviceTimeout() can tell if things are moving
+    volatile uint8_t    gI2cProgress;
+
+    uint16_t            gI2cTimeout;
+    uint8_t             gI2cWatchProgress;
+    unsigned long       gI2cWatchStart;
+
+#endif
+
 
     void waitForCompletion( volatile uint8_t& status )
     {
 
         // Wait for completion
-        while ( status == I2cMaster::kI2cNotStarted || status == I2cMaster::kI2cInProgress )
+        auto pending = [&]{ return status == I2cMaster::kI2cNotStarted || status == I2cMaster::kI2cInProgress; };
+
+        while ( pending() )
+        {
+#ifdef I2C_MASTER_TIMEOUTS
+            // Give up (and reset the bus) if the TWI hardware gets stuck
+            I2cMaster::serviceTimeout();
+#endif
+
+            // Every TWI event (and every timer0 overflow, for the timeout) wakes us
+            sleepUntilInterruptIf( pending, SLEEP_MODE_IDLE );
+        }
+    }
+
+
+
+    void startI2c()
+    {
+        if ( !gI2cBusy && !(TWCR & (1<<TWIE)) )
         {
-            // Just spin
+            while ( TWCR & (1<<TWSTO) )
+            {
+                // spin
+            }
+
+            gI2cBusy = 1;
+#ifdef I2C_MASTER_TIMEOUTS
+            ++gI2cProgress;
+#endif
+
+#if I2C_MASTER_SLA_NACK_SPECIAL_HANDLING
+            gRetries = 0;
+#endif
+
+            TWCR = (1<<TWEN)        // TWI Interface enabled
+                    | (1<<TWIE)     // Enable Interupt
+                    | (1<<TWINT)    // Clear the interrupt flag
+                    | (0<<TWEA)     // ACK doesn't matter
+                    | (1<<TWSTA);   // Initiate a start condition
         }
     }
 
 
 
-    void startI2c()
-    {
-        if ( !gI2cBusy && !(TWCR & (1<<TWIE)) )
+    uint8_t queueTransaction( uint8_t address, I2cTxMode txMode, uint8_t registerAddress,
+                                const uint8_t* txData, size_t txLen, uint8_t* rxBuf, uint8_t rxLen,
+                                volatile uint8_t* rxCnt, volatile uint8_t* status, uint8_t priority,
+                                I2cMaster::I2cCallback callback = 0, void* context = 0,
+                                const uint8_t* noCopyData = 0, uint16_t noCopyLen = 0, bool inProgmem = false )
+    {
+        // Check everything before taking a slot
+
+        if ( ( txMode & kI2cWriteMask ) && txLen + 1 > kMaxMsgLen )
+        {
+            // If data is too long, ignore the request but return code to indicate a problem
+            return I2cMaster::kI2cErrMsgTooLong;
+        }
+
+        if ( !status && !callback )
+        {
+            // If no status (and no callback), ignore the request but return code to indicate a problem
+            return I2cMaster::kI2cErrNullStatusPtr;
+        }
+
+        if ( ( txMode & kI2cWriteMask ) && ( ( txLen && !txData ) || ( noCopyLen && !noCopyData ) ) )
+        {
+            // If writing and no data provided, ignore the request but return code to indicate a problem
+            return I2cMaster::kI2cErrWriteWithoutData;
+        }
+
+        if ( ( txMode & kI2cReadMask ) && ( !rxBuf || !rxLen || !rxCnt ) )
+        {
+            // If reading and no storage provided, ignore the request but return code to indicate a problem
+            return I2cMaster::kI2cErrReadWithoutStorage;
+        }
+
+        if ( !gI2cBuffer.hasStorage() )
+        {
+            // No queue at all, so it will never have room
+            return I2cMaster::kI2cErrTxBufferFull;
+        }
+
+        I2cMaster::I2cTransaction* t;
+        while ( !( t = gI2cBuffer.allocate() ) )
+        {
+            if ( !( SREG & (1 << SREG_I) ) )
+            {
+                // Called with interrupts off (e.g., from a callback), so waiting won't free a slot
+                return I2cMaster::kI2cErrTxBufferFull;
+            }
+
+            // Delay 2 I2C cycles at 400 KHz
+            _delay_us( 5 );
+        }
+
+        // The slot belongs to us until we submit it, so fill it in without blocking interrupts
+        t->mAddress = address;
+        t->mTxMode = static_cast<uint8_t>( txMode );
+        t->mPhase = static_cast<uint8_t>( txMode );
+        t->mPriority = priority;
+        setBitRateFor( t );
+
+        if ( txMode & kI2cWriteMask )
+        {
+            t->mTxBuffer[0] = registerAddress;
+            if ( txLen )
+            {
+                memcpy( t->mTxBuffer + 1, txData, txLen );
+            }
+            t->mTxBufferSize = txLen + 1;
+            t->mTxData = noCopyData;
+            t->mTxDataSize = noCopyLen;
+            t->mTxDataInProgmem = inProgmem;
+        }
+        else
+        {
+            t->mTxBufferSize = 0;
+            t->mTxData = 0;
+            t->mTxDataSize = 0;
+            t->mTxDataInProgmem = false;
+        }
+
+        t->mSegments = 0;
+        t->mNbrSegments = 0;
+        t->mCurrentSegment = 0;
+
+        if ( txMode & kI2cReadMask )
+        {
+            t->mRxBuffer = rxBuf;
+            t->mRxBufferSize = rxLen;
+            t->mRxCounter = rxCnt;
+            *rxCnt = 0;
+        }
+        else
+        {
+            // Just to make sure things are consistent
+            t->mRxBuffer = 0;
+            t->mRxBufferSize = 0;
+            t->mRxCounter = 0;
+        }
+
+        t->mStatus = status;
+        if ( status )
+        {
+            *status = I2cMaster::kI2cNotStarted;
+        }
+        t->mCallback = callback;
+        t->mContext = context;
+
+        gI2cBuffer.submit( t );
+
+#ifdef DEBUG_I2cMasterBuffer
+        debugSout->println( "Pushed into buffer" );
+        gI2cBuffer.dumpBufferContents();
+#endif
+
+        startI2c();
+
+        return I2cMaster::kI2cNoError;
+    }
+
+}
+
+
+namespace
+{
+
+    uint8_t queueSegments( const I2cMaster::I2cSegment* segments, uint8_t nbrSegments, volatile uint8_t* status,
+                            uint8_t priority, I2cMaster::I2cCallback callback, void* context )
+    {
+        // Check everything before taking a slot
+
+        if ( !status && !callback )
+        {
+            // If no status (and no callback), ignore the request but return code to indicate a problem
+            return I2cMaster::kI2cErrNullStatusPtr;
+        }
+
+        if ( !segments || !nbrSegments )
+        {
+            // Nothing to do, which is treated like a write without data
+            return I2cMaster::kI2cErrWriteWithoutData;
+        }
+
+        for ( uint8_t i = 0; i < nbrSegments; ++i )
+        {
+            if ( segments[i].txLen && !segments[i].txData )
+            {
+                return I2cMaster::kI2cErrWriteWithoutData;
+            }
+
+            if ( segments[i].rxLen && !segments[i].rxData )
+            {
+                return I2cMaster::kI2cErrReadWithoutStorage;
+            }
+        }
+
+        if ( !gI2cBuffer.hasStorage() )
+        {
+            // No queue at all, so it will never have room
+            return I2cMaster::kI2cErrTxBufferFull;
+        }
+
+        I2cMaster::I2cTransaction* t;
+        while ( !( t = gI2cBuffer.allocate() ) )
         {
-            while ( TWCR & (1<<TWSTO) )
+            if ( !( SREG & (1 << SREG_I) ) )
             {
-                // spin
+                // Called with interrupts off (e.g., from a callback), so waiting won't free a slot
+                return I2cMaster::kI2cErrTxBufferFull;
             }
 
-            gI2cBusy = 1;
+            // Delay 2 I2C cycles at 400 KHz
+            _delay_us( 5 );
+        }
 
-#if I2C_MASTER_SLA_NACK_SPECIAL_HANDLING
-            gRetries = 0;
-#endif
+        // The slot belongs to us until we submit it, so fill it in without blocking interrupts
+        t->mSegments = segments;
+        t->mNbrSegments = nbrSegments;
+        t->mCurrentSegment = 0;
+        loadSegment( t );
 
-            TWCR = (1<<TWEN)        // TWI Interface enabled
-                    | (1<<TWIE)     // Enable Interupt
-                    | (1<<TWINT)    // Clear the interrupt flag
-                    | (0<<TWEA)     // ACK doesn't matter
-                    | (1<<TWSTA);   // Initiate a start condition
+        t->mPriority = priority;
+        t->mStatus = status;
+        if ( status )
+        {
+            *status = I2cMaster::kI2cNotStarted;
         }
+        t->mCallback = callback;
+        t->mContext = context;
+
+        gI2cBuffer.submit( t );
+
+        startI2c();
+
+        return I2cMaster::kI2cNoError;
     }
 
 }
 
 
-void I2cMaster::start( uint8_t speed )
+void I2cMaster::start( uint32_t speed )
 {
     // Initialize our internal flags
     gI2cBusy = false;
 
+#if I2C_MASTER_MAX_TX_MSG_NBR > 0
+    // Use the built-in queue unless the application has provided its own
+    if ( !gI2cBuffer.hasStorage() )
+    {
+        gI2cBuffer.setStorage( gI2cDefaultSlots, kMaxNbrMsgs );
+    }
+#endif
+
 #if I2C_MASTER_SLA_NACK_SPECIAL_HANDLING
     gRetries = 0;
 #endif
@@ -520,20 +801,10 @@ void I2cMaster::start( uint8_t speed )
     // Default content = SDA released.
     TWDR = 0xFF;
 
-    // Set bus speed
-    if ( speed == kI2cBusSlow )
-    {
-        // Slow = 100 KHz
-        TWBR = ( (F_CPU / 100000) - 16 ) / 2;
-    }
-    else
-    {
-        // Fast = 400 KHz
-        TWBR = ( (F_CPU / 400000) - 16 ) / 2;
-    }
-
-    // Set TWI prescaler (clear it)
-    TWSR &= ~( ( 1 << TWPS0 ) | ( 1 << TWPS1 ) );
+    // Set bus speed (bit rate and prescaler)
+    gI2cBusBitRate = computeBitRate( speed );
+    TWBR = gI2cBusBitRate.twbr;
+    TWSR = gI2cBusBitRate.twps;
 
     // Enable TWI module
     TWCR = (1<<TWEN)        // TWI Interface enabled
@@ -545,6 +816,44 @@ void I2cMaster::start( uint8_t speed )
 
 
 
+uint8_t I2cMaster::setDeviceSpeed( uint8_t address, uint32_t speed )
+{
+#if I2C_MASTER_MAX_DEVICE_SPEEDS > 0
+
+    BitRate r = computeBitRate( speed );
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        uint8_t i = 0;
+        while ( i < gI2cNbrDeviceSpeeds && gI2cDeviceSpeeds[i].address != address )
+        {
+            ++i;
+        }
+
+        if ( i >= kMaxNbrSpeeds )
+        {
+            return kI2cErrTooManyDeviceSpeeds;
+        }
+
+        gI2cDeviceSpeeds[i].address = address;
+        gI2cDeviceSpeeds[i].rate = r;
+        if ( i == gI2cNbrDeviceSpeeds )
+        {
+            ++gI2cNbrDeviceSpeeds;
+        }
+    }
+
+    return kI2cNoError;
+
+#else
+
+    return kI2cErrTooManyDeviceSpeeds;
+
+#endif
+}
+
+
+
 void I2cMaster::stop()
 {
     TWCR = 0;
@@ -577,178 +886,122 @@ bool I2cMaster::busy()
 
 
 
-// Asynchronous
-
-uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, volatile uint8_t* status )
-{
-    while ( gI2cBuffer.isFull() )
-    {
-        // Delay 2 I2C cycles at 400 KHz
-        _delay_us( 5 );
-    }
-
-    uint8_t err = gI2cBuffer.push( address, kI2cWrite, &registerAddress, 1, 0, 0, 0, status );
-
-#ifdef DEBUG_I2cMasterBuffer
-    debugSout->print( "writeAsync1 pushed into buffer err= " );
-    debugSout->println( err );
-    gI2cBuffer.dumpBufferContents();
-#endif
-
-    if ( !err )
-    {
-        startI2c();
-    }
-
-    return err;
-}
 
 
-uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, uint8_t data, volatile uint8_t* status )
+void I2cMaster::setTransactionQueue( I2cTransaction* slots, uint8_t nbrSlots )
 {
-    uint8_t temp[2];
-    temp[0] = registerAddress;
-    temp[1] = data;
+    gI2cBuffer.setStorage( slots, nbrSlots );
+}
 
-    while ( gI2cBuffer.isFull() )
-    {
-        // Delay 2 I2C cycles at 400 KHz
-        _delay_us( 5 );
-    }
 
-    uint8_t err = gI2cBuffer.push( address, kI2cWrite, temp, 2, 0, 0, 0, status );
 
-#ifdef DEBUG_I2cMasterBuffer
-    debugSout->print( "writeAsync2 pushed into buffer err= " );
-    debugSout->println( err );
-    gI2cBuffer.dumpBufferContents();
-#endif
 
-    if ( !err )
-    {
-        startI2c();
-    }
+// Asynchronous
 
-    return err;
+uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, volatile uint8_t* status, uint8_t priority )
+{
+    return queueTransaction( address, kI2cWrite, registerAddress, 0, 0, 0, 0, 0, status, priority );
 }
 
 
-uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, const char* data, volatile uint8_t* status )
+uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, uint8_t data, volatile uint8_t* status,
+                        uint8_t priority )
 {
-    size_t nbrBytes = strlen( data );
+    return queueTransaction( address, kI2cWrite, registerAddress, &data, 1, 0, 0, 0, status, priority );
+}
 
-    uint8_t temp[ nbrBytes + 1 ];
-    temp[0] = registerAddress;
-    memcpy( temp + 1, data, nbrBytes );
 
-    // TODO Optimize with strcpy -> nbrBytes
+uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, const char* data, volatile uint8_t* status,
+                        uint8_t priority )
+{
+    // Copied straight into the queue slot, no intermediate buffer needed
+    return queueTransaction( address, kI2cWrite, registerAddress, reinterpret_cast<const uint8_t*>( data ),
+                                strlen( data ), 0, 0, 0, status, priority );
+}
 
-    while ( gI2cBuffer.isFull() )
-    {
-        // Delay 2 I2C cycles at 400 KHz
-        _delay_us( 5 );
-    }
 
-    uint8_t err = gI2cBuffer.push( address, kI2cWrite, temp, nbrBytes + 1, 0, 0, 0, status );
+uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, uint8_t* data, uint8_t numberBytes,
+                        volatile uint8_t* status, uint8_t priority )
+{
+    return queueTransaction( address, kI2cWrite, registerAddress, data, numberBytes, 0, 0, 0, status, priority );
+}
 
-#ifdef DEBUG_I2cMasterBuffer
-    debugSout->print( "writeAsync3 pushed into buffer err= " );
-    debugSout->println( err );
-    gI2cBuffer.dumpBufferContents();
-#endif
 
-    if ( !err )
-    {
-        startI2c();
-    }
 
-    return err;
+uint8_t I2cMaster::writeAsyncNoCopy( uint8_t address, uint8_t registerAddress, const uint8_t* data,
+                        uint16_t numberBytes, volatile uint8_t* status, uint8_t priority )
+{
+    return queueTransaction( address, kI2cWrite, registerAddress, 0, 0, 0, 0, 0, status, priority, 0, 0,
+                                data, numberBytes, false );
 }
 
 
-uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, uint8_t* data, uint8_t numberBytes,
-                        volatile uint8_t* status )
+uint8_t I2cMaster::writeAsyncNoCopy_P( uint8_t address, uint8_t registerAddress, const uint8_t* data,
+                        uint16_t numberBytes, volatile uint8_t* status, uint8_t priority )
 {
-    uint8_t temp[ numberBytes + 1 ];
-    temp[0] = registerAddress;
-    memcpy( temp + 1, data, numberBytes );
+    return queueTransaction( address, kI2cWrite, registerAddress, 0, 0, 0, 0, 0, status, priority, 0, 0,
+                                data, numberBytes, true );
+}
 
-    while ( gI2cBuffer.isFull() )
-    {
-        // Delay 2 I2C cycles at 400 KHz
-        _delay_us( 5 );
-    }
 
-    uint8_t err = gI2cBuffer.push( address, kI2cWrite, temp, numberBytes + 1, 0, 0, 0, status );
 
-#ifdef DEBUG_I2cMasterBuffer
-    debugSout->print( "writeAsync4 pushed into buffer err= " );
-    debugSout->println( err );
-    gI2cBuffer.dumpBufferContents();
-#endif
+uint8_t I2cMaster::readAsync( uint8_t address, uint8_t numberBytes, volatile uint8_t* destination,
+                    volatile uint8_t* bytesRead, volatile uint8_t* status, uint8_t priority )
+{
+    return queueTransaction( address, kI2cRead, 0, 0, 0, const_cast<uint8_t*>( destination ), numberBytes,
+                                bytesRead, status, priority );
+}
 
-    if ( !err )
-    {
-        startI2c();
-    }
 
-    return err;
+uint8_t I2cMaster::readAsync( uint8_t address, uint8_t registerAddress, uint8_t numberBytes,
+                    volatile uint8_t* destination, volatile uint8_t* bytesRead,
+                    volatile uint8_t* status, uint8_t priority )
+{
+    return queueTransaction( address, kI2cWriteRestartRead, registerAddress, 0, 0,
+                                const_cast<uint8_t*>( destination ), numberBytes, bytesRead, status, priority );
 }
 
 
 
-uint8_t I2cMaster::readAsync( uint8_t address, uint8_t numberBytes, volatile uint8_t* destination,
-                    volatile uint8_t* bytesRead, volatile uint8_t* status )
+uint8_t I2cMaster::writeAsync( uint8_t address, uint8_t registerAddress, uint8_t* data, uint8_t numberBytes,
+                        I2cCallback callback, void* context, uint8_t priority )
 {
-    while ( gI2cBuffer.isFull() )
-    {
-        // Delay 2 I2C cycles at 400 KHz
-        _delay_us( 5 );
-    }
-
-    uint8_t err = gI2cBuffer.push( address, kI2cRead, 0, 0, const_cast<uint8_t*>( destination ), numberBytes, bytesRead,
-                        status );
-
-#ifdef DEBUG_I2cMasterBuffer
-    debugSout->print( "readAsync1 pushed into buffer err= " );
-    debugSout->println( err );
-    gI2cBuffer.dumpBufferContents();
-#endif
+    return queueTransaction( address, kI2cWrite, registerAddress, data, numberBytes, 0, 0, 0, 0, priority,
+                                callback, context );
+}
 
-    if ( !err )
-    {
-        startI2c();
-    }
 
-    return err;
+uint8_t I2cMaster::readAsync( uint8_t address, uint8_t numberBytes, volatile uint8_t* destination,
+                    volatile uint8_t* bytesRead, I2cCallback callback, void* context, uint8_t priority )
+{
+    return queueTransaction( address, kI2cRead, 0, 0, 0, const_cast<uint8_t*>( destination ), numberBytes,
+                                bytesRead, 0, priority, callback, context );
 }
 
 
 uint8_t I2cMaster::readAsync( uint8_t address, uint8_t registerAddress, uint8_t numberBytes,
                     volatile uint8_t* destination, volatile uint8_t* bytesRead,
-                    volatile uint8_t* status )
+                    I2cCallback callback, void* context, uint8_t priority )
 {
-    while ( gI2cBuffer.isFull() )
-    {
-        // Delay 2 I2C cycles at 400 KHz
-        _delay_us( 5 );
-    }
+    return queueTransaction( address, kI2cWriteRestartRead, registerAddress, 0, 0,
+                                const_cast<uint8_t*>( destination ), numberBytes, bytesRead, 0, priority,
+                                callback, context );
+}
 
-    uint8_t err = gI2cBuffer.push( address, kI2cWriteRestartRead, &registerAddress, 1, const_cast<uint8_t*>( destination ),
-                        numberBytes, bytesRead, status );
 
-#ifdef DEBUG_I2cMasterBuffer
-    debugSout->print( "readAsync2 pushed into buffer err= " );
-    debugSout->println( err );
-    gI2cBuffer.dumpBufferContents();
-#endif
 
-    if ( !err )
-    {
-        startI2c();
-    }
 
-    return err;
+uint8_t I2cMaster::transactAsync( const I2cSegment* segments, uint8_t nbrSegments, volatile uint8_t* status,
+                        uint8_t priority )
+{
+    return queueSegments( segments, nbrSegments, status, priority, 0, 0 );
+}
+
+
+uint8_t I2cMaster::transactAsync( const I2cSegment* segments, uint8_t nbrSegments, I2cCallback callback,
+                        void* context, uint8_t priority )
+{
+    return queueSegments( segments, nbrSegments, 0, priority, callback, context );
 }
 
 
@@ -911,31 +1164,75 @@ int I2cMaster::readSync( uint8_t address, uint8_t registerAddress, uint8_t numbe
 
 
 
+namespace
+{
+
+    // Only called from the ISR: report the outcome of the current message and retire it,
+    // returning true if there is another message to send
+    bool finishCurrentMessage( uint8_t status )
+    {
+        I2cMaster::I2cTransaction* t = gI2cBuffer.current();
+
+        if ( t->mStatus )
+        {
+            *(t->mStatus) = status;
+        }
+
+        I2cMaster::I2cCallback callback = t->mCallback;
+        void* context = t->mContext;
+
+        // Free the slot first so the callback can reuse it
+        gI2cBuffer.doneWithCurrentMessage();
+
+        if ( callback )
+        {
+            callback( status, context );
+        }
+
+        // The callback may have queued more messages
+        return gI2cBuffer.current();
+    }
+
+};
+
+
+
+
 ISR( TWI_vect )
 {
-    volatile uint8_t* n;
+    PROFILE_PROBE( kProfileI2cMaster );
+
+    I2cMaster::I2cTransaction* t = gI2cBuffer.current();
     int b;
 
+#ifdef I2C_MASTER_TIMEOUTS
+    ++gI2cProgress;
+#endif
+
     switch ( TW_STATUS )
     {
         case TW_START:              // START has been transmitted
         case TW_REP_START:          // Repeated START has been transmitted
             // Send the address of the node we want to communicate with
-            if ( gI2cBuffer.getCurrentTxMode() & kI2cWriteMask )
+            if ( t->mPhase & kI2cWriteMask )
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( SLA_W(gI2cBuffer.getCurrentAddress()), kSentAddressSendNextByte, TW_STATUS );
-#endif
-                TWDR = SLA_W( gI2cBuffer.getCurrentAddress() );
+                TRACE_EVENT( kTraceI2cMaster, kSentAddressSendNextByte, SLA_W(t->mAddress), TW_STATUS );
+                TWDR = SLA_W( t->mAddress );
             }
             else
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( SLA_R(gI2cBuffer.getCurrentAddress()), kSentAddressReadNextByte, TW_STATUS );
-#endif
-                TWDR = SLA_R( gI2cBuffer.getCurrentAddress() );
+                TRACE_EVENT( kTraceI2cMaster, kSentAddressReadNextByte, SLA_R(t->mAddress), TW_STATUS );
+                TWDR = SLA_R( t->mAddress );
+            }
+            // Switch to the speed for this device
+            TWBR = t->mBitRate;
+            TWSR = t->mPrescaler;
+            // This message is now on the bus; nothing can be queued ahead of it
+            gI2cBuffer.lockCurrentMessage();
+            if ( t->mStatus )
+            {
+                *(t->mStatus) = I2cMaster::kI2cInProgress;
             }
-            *(gI2cBuffer.getCurrentStatus()) = I2cMaster::kI2cInProgress;
 #if I2C_MASTER_SLA_NACK_SPECIAL_HANDLING
             gRetries = 0;
 #endif
@@ -949,42 +1246,32 @@ ISR( TWI_vect )
             b = gI2cBuffer.getCurrentByte();
             if ( b != -1 )
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( b, kSendNextByte, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kSendNextByte, b, TW_STATUS );
                 // Send the next byte
                 TWDR = static_cast<uint8_t>( b );
                 sendNextByte();
             }
             else                    // Send STOP or RESTART after last byte
             {
-                if ( gI2cBuffer.getCurrentTxMode() == kI2cWriteRestartRead )
+                if ( t->mPhase == kI2cWriteRestartRead )
                 {
-#ifdef DEBUG_I2cMasterDiary
-                    DebugDiaryEntry( 0, kSendRestartSameMsg, TW_STATUS );
-#endif
-                    // Need to set a restart and update txMode accordingly
-                    gI2cBuffer.setCurrentTxMode( kI2cRead );
+                    TRACE_EVENT( kTraceI2cMaster, kSendRestartSameMsg, 0, TW_STATUS );
+                    // Need to set a restart and move on to the read phase
+                    t->mPhase = kI2cRead;
                     sendRestart();
                 }
                 else
                 {
-                    // Done with this message
-                   *(gI2cBuffer.getCurrentStatus()) = I2cMaster::kI2cCompletedOk;
-                    // Is there another message?
-                    if ( gI2cBuffer.doneWithCurrentMessage() )
+                    // Done with this message; is there another message?
+                    if ( gI2cBuffer.nextSegment() || finishCurrentMessage( I2cMaster::kI2cCompletedOk ) )
                     {
-#ifdef DEBUG_I2cMasterDiary
-                        DebugDiaryEntry( 0, kSendRestartNewMsg, TW_STATUS );
-#endif
+                        TRACE_EVENT( kTraceI2cMaster, kSendRestartNewMsg, 0, TW_STATUS );
                         // Keep control of the bus and restart a new msg
                         sendRestart();
                     }
                     else
                     {
-#ifdef DEBUG_I2cMasterDiary
-                        DebugDiaryEntry( 0, kFinished, TW_STATUS );
-#endif
+                        TRACE_EVENT( kTraceI2cMaster, kFinished, 0, TW_STATUS );
                         // Done for now
                         gI2cBusy = false;
                         sendStop();
@@ -994,19 +1281,15 @@ ISR( TWI_vect )
             break;
 
         case TW_MR_SLA_ACK:         // SLA+R has been tramsmitted and ACK received
-            if ( gI2cBuffer.getCurrentRxBufferSize() > 1 )
+            if ( t->mRxBufferSize > 1 )
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( 0, kGetNextByteAckAfterSLAR, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kGetNextByteAckAfterSLAR, 0, TW_STATUS );
                 // Next byte is not the last one; send an ACK when we get it
                 getNextByteWithACK();
             }
             else
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( 0, kGetNextByteNAckAfterSLAR, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kGetNextByteNAckAfterSLAR, 0, TW_STATUS );
                 // Only 1 byte to get; next byte is last one so have to send NACK when we get it
                 getNextByteWithNACK();
             }
@@ -1014,58 +1297,49 @@ ISR( TWI_vect )
 
         case TW_MR_DATA_ACK:        // Data byte has been received and ACK tramsmitted
             // Store the byte, if there is room
-            n = gI2cBuffer.getCurrentRxBufferCtr();
-            *( gI2cBuffer.getCurrentRxBufferPtr() + *n ) = TWDR;
-            ++(*n);
-            if ( *n < gI2cBuffer.getCurrentRxBufferSize() - 1 )
+            b = *(t->mRxCounter);
+            t->mRxBuffer[ b ] = TWDR;
+            *(t->mRxCounter) = ++b;
+            if ( b < t->mRxBufferSize - 1 )
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( *(gI2cBuffer.getCurrentRxBufferPtr() + *n - 1), kGetNextByteAck, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kGetNextByteAck, t->mRxBuffer[ b - 1 ], TW_STATUS );
                 // Next byte is not the last one, so send an ACK when we get it
                 getNextByteWithACK();
             }
             else
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( *(gI2cBuffer.getCurrentRxBufferPtr() + *n - 1), kGetNextByteNAck, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kGetNextByteNAck, t->mRxBuffer[ b - 1 ], TW_STATUS );
                 // Next byte is the last one, so send a NACK when we get it
                 getNextByteWithNACK();
             }
             break;
 
         case TW_MR_DATA_NACK:       // Data byte has been received and NACK tramsmitted
-            n = gI2cBuffer.getCurrentRxBufferCtr();
-            *( gI2cBuffer.getCurrentRxBufferPtr() + *n ) = TWDR;
-            ++(*n);
-            // Done with this message
-            *(gI2cBuffer.getCurrentStatus()) = I2cMaster::kI2cCompletedOk;
-            if ( gI2cBuffer.doneWithCurrentMessage() )
+            b = *(t->mRxCounter);
+            t->mRxBuffer[ b ] = TWDR;
+            *(t->mRxCounter) = b + 1;
+            // Done with this message; is there another message?
+            if ( gI2cBuffer.nextSegment() || finishCurrentMessage( I2cMaster::kI2cCompletedOk ) )
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( *(gI2cBuffer.getCurrentRxBufferPtr() + *n - 1), kRcvDoneRestart, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kRcvDoneRestart, TWDR, TW_STATUS );
                 // Keep control of the bus and restart a new msg
                 sendRestart();
             }
             else
             {
                 // Done for now
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( *(gI2cBuffer.getCurrentRxBufferPtr() + *n - 1), kRcvDoneStop, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kRcvDoneStop, TWDR, TW_STATUS );
                 gI2cBusy = false;
                 sendStop();
             }
             break;
 
         case TW_MT_ARB_LOST:        // Arbitration lost (same as TW_MR_ARB_LOST)
-            // Try it again
-#ifdef DEBUG_I2cMasterDiary
-            DebugDiaryEntry( 0, kArbLostRestart, TW_STATUS );
-#endif
-            sendRestart();
+            // Another master won the bus, which may have changed the state of the device;
+            // start the whole message over again once the bus is free
+            TRACE_EVENT( kTraceI2cMaster, kArbLostRestart, 0, TW_STATUS );
+            gI2cBuffer.rewindCurrentMessage();
+            sendStart();
             break;
 
         case TW_MT_SLA_NACK:        // SLA+W has been tramsmitted and NACK received
@@ -1074,46 +1348,33 @@ ISR( TWI_vect )
 #if I2C_MASTER_SLA_NACK_SPECIAL_HANDLING
             if ( gRetries++ < 3 )
             {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( 0, kTryStartAgain, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kTryStartAgain, 0, TW_STATUS );
                 _delay_us( 5 );         // Two cycles at 400KHz
+                gI2cBuffer.rewindCurrentSegment();
                 sendStart();
+                break;
             }
-            else
-            {
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( 0, kTryStartAgainError, TW_STATUS );
-#endif
-                gRetries = 0;
-                *(gI2cBuffer.getCurrentStatus()) = ( TW_STATUS | I2cMaster::kI2cError );
-                gI2cBusy = false;
-                sendStop();
-            }
-            break;
+            TRACE_EVENT( kTraceI2cMaster, kTryStartAgainError, 0, TW_STATUS );
+            gRetries = 0;
 #endif
-        // Intentional fall-through if the special handling code above is not turned on.
+        // Intentional fall-through if the special handling code above is not turned on,
+        // or if we've run out of retries.
 
         case TW_MT_DATA_NACK:       // Data byte has been tramsmitted and NACK received
         case TW_NO_INFO:            // No relevant state information available
         case TW_BUS_ERROR:          // Bus error due to an illegal START or STOP condition
         default:
             // Report the error
-            *(gI2cBuffer.getCurrentStatus()) = ( TW_STATUS | I2cMaster::kI2cError );
-            if ( gI2cBuffer.doneWithCurrentMessage() )
+            if ( t && finishCurrentMessage( TW_STATUS | I2cMaster::kI2cError ) )
             {
                 // Keep control of the bus and restart a new msg
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( 0, kErrorStartStop, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kErrorStartStop, 0, TW_STATUS );
                 sendStopAndStart();
             }
             else
             {
                 // Done for now
-#ifdef DEBUG_I2cMasterDiary
-                DebugDiaryEntry( 0, kErrorStop, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cMaster, kErrorStop, 0, TW_STATUS );
                 gI2cBusy = false;
                 sendStop();
             }
@@ -1125,68 +1386,134 @@ ISR( TWI_vect )
 
 
 
-//********************************************************
+// Timeouts and bus recovery
 
+#ifdef I2C_MASTER_TIMEOUTS
 
-#ifdef DEBUG_I2cMasterDiary
+void I2cMaster::setTimeout( uint16_t milliseconds )
+{
+    gI2cTimeout = milliseconds;
+    gI2cWatchProgress = gI2cProgress;
+    gI2cWatchStart = millis();
+}
 
 
-namespace
-{
 
-    void DebugDiaryEntry( uint8_t content, uint8_t control, uint8_t status )
+bool I2cMaster::serviceTimeout()
+{
+    if ( !gI2cTimeout )
     {
-        debugContent[ debugPtr ] = content;
-        debugControl[ debugPtr ] = control;
-        debugStatus[ debugPtr ] = status;
-        ++debugPtr;
+        return false;
     }
 
-};
+    uint8_t progress = gI2cProgress;
+    unsigned long now = millis();
 
+    if ( !busy() || progress != gI2cWatchProgress )
+    {
+        // Idle or still moving; restart the clock
+        gI2cWatchProgress = progress;
+        gI2cWatchStart = now;
+        return false;
+    }
 
+    if ( now - gI2cWatchStart < gI2cTimeout )
+    {
+        return false;
+    }
 
-void I2cMaster::clearDebugI2cDiary()
-{
     ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
     {
-        for ( uint8_t i = 0; i < DEBUG_I2cMasterDiaryBufferSize; ++i )
+        // Abandon whatever was on the bus
+        TWCR = 0;
+        if ( gI2cBuffer.current() )
         {
-            debugContent[ i ] = 0;
-            debugControl[ i ] = 0;
-            debugStatus[ i ] = 0;
+            finishCurrentMessage( I2cMaster::kI2cTimedOut );
         }
-        debugPtr = 0;
+        gI2cBusy = false;
+    }
+
+    recoverBus();
+
+    gI2cWatchProgress = gI2cProgress;
+    gI2cWatchStart = millis();
+
+    // Get going on anything else that is queued
+    if ( gI2cBuffer.current() )
+    {
+        startI2c();
     }
+
+    return true;
+}
+
+#else
+
+void I2cMaster::setTimeout( uint16_t )
+{
+    // Timeouts are only available if I2C_MASTER_TIMEOUTS is defined when the library is compiled
+}
+
+
+
+bool I2cMaster::serviceTimeout()
+{
+    return false;
 }
 
+#endif
+
 
 
-void I2cMaster::dumpDebugI2cDiary()
+void I2cMaster::recoverBus()
 {
-    debugSout->println( "I2C diary follows..." );
-    debugSout->println( "#, status, sent, sent, next" );
-    for ( uint8_t i = 0; i < debugPtr; ++i )
+    // Remember the pullup settings so we can restore them
+    uint8_t sdaPort = getGpioPORT( pSDA ) & getGpioMASK( pSDA );
+    uint8_t sclPort = getGpioPORT( pSCL ) & getGpioMASK( pSCL );
+
+    // Disconnect the TWI hardware so we control the pins directly
+    TWCR = 0;
+
+    // Both lines released (inputs); they're pulled high by the pullups
+    getGpioDDR( pSDA ) &= ~getGpioMASK( pSDA );
+    getGpioDDR( pSCL ) &= ~getGpioMASK( pSCL );
+    _delay_us( 5 );
+
+    // Clock SCL until the slave lets go of SDA (at most 9 clocks gets it through a byte and its ACK)
+    for ( uint8_t i = 0; i < 9 && !( getGpioPIN( pSDA ) & getGpioMASK( pSDA ) ); ++i )
     {
-        debugSout->print( i );
-        debugSout->print( ", " );
-        debugSout->print( debugStatus[ i ], kHex );
-        debugSout->print( ", " );
-        debugSout->print( debugContent[ i ] );
-        debugSout->print( ", " );
-        debugSout->print( static_cast<char>( debugContent[ i ] ) );
-        debugSout->print( ", " );
-        debugSout->println( debugControl[ i ] );
+        getGpioPORT( pSCL ) &= ~getGpioMASK( pSCL );
+        getGpioDDR( pSCL ) |= getGpioMASK( pSCL );
+        _delay_us( 5 );
+        getGpioDDR( pSCL ) &= ~getGpioMASK( pSCL );
+        getGpioPORT( pSCL ) |= sclPort;
+        _delay_us( 5 );
     }
-    debugSout->println();
+
+    // Generate a START followed by a STOP (SDA low then high while SCL is high) to reset the slaves
+    getGpioPORT( pSDA ) &= ~getGpioMASK( pSDA );
+    getGpioDDR( pSDA ) |= getGpioMASK( pSDA );
+    _delay_us( 5 );
+    getGpioDDR( pSDA ) &= ~getGpioMASK( pSDA );
+    getGpioPORT( pSDA ) |= sdaPort;
+    _delay_us( 5 );
+
+    // Re-enable TWI module
+    TWCR = (1<<TWEN)        // TWI Interface enabled
+            | (0<<TWIE)     // Enable Interupt
+            | (1<<TWINT)    // Clear the interrupt flag
+            | (0<<TWEA)     // ACK doesn't matter
+            | (0<<TWSTA);   // Initiate a start condition
 }
 
 
-#endif
 
 
 
-#if defined( DEBUG_I2cMasterBuffer ) || defined( DEBUG_I2cMasterDiary )
+//********************************************************
+
+
+#ifdef DEBUG_I2cMasterBuffer
 
 void I2cMaster::setDebugSout( Serial0* s )
 {
@@ -29,14 +29,18 @@
  *
  * To use these functions, include I2cMaster.h and link against I2cMaster.cpp.
  *
+ * The bus timeout (see I2cMaster::setTimeout()) is only available if the macro \c I2C_MASTER_TIMEOUTS is defined
+ * when I2cMaster.cpp is compiled.  Because it is measured with millis(), you then also need to link against
+ * SystemClock.cpp.  Otherwise setTimeout() does nothing and serviceTimeout() always returns false.
+ *
  * These interfaces are buffered for both input and output and operate using interrupts associated
  * with the TWI hardware.  This means the asynchronous transmit functions return immediately after queuing data
  * in the output buffer for transmission and the transmission happens asynchronously, using
  * dedicated TWI hardware. Similarly, data is received asynchronously and placed into the input buffer.
  *
- * The transmit buffer is a ring buffer.  If you try to queue more data than the transmit
- * buffer can hold, the write functions will block until there is room in the buffer (as a result of
- * data being transmitted).  Receive buffers are provided by the callers of these functions.  Note that
+ * The transmit buffer is a queue of transaction descriptors, ordered by priority.  If you try to queue more
+ * transactions than the transmit buffer can hold, the write functions will block until there is room in the
+ * buffer (as a result of data being transmitted).  Receive buffers are provided by the callers of these functions.  Note that
  * due to the nature of the I2C protocol, Master I2C "read" operations must still write a command instructing
  * the destination device to send data for the Master to read, and thus "read" operations still utilize the
  * transmit buffer.
@@ -49,7 +53,8 @@
  * to specify the maximum number of transmit messages to hold in the buffer.  You need to make these define
  * these macros prior to including the file I2cMaster.h, each time it is included.  So you should define these
  * using a compiler option (e.g., \c -DI2C_MASTER_MAX_TX_MSG_LEN=32 \c -DI2C_MASTER_MAX_TX_MSG_NBR=5) to ensure they
- * are consistently defined throughout your project.
+ * are consistently defined throughout your project.  Alternatively, your application can provide its own storage for
+ * the transaction queue by calling I2cMaster::setTransactionQueue().
  *
  * This interface assumes your application will operator in I2C Master mode as defined in the I2C protocol.  If you
  * wish your application to operate in I2C Slave mode, then instead include I2cSlave.h and link against I2cSlave.cpp.
@@ -80,7 +85,7 @@
 #include <util/atomic.h>
 
 
-#if defined( DEBUG_I2cMasterBuffer ) || defined( DEBUG_I2cMasterDiary )
+#ifdef DEBUG_I2cMasterBuffer
 #include "USART0.h"
 #endif
 
@@ -104,6 +109,14 @@
 #error "I2C_MASTER_MAX_TX_MSG_NBR exceeds size of a uint8_t"
 #endif
 
+#ifndef I2C_MASTER_MAX_DEVICE_SPEEDS
+#define I2C_MASTER_MAX_DEVICE_SPEEDS    4
+#endif
+
+#if I2C_MASTER_MAX_DEVICE_SPEEDS > 255
+#error "I2C_MASTER_MAX_DEVICE_SPEEDS exceeds size of a uint8_t"
+#endif
+
 
 
 
@@ -143,14 +156,16 @@ namespace I2cMaster
 {
 
     /*!
-    * \brief This enum lists I2C bus speed configurations.
+    * \brief This enum lists I2C bus speed configurations.  Any other value passed to start() or setDeviceSpeed()
+    * is interpreted as a frequency in Hz.
     *
     * \hideinitializer
     */
     enum I2cBusSpeed
     {
         kI2cBusSlow                 = 0,                    //!< I2C slow (standard) mode: 100 KHz  \hideinitializer
-        kI2cBusFast                 = 1                     //!< I2C fast mode: 400 KHz  \hideinitializer
+        kI2cBusFast                 = 1,                    //!< I2C fast mode: 400 KHz  \hideinitializer
+        kI2cBusFastPlus             = 2                     //!< I2C fast mode plus: 1 MHz (or as close as F_CPU allows)  \hideinitializer
     };
 
 
@@ -162,7 +177,8 @@ namespace I2cMaster
         kI2cCompletedOk                    = 0x00,          //!< I2C communications completed on this message with no error.
         kI2cError                          = 0x01,          //!< I2C communications had an error on this message.
         kI2cNotStarted                     = 0x02,          //!< I2C communications not started on this message.
-        kI2cInProgress                     = 0x04           //!< I2C communications on this message still in progress.
+        kI2cInProgress                     = 0x04,          //!< I2C communications on this message still in progress.
+        kI2cTimedOut                       = 0x03           //!< I2C communications on this message timed out and the bus was reset (includes kI2cError).
     };
 
 
@@ -176,7 +192,8 @@ namespace I2cMaster
         kI2cErrMsgTooLong           = 2,                    //!< The message is too long for the transmit buffer
         kI2cErrNullStatusPtr        = 3,                    //!< The pointer to the status variable is null (need to provide a valid pointer)
         kI2cErrWriteWithoutData     = 4,                    //!< No data provided to send
-        kI2cErrReadWithoutStorage   = 5                     //!< Performing a write+read, but no buffer provided to store the "read" data
+        kI2cErrReadWithoutStorage   = 5,                    //!< Performing a write+read, but no buffer provided to store the "read" data
+        kI2cErrTooManyDeviceSpeeds  = 6                     //!< No room to record another device speed (increase I2C_MASTER_MAX_DEVICE_SPEEDS)
     };
 
 
@@ -192,6 +209,87 @@ namespace I2cMaster
     };
 
 
+    /*!
+    * \brief This enum lists convenient transaction priorities.  Any value from 0 to 255 may be used as a priority;
+    * transactions with a higher priority are transmitted ahead of queued transactions with a lower priority, and
+    * transactions of equal priority are transmitted in the order they were queued.
+    *
+    * \hideinitializer
+    */
+    enum I2cPriorities
+    {
+        kI2cPriorityLow             = 0,                    //!< Low priority (e.g., bulk display updates)  \hideinitializer
+        kI2cPriorityNormal          = 128,                  //!< Normal priority (the default)  \hideinitializer
+        kI2cPriorityHigh            = 255                   //!< High priority (e.g., latency-critical sensor reads)  \hideinitializer
+    };
+
+
+
+    /*!
+    * \brief This struct describes one segment of a multi-segment transaction (see transactAsync()).
+    *
+    * A segment addresses one device, optionally writes data to it, and then optionally reads data back from
+    * it (after a repeated start).  Consecutive segments are separated by a repeated start, so the bus is not released
+    * until the last segment completes.
+    */
+    struct I2cSegment
+    {
+        uint8_t         address;        //!< The I2C address of the device for this segment
+        const uint8_t*  txData;         //!< The data to write (typically starting with a register address); may be null if txLen is 0
+        uint8_t         txLen;          //!< The number of bytes to write (0 for a pure read)
+        uint8_t*        rxData;         //!< The buffer for the data read back; may be null if rxLen is 0
+        uint8_t         rxLen;          //!< The number of bytes to read (0 for a pure write)
+    };
+
+
+
+    /*!
+    * \brief The type of a completion callback for an asynchronous transaction.
+    *
+    * The callback is invoked from the TWI interrupt when the transaction completes or fails, so it must be short.
+    * It may queue further transactions (e.g., to chain straight into the next transfer); the slot used by the
+    * transaction that just finished is already available for reuse.
+    *
+    * \arg \c status the final status of the transaction; values correspond to I2cStatusCodes (if an error occurred,
+    * \c kI2cError is combined with the TWI hardware status code).
+    * \arg \c context the context pointer that was passed when the transaction was queued.
+    */
+    typedef void (*I2cCallback)( uint8_t status, void* context );
+
+
+
+    /*!
+    * \brief This struct is the descriptor for one queued I2C transaction.  An application only needs it to
+    * provide its own storage for the transaction queue via setTransactionQueue(); its members are managed
+    * by I2cMaster and should be treated as private.
+    */
+    struct I2cTransaction
+    {
+        I2cTransaction*     mNext;
+        uint8_t*            mRxBuffer;
+        volatile uint8_t*   mRxCounter;
+        volatile uint8_t*   mStatus;
+        I2cCallback         mCallback;
+        void*               mContext;
+        const uint8_t*      mTxData;
+        uint16_t            mTxDataSize;
+        uint8_t             mTxDataInProgmem;
+        const I2cSegment*   mSegments;
+        uint8_t             mNbrSegments;
+        uint8_t             mCurrentSegment;
+        volatile uint8_t    mSegmentRxCounter;
+        uint8_t             mAddress;
+        uint8_t             mTxMode;
+        uint8_t             mPhase;
+        uint8_t             mPriority;
+        uint8_t             mBitRate;
+        uint8_t             mPrescaler;
+        uint8_t             mTxBufferSize;
+        uint8_t             mRxBufferSize;
+        uint8_t             mTxBuffer[ I2C_MASTER_MAX_TX_MSG_LEN ];
+    };
+
+
 
 
 
@@ -201,10 +299,29 @@ namespace I2cMaster
      *
      * This function enables the TWI related interrupts and enables the built-in hardware pullups.
      *
-     * \arg \c speed the speed mode for the I2C protocol.  The options are slow (100 KHz) or fast (400 KHz); the
-     * default is fast (kI2cBusFast).
+     * \arg \c speed the speed of the I2C bus.  This can be one of the I2cBusSpeed modes (slow = 100 KHz,
+     * fast = 400 KHz, fast plus = 1 MHz), or any other value, which is taken as the desired frequency in Hz.
+     * The TWI bit rate and prescaler are computed from \c F_CPU to give the fastest frequency that does not
+     * exceed the one requested (limited to F_CPU/16 at the top end).  The default is fast (kI2cBusFast).
      */
-    void start( uint8_t speed = kI2cBusFast );
+    void start( uint32_t speed = kI2cBusFast );
+
+
+    /*!
+     * \brief Sets the bus speed to use when communicating with a particular device, which may differ from the
+     * bus speed set by start().  This lets slow and fast devices share the bus without every transaction running
+     * at the speed of the slowest device: the TWI bit rate is switched as each transaction addresses its device.
+     *
+     * Up to \c I2C_MASTER_MAX_DEVICE_SPEEDS devices (default 4) can have their own speed.  The new speed
+     * applies to transactions queued after this call.
+     *
+     * \arg \c address the I2C address of the device.
+     * \arg \c speed the speed for this device; same interpretation as for start().  Calling this function again for
+     * the same device replaces its speed.
+     *
+     * \returns kI2cNoError, or kI2cErrTooManyDeviceSpeeds if there is no room to record this device.
+     */
+    uint8_t setDeviceSpeed( uint8_t address, uint32_t speed );
 
 
     /*!
@@ -235,6 +352,63 @@ namespace I2cMaster
     bool busy();
 
 
+    /*!
+     * \brief Sets how long the TWI hardware may go without making progress before the current transaction is
+     * abandoned and the bus is reset.
+     *
+     * Timeouts are only available if the macro \c I2C_MASTER_TIMEOUTS is defined when I2cMaster.cpp is compiled;
+     * otherwise this function does nothing.  The timeout is measured using millis(), so you must also link against
+     * SystemClock.cpp and call initSystemClock() for it to work.  No timeout is applied until you call this function.
+     *
+     * Timeouts are detected by serviceTimeout(), which the synchronous functions call automatically while they wait.
+     * If you use the asynchronous functions, call serviceTimeout() regularly (e.g., from your main loop).
+     *
+     * \arg \c milliseconds the timeout in milliseconds; 0 disables the timeout.
+     */
+    void setTimeout( uint16_t milliseconds );
+
+
+    /*!
+     * \brief Checks whether the TWI hardware has stopped making progress for longer than the timeout set by
+     * setTimeout().  If so, the current transaction is marked kI2cTimedOut (and its callback, if any, is invoked),
+     * the bus is reset by calling recoverBus(), and any remaining queued transactions are started.
+     *
+     * This function never blocks (other than for the brief bus reset itself).  Unless \c I2C_MASTER_TIMEOUTS is
+     * defined when I2cMaster.cpp is compiled, it does nothing.
+     *
+     * \returns true if a timeout occurred and the bus was reset; false otherwise.
+     */
+    bool serviceTimeout();
+
+
+    /*!
+     * \brief Resets a stuck I2C bus.  The TWI hardware is disconnected from the bus, then SCL is clocked
+     * up to 9 times (until the slave holding SDA low releases it) and a STOP is generated, after which the
+     * TWI hardware is re-enabled.
+     *
+     * Call this function only when no transaction is in progress (for instance, at start up or after a timeout);
+     * serviceTimeout() calls it automatically when a transaction times out.
+     */
+    void recoverBus();
+
+
+    /*!
+     * \brief Replaces the built-in transaction queue with storage provided by the application.
+     *
+     * By default I2cMaster queues up to \c I2C_MASTER_MAX_TX_MSG_NBR transactions in a built-in array.  An application
+     * that needs a deeper (or shallower) queue can instead provide its own array of I2cTransaction descriptors.  If you
+     * always provide your own storage, define \c I2C_MASTER_MAX_TX_MSG_NBR to be 0 to eliminate the built-in array.
+     *
+     * Call this function only when the TWI hardware is idle (i.e., busy() returns false); any transactions still
+     * queued are discarded.
+     *
+     * \arg \c slots an array of I2cTransaction descriptors that I2cMaster will use for its transaction queue; the
+     * array must remain valid for as long as I2cMaster uses it.
+     * \arg \c nbrSlots the number of descriptors in the array.
+     */
+    void setTransactionQueue( I2cTransaction* slots, uint8_t nbrSlots );
+
+
 
 
     // Asynchronous functions
@@ -253,10 +427,13 @@ namespace I2cMaster
      * \arg \c status a pointer to a byte-size location in which the commincations status of this message will be
      * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
      * hardware); values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
      *
      * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
      */
-    uint8_t writeAsync( uint8_t address, uint8_t registerAddress, volatile uint8_t* status );
+    uint8_t writeAsync( uint8_t address, uint8_t registerAddress, volatile uint8_t* status,
+                        uint8_t priority = kI2cPriorityNormal );
 
 
     /*!
@@ -273,10 +450,13 @@ namespace I2cMaster
      * \arg \c status a pointer to a byte-size location in which the commincations status of this message will be
      * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
      * hardware); values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
      *
      * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
      */
-    uint8_t writeAsync( uint8_t address, uint8_t registerAddress, uint8_t data, volatile uint8_t* status );
+    uint8_t writeAsync( uint8_t address, uint8_t registerAddress, uint8_t data, volatile uint8_t* status,
+                        uint8_t priority = kI2cPriorityNormal );
 
 
     /*!
@@ -294,10 +474,13 @@ namespace I2cMaster
      * \arg \c status a pointer to a byte-size location in which the commincations status of this message will be
      * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
      * hardware); values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
      *
      * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
      */
-    uint8_t writeAsync( uint8_t address, uint8_t registerAddress, const char* data, volatile uint8_t* status );
+    uint8_t writeAsync( uint8_t address, uint8_t registerAddress, const char* data, volatile uint8_t* status,
+                        uint8_t priority = kI2cPriorityNormal );
 
 
     /*!
@@ -316,11 +499,72 @@ namespace I2cMaster
      * \arg \c status a pointer to a byte-size location in which the commincations status of this message will be
      * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
      * hardware); values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
      *
      * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
      */
     uint8_t writeAsync( uint8_t address, uint8_t registerAddress, uint8_t* data, uint8_t numberBytes,
-                            volatile uint8_t* status );
+                            volatile uint8_t* status, uint8_t priority = kI2cPriorityNormal );
+
+
+
+    /*!
+     * \brief Transmit a single register address and corresponding buffer of data asynchronously, without
+     * copying the data into the transmit buffer.  This function queues the message and returns immediately.
+     * Eventual status of the transmitted message can be monitored via the designated status variable (passed as a
+     * pointer to this function).
+     *
+     * Only the register address is stored in the transmit buffer; the TWI interrupt reads the data directly from
+     * the caller's buffer.  This means the message length is not limited by \c I2C_MASTER_MAX_TX_MSG_LEN, but
+     * the caller must not modify or release the buffer until the status reports the message is no longer
+     * kI2cNotStarted or kI2cInProgress.
+     *
+     * If the transmit buffer is full, this function will block until room is available in the buffer.
+     *
+     * \arg \c address the I2C address of the destination device for this message
+     * \arg \c registerAddress in device-centric terms, the register address on the destination device; think of it as
+     * a one-byte instruction to the destination device telling it to do something (e.g., an address in a memory device).
+     * \arg \c data a buffer of data serving as a parameter to the register address (e.g., an EEPROM page or a
+     * display framebuffer); it must remain valid until the transmission is complete.
+     * \arg \c numberBytes the number of bytes from the buffer to transmit.
+     * \arg \c status a pointer to a byte-size location in which the commincations status of this message will be
+     * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
+     * hardware); values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
+     *
+     * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
+     */
+    uint8_t writeAsyncNoCopy( uint8_t address, uint8_t registerAddress, const uint8_t* data, uint16_t numberBytes,
+                                volatile uint8_t* status, uint8_t priority = kI2cPriorityNormal );
+
+
+    /*!
+     * \brief Transmit a single register address and corresponding buffer of data stored in flash memory (PROGMEM)
+     * asynchronously.  This function queues the message and returns immediately.  Eventual status of the
+     * transmitted message can be monitored via the designated status variable (passed as a pointer to this function).
+     *
+     * The TWI interrupt reads the data directly from flash memory, so the message length is not limited by
+     * \c I2C_MASTER_MAX_TX_MSG_LEN and no SRAM is needed for the data.
+     *
+     * If the transmit buffer is full, this function will block until room is available in the buffer.
+     *
+     * \arg \c address the I2C address of the destination device for this message
+     * \arg \c registerAddress in device-centric terms, the register address on the destination device; think of it as
+     * a one-byte instruction to the destination device telling it to do something (e.g., an address in a memory device).
+     * \arg \c data a pointer to the data in flash memory (PROGMEM) serving as a parameter to the register address.
+     * \arg \c numberBytes the number of bytes to transmit.
+     * \arg \c status a pointer to a byte-size location in which the commincations status of this message will be
+     * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
+     * hardware); values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
+     *
+     * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
+     */
+    uint8_t writeAsyncNoCopy_P( uint8_t address, uint8_t registerAddress, const uint8_t* data, uint16_t numberBytes,
+                                volatile uint8_t* status, uint8_t priority = kI2cPriorityNormal );
 
 
 
@@ -341,11 +585,14 @@ namespace I2cMaster
      * \arg \c status a pointer to a byte-size location in which the commincations status of this message will be
      * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
      * hardware) values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
      *
      * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
      */
     uint8_t readAsync( uint8_t address, uint8_t numberBytes, volatile uint8_t* destination,
-                        volatile uint8_t* bytesRead, volatile uint8_t* status );
+                        volatile uint8_t* bytesRead, volatile uint8_t* status,
+                        uint8_t priority = kI2cPriorityNormal );
 
 
     /*!
@@ -368,12 +615,153 @@ namespace I2cMaster
      * \arg \c status a pointer to a byte-size location in which the commincations status of this message will be
      * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
      * hardware); values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
      *
      * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
      */
     uint8_t readAsync( uint8_t address, uint8_t registerAddress, uint8_t numberBytes,
                         volatile uint8_t* destination, volatile uint8_t* bytesRead,
-                        volatile uint8_t* status );
+                        volatile uint8_t* status, uint8_t priority = kI2cPriorityNormal );
+
+
+
+    /*!
+     * \brief Transmit a single register address and corresponding buffer of data asynchronously, reporting completion
+     * through a callback.  This function queues the message and returns immediately.  When the transmission completes
+     * (or fails), the callback is invoked from the TWI interrupt.
+     *
+     * If the transmit buffer is full, this function will block until room is available in the buffer (but if it
+     * is called with interrupts disabled, e.g., from within a callback, it returns kI2cErrTxBufferFull instead).
+     *
+     * \arg \c address the I2C address of the destination device for this message
+     * \arg \c registerAddress in device-centric terms, the register address on the destination device; think of it as
+     * a one-byte instruction to the destination device telling it to do something (e.g., an address in a memory device).
+     * \arg \c data a buffer of data serving as a parameter to the register address (e.g., the data to store
+     * sequentially starting at the registerAddress).
+     * \arg \c numberBytes the number of bytes from the buffer to transmit.
+     * \arg \c callback the function to call (from the TWI interrupt) when the transaction completes or fails.
+     * \arg \c context a pointer that is passed unchanged to the callback.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
+     *
+     * \returns error codes corresponding to I2cSendErrorCodes (0 means no error).
+     */
+    uint8_t writeAsync( uint8_t address, uint8_t registerAddress, uint8_t* data, uint8_t numberBytes,
+                            I2cCallback callback, void* context, uint8_t priority = kI2cPriorityNormal );
+
+
+
+    /*!
+     * \brief Request to read data from a device and receive that data asynchronously, reporting completion
+     * through a callback.  This function queues the message and returns immediately.  When the read completes
+     * (or fails), the callback is invoked from the TWI interrupt and the received data can be read from the
+     * receive buffer.
+     *
+     * If the transmit buffer is full, this function will block until room is available in the buffer (but if it
+     * is called with interrupts disabled, e.g., from within a callback, it returns kI2cErrTxBufferFull instead).
+     *
+     * \arg \c address the I2C address of the destination device you want to read from.
+     * \arg \c numberBytes the number of bytes you expect to read.
+     * \arg \c destination a pointer to a buffer in which the received data will be stored; the buffer should be
+     * at least \c numberBytes large.
+     * \arg \c bytesRead a pointer to a byte-sized countered in which the TWI hardware will asynchronously keep track
+     * of how many bytes have been received.
+     * \arg \c callback the function to call (from the TWI interrupt) when the transaction completes or fails.
+     * \arg \c context a pointer that is passed unchanged to the callback.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
+     *
+     * \returns error codes corresponding to I2cSendErrorCodes (0 means no error).
+     */
+    uint8_t readAsync( uint8_t address, uint8_t numberBytes, volatile uint8_t* destination,
+                        volatile uint8_t* bytesRead, I2cCallback callback, void* context,
+                        uint8_t priority = kI2cPriorityNormal );
+
+
+
+    /*!
+     * \brief Request to read data from a specific register on a device and receive that data asynchronously,
+     * reporting completion through a callback.  This function queues the message and returns immediately.  When the
+     * read completes (or fails), the callback is invoked from the TWI interrupt and the received data can be read
+     * from the receive buffer.
+     *
+     * If the transmit buffer is full, this function will block until room is available in the buffer (but if it
+     * is called with interrupts disabled, e.g., from within a callback, it returns kI2cErrTxBufferFull instead).
+     *
+     * \arg \c address the I2C address of the destination device you want to read from.
+     * \arg \c registerAddress in device-centric terms, the register address on the destination device; think of it as
+     * a one-byte instruction to the destination device telling it what you want to read (e.g., temperature or the
+     * starting address of a block of memory).
+     * \arg \c numberBytes the number of bytes you expect to read.
+     * \arg \c destination a pointer to a buffer in which the received data will be stored; the buffer should be
+     * at least \c numberBytes large.
+     * \arg \c bytesRead a pointer to a byte-sized countered in which the TWI hardware will asynchronously keep track
+     * of how many bytes have been received.
+     * \arg \c callback the function to call (from the TWI interrupt) when the transaction completes or fails.
+     * \arg \c context a pointer that is passed unchanged to the callback.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
+     *
+     * \returns error codes corresponding to I2cSendErrorCodes (0 means no error).
+     */
+    uint8_t readAsync( uint8_t address, uint8_t registerAddress, uint8_t numberBytes,
+                        volatile uint8_t* destination, volatile uint8_t* bytesRead,
+                        I2cCallback callback, void* context, uint8_t priority = kI2cPriorityNormal );
+
+
+
+    /*!
+     * \brief Queue a multi-segment transaction (a sequence of writes and reads, possibly to different devices)
+     * that the TWI interrupt executes back-to-back without releasing the bus.  This function queues the
+     * transaction and returns immediately.  Eventual status of the whole transaction can be monitored via the
+     * designated status variable (passed as a pointer to this function).
+     *
+     * Each segment is separated from the next by a repeated start, so a single submission can, for example, read
+     * several registers from several different devices with only one start and one stop on the bus.
+     *
+     * The segment array, and the transmit and receive buffers it points to, are used in place (not copied), so they
+     * must remain valid until the status reports the transaction is no longer kI2cNotStarted or kI2cInProgress.
+     *
+     * If the transmit buffer is full, this function will block until room is available in the buffer.
+     *
+     * \arg \c segments an array of segments describing the transaction.
+     * \arg \c nbrSegments the number of segments in the array.
+     * \arg \c status a pointer to a byte-size location in which the commincations status of this transaction will be
+     * reported (volatile because the value will be updates asynchronously after the function returns by the TWI
+     * hardware); values correspond to I2cStatusCodes.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
+     *
+     * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
+     */
+    uint8_t transactAsync( const I2cSegment* segments, uint8_t nbrSegments, volatile uint8_t* status,
+                            uint8_t priority = kI2cPriorityNormal );
+
+
+    /*!
+     * \brief Queue a multi-segment transaction (a sequence of writes and reads, possibly to different devices)
+     * that the TWI interrupt executes back-to-back without releasing the bus, reporting completion through a
+     * callback.  This function queues the transaction and returns immediately.  When the whole transaction
+     * completes (or fails), the callback is invoked from the TWI interrupt.
+     *
+     * The segment array, and the transmit and receive buffers it points to, are used in place (not copied), so they
+     * must remain valid until the callback is invoked.
+     *
+     * If the transmit buffer is full, this function will block until room is available in the buffer (but if it
+     * is called with interrupts disabled, e.g., from within a callback, it returns kI2cErrTxBufferFull instead).
+     *
+     * \arg \c segments an array of segments describing the transaction.
+     * \arg \c nbrSegments the number of segments in the array.
+     * \arg \c callback the function to call (from the TWI interrupt) when the transaction completes or fails.
+     * \arg \c context a pointer that is passed unchanged to the callback.
+     * \arg \c priority the priority of this transaction relative to other queued transactions; values correspond
+     * to I2cPriorities (default kI2cPriorityNormal).
+     *
+     * \returns error codes corresponding to I2cSendErrorCodes (0 means no error)
+     */
+    uint8_t transactAsync( const I2cSegment* segments, uint8_t nbrSegments, I2cCallback callback, void* context,
+                            uint8_t priority = kI2cPriorityNormal );
 
 
 
@@ -481,19 +869,11 @@ namespace I2cMaster
     int readSync( uint8_t address, uint8_t registerAddress, uint8_t numberBytes, uint8_t* destination );
 
 
-#if defined( DEBUG_I2cMasterBuffer ) || defined( DEBUG_I2cMasterDiary )
-    void setDebugSout( Serial0* s );
-#endif
-
 #ifdef DEBUG_I2cMasterBuffer
+    void setDebugSout( Serial0* s );
     void dumpBufferContents();
 #endif
 
-#ifdef DEBUG_I2cMasterDiary
-    void clearDebugI2cDiary();
-    void dumpDebugI2cDiary();
-#endif
-
 
 };
 
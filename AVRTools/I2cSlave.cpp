@@ -31,29 +31,18 @@
 
 
 #include "ArduinoPins.h"
+#include "Profiler.h"
+#include "Trace.h"
 
 
 
 
 
 
-#ifdef DEBUG_I2cSlaveDiary
-
-#ifndef DEBUG_I2cSlaveDiaryBufferSize
-#define DEBUG_I2cSlaveDiaryBufferSize         32
-#endif
-
-#if DEBUG_I2cSlaveDiaryBufferSize > 255
-#error "DEBUG_I2cSlaveDiaryBufferSize exceeds size of a uint8_t"
-#endif
-
-
-#include "USART0.h"
-
-
 namespace
 {
 
+    // Events recorded by TRACE_EVENT() (see Trace.h)
     enum
     {
         kStartXmitData              = 1,
@@ -71,37 +60,69 @@ namespace
         kErrorStandby               = 90
     };
 
+};
 
-    uint8_t     debugContent[ DEBUG_I2cSlaveDiaryBufferSize ];
-    uint8_t     debugControl[ DEBUG_I2cSlaveDiaryBufferSize ];
-    uint8_t     debugStatus[ DEBUG_I2cSlaveDiaryBufferSize ];
-    uint8_t     debugPtr;
 
-    void DebugDiaryEntry( uint8_t content, uint8_t control, uint8_t status );
 
-    Serial0*    debugSout;
 
-};
 
-#endif
+namespace
+{
 
+    const uint8_t kI2cBufferSize = I2C_SLAVE_BUFFER_SIZE;
 
+#if I2C_SLAVE_RX_QUEUE_DEPTH > 0
 
+    const uint8_t kI2cRxQueueDepth = I2C_SLAVE_RX_QUEUE_DEPTH;
 
+    // Received messages wait here for poll()
+    uint8_t gI2cRxQueue[ kI2cRxQueueDepth ][ kI2cBufferSize ];
+    uint8_t gI2cRxQueueLen[ kI2cRxQueueDepth ];
+    uint8_t gI2cRxHead;                 // Only changed by the ISR
+    uint8_t gI2cRxTail;                 // Only changed by poll()
+    volatile uint8_t gI2cRxCount;
+    uint8_t* gI2cRxBuffer;              // Slot being received into (null if the queue was full)
 
-namespace
-{
+    // Replies: the ISR transmits from the front buffer; poll() stages into the back buffer
+    uint8_t gI2cTxBuffers[ 2 ][ kI2cBufferSize ];
+    uint8_t gI2cTxSize[ 2 ];
+    volatile uint8_t gI2cTxFront;
+    volatile bool gI2cTxPending;
 
-    const uint8_t kI2cBufferSize = I2C_SLAVE_BUFFER_SIZE;
+    inline uint8_t* rxBuffer()
+    { return gI2cRxBuffer; }
+
+    inline uint8_t* txBuffer()
+    { return gI2cTxBuffers[ gI2cTxFront ]; }
+
+#else
 
     uint8_t gI2cBuffer[ kI2cBufferSize ];
 
+    inline uint8_t* rxBuffer()
+    { return gI2cBuffer; }
+
+    inline uint8_t* txBuffer()
+    { return gI2cBuffer; }
+
+#endif
+
     uint8_t gI2cBufferIndex;
     uint8_t gI2cMsgSize;
 
     uint8_t gI2cStatus;
     bool gI2cBusy;
 
+    // Register-map mode
+    uint8_t* volatile gI2cRegisters;
+    uint8_t gI2cNbrRegisters;
+    const uint8_t* gI2cReadOnlyMask;
+    I2cSlave::I2cRegisterWriteCallback gI2cRegisterCallback;
+    uint8_t gI2cRegPointer;
+    bool gI2cRegPointerNext;
+    uint8_t gI2cRegWriteStart;
+    uint8_t gI2cRegWriteCount;
+
 };
 
 
@@ -117,6 +138,17 @@ void I2cSlave::start( uint8_t ownAddress, uint8_t speed, bool answerGeneralCall
     gI2cBufferIndex = 0;
     gI2cMsgSize = 0;
 
+#if I2C_SLAVE_RX_QUEUE_DEPTH > 0
+    gI2cRxHead = 0;
+    gI2cRxTail = 0;
+    gI2cRxCount = 0;
+    gI2cRxBuffer = 0;
+    gI2cTxFront = 0;
+    gI2cTxPending = false;
+    gI2cTxSize[ 0 ] = 0;
+    gI2cTxSize[ 1 ] = 0;
+#endif
+
     // Activate internal pull-ups
     pullups( kPullupsOn );
 
@@ -190,6 +222,62 @@ bool I2cSlave::busy()
 
 
 
+void I2cSlave::setRegisterMap( uint8_t* registers, uint8_t nbrRegisters, const uint8_t* readOnlyMask,
+                                I2cRegisterWriteCallback callback )
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        gI2cRegisters = nbrRegisters ? registers : 0;
+        gI2cNbrRegisters = nbrRegisters;
+        gI2cReadOnlyMask = readOnlyMask;
+        gI2cRegisterCallback = callback;
+        gI2cRegPointer = 0;
+        gI2cRegPointerNext = false;
+        gI2cRegWriteCount = 0;
+    }
+}
+
+
+
+#if I2C_SLAVE_RX_QUEUE_DEPTH > 0
+
+uint8_t I2cSlave::poll()
+{
+    uint8_t n = 0;
+
+    while ( gI2cRxCount )
+    {
+        // Keep the ISR from swapping in the back buffer while we fill it
+        gI2cTxPending = false;
+        uint8_t back = gI2cTxFront ^ 1;
+
+        uint8_t len = gI2cRxQueueLen[ gI2cRxTail ];
+        memcpy( gI2cTxBuffers[ back ], gI2cRxQueue[ gI2cRxTail ], len );
+
+        // The receive slot can be reused now
+        if ( ++gI2cRxTail >= kI2cRxQueueDepth )
+        {
+            gI2cRxTail = 0;
+        }
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            --gI2cRxCount;
+        }
+
+        gI2cTxSize[ back ] = processI2cMessage( gI2cTxBuffers[ back ], len );
+
+        // Swap it in the next time the Master reads
+        gI2cTxPending = true;
+        ++n;
+    }
+
+    return n;
+}
+
+#endif
+
+
+
 
 
 
@@ -248,8 +336,134 @@ bool I2cSlave::busy()
 
 
 
+namespace
+{
+
+    // Only called from the ISR: get ready to receive a message from the Master
+    inline void startReceive()
+    {
+#if I2C_SLAVE_RX_QUEUE_DEPTH > 0
+        if ( gI2cRxCount < kI2cRxQueueDepth )
+        {
+            gI2cRxBuffer = gI2cRxQueue[ gI2cRxHead ];
+            standby();
+        }
+        else
+        {
+            // No room in the queue, so refuse the data
+            gI2cRxBuffer = 0;
+            getNextByteWithNACK();
+        }
+#else
+        standby();
+#endif
+    }
+
+};
+
+
+
+
+namespace
+{
+
+    inline void nextRegister()
+    {
+        if ( ++gI2cRegPointer >= gI2cNbrRegisters )
+        {
+            gI2cRegPointer = 0;
+        }
+    }
+
+
+    // Only called from the ISR: handle the event if it is part of a normal register-map exchange;
+    // returns false to leave it to the regular handling (e.g., errors)
+    inline bool handleRegisterMapEvent()
+    {
+        uint8_t reg;
+
+        switch ( TW_STATUS )
+        {
+            case TW_SR_SLA_ACK:             // Own SLA+W has been received ACK has been returned
+            case TW_SR_ARB_LOST_SLA_ACK:    // Arbitration lost; own SLA+W received; ACK returned
+            case TW_SR_GCALL_ACK:           // General call address has been received; ACK has been returned
+            case TW_SR_ARB_LOST_GCALL_ACK:  // Arbitration lost; General call address received; ACK returned
+                // First byte will be the register pointer
+                gI2cRegPointerNext = true;
+                gI2cRegWriteCount = 0;
+                gI2cBusy = true;
+                gI2cStatus = I2cSlave::kI2cInProgress;
+                standby();
+                return true;
+
+            case TW_SR_DATA_ACK:            // Data has been received; ACK has been returned
+            case TW_SR_GCALL_DATA_ACK:      // Data has been received; ACK has been returned
+                reg = TWDR;
+                if ( gI2cRegPointerNext )
+                {
+                    gI2cRegPointer = ( reg < gI2cNbrRegisters ) ? reg : 0;
+                    gI2cRegWriteStart = gI2cRegPointer;
+                    gI2cRegPointerNext = false;
+                }
+                else
+                {
+                    if ( !gI2cReadOnlyMask || !( gI2cReadOnlyMask[ gI2cRegPointer >> 3 ] & ( 1 << ( gI2cRegPointer & 0x07 ) ) ) )
+                    {
+                        gI2cRegisters[ gI2cRegPointer ] = reg;
+                    }
+                    ++gI2cRegWriteCount;
+                    nextRegister();
+                }
+                getNextByteWithACK();
+                return true;
+
+            case TW_SR_STOP:                // A STOP condition or repeated START condition
+                gI2cBusy = false;
+                gI2cStatus = I2cSlave::kI2cCompletedOk;
+                if ( gI2cRegWriteCount && gI2cRegisterCallback )
+                {
+                    gI2cRegisterCallback( gI2cRegWriteStart, gI2cRegWriteCount );
+                }
+                gI2cRegWriteCount = 0;
+                standby();
+                return true;
+
+            case TW_ST_SLA_ACK:             // Own SLA+R has been received; ACK has been returned
+            case TW_ST_ARB_LOST_SLA_ACK:    // Arbitration lost in SLA+R/W as Master; own SLA+R received; ACK returned
+            case TW_ST_DATA_ACK:            // Data byte in TWDR has been transmitted; ACK has been received
+                gI2cBusy = true;
+                gI2cStatus = I2cSlave::kI2cInProgress;
+                TWDR = gI2cRegisters[ gI2cRegPointer ];
+                nextRegister();
+                transmitByte();
+                return true;
+
+            case TW_ST_DATA_NACK:          // Data byte in TWDR has been transmitted; NACK has been received.
+                // The Master has read as much as it wants
+                gI2cBusy = false;
+                gI2cStatus = I2cSlave::kI2cCompletedOk;
+                standby();
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+};
+
+
+
+
 ISR( TWI_vect )
 {
+    PROFILE_PROBE( kProfileI2cSlave );
+
+    if ( gI2cRegisters && handleRegisterMapEvent() )
+    {
+        return;
+    }
+
     switch ( TW_STATUS )
     {
         case TW_ST_SLA_ACK:             // Own SLA+R has been received; ACK has been returned
@@ -258,12 +472,19 @@ ISR( TWI_vect )
             gI2cBufferIndex = 0;
             gI2cStatus = I2cSlave::kI2cInProgress;
             gI2cBusy = true;
-            if ( gI2cBufferIndex < gI2cMsgSize )
+#if I2C_SLAVE_RX_QUEUE_DEPTH > 0
+            if ( gI2cTxPending )
             {
-                TWDR = gI2cBuffer[ gI2cBufferIndex++ ];
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( gI2cBuffer[ gI2cBufferIndex - 1 ], kStartXmitData, TW_STATUS );
+                // A new reply has been staged, so switch to it
+                gI2cTxFront ^= 1;
+                gI2cMsgSize = gI2cTxSize[ gI2cTxFront ];
+                gI2cTxPending = false;
+            }
 #endif
+            if ( gI2cBufferIndex < gI2cMsgSize )
+            {
+                TWDR = txBuffer()[ gI2cBufferIndex++ ];
+                TRACE_EVENT( kTraceI2cSlave, kStartXmitData, txBuffer()[ gI2cBufferIndex - 1 ], TW_STATUS );
             }
             else
             {
@@ -271,9 +492,7 @@ ISR( TWI_vect )
                 // Note that using the "send last byte (EA clear)" method doesn't work very well
                 // Better to just send dummy data
                 TWDR = 0xFF;
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( 0xFF, kStartXmitNoData, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cSlave, kStartXmitNoData, 0xFF, TW_STATUS );
             }
             transmitByte();
             break;
@@ -283,10 +502,8 @@ ISR( TWI_vect )
             gI2cBusy = true;
             if ( gI2cBufferIndex < gI2cMsgSize )
             {
-                TWDR = gI2cBuffer[ gI2cBufferIndex++ ];
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( gI2cBuffer[ gI2cBufferIndex - 1 ], kContinueXmitData, TW_STATUS );
-#endif
+                TWDR = txBuffer()[ gI2cBufferIndex++ ];
+                TRACE_EVENT( kTraceI2cSlave, kContinueXmitData, txBuffer()[ gI2cBufferIndex - 1 ], TW_STATUS );
             }
             else
             {
@@ -294,9 +511,7 @@ ISR( TWI_vect )
                 // Note that using the "send last byte (EA clear)" method doesn't work very well
                 // Better to just send dummy data
                 TWDR = 0xFF;
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( 0xFF, kContinueXmitNoData, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cSlave, kContinueXmitNoData, 0xFF, TW_STATUS );
             }
             transmitByte();
             break;
@@ -307,17 +522,13 @@ ISR( TWI_vect )
             {
                 // All expected data transceived
                 gI2cStatus = I2cSlave::kI2cCompletedOk;
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( 0, kGotNackOkay, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cSlave, kGotNackOkay, 0, TW_STATUS );
             }
             else
             {
                 // Master has sent a NACK before all data where sent
                 gI2cStatus = I2cSlave::kI2cTxPartial;
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( 0, kGotNackEarly, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cSlave, kGotNackEarly, 0, TW_STATUS );
             }
             gI2cBusy = false;   // Transmit is finished, we are not busy anymore
             standby();
@@ -328,10 +539,8 @@ ISR( TWI_vect )
             gI2cBufferIndex = 0;
             gI2cBusy = true;
             gI2cStatus = I2cSlave::kI2cInProgress;
-#ifdef DEBUG_I2cSlaveDiary
-            DebugDiaryEntry( 0, kStartGcallRcv, TW_STATUS );
-#endif
-            standby();
+            TRACE_EVENT( kTraceI2cSlave, kStartGcallRcv, 0, TW_STATUS );
+            startReceive();
             break;
 
         case TW_SR_SLA_ACK:             // Own SLA+W has been received ACK has been returned
@@ -339,48 +548,52 @@ ISR( TWI_vect )
             gI2cBufferIndex = 0;
             gI2cBusy = true;
             gI2cStatus = I2cSlave::kI2cInProgress;
-#ifdef DEBUG_I2cSlaveDiary
-            DebugDiaryEntry( 0, kStartRcv, TW_STATUS );
-#endif
-            standby();
+            TRACE_EVENT( kTraceI2cSlave, kStartRcv, 0, TW_STATUS );
+            startReceive();
             break;
 
         case TW_SR_DATA_ACK:            // Data has been received; ACK has been returned
         case TW_SR_GCALL_DATA_ACK:      // Data has been received; ACK has been returned
-            gI2cBuffer[ gI2cBufferIndex++ ] = TWDR;
+            rxBuffer()[ gI2cBufferIndex++ ] = TWDR;
             if ( gI2cBufferIndex < kI2cBufferSize - 1 )
             {
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( gI2cBuffer[ gI2cBufferIndex - 1 ], kDataRcv, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cSlave, kDataRcv, rxBuffer()[ gI2cBufferIndex - 1 ], TW_STATUS );
                 getNextByteWithACK();
             }
             else
             {
                 // Next byte will be the last one that fits; respond with NACK
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( gI2cBuffer[ gI2cBufferIndex - 1 ], kDataRcvLastByte, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cSlave, kDataRcvLastByte, rxBuffer()[ gI2cBufferIndex - 1 ], TW_STATUS );
                 getNextByteWithNACK();
             }
             break;
 
         case TW_SR_STOP:                // A STOP condition or repeated START condition
+#if I2C_SLAVE_RX_QUEUE_DEPTH > 0
+            if ( gI2cRxBuffer )
+            {
+                // Queue it for poll() and release the bus right away
+                gI2cRxQueueLen[ gI2cRxHead ] = gI2cBufferIndex;
+                if ( ++gI2cRxHead >= kI2cRxQueueDepth )
+                {
+                    gI2cRxHead = 0;
+                }
+                ++gI2cRxCount;
+                gI2cRxBuffer = 0;
+            }
+#else
             gI2cMsgSize = I2cSlave::processI2cMessage( gI2cBuffer, gI2cBufferIndex );
+#endif
             gI2cBusy = false;
             if ( gI2cStatus == I2cSlave::kI2cInProgress )
             {
                 gI2cStatus = I2cSlave::kI2cCompletedOk;
-#ifdef DEBUG_I2cSlaveDiary
-                DebugDiaryEntry( 0, kStopWhileInProgress, TW_STATUS );
-#endif
+                TRACE_EVENT( kTraceI2cSlave, kStopWhileInProgress, 0, TW_STATUS );
             }
-#ifdef DEBUG_I2cSlaveDiary
             else
             {
-                DebugDiaryEntry( 0, kStopOtherwise, TW_STATUS );
+                TRACE_EVENT( kTraceI2cSlave, kStopOtherwise, 0, TW_STATUS );
             }
-#endif
             standby();
             break;
 
@@ -394,79 +607,10 @@ ISR( TWI_vect )
         default:
             gI2cBusy = false;
             gI2cStatus = TW_STATUS | I2cSlave::kI2cError;
-#ifdef DEBUG_I2cSlaveDiary
-            DebugDiaryEntry( 0, kErrorStandby, TW_STATUS );
-#endif
+            TRACE_EVENT( kTraceI2cSlave, kErrorStandby, 0, TW_STATUS );
             standby();
     }
 }
 
 
-#ifdef DEBUG_I2cSlaveDiary
-
-
-namespace
-{
-
-    void DebugDiaryEntry( uint8_t content, uint8_t control, uint8_t status )
-    {
-        debugContent[ debugPtr ] = content;
-        debugControl[ debugPtr ] = control;
-        debugStatus[ debugPtr ] = status;
-        ++debugPtr;
-    }
-
-};
-
-
-
-void I2cSlave::clearDebugI2cDiary()
-{
-    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-    {
-        for ( uint8_t i = 0; i < DEBUG_I2cSlaveDiaryBufferSize; ++i )
-        {
-            debugContent[ i ] = 0;
-            debugControl[ i ] = 0;
-            debugStatus[ i ] = 0;
-        }
-        debugPtr = 0;
-    }
-}
-
-
-
-void I2cSlave::dumpDebugI2cDiary()
-{
-    // Can't ATOMIC_BLOCK because need to use serial output, so temporarily pause I2C
-
-    pauseI2c();
-
-    debugSout->println( "I2C diary follows..." );
-    debugSout->println( "#, status, sent, sent, next" );
-    for ( uint8_t i = 0; i < debugPtr; ++i )
-    {
-        debugSout->print( i );
-        debugSout->print( ", " );
-        debugSout->print( debugStatus[ i ], kHex );
-        debugSout->print( ", " );
-        debugSout->print( debugContent[ i ] );
-        debugSout->print( ", " );
-        debugSout->print( static_cast<char>( debugContent[ i ] ) );
-        debugSout->print( ", " );
-        debugSout->println( debugControl[ i ] );
-    }
-    debugSout->println();
-
-    enableI2c();
-}
-
-
-
-void I2cSlave::setDebugSout( Serial0* s )
-{
-    debugSout = s;
-}
-
-#endif
 
@@ -43,6 +43,19 @@
  * file I2cSlave.h, each time it is included.  So you should define it using a compiler option
  * (e.g., \c -DI2C_SLAVE_BUFFER_SIZE=64) to ensure it is consistently defined throughout your project.
  *
+ * By default, the user-supplied function processI2cMessage() is called from the TWI interrupt, and the I2C
+ * bus is held (by clock stretching) while it runs.  Alternatively, defining the macro \c I2C_SLAVE_RX_QUEUE_DEPTH to
+ * a non-zero value (e.g., \c -DI2C_SLAVE_RX_QUEUE_DEPTH=2) enables deferred processing: the TWI interrupt places
+ * each received message in a queue of that many buffers and releases the bus immediately, and your main loop calls
+ * I2cSlave::poll(), which calls processI2cMessage() for each queued message.  Replies are staged in a separate
+ * transmit buffer that is swapped in the next time the Master reads.  Each queued buffer is \c I2C_SLAVE_BUFFER_SIZE
+ * bytes.  If the queue is full, further messages are not acknowledged.
+ *
+ * Many Slaves simply expose a set of registers to the Master.  For these, I2cSlave::setRegisterMap() provides a
+ * register-map mode in which the TWI interrupt itself implements the usual protocol (the first byte written by the
+ * Master sets the register pointer; subsequent bytes written or read access consecutive registers with
+ * auto-increment), without any message parsing by processI2cMessage().
+ *
  * This interface assumes your application will operator in I2C Slave mode as defined in the I2C protocol.
  * If you wish your application to operate in I2C Master mode, then instead include I2cMaster.h and link
  * against I2cMaster.cpp.
@@ -67,10 +80,6 @@
 
 #include <stdint.h>
 
-#ifdef DEBUG_I2cSlaveDiary
-#include "USART0.h"
-#endif
-
 
 
 #ifndef I2C_SLAVE_BUFFER_SIZE
@@ -81,6 +90,14 @@
 #error "I2C_SLAVE_BUFFER_SIZE exceeds size of a uint8_t"
 #endif
 
+#ifndef I2C_SLAVE_RX_QUEUE_DEPTH
+#define I2C_SLAVE_RX_QUEUE_DEPTH    0
+#endif
+
+#if I2C_SLAVE_RX_QUEUE_DEPTH > 128
+#error "I2C_SLAVE_RX_QUEUE_DEPTH exceeds 128"
+#endif
+
 
 
 
@@ -123,7 +140,8 @@ namespace I2cSlave
      *
      * \note This function is called at interrupt time, so the implementation must be kept short.  If any significant
      * work must be done as a result of the message received from the Master, this function should simply set a flag
-     * that can be detected by the main execution thread and have it do the heavy lifting.
+     * that can be detected by the main execution thread and have it do the heavy lifting.  (If \c I2C_SLAVE_RX_QUEUE_DEPTH
+     * is non-zero, this function is instead called from poll() in the main execution thread; see poll().)
      *
      * \arg \c buffer is both an input and output parameter.  On entrance to the function, it
      * contains the message received from the Master; on return from the function should contain
@@ -232,15 +250,61 @@ namespace I2cSlave
     bool busy();
 
 
-#ifdef DEBUG_I2cSlaveDiary
+    /*!
+    * \brief The type of the optional function called in register-map mode when the Master has written to registers.
+    *
+    * It is called from the TWI interrupt at the end of each message that wrote to one or more registers, so it must
+    * be kept short.
+    *
+    * \arg \c firstRegister the first register written by the message.
+    * \arg \c count the number of registers written (consecutive, with wrap-around, starting at \c firstRegister).
+    */
+    typedef void (*I2cRegisterWriteCallback)( uint8_t firstRegister, uint8_t count );
+
+
+    /*!
+     * \brief Switches the Slave into register-map mode, exposing an array of registers directly to the Master.
+     *
+     * In register-map mode the TWI interrupt handles each byte as it arrives.  The first byte of each write from the
+     * Master sets the register pointer; any further bytes in the same write are stored in consecutive registers.
+     * Reads from the Master return consecutive registers starting at the register pointer.  The register pointer
+     * auto-increments after every byte, wrapping around at the end of the register array, and persists between
+     * messages (so the usual "write register address, repeated start, read" sequence works).  Writes to read-only
+     * registers are ignored.
+     *
+     * processI2cMessage() is not called in register-map mode (but must still be defined; it can simply return 0).
+     *
+     * \arg \c registers the register array; it must remain valid while register-map mode is in use.  Pass null to
+     * leave register-map mode and return to normal message processing.
+     * \arg \c nbrRegisters the number of registers in the array.
+     * \arg \c readOnlyMask an optional bitmask (one bit per register, bit \c (n % 8) of byte \c (n / 8) for
+     * register \c n) in which set bits mark registers the Master cannot write; null (the default) means all
+     * registers are writable.
+     * \arg \c callback an optional function called (from the TWI interrupt) after the Master writes registers;
+     * null (the default) for none.
+     */
+    void setRegisterMap( uint8_t* registers, uint8_t nbrRegisters, const uint8_t* readOnlyMask = 0,
+                            I2cRegisterWriteCallback callback = 0 );
+
 
-    void setDebugSout( Serial0* s );
 
-    void clearDebugI2cDiary();
-    void dumpDebugI2cDiary();
+#if I2C_SLAVE_RX_QUEUE_DEPTH > 0
+
+    /*!
+     * \brief Processes the messages received from the Master since the last call, by calling processI2cMessage()
+     * for each one in turn.  This function is only available if \c I2C_SLAVE_RX_QUEUE_DEPTH is non-zero.
+     *
+     * Call this function regularly from your main loop.  Any reply returned by processI2cMessage() is staged and sent
+     * the next time the Master reads from this Slave; so a Master that writes a command and immediately
+     * reads the reply (e.g., with a repeated start) will get the previous reply unless it allows time for poll().
+     *
+     * \returns the number of messages processed.
+     */
+    uint8_t poll();
 
 #endif
 
+
 };
 
 
@@ -30,6 +30,10 @@
 #include <avr/interrupt.h>
 #include <util/atomic.h>
 
+#ifdef STACK_PAINTING
+#include "MemUtils.h"
+#endif
+
 
 
 
@@ -79,6 +83,11 @@ void initSystem()
 #endif
     }
 
+#ifdef STACK_PAINTING
+    // Paint the free memory so MemUtils can later report how deep the stack has grown
+    MemUtils::paintStack();
+#endif
+
     // Enable interrupts
     sei();
 }
@@ -44,6 +44,9 @@
  *
  * This function is generally called at the very beginning of \c main().
  *
+ * If the macro \c STACK_PAINTING is defined when InitSystem.cpp is compiled, this function also calls
+ * MemUtils::paintStack() (so you must link against MemUtils.cpp as well).
+ *
  */
 
 void initSystem();
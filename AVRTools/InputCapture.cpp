@@ -0,0 +1,218 @@
+/*
+    InputCapture.cpp - Functions to measure periods and pulse widths with the
+    input capture unit of a 16-bit timer, for AVR ATMega328p (Arduino Uno)
+    and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "InputCapture.h"
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "Profiler.h"
+#include "RingBufferT.h"
+
+
+
+// The bit positions in the control and interrupt registers are the same for all the 16-bit timers,
+// so the timer1 names are used throughout
+
+namespace
+{
+    RingBufferT< uint32_t, uint8_t, INPUT_CAPTURE_BUFFER_SIZE >     gCaptures;
+
+    // The upper 16 bits of the 32-bit extended count
+    volatile uint16_t   gOverflows;
+
+    volatile uint32_t   gLastEdge;
+    volatile uint16_t   gOverruns;
+
+    // Set after the first edge (until then there is nothing to take a difference with)
+    bool                gStarted;
+
+    // Set in the pulse width modes, which capture alternate edges
+    bool                gToggleEdges;
+
+    // The ICES1 bit of the edge that starts a measurement
+    uint8_t             gStartEdge;
+
+
+    // The extended count of the timer now.  Call with interrupts disabled.
+    uint32_t readExtended()
+    {
+        uint16_t ovf = gOverflows;
+        uint16_t t = INPUT_CAPTURE_TCNT;
+
+        // An overflow that happened before TCNT was read but hasn't been serviced yet
+        if ( ( INPUT_CAPTURE_TIFR & ( 1 << TOV1 ) ) && t < 0x8000 )
+        {
+            ++ovf;
+        }
+
+        return ( static_cast<uint32_t>( ovf ) << 16 ) | t;
+    }
+
+};
+
+
+
+
+ISR( INPUT_CAPTURE_CAPT_vect )
+{
+    PROFILE_PROBE( kProfileInputCapture );
+
+    uint16_t icr = INPUT_CAPTURE_ICR;
+    uint16_t ovf = gOverflows;
+
+    // The capture interrupt has priority over the overflow interrupt, so an overflow that
+    // came just before the edge may not have been counted yet
+    if ( ( INPUT_CAPTURE_TIFR & ( 1 << TOV1 ) ) && icr < 0x8000 )
+    {
+        ++ovf;
+    }
+
+    uint32_t edgeTime = ( static_cast<uint32_t>( ovf ) << 16 ) | icr;
+
+    uint8_t tccrb = INPUT_CAPTURE_TCCRB;
+    uint8_t edge = tccrb & ( 1 << ICES1 );
+    if ( gToggleEdges )
+    {
+        // Capture the opposite edge next; changing the edge can set the capture flag, so clear it (by writing a 1)
+        INPUT_CAPTURE_TCCRB = tccrb ^ ( 1 << ICES1 );
+        INPUT_CAPTURE_TIFR = ( 1 << ICF1 );
+    }
+
+    if ( gStarted && ( !gToggleEdges || edge != gStartEdge ) )
+    {
+        if ( gCaptures.push( edgeTime - gLastEdge ) )
+        {
+            ++gOverruns;
+        }
+    }
+
+    gLastEdge = edgeTime;
+    gStarted = true;
+}
+
+
+
+
+ISR( INPUT_CAPTURE_OVF_vect )
+{
+    ++gOverflows;
+}
+
+
+
+
+void initInputCapture( uint8_t mode, bool noiseCanceler )
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        // Normal mode (count to 0xFFFF and wrap), no outputs
+        INPUT_CAPTURE_TCCRB = 0;
+        INPUT_CAPTURE_TCCRA = 0;
+        INPUT_CAPTURE_TCNT = 0;
+
+        gCaptures.clear();
+        gOverflows = 0;
+        gLastEdge = 0;
+        gOverruns = 0;
+        gStarted = false;
+        gToggleEdges = ( mode == kCaptureHighWidth || mode == kCaptureLowWidth );
+        gStartEdge = ( mode == kCaptureRisingPeriod || mode == kCaptureHighWidth ) ? ( 1 << ICES1 ) : 0;
+
+        // Clear stale flags (by writing a 1) and enable the capture and overflow interrupts
+        INPUT_CAPTURE_TIFR = ( 1 << ICF1 ) | ( 1 << TOV1 );
+        INPUT_CAPTURE_TIMSK = ( 1 << ICIE1 ) | ( 1 << TOIE1 );
+
+        // Select the edge and noise canceler and start the timer
+        uint8_t tccrb = gStartEdge | ( noiseCanceler ? ( 1 << ICNC1 ) : 0 );
+#if INPUT_CAPTURE_PRESCALER == 1
+        tccrb |= ( 1 << CS10 );
+#elif INPUT_CAPTURE_PRESCALER == 8
+        tccrb |= ( 1 << CS11 );
+#else
+        tccrb |= ( 1 << CS11 ) | ( 1 << CS10 );
+#endif
+        INPUT_CAPTURE_TCCRB = tccrb;
+    }
+}
+
+
+
+
+void stopInputCapture()
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        INPUT_CAPTURE_TCCRB = 0;
+        INPUT_CAPTURE_TIMSK = 0;
+    }
+}
+
+
+
+
+bool inputCaptureAvailable()
+{
+    return gCaptures.isNotEmpty();
+}
+
+
+
+
+bool readInputCapture( uint32_t* ticks )
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( gCaptures.isEmpty() )
+        {
+            return false;
+        }
+        *ticks = gCaptures.pull();
+    }
+    return true;
+}
+
+
+
+
+uint16_t inputCaptureOverruns()
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        return gOverruns;
+    }
+}
+
+
+
+
+uint32_t ticksSinceLastInputCapture()
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        return readExtended() - gLastEdge;
+    }
+}
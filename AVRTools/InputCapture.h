@@ -0,0 +1,223 @@
+/*
+    InputCapture.h - Functions to measure periods and pulse widths with the
+    input capture unit of a 16-bit timer, for AVR ATMega328p (Arduino Uno)
+    and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief Include this file to measure the period or pulse width of a signal with the input capture unit
+ * of a 16-bit timer.
+ *
+ * Polling a pin against micros() has a resolution of 4 us and misses edges when the CPU is busy.  The input
+ * capture unit instead copies the timer count to the ICRn register in hardware at the moment of the edge, so
+ * the measurement jitter is a single timer tick however long the interrupt takes to respond.  The interrupt
+ * function extends the captured count to 32 bits with an overflow counter, takes the difference with the previous
+ * edge, and pushes it into a ring buffer (of \c INPUT_CAPTURE_BUFFER_SIZE measurements, default 16) for
+ * readInputCapture().  This suits RPM sensors, flow meters, and other pulse trains.
+ *
+ * The timer is selected at compile time by the macro \c INPUT_CAPTURE_TIMER and the prescaler by
+ * \c INPUT_CAPTURE_PRESCALER (1, 8, or 64; default 8, giving 0.5 us ticks and periods up to about 35 minutes at
+ * 16 MHz).  The signal must be connected to the input capture pin of the timer:
+ *
+ * Timer | Pin | Arduino pin
+ * :---: | :-: | :---------:
+ *   1   | ICP1 (PB0 on the ATmega328P) | Uno pin 8
+ *   4   | ICP4 (PL0, ATmega2560 only) | Mega pin 49
+ *   5   | ICP5 (PL1, ATmega2560 only) | Mega pin 48
+ *
+ * The default is timer1 on the ATmega328P and timer4 on the ATmega2560 (whose ICP1 pin is not brought out on the
+ * Arduino Mega).
+ *
+ * To use these functions, include InputCapture.h in your source code, link against InputCapture.cpp, set the
+ * input capture pin to input, and call initInputCapture().
+ *
+ * \note The input capture takes over the selected timer, so the timer cannot also be used for PWM, for the
+ * high-resolution clock (HighResClock.h), or for other purposes (for example, timer1 is used by
+ * startA2DAcquisition()).  Linking against InputCapture.cpp installs the capture and overflow interrupt functions
+ * of the timer.
+ */
+
+
+
+#ifndef InputCapture_h
+#define InputCapture_h
+
+#include <stdint.h>
+
+#include <avr/io.h>
+
+
+
+#ifndef INPUT_CAPTURE_TIMER
+#if defined(__AVR_ATmega2560__)
+#define INPUT_CAPTURE_TIMER         4
+#else
+#define INPUT_CAPTURE_TIMER         1
+#endif
+#endif
+
+#ifndef INPUT_CAPTURE_PRESCALER
+#define INPUT_CAPTURE_PRESCALER     8
+#endif
+
+#if INPUT_CAPTURE_PRESCALER != 1 && INPUT_CAPTURE_PRESCALER != 8 && INPUT_CAPTURE_PRESCALER != 64
+#error "INPUT_CAPTURE_PRESCALER must be 1, 8, or 64"
+#endif
+
+#ifndef INPUT_CAPTURE_BUFFER_SIZE
+#define INPUT_CAPTURE_BUFFER_SIZE   16
+#endif
+
+#if INPUT_CAPTURE_BUFFER_SIZE < 2 || INPUT_CAPTURE_BUFFER_SIZE > 255
+#error "INPUT_CAPTURE_BUFFER_SIZE must be between 2 and 255"
+#endif
+
+
+#if INPUT_CAPTURE_TIMER == 1
+
+#define INPUT_CAPTURE_TCCRA         TCCR1A
+#define INPUT_CAPTURE_TCCRB         TCCR1B
+#define INPUT_CAPTURE_TCNT          TCNT1
+#define INPUT_CAPTURE_ICR           ICR1
+#define INPUT_CAPTURE_TIMSK         TIMSK1
+#define INPUT_CAPTURE_TIFR          TIFR1
+#define INPUT_CAPTURE_CAPT_vect     TIMER1_CAPT_vect
+#define INPUT_CAPTURE_OVF_vect      TIMER1_OVF_vect
+
+#elif INPUT_CAPTURE_TIMER == 4 && defined(__AVR_ATmega2560__)
+
+#define INPUT_CAPTURE_TCCRA         TCCR4A
+#define INPUT_CAPTURE_TCCRB         TCCR4B
+#define INPUT_CAPTURE_TCNT          TCNT4
+#define INPUT_CAPTURE_ICR           ICR4
+#define INPUT_CAPTURE_TIMSK         TIMSK4
+#define INPUT_CAPTURE_TIFR          TIFR4
+#define INPUT_CAPTURE_CAPT_vect     TIMER4_CAPT_vect
+#define INPUT_CAPTURE_OVF_vect      TIMER4_OVF_vect
+
+#elif INPUT_CAPTURE_TIMER == 5 && defined(__AVR_ATmega2560__)
+
+#define INPUT_CAPTURE_TCCRA         TCCR5A
+#define INPUT_CAPTURE_TCCRB         TCCR5B
+#define INPUT_CAPTURE_TCNT          TCNT5
+#define INPUT_CAPTURE_ICR           ICR5
+#define INPUT_CAPTURE_TIMSK         TIMSK5
+#define INPUT_CAPTURE_TIFR          TIFR5
+#define INPUT_CAPTURE_CAPT_vect     TIMER5_CAPT_vect
+#define INPUT_CAPTURE_OVF_vect      TIMER5_OVF_vect
+
+#else
+
+#error "INPUT_CAPTURE_TIMER must be 1 (or 4 or 5 on the ATmega2560)"
+
+#endif
+
+
+/*!
+ * \brief The number of input capture ticks per second (use it to convert a period to a frequency).
+ *
+ * \hideinitializer
+ */
+
+#define inputCaptureTicksPerSecond()        ( F_CPU / INPUT_CAPTURE_PRESCALER )
+
+
+
+/*!
+ * \brief This enum lists what the input capture can measure.
+ */
+
+enum InputCaptureModes
+{
+    kCaptureRisingPeriod,       //!< The time between successive rising edges
+    kCaptureFallingPeriod,      //!< The time between successive falling edges
+    kCaptureHighWidth,          //!< The time from each rising edge to the next falling edge
+    kCaptureLowWidth            //!< The time from each falling edge to the next rising edge
+};
+
+
+
+/*!
+ * \brief Initialize the timer and start measuring.  Any measurements left in the buffer are discarded.
+ *
+ * \arg \c mode what to measure (one of the InputCaptureModes).
+ * \arg \c noiseCanceler if true, turn on the noise canceler of the input capture unit, which ignores an
+ * edge unless the new level lasts for 4 CPU cycles (delaying each capture by 4 cycles).
+ */
+
+void initInputCapture( uint8_t mode, bool noiseCanceler = false );
+
+
+
+/*!
+ * \brief Stop the timer and its interrupts.
+ */
+
+void stopInputCapture();
+
+
+
+/*!
+ * \brief Determine if there are measurements waiting in the buffer.
+ *
+ * \returns true if readInputCapture() will succeed.
+ */
+
+bool inputCaptureAvailable();
+
+
+
+/*!
+ * \brief Get the oldest measurement from the buffer.
+ *
+ * \arg \c ticks a pointer to where the measurement (in ticks; see inputCaptureTicksPerSecond()) is stored.
+ *
+ * \returns true if a measurement was available; false if the buffer was empty.
+ */
+
+bool readInputCapture( uint32_t* ticks );
+
+
+
+/*!
+ * \brief Get the number of measurements lost because the buffer was full (since initInputCapture()).
+ *
+ * \returns the number of measurements lost.
+ */
+
+uint16_t inputCaptureOverruns();
+
+
+
+/*!
+ * \brief Get the time elapsed since the last captured edge.  Since no measurement arrives when a signal stops,
+ * use this to detect a stopped signal (for example, to report zero RPM).
+ *
+ * \returns the number of ticks since the last edge, or since initInputCapture() if no edge was captured.
+ */
+
+uint32_t ticksSinceLastInputCapture();
+
+
+
+
+#endif
@@ -0,0 +1,123 @@
+/*
+    MemPool.cpp - Fixed-size block pools with constant-time allocation
+    and release, for AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "MemPool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <util/atomic.h>
+
+
+
+
+MemPool::MemPool( void* storage, size_t blockSize, uint8_t nbrBlocks )
+: mStorage( static_cast<uint8_t*>( storage ) ),
+mFreeList( 0 ),
+mBlockSize( blockSize < sizeof( FreeBlock ) ? sizeof( FreeBlock ) : blockSize ),
+mNbrBlocks( nbrBlocks ),
+mNbrNeverUsed( nbrBlocks ),
+mInUse( 0 ),
+mMaxInUse( 0 ),
+mFailures( 0 )
+{
+    // Blocks are carved from the storage the first time they are needed, so there's nothing else to do
+}
+
+
+
+
+void* MemPool::allocate()
+{
+    void* block;
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( mFreeList )
+        {
+            // Reuse a released block
+            block = mFreeList;
+            mFreeList = mFreeList->next;
+        }
+        else if ( mNbrNeverUsed )
+        {
+            // Take the next block never used
+            --mNbrNeverUsed;
+            block = mStorage + mBlockSize * ( mNbrBlocks - 1 - mNbrNeverUsed );
+        }
+        else
+        {
+            ++mFailures;
+            return 0;
+        }
+
+        if ( ++mInUse > mMaxInUse )
+        {
+            mMaxInUse = mInUse;
+        }
+    }
+
+    return block;
+}
+
+
+
+
+void MemPool::release( void* block )
+{
+    if ( !block )
+    {
+        return;
+    }
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        FreeBlock* b = static_cast<FreeBlock*>( block );
+        b->next = mFreeList;
+        mFreeList = b;
+        --mInUse;
+    }
+}
+
+
+
+
+uint8_t MemPool::blocksFree() const
+{
+    // A single byte read, so no need to block interrupts
+    return mNbrBlocks - mInUse;
+}
+
+
+
+
+void MemPool::getStatistics( MemPoolStatistics* stats ) const
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        stats->blockSize = mBlockSize;
+        stats->nbrBlocks = mNbrBlocks;
+        stats->blocksInUse = mInUse;
+        stats->maxBlocksInUse = mMaxInUse;
+        stats->failures = mFailures;
+    }
+}
@@ -0,0 +1,319 @@
+/*
+    MemPool.h - Fixed-size block pools with constant-time allocation
+    and release, for AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides pools of fixed-size memory blocks.
+ *
+ * A MemPool hands out blocks of a single size from storage set aside for it, in constant time and without
+ * ever fragmenting:  released blocks go onto the pool's own free list and are reused exactly.  This makes pools
+ * a good fit for long-running programs that repeatedly create and destroy objects of a few sizes, which over time
+ * fragments the general heap (MemUtils::getFreeListStats() shows this happening).  Pools can be used from
+ * interrupt functions.
+ *
+ * There are three ways to use pools:
+ * - Allocate raw blocks with MemPool::allocate() and MemPool::release(), or construct and destroy objects
+ * in a pool with poolNew() and poolDelete().
+ * - Derive a class from PoolAllocated, so that \c new and \c delete of that class use a pool of its own.
+ * - Compile new.cpp with the macro \c NEW_USES_MEMORY_POOLS defined, so that all small \c new requests are
+ * served from pools of 8, 16, and 32 byte blocks (see new.h).
+ *
+ * To use pools, include MemPool.h in your source code and link against MemPool.cpp.
+ */
+
+
+
+#ifndef MemPool_h
+#define MemPool_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "new.h"
+
+
+
+/*!
+ * \brief This struct reports the state of a MemPool.
+ */
+
+struct MemPoolStatistics
+{
+    uint16_t    blockSize;              //!< The size of each block (in bytes)
+    uint8_t     nbrBlocks;              //!< The number of blocks in the pool
+    uint8_t     blocksInUse;            //!< The number of blocks currently allocated
+    uint8_t     maxBlocksInUse;         //!< The largest number of blocks ever allocated at once
+    uint16_t    failures;               //!< The number of allocations that failed because the pool was empty
+};
+
+
+
+/*!
+ * \brief This class manages a pool of fixed-size blocks in storage supplied by the caller.
+ * Usually you use it through MemPoolT, which supplies the storage as well.
+ */
+
+class MemPool
+{
+
+public:
+
+    /*!
+     * \brief Constructor.  Nothing is written to the storage until blocks are allocated, so the constructor
+     * takes constant time however large the pool.
+     *
+     * \arg \c storage the memory for the blocks (at least \c blockSize * \c nbrBlocks bytes, or
+     * sizeof(void*) * \c nbrBlocks if larger).
+     * \arg \c blockSize the size of each block (blocks smaller than a pointer are enlarged to a pointer).
+     * \arg \c nbrBlocks the number of blocks.
+     */
+    MemPool( void* storage, size_t blockSize, uint8_t nbrBlocks );
+
+
+    /*!
+     * \brief Allocate a block.
+     *
+     * \returns a pointer to the block, or null if all blocks are in use.
+     */
+    void* allocate();
+
+
+    /*!
+     * \brief Return a block to the pool.
+     *
+     * \arg \c block a block previously returned by allocate() (null is ignored).
+     */
+    void release( void* block );
+
+
+    /*!
+     * \brief Determine if memory belongs to this pool.
+     *
+     * \arg \c ptr the memory to check.
+     *
+     * \returns true if \c ptr lies within the pool's storage.
+     */
+    bool owns( const void* ptr ) const
+    {
+        return reinterpret_cast<uintptr_t>( ptr ) >= reinterpret_cast<uintptr_t>( mStorage )
+            && reinterpret_cast<uintptr_t>( ptr ) < reinterpret_cast<uintptr_t>( mStorage + mBlockSize * mNbrBlocks );
+    }
+
+
+    /*!
+     * \brief Get the size of the blocks in the pool.
+     *
+     * \returns the size of each block (in bytes).
+     */
+    size_t blockSize() const
+    { return mBlockSize; }
+
+
+    /*!
+     * \brief Get the number of blocks available.
+     *
+     * \returns the number of blocks not allocated.
+     */
+    uint8_t blocksFree() const;
+
+
+    /*!
+     * \brief Get a consistent snapshot of the state of the pool.
+     *
+     * \arg \c stats a pointer to where the statistics will be copied.
+     */
+    void getStatistics( MemPoolStatistics* stats ) const;
+
+
+private:
+
+    struct FreeBlock
+    {
+        FreeBlock*  next;
+    };
+
+    uint8_t*    mStorage;
+    FreeBlock*  mFreeList;
+    uint16_t    mBlockSize;
+    uint8_t     mNbrBlocks;
+    uint8_t     mNbrNeverUsed;
+    uint8_t     mInUse;
+    uint8_t     mMaxInUse;
+    uint16_t    mFailures;
+};
+
+
+
+/*!
+ * \brief This template class is a MemPool that contains its own storage.
+ *
+ * \tparam BLOCK_SIZE the size of each block.
+ * \tparam NBR_BLOCKS the number of blocks (1 to 255).
+ */
+
+template< size_t BLOCK_SIZE, uint8_t NBR_BLOCKS > class MemPoolT : public MemPool
+{
+    static_assert( NBR_BLOCKS >= 1, "A MemPoolT needs at least one block" );
+
+public:
+
+    /*!
+     * \brief Constructor.
+     */
+    MemPoolT()
+    : MemPool( mBlocks, BLOCK_SIZE, NBR_BLOCKS )
+    {}
+
+
+private:
+
+    // MemPool doesn't touch this in its constructor, so it can be a member (constructed after the base)
+    uint8_t     mBlocks[ ( BLOCK_SIZE < sizeof( void* ) ? sizeof( void* ) : BLOCK_SIZE ) * NBR_BLOCKS ];
+};
+
+
+
+/*!
+ * \brief Construct an object in a block allocated from a pool.
+ *
+ * \arg \c pool the pool to use; its blocks must be large enough to hold a T.
+ * \arg \c args the arguments for the constructor of T.
+ *
+ * \returns a pointer to the new object, or null if the pool is empty (or its blocks too small).
+ */
+
+template< typename T, typename... ARGS > T* poolNew( MemPool& pool, ARGS&&... args )
+{
+    if ( sizeof( T ) > pool.blockSize() )
+    {
+        return 0;
+    }
+    void* block = pool.allocate();
+    return block ? ::new( block ) T( static_cast<ARGS&&>( args )... ) : 0;
+}
+
+
+
+/*!
+ * \brief Destroy an object created with poolNew() and return its block to the pool.
+ *
+ * \arg \c pool the pool the object came from.
+ * \arg \c obj the object to destroy (null is ignored).
+ */
+
+template< typename T > void poolDelete( MemPool& pool, T* obj )
+{
+    if ( obj )
+    {
+        obj->~T();
+        pool.release( obj );
+    }
+}
+
+
+
+/*!
+ * \brief Holder for the pool of a PoolAllocated class.  It is separate from PoolAllocated so that
+ * sizeof(T) isn't needed until T is complete.
+ */
+
+template< typename T, uint8_t NBR_BLOCKS > struct PoolAllocatedStorage
+{
+    static MemPoolT< sizeof( T ), NBR_BLOCKS > sPool;       //!< The pool for objects of class T
+};
+
+template< typename T, uint8_t NBR_BLOCKS > MemPoolT< sizeof( T ), NBR_BLOCKS > PoolAllocatedStorage< T, NBR_BLOCKS >::sPool;
+
+
+
+/*!
+ * \brief Deriving a class from this template gives it its own pool of NBR_BLOCKS objects, used by
+ * \c new and \c delete for that class.
+ *
+ * ~~~C
+ * class Message : public PoolAllocated< Message, 8 >
+ * {
+ *      ...
+ * };
+ *
+ * Message* m = new Message;        // Null if all 8 are in use (and then no constructor runs)
+ * ~~~
+ *
+ * The class \c operator \c new is declared \c throw(), which makes every \c new of the class behave like
+ * \c new \c (std::nothrow):  the compiler checks the pointer returned and only runs the constructor if it is
+ * not null, so always check the result of \c new.  Objects of derived classes of a different size fall back
+ * to the global \c new and \c delete.
+ *
+ * \tparam T the class being derived.
+ * \tparam NBR_BLOCKS the number of objects the pool can hold (1 to 255).
+ */
+
+template< typename T, uint8_t NBR_BLOCKS > class PoolAllocated
+{
+
+public:
+
+    /*!
+     * \brief Allocate memory for an object from the pool.
+     *
+     * \arg \c size the size of the object.
+     *
+     * \returns the memory, or null if the pool is empty (declared \c throw() so that a null return
+     * skips the constructor).
+     */
+    static void* operator new( size_t size ) throw()
+    {
+        return ( size == sizeof( T ) ) ? pool().allocate() : ::operator new( size );
+    }
+
+
+    /*!
+     * \brief Return the memory of an object to the pool.
+     *
+     * \arg \c ptr the memory to release.
+     */
+    static void operator delete( void* ptr ) throw()
+    {
+        if ( pool().owns( ptr ) )
+        {
+            pool().release( ptr );
+        }
+        else
+        {
+            ::operator delete( ptr );
+        }
+    }
+
+
+    /*!
+     * \brief Get the pool for this class (for example, to get its statistics).
+     *
+     * \returns the pool.
+     */
+    static MemPool& pool()
+    { return PoolAllocatedStorage< T, NBR_BLOCKS >::sPool; }
+};
+
+
+
+#endif
@@ -55,6 +55,37 @@ struct __freelist
 
 
 
+namespace
+{
+
+    const char  kStackPaint     = 0xC5;         // Unlikely in real stack contents (not 0x00, 0xFF, or a small number)
+
+    char*       gPaintStart;                    // The lowest address painted
+
+
+    char* deepestStackByte()
+    {
+        // The heap may have grown over the paint since; start above both
+        char* p = HEAP_TOP ? HEAP_TOP : HEAP_START;
+        if ( p < gPaintStart )
+        {
+            p = gPaintStart;
+        }
+
+        char* stack = STACK;
+        while ( p < stack && *p == kStackPaint )
+        {
+            ++p;
+        }
+
+        return p;
+    }
+
+};
+
+
+
+
 
 
 size_t MemUtils::memoryAvailableOnFreeList()
@@ -115,6 +146,43 @@ size_t MemUtils::getFreeListStats( int* nbrBlocks, size_t* sizeSmallestBlock, si
 
 
 
+int MemUtils::getFreeListHistogram( int* counts, uint8_t nbrBins )
+{
+    for ( uint8_t i = 0; i < nbrBins; ++i )
+    {
+        counts[i] = 0;
+    }
+
+    if ( !nbrBins )
+    {
+        return 0;
+    }
+
+    struct __freelist* current;
+    int nbr = 0;
+
+    for ( current = __flp; current; current = current->nx )
+    {
+        // Find the bin by halving the size until it drops below 4
+        size_t size = current->sz;
+        uint8_t bin = 0;
+        while ( size >= 4 && bin < nbrBins - 1 )
+        {
+            size >>= 1;
+            ++bin;
+        }
+
+        ++counts[ bin ];
+        ++nbr;
+    }
+
+    return nbr;
+}
+
+
+
+
+
 size_t MemUtils::freeSRAM()
 {
     size_t freeMemory;
@@ -168,3 +236,68 @@ void MemUtils::resetHeap()
     // This "forgets" any existing heap allocations
     __brkval = 0;
 }
+
+
+
+
+
+MemUtils::HeapMark MemUtils::markHeap()
+{
+    HeapMark mark;
+    mark.heapTop = __brkval;
+    mark.freeList = __flp;
+
+    // Hide the free list, so the batch allocates only above the current top of the heap
+    __flp = 0;
+
+    return mark;
+}
+
+
+
+
+
+void MemUtils::releaseHeapToMark( const HeapMark& mark )
+{
+    // Everything above the marked top, and the free list built since, is simply forgotten
+    __brkval = mark.heapTop;
+    __flp = static_cast<struct __freelist*>( mark.freeList );
+}
+
+
+
+
+
+void MemUtils::paintStack()
+{
+    char* p = HEAP_TOP ? HEAP_TOP : HEAP_START;
+    gPaintStart = p;
+
+    // Everything below the stack pointer is free (and this loop pushes nothing)
+    char* stack = STACK;
+    while ( p < stack )
+    {
+        *p++ = kStackPaint;
+    }
+}
+
+
+
+
+
+size_t MemUtils::maxStackUsed()
+{
+    return static_cast<size_t>( RAMEND + 1 - reinterpret_cast<size_t>( deepestStackByte() ) );
+}
+
+
+
+
+
+size_t MemUtils::minFreeMemoryBetweenHeapAndStack()
+{
+    char* heapTop = HEAP_TOP ? HEAP_TOP : HEAP_START;
+    char* deepest = deepestStackByte();
+
+    return ( deepest > heapTop ) ? deepest - heapTop : 0;
+}
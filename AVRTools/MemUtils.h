@@ -37,6 +37,12 @@
 #define MemUtils_h
 
 #include <stddef.h>
+#include <stdint.h>
+
+
+
+struct MemPoolStatistics;
+
 
 /*!
  * \brief A namespace providing encapsulation for functions that report the available memory in SRAM
@@ -87,6 +93,92 @@ namespace MemUtils
 
 
 
+    /*!
+     * \brief The state of the heap saved by markHeap() and restored by releaseHeapToMark().
+     */
+
+    struct HeapMark
+    {
+        char*   heapTop;                //!< The top of the heap when marked
+        void*   freeList;               //!< The head of the free list when marked
+    };
+
+
+
+    /*!
+     * \brief Mark the current state of the heap, to begin a batch of allocations that will all be released
+     * together by releaseHeapToMark().
+     *
+     * The free list is set aside until the release, so allocations made during the batch are all carved
+     * contiguously from above the top of the heap; releasing them leaves no fragments behind.
+     *
+     * \note During the batch, don't free memory allocated before the mark (it will be lost until resetHeap());
+     * the batch's own memory may be freed and reused.  Marks may be nested, provided they are released in
+     * reverse order.
+     *
+     * \returns The mark to pass to releaseHeapToMark().
+     *
+     */
+
+    HeapMark markHeap();
+
+
+
+    /*!
+     * \brief Release every allocation made since markHeap(), in constant time, restoring the heap (and its free
+     * list) exactly as it was when marked.
+     *
+     * \note Any pointers to memory allocated since the mark are invalid afterwards.
+     *
+     * \arg \c mark the mark returned by markHeap().
+     *
+     */
+
+    void releaseHeapToMark( const HeapMark& mark );
+
+
+
+    /*!
+     * \brief A scoped heap arena:  it marks the heap when constructed and releases back to the mark when
+     * destroyed, so that everything allocated during its lifetime is released together.
+     *
+     * ~~~C
+     * {
+     *      MemUtils::HeapArena arena;
+     *      char* scratch = static_cast<char*>( malloc( 200 ) );
+     *      ...
+     * }    // scratch (and anything else allocated in the block) released here
+     * ~~~
+     */
+
+    class HeapArena
+    {
+
+    public:
+
+        /*!
+         * \brief Constructor.  Marks the heap.
+         */
+        HeapArena()
+        : mMark( markHeap() )
+        {}
+
+        /*!
+         * \brief Destructor.  Releases everything allocated since construction.
+         */
+        ~HeapArena()
+        { releaseHeapToMark( mMark ); }
+
+    private:
+
+        HeapMark    mMark;
+
+        HeapArena( const HeapArena& );
+        HeapArena& operator=( const HeapArena& );
+    };
+
+
+
     /*!
      * \brief Get the free memory on the heap free-list.
      *
@@ -123,6 +215,90 @@ namespace MemUtils
 
     size_t getFreeListStats( int* nbrBlocks, size_t* sizeSmallestBlock, size_t* sizeLargestBlock );
 
+
+
+    /*!
+     * \brief Get a histogram of the sizes of the blocks on the heap free-list.
+     *
+     * Bin 0 counts blocks of 2 or 3 bytes, bin 1 blocks of 4 to 7 bytes, bin 2 blocks of 8 to 15 bytes, and
+     * so on, each bin doubling in size; the last bin also counts all blocks larger still.  Many blocks
+     * in the low bins, and few in the high ones, means the heap is fragmented.
+     *
+     * \arg \c counts returns the number of blocks in each bin.
+     * \arg \c nbrBins the number of bins in \c counts (for example, 8).
+     *
+     * \returns The total number of blocks on the free-list.
+     *
+     */
+
+    int getFreeListHistogram( int* counts, uint8_t nbrBins );
+
+
+
+    /*!
+     * \brief Get information about the block pools used by \c new when new.cpp is compiled with
+     * \c NEW_USES_MEMORY_POOLS defined (see new.h).
+     *
+     * \note This function is provided by new.cpp, and only exists if new.cpp is compiled with
+     * \c NEW_USES_MEMORY_POOLS defined.
+     *
+     * \arg \c sizeClass the pool:  0 for 8 byte blocks, 1 for 16 byte blocks, 2 for 32 byte blocks.
+     * \arg \c stats returns the statistics of the pool (see MemPoolStatistics in MemPool.h).
+     *
+     * \returns true if \c sizeClass is valid, false otherwise.
+     *
+     */
+
+    bool getNewPoolStats( uint8_t sizeClass, MemPoolStatistics* stats );
+
+
+
+    /*!
+     * \brief Paint the unused memory between the heap and the stack with a known pattern, so that
+     * maxStackUsed() and minFreeMemoryBetweenHeapAndStack() can later find how deep the stack has ever grown.
+     *
+     * If the macro \c STACK_PAINTING is defined when InitSystem.cpp is compiled, initSystem() calls this
+     * function (and you must then link against MemUtils.cpp).  You can also call it yourself at any time to
+     * restart the measurement from the current stack depth.  It takes about 6 clock cycles per free byte.
+     *
+     */
+
+    void paintStack();
+
+
+
+    /*!
+     * \brief Get the deepest the stack has ever been since paintStack() was called, including any nested
+     * interrupt functions.
+     *
+     * This scans the painted memory for the lowest byte the stack has overwritten, so it takes time
+     * proportional to the memory never used.
+     *
+     * \note The result is only meaningful if paintStack() has been called.
+     *
+     * \returns The largest number of bytes of SRAM the stack has ever occupied.
+     *
+     */
+
+    size_t maxStackUsed();
+
+
+
+    /*!
+     * \brief Get the smallest the free memory between the heap and the stack has ever been since
+     * paintStack() was called.
+     *
+     * This is the memory that neither the stack nor the heap has touched, which could safely be given
+     * to larger buffers instead (less a safety margin, since a rare deep call chain may not have happened yet).
+     *
+     * \note The result is only meaningful if paintStack() has been called.
+     *
+     * \returns The number of bytes between the top of the heap and the deepest point the stack has reached.
+     *
+     */
+
+    size_t minFreeMemoryBetweenHeapAndStack();
+
 };
 
 #endif
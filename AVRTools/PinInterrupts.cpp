@@ -0,0 +1,322 @@
+/*
+    PinInterrupts.cpp - Functions to attach callbacks to the external and pin change
+    interrupts of AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "PinInterrupts.h"
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "Profiler.h"
+
+#ifdef PIN_INTERRUPT_TIMESTAMPS
+#include "SystemClock.h"
+#endif
+
+
+
+
+namespace
+{
+    PinInterruptCallback    gExternalCallbacks[ kNbrExternalInterrupts ];
+    uint8_t                 gExternalEdges[ kNbrExternalInterrupts ];
+
+    PinInterruptCallback    gPinChangeCallbacks[ kNbrPinChangeInterrupts ];
+
+    // Per bank of 8 pins:  the levels seen by the last interrupt, and the pins attached for each edge
+    uint8_t                 gLastLevels[ 3 ];
+    uint8_t                 gRisingEdges[ 3 ];
+    uint8_t                 gFallingEdges[ 3 ];
+
+
+
+    inline unsigned long timestamp()
+    {
+#ifdef PIN_INTERRUPT_TIMESTAMPS
+        return micros();
+#else
+        return 0;
+#endif
+    }
+
+
+    inline bool validEdges( uint8_t edges )
+    {
+        return edges && !( edges & ~kPinEdgeBoth );
+    }
+
+
+    // With a constant argument (as in the interrupt functions) this reduces to a single bit test
+    inline bool readExternalPin( uint8_t intNbr )
+    {
+#if defined(__AVR_ATmega328P__)
+        // INT0 and INT1 are PD2 and PD3
+        return PIND & ( 1 << ( intNbr + 2 ) );
+#else
+        // INT0 to INT3 are PD0 to PD3, INT4 to INT7 are PE4 to PE7
+        return ( intNbr < 4 ) ? ( PIND & ( 1 << intNbr ) ) : ( PINE & ( 1 << intNbr ) );
+#endif
+    }
+
+
+    inline uint8_t readBank( uint8_t bank )
+    {
+        switch ( bank )
+        {
+            case 0:
+                return PINB;
+
+            case 1:
+#if defined(__AVR_ATmega328P__)
+                return PINC;
+#else
+                // PCINT8 is PE0, PCINT9 to PCINT15 are PJ0 to PJ6
+                return ( PINE & 0x01 ) | ( PINJ << 1 );
+#endif
+
+            default:
+#if defined(__AVR_ATmega328P__)
+                return PIND;
+#else
+                return PINK;
+#endif
+        }
+    }
+
+
+    volatile uint8_t& pinChangeMask( uint8_t bank )
+    {
+        return ( bank == 0 ) ? PCMSK0 : ( bank == 1 ) ? PCMSK1 : PCMSK2;
+    }
+
+
+    inline void dispatchExternal( uint8_t intNbr )
+    {
+        unsigned long t = timestamp();
+        uint8_t edges = gExternalEdges[ intNbr ];
+
+        // The hardware only interrupts on the edges asked for, so unless it's both the level is known
+        bool level = ( edges == kPinEdgeBoth ) ? readExternalPin( intNbr ) : ( edges == kPinEdgeRising );
+
+        gExternalCallbacks[ intNbr ]( level, t );
+    }
+
+
+    inline void dispatchPinChange( uint8_t bank, uint8_t levels )
+    {
+        unsigned long t = timestamp();
+
+        uint8_t changed = levels ^ gLastLevels[ bank ];
+        gLastLevels[ bank ] = levels;
+
+        // Only the attached pins have edge bits, so this also masks out the pins nobody is watching
+        uint8_t fire = changed & ( ( levels & gRisingEdges[ bank ] ) | ( ~levels & gFallingEdges[ bank ] ) );
+
+        PinInterruptCallback* callback = gPinChangeCallbacks + 8 * bank;
+        for ( uint8_t bit = 1; fire; bit <<= 1, ++callback )
+        {
+            if ( fire & bit )
+            {
+                fire &= ~bit;
+                (*callback)( levels & bit, t );
+            }
+        }
+    }
+
+};
+
+
+
+
+#define _defineExternalIsr( n )                                                     \
+    ISR( INT##n##_vect )                                                            \
+    {                                                                               \
+        PROFILE_PROBE( kProfilePinInterrupts );                                     \
+        dispatchExternal( n );                                                      \
+    }
+
+_defineExternalIsr( 0 )
+_defineExternalIsr( 1 )
+
+#if defined(__AVR_ATmega2560__)
+_defineExternalIsr( 2 )
+_defineExternalIsr( 3 )
+_defineExternalIsr( 4 )
+_defineExternalIsr( 5 )
+_defineExternalIsr( 6 )
+_defineExternalIsr( 7 )
+#endif
+
+#undef _defineExternalIsr
+
+
+
+#define _definePinChangeIsr( n )                                                    \
+    ISR( PCINT##n##_vect )                                                          \
+    {                                                                               \
+        PROFILE_PROBE( kProfilePinInterrupts );                                     \
+        dispatchPinChange( n, readBank( n ) );                                      \
+    }
+
+_definePinChangeIsr( 0 )
+_definePinChangeIsr( 1 )
+_definePinChangeIsr( 2 )
+
+#undef _definePinChangeIsr
+
+
+
+
+int attachExternalInterrupt( uint8_t intNbr, PinInterruptCallback callback, uint8_t edges )
+{
+    if ( intNbr >= kNbrExternalInterrupts )
+    {
+        return kPinIntErrBadNumber;
+    }
+
+    if ( !validEdges( edges ) )
+    {
+        return kPinIntErrBadEdges;
+    }
+
+    // ISCn1:0 is 1 for any change, 2 for a falling edge, 3 for a rising edge
+    uint8_t sense = ( edges == kPinEdgeBoth ) ? 1 : ( ( edges == kPinEdgeFalling ) ? 2 : 3 );
+    uint8_t shift = 2 * ( intNbr & 0x03 );
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        // Changing the sense control can raise the interrupt flag, so disable the interrupt first
+        EIMSK &= ~( 1 << intNbr );
+
+        gExternalCallbacks[ intNbr ] = callback;
+        gExternalEdges[ intNbr ] = edges;
+
+#if defined(EICRB)
+        volatile uint8_t& eicr = ( intNbr < 4 ) ? EICRA : EICRB;
+#else
+        volatile uint8_t& eicr = EICRA;
+#endif
+        eicr = ( eicr & ~( 0x03 << shift ) ) | ( sense << shift );
+
+        // Clear a stale flag (by writing a 1) and enable the interrupt
+        EIFR = ( 1 << intNbr );
+        EIMSK |= ( 1 << intNbr );
+    }
+
+    return 0;
+}
+
+
+
+
+void detachExternalInterrupt( uint8_t intNbr )
+{
+    if ( intNbr < kNbrExternalInterrupts )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            EIMSK &= ~( 1 << intNbr );
+            gExternalCallbacks[ intNbr ] = 0;
+        }
+    }
+}
+
+
+
+
+int attachPinChangeInterrupt( uint8_t pcintNbr, PinInterruptCallback callback, uint8_t edges )
+{
+    if ( pcintNbr >= kNbrPinChangeInterrupts )
+    {
+        return kPinIntErrBadNumber;
+    }
+
+    if ( !validEdges( edges ) )
+    {
+        return kPinIntErrBadEdges;
+    }
+
+    uint8_t bank = pcintNbr >> 3;
+    uint8_t bit = 1 << ( pcintNbr & 0x07 );
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        gPinChangeCallbacks[ pcintNbr ] = callback;
+
+        // Start from the current level of this pin, so an earlier change doesn't look like an edge
+        // (but leave the other pins alone, so their pending changes are still seen)
+        gLastLevels[ bank ] = ( gLastLevels[ bank ] & ~bit ) | ( readBank( bank ) & bit );
+
+        if ( edges & kPinEdgeRising )
+        {
+            gRisingEdges[ bank ] |= bit;
+        }
+        else
+        {
+            gRisingEdges[ bank ] &= ~bit;
+        }
+
+        if ( edges & kPinEdgeFalling )
+        {
+            gFallingEdges[ bank ] |= bit;
+        }
+        else
+        {
+            gFallingEdges[ bank ] &= ~bit;
+        }
+
+        pinChangeMask( bank ) |= bit;
+        PCICR |= ( 1 << ( PCIE0 + bank ) );
+    }
+
+    return 0;
+}
+
+
+
+
+void detachPinChangeInterrupt( uint8_t pcintNbr )
+{
+    if ( pcintNbr >= kNbrPinChangeInterrupts )
+    {
+        return;
+    }
+
+    uint8_t bank = pcintNbr >> 3;
+    uint8_t bit = 1 << ( pcintNbr & 0x07 );
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        gRisingEdges[ bank ] &= ~bit;
+        gFallingEdges[ bank ] &= ~bit;
+        gPinChangeCallbacks[ pcintNbr ] = 0;
+
+        volatile uint8_t& mask = pinChangeMask( bank );
+        mask &= ~bit;
+        if ( !mask )
+        {
+            PCICR &= ~( 1 << ( PCIE0 + bank ) );
+        }
+    }
+}
@@ -0,0 +1,161 @@
+/*
+    PinInterrupts.h - Functions to attach callbacks to the external and pin change
+    interrupts of AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides functions that attach a callback to an individual pin, called from the external
+ * interrupt (INTn) or pin change interrupt (PCINTn) of that pin.
+ *
+ * External interrupts are identified by their number (0 and 1 on the ATmega328P, 0 to 7 on the ATmega2560)
+ * and pin change interrupts by their PCINT number (0 to 23); the comments in ArduinoUnoPins.h and
+ * ArduinoMegaPins.h give the INT and PCINT numbers of each Arduino pin.  Each callback only runs for the
+ * edges it was attached for (rising, falling, or both).
+ *
+ * The hardware raises a single pin change interrupt for a bank of 8 pins.  The interrupt function finds the pins
+ * that changed with one XOR of the port against its last value, masked by the pins attached, and filters the
+ * changes by edge with two ANDs, so pins that didn't change (or changed on an edge nobody asked for) cost
+ * nothing.  Callbacks run inside the interrupt function, so they should be short; they receive the level
+ * of the pin after the edge.
+ *
+ * If the macro \c PIN_INTERRUPT_TIMESTAMPS is defined when PinInterrupts.cpp is compiled, each interrupt function
+ * reads micros() once on entry and passes the value to the callbacks it calls (otherwise they receive 0).  This
+ * makes it easy to measure the period of an encoder or tachometer without reading the clock in each callback.
+ *
+ * To use these functions, include PinInterrupts.h in your source code and link against PinInterrupts.cpp (and
+ * SystemClock.cpp if \c PIN_INTERRUPT_TIMESTAMPS is defined).  The pins must be set to input, as usual.
+ *
+ * \note Linking against PinInterrupts.cpp installs interrupt functions for all the external and pin change
+ * interrupts, so you cannot also define your own.  The guards Interrupts::ExternalOff and
+ * Interrupts::PinChangeOff in InterruptUtils.h work as usual with the interrupts managed here.
+ */
+
+
+
+#ifndef PinInterrupts_h
+#define PinInterrupts_h
+
+#include <stdint.h>
+
+#include <avr/io.h>
+
+
+
+/*!
+ * \brief This enum lists the edges a callback can be attached for.
+ */
+
+enum PinInterruptEdges
+{
+    kPinEdgeRising      = 0x01,                                 //!< Call on a rising edge (low to high)
+    kPinEdgeFalling     = 0x02,                                 //!< Call on a falling edge (high to low)
+    kPinEdgeBoth        = ( kPinEdgeRising | kPinEdgeFalling )  //!< Call on every change
+};
+
+
+
+/*!
+ * \brief This enum lists the error codes returned by the functions that attach callbacks.
+ */
+
+enum PinInterruptErrors
+{
+    kPinIntErrBadNumber     = -1,           //!< There is no interrupt with the number given
+    kPinIntErrBadEdges      = -2            //!< The edges given are not one of the PinInterruptEdges
+};
+
+
+
+/*!
+ * \brief The type of a callback.
+ *
+ * \arg \c level the level of the pin after the edge (true if high).
+ * \arg \c timestamp the value of micros() when the interrupt function started, if \c PIN_INTERRUPT_TIMESTAMPS
+ * is defined; otherwise 0.
+ */
+
+typedef void (*PinInterruptCallback)( bool level, unsigned long timestamp );
+
+
+
+#if defined(__AVR_ATmega328P__)
+#define kNbrExternalInterrupts      2
+#elif defined(__AVR_ATmega2560__)
+#define kNbrExternalInterrupts      8
+#else
+#error "Undefined AVR processor type"
+#endif
+
+#define kNbrPinChangeInterrupts     24
+
+
+
+/*!
+ * \brief Attach a callback to an external interrupt and enable the interrupt.
+ *
+ * \arg \c intNbr the number of the external interrupt (0 to 1 on the ATmega328P, 0 to 7 on the ATmega2560).
+ * \arg \c callback the function to call (not null).
+ * \arg \c edges the edges to call it for (one of the PinInterruptEdges).
+ *
+ * \returns 0 on success, or one of the PinInterruptErrors.
+ */
+
+int attachExternalInterrupt( uint8_t intNbr, PinInterruptCallback callback, uint8_t edges );
+
+
+
+/*!
+ * \brief Disable an external interrupt and detach its callback.
+ *
+ * \arg \c intNbr the number of the external interrupt.
+ */
+
+void detachExternalInterrupt( uint8_t intNbr );
+
+
+
+/*!
+ * \brief Attach a callback to a pin change interrupt and enable the interrupt.
+ *
+ * \arg \c pcintNbr the PCINT number of the pin (0 to 23).
+ * \arg \c callback the function to call (not null).
+ * \arg \c edges the edges to call it for (one of the PinInterruptEdges).
+ *
+ * \returns 0 on success, or one of the PinInterruptErrors.
+ */
+
+int attachPinChangeInterrupt( uint8_t pcintNbr, PinInterruptCallback callback, uint8_t edges );
+
+
+
+/*!
+ * \brief Disable a pin change interrupt and detach its callback.  When the last pin of a bank is detached,
+ * the pin change interrupt of the bank is disabled.
+ *
+ * \arg \c pcintNbr the PCINT number of the pin.
+ */
+
+void detachPinChangeInterrupt( uint8_t pcintNbr );
+
+
+
+#endif
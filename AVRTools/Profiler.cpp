@@ -0,0 +1,232 @@
+/*
+    Profiler.cpp - Compile-time optional probes that measure how long
+    interrupt functions (or any other code) take to run.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "Profiler.h"
+
+#ifdef ISR_PROFILING
+
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "HighResClock.h"
+#include "RingBufferT.h"
+#include "Writer.h"
+
+
+
+namespace
+{
+
+    struct ProfileSample
+    {
+        uint8_t     probe;
+        uint16_t    duration;
+    };
+
+    struct ProfileTotals
+    {
+        uint32_t    count;
+        uint32_t    totalTicks;
+        uint16_t    minTicks;
+        uint16_t    maxTicks;
+    };
+
+
+    RingBufferT< ProfileSample, uint16_t, PROFILER_BUFFER_SIZE >    gProfileSamples;
+
+    ProfileTotals       gProfileTotals[ kProfileNbrProbes ];
+    volatile uint16_t   gProfileDropped;
+    uint64_t            gProfileStartTicks;
+
+
+    // The probe names, in PROGMEM so they don't take up RAM
+    const PROGMEM char sNameI2cMaster[]      = "I2cMaster";
+    const PROGMEM char sNameI2cSlave[]       = "I2cSlave";
+    const PROGMEM char sNameUsart0Rx[]       = "USART0 RX";
+    const PROGMEM char sNameUsart0Udre[]     = "USART0 UDRE";
+    const PROGMEM char sNameUsart1Rx[]       = "USART1 RX";
+    const PROGMEM char sNameUsart1Udre[]     = "USART1 UDRE";
+    const PROGMEM char sNameUsart2Rx[]       = "USART2 RX";
+    const PROGMEM char sNameUsart2Udre[]     = "USART2 UDRE";
+    const PROGMEM char sNameUsart3Rx[]       = "USART3 RX";
+    const PROGMEM char sNameUsart3Udre[]     = "USART3 UDRE";
+    const PROGMEM char sNameSystemClock[]    = "SystemClock";
+    const PROGMEM char sNameA2D[]            = "A2D";
+    const PROGMEM char sNamePinInterrupts[]  = "Pin interrupts";
+    const PROGMEM char sNameInputCapture[]   = "Input capture";
+    const PROGMEM char sNameUser0[]          = "User0";
+    const PROGMEM char sNameUser1[]          = "User1";
+    const PROGMEM char sNameUser2[]          = "User2";
+    const PROGMEM char sNameUser3[]          = "User3";
+
+    const char* const   kProbeNames[ kProfileNbrProbes ] PROGMEM =
+    {
+        sNameI2cMaster,
+        sNameI2cSlave,
+        sNameUsart0Rx,
+        sNameUsart0Udre,
+        sNameUsart1Rx,
+        sNameUsart1Udre,
+        sNameUsart2Rx,
+        sNameUsart2Udre,
+        sNameUsart3Rx,
+        sNameUsart3Udre,
+        sNameSystemClock,
+        sNameA2D,
+        sNamePinInterrupts,
+        sNameInputCapture,
+        sNameUser0,
+        sNameUser1,
+        sNameUser2,
+        sNameUser3
+    };
+
+
+    void printProbeName( Writer& out, uint8_t probe )
+    {
+        const char* name = reinterpret_cast<const char*>( pgm_read_word( &kProbeNames[ probe ] ) );
+
+        char c;
+        while ( ( c = pgm_read_byte( name++ ) ) )
+        {
+            out.print( c );
+        }
+    }
+
+};
+
+
+
+
+void recordProfileSample( uint8_t probe, uint16_t start, uint16_t end )
+{
+    ProfileSample s;
+    s.probe = probe;
+    s.duration = end - start;
+
+    if ( gProfileSamples.push( s ) )
+    {
+        // Probes can nest (an interrupt can interrupt a probed function), so update the count atomically
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            ++gProfileDropped;
+        }
+    }
+}
+
+
+
+
+void collectProfileSamples()
+{
+    while ( gProfileSamples.isNotEmpty() )
+    {
+        ProfileSample s = gProfileSamples.pull();
+
+        if ( s.probe < kProfileNbrProbes )
+        {
+            ProfileTotals* t = &gProfileTotals[ s.probe ];
+
+            if ( !t->count || s.duration < t->minTicks )
+            {
+                t->minTicks = s.duration;
+            }
+            if ( s.duration > t->maxTicks )
+            {
+                t->maxTicks = s.duration;
+            }
+            t->totalTicks += s.duration;
+            ++t->count;
+        }
+    }
+}
+
+
+
+
+void printProfileReport( Writer& out )
+{
+    collectProfileSamples();
+
+    uint64_t elapsedTicks = highResTicks64() - gProfileStartTicks;
+    uint32_t elapsedMs = elapsedTicks * highResClockCyclesPerTick() / ( F_CPU / 1000L );
+
+    uint16_t dropped;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        dropped = gProfileDropped;
+    }
+
+    out.print( "Profile over " );
+    out.print( elapsedMs );
+    out.print( " ms; cycles min/avg/max; dropped " );
+    out.println( dropped );
+
+    for ( uint8_t i = 0; i < kProfileNbrProbes; ++i )
+    {
+        ProfileTotals* t = &gProfileTotals[i];
+
+        if ( t->count )
+        {
+            printProbeName( out, i );
+            out.print( ": " );
+            out.print( t->count );
+            out.print( " calls, " );
+            out.print( elapsedMs ? static_cast<uint32_t>( t->count * 1000ULL / elapsedMs ) : 0UL );
+            out.print( "/s, " );
+            out.print( static_cast<uint32_t>( t->minTicks ) * highResClockCyclesPerTick() );
+            out.print( '/' );
+            out.print( t->totalTicks / t->count * highResClockCyclesPerTick() );
+            out.print( '/' );
+            out.println( static_cast<uint32_t>( t->maxTicks ) * highResClockCyclesPerTick() );
+        }
+    }
+}
+
+
+
+
+void resetProfileStatistics()
+{
+    gProfileSamples.clear();
+
+    for ( uint8_t i = 0; i < kProfileNbrProbes; ++i )
+    {
+        gProfileTotals[i].count = 0;
+        gProfileTotals[i].totalTicks = 0;
+        gProfileTotals[i].minTicks = 0;
+        gProfileTotals[i].maxTicks = 0;
+    }
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        gProfileDropped = 0;
+    }
+
+    gProfileStartTicks = highResTicks64();
+}
+
+
+#endif
@@ -0,0 +1,205 @@
+/*
+    Profiler.h - Compile-time optional probes that measure how long
+    interrupt functions (or any other code) take to run.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides probes that measure the duration and frequency of interrupt functions.
+ *
+ * If the macro \c ISR_PROFILING is defined when the library is compiled, the interrupt functions of I2cMaster,
+ * I2cSlave, the USART modules, SystemClock, Analog2Digital, PinInterrupts, and InputCapture each start with a
+ * probe.  A probe takes a timestamp when the interrupt function starts and another when it exits, and pushes a
+ * record into a ring buffer (a RingBufferT of \c PROFILER_BUFFER_SIZE records, default 32).  From the main loop, call
+ * collectProfileSamples() often enough to keep the ring buffer from filling, and call printProfileReport()
+ * to print the number of calls, the calls per second, and the minimum, average, and maximum durations of each probe.
+ *
+ * If \c ISR_PROFILING is not defined, the probes compile to nothing, so they cost nothing.  Like
+ * \c USART_COLLECT_STATISTICS, the macro must be defined the same way for the library and your code.
+ *
+ * Timestamps come from the high-resolution clock (HighResClock.h), so when profiling you must also link against
+ * HighResClock.cpp and call initHighResClock().  Durations are reported in CPU clock cycles; each probe adds
+ * a few dozen cycles to the code it measures.
+ *
+ * You can put probes in your own code with PROFILE_PROBE( kProfileUser0 ) (through kProfileUser3) at the start
+ * of a block; the probe measures until the end of the block.
+ */
+
+
+
+#ifndef Profiler_h
+#define Profiler_h
+
+#include <stdint.h>
+
+
+
+#ifndef PROFILER_BUFFER_SIZE
+#define PROFILER_BUFFER_SIZE        32
+#endif
+
+#if PROFILER_BUFFER_SIZE < 2 || PROFILER_BUFFER_SIZE > 255
+#error "PROFILER_BUFFER_SIZE must be between 2 and 255"
+#endif
+
+
+
+/*!
+ * \brief This enum lists the probes.  The library places the first ones in its interrupt functions; the
+ * kProfileUserN probes are available for your own code.
+ */
+
+enum ProfileProbes
+{
+    kProfileI2cMaster,          //!< The TWI interrupt function of I2cMaster
+    kProfileI2cSlave,           //!< The TWI interrupt function of I2cSlave
+    kProfileUsart0Rx,           //!< The receive interrupt function of %USART0
+    kProfileUsart0Udre,         //!< The data register empty interrupt function of %USART0
+    kProfileUsart1Rx,           //!< The receive interrupt function of %USART1 (ATmega2560 only)
+    kProfileUsart1Udre,         //!< The data register empty interrupt function of %USART1 (ATmega2560 only)
+    kProfileUsart2Rx,           //!< The receive interrupt function of %USART2 (ATmega2560 only)
+    kProfileUsart2Udre,         //!< The data register empty interrupt function of %USART2 (ATmega2560 only)
+    kProfileUsart3Rx,           //!< The receive interrupt function of %USART3 (ATmega2560 only)
+    kProfileUsart3Udre,         //!< The data register empty interrupt function of %USART3 (ATmega2560 only)
+    kProfileSystemClock,        //!< The timer0 overflow interrupt function of SystemClock
+    kProfileA2D,                //!< The ADC interrupt function of Analog2Digital
+    kProfilePinInterrupts,      //!< The external and pin change interrupt functions of PinInterrupts
+    kProfileInputCapture,       //!< The capture interrupt function of InputCapture
+    kProfileUser0,              //!< Available for your code
+    kProfileUser1,              //!< Available for your code
+    kProfileUser2,              //!< Available for your code
+    kProfileUser3,              //!< Available for your code
+
+    kProfileNbrProbes           //!< The number of probes (not a probe)
+};
+
+
+
+#ifdef ISR_PROFILING
+
+#include "HighResClock.h"
+
+class Writer;
+
+
+
+/*!
+ * \brief Record one execution of a probe.  You don't normally call this directly; use PROFILE_PROBE().
+ *
+ * \arg \c probe the probe (one of ProfileProbes).
+ * \arg \c start the timestamp (in high-resolution clock ticks) when the probed code started.
+ * \arg \c end the timestamp when the probed code finished.
+ */
+
+void recordProfileSample( uint8_t probe, uint16_t start, uint16_t end );
+
+
+
+/*!
+ * \brief This class implements a probe:  it takes a timestamp when it is constructed and records a sample when
+ * it is destroyed, so it measures the rest of the enclosing block, whichever way the block exits.
+ */
+
+class ProfileProbe
+{
+public:
+
+    /*!
+     * \brief Start timing.
+     *
+     * \arg \c probe the probe (one of ProfileProbes).
+     */
+
+    ProfileProbe( uint8_t probe )
+    : mStart( highResTicks() ), mProbe( probe )
+    {}
+
+
+    /*!
+     * \brief Stop timing and record the sample.
+     */
+
+    ~ProfileProbe()
+    {
+        recordProfileSample( mProbe, mStart, highResTicks() );
+    }
+
+private:
+
+    uint16_t    mStart;
+    uint8_t     mProbe;
+};
+
+
+
+/*!
+ * \brief Move the samples recorded by the probes from the ring buffer into the totals reported by
+ * printProfileReport().  Call this from the main loop often enough to keep the ring buffer from filling;
+ * samples recorded while the ring buffer is full are counted as dropped.
+ */
+
+void collectProfileSamples();
+
+
+
+/*!
+ * \brief Print a report of every probe that has recorded samples:  the number of calls, the calls per
+ * second, and the minimum, average, and maximum durations in CPU cycles.  This calls collectProfileSamples()
+ * first.
+ *
+ * \arg \c out where to print the report (for example, Serial0).
+ */
+
+void printProfileReport( Writer& out );
+
+
+
+/*!
+ * \brief Clear the totals and restart the time base used to compute calls per second.
+ */
+
+void resetProfileStatistics();
+
+
+
+/*!
+ * \def PROFILE_PROBE( probe )
+ *
+ * \brief Place a probe that measures from this point to the end of the enclosing block.  When
+ * \c ISR_PROFILING is not defined, this expands to nothing.
+ *
+ * \arg \c probe the probe (one of ProfileProbes).
+ *
+ * \hideinitializer
+ */
+
+#define PROFILE_PROBE( probe )      ProfileProbe profileProbe_( probe )
+
+#else
+
+#define PROFILE_PROBE( probe )
+
+#endif
+
+
+
+#endif
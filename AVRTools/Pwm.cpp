@@ -31,6 +31,93 @@
 
 
 
+namespace
+{
+    // The CSn2:0 values of the PwmPrescalers for the timers other than timer2 (which lack 32 and 128);
+    // for timer2 the value is simply the PwmPrescaler plus 1
+    const uint8_t kClockSelect[] = { 1, 2, 3, 3, 4, 4, 5 };
+
+    // The WGMn3:0 values of the PwmModes for the 16-bit timers
+    const uint8_t kWgm16Bit[] = { 1, 5, 2, 6, 3, 7, 10, 14 };
+
+    // The prescalers of the 16-bit timers, in the order of their CSn2:0 values (starting at 1)
+    const uint16_t kDivisors[] = { 1, 8, 64, 256, 1024 };
+
+
+
+    uint8_t clockSelect( uint8_t prescaler )
+    {
+        return kClockSelect[ ( prescaler > kPwmPrescaler1024 ) ? kPwmPrescaler1024 : prescaler ];
+    }
+
+
+    uint8_t clockSelectTimer2( uint8_t prescaler )
+    {
+        return ( ( prescaler > kPwmPrescaler1024 ) ? kPwmPrescaler1024 : prescaler ) + 1;
+    }
+
+
+    // Call with the timer cleared
+    void init8BitTimer( volatile uint8_t& tccra, volatile uint8_t& tccrb, uint8_t mode, uint8_t cs )
+    {
+        // Modes 1 (phase correct) and 3 (fast), both with TOP 0xFF; the WGMn1:0 bits are the same for both timers
+        tccra |= ( mode & 0x01 ) ? ( ( 1 << WGM00 ) | ( 1 << WGM01 ) ) : ( 1 << WGM00 );
+        tccrb |= cs;
+    }
+
+
+    // Call with the timer cleared; the bit positions are the same for all the 16-bit timers
+    void init16BitTimer( volatile uint8_t& tccra, volatile uint8_t& tccrb, uint8_t mode, uint8_t cs )
+    {
+        uint8_t wgm = kWgm16Bit[ ( mode > kPwmFastIcr ) ? kPwmPhaseCorrect8Bit : mode ];
+
+        // WGMn1:0 are in TCCRnA, WGMn3:2 in TCCRnB; setting the clock select last starts the timer
+        tccra |= ( wgm & 0x03 );
+        tccrb |= ( ( wgm & 0x0C ) << ( WGM12 - 2 ) ) | cs;
+    }
+
+
+    // Call with the timer cleared
+    uint16_t init16BitTimerFrequency( volatile uint8_t& tccra, volatile uint8_t& tccrb, volatile uint16_t& icr,
+                                      uint32_t hz, bool fast )
+    {
+        if ( !hz )
+        {
+            return 0;
+        }
+
+        for ( uint8_t i = 0; i < sizeof( kDivisors ) / sizeof( kDivisors[0] ); ++i )
+        {
+            // Fast PWM runs at F_CPU / ( N * ( TOP + 1 ) ), phase-correct PWM at F_CPU / ( 2 * N * TOP )
+            uint32_t counts = F_CPU / ( ( fast ? 1UL : 2UL ) * kDivisors[i] * hz );
+            uint32_t top = fast ? counts - 1 : counts;
+
+            if ( counts <= 3 )
+            {
+                // Too fast (and a larger prescaler would only make it worse)
+                return 0;
+            }
+
+            if ( top <= 0xFFFF )
+            {
+                ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+                {
+                    icr = top;
+                }
+                init16BitTimer( tccra, tccrb, fast ? kPwmFastIcr : kPwmPhaseCorrectIcr, i + 1 );
+                return top;
+            }
+        }
+
+        // Too slow even with the largest prescaler
+        return 0;
+    }
+
+};
+
+
+
+
 void clearTimer0()
 {
     // Clear Timer0
@@ -40,15 +127,12 @@ void clearTimer0()
 }
 
 
-void initPwmTimer0()
+void initPwmTimer0( uint8_t mode, uint8_t prescaler )
 {
     clearTimer0();
 
-    // Set Timer1 prescale factor to 64
-    TCCR0B |= ( 1 << CS01 ) | ( 1 << CS00 );
-
-    // Put Timer1 in 8-bit phase correct pwm mode
-    TCCR0A |= ( 1 << WGM00 );
+    // Put Timer0 in the 8-bit pwm mode of the selected kind, and set its prescale factor
+    init8BitTimer( TCCR0A, TCCR0B, mode, clockSelect( prescaler ) );
 }
 
 
@@ -64,15 +148,21 @@ void clearTimer1()
 }
 
 
-void initPwmTimer1()
+void initPwmTimer1( uint8_t mode, uint8_t prescaler )
 {
     clearTimer1();
 
-    // Set Timer1 prescale factor to 64
-    TCCR1B |= ( 1 << CS11 ) | ( 1 << CS10 );
+    // Put Timer1 in the selected pwm mode, and set its prescale factor
+    init16BitTimer( TCCR1A, TCCR1B, mode, clockSelect( prescaler ) );
+}
+
+
+uint16_t initPwmTimer1Frequency( uint32_t hz, bool fast )
+{
+    clearTimer1();
 
-    // Put Timer1 in 8-bit phase correct pwm mode
-    TCCR1A |= ( 1 << WGM10 );
+    // Put Timer1 in a pwm mode with TOP = ICR1, with the prescale factor and TOP for the frequency
+    return init16BitTimerFrequency( TCCR1A, TCCR1B, ICR1, hz, fast );
 }
 
 
@@ -88,15 +178,12 @@ void clearTimer2()
 }
 
 
-void initPwmTimer2()
+void initPwmTimer2( uint8_t mode, uint8_t prescaler )
 {
     clearTimer2();
 
-    // Set Timer2 prescale factor to 64
-    TCCR2B |= ( 1 << CS22 );
-
-    // Put Timer2 in 8-bit phase correct pwm mode
-    TCCR2A |= ( 1 << WGM20 );
+    // Put Timer2 in the 8-bit pwm mode of the selected kind, and set its prescale factor
+    init8BitTimer( TCCR2A, TCCR2B, mode, clockSelectTimer2( prescaler ) );
 }
 
 
@@ -114,15 +201,21 @@ void clearTimer3()
 }
 
 
-void initPwmTimer3()
+void initPwmTimer3( uint8_t mode, uint8_t prescaler )
 {
     clearTimer3();
 
-    // Set Timer3 prescale factor to 64
-    TCCR3B |= ( 1 << CS31 ) | ( 1 << CS30 );
+    // Put Timer3 in the selected pwm mode, and set its prescale factor
+    init16BitTimer( TCCR3A, TCCR3B, mode, clockSelect( prescaler ) );
+}
+
 
-    // Put Timer3 in 8-bit phase correct pwm mode
-    TCCR3A |= ( 1 << WGM30 );
+uint16_t initPwmTimer3Frequency( uint32_t hz, bool fast )
+{
+    clearTimer3();
+
+    // Put Timer3 in a pwm mode with TOP = ICR3, with the prescale factor and TOP for the frequency
+    return init16BitTimerFrequency( TCCR3A, TCCR3B, ICR3, hz, fast );
 }
 
 
@@ -140,15 +233,21 @@ void clearTimer4()
 }
 
 
-void initPwmTimer4()
+void initPwmTimer4( uint8_t mode, uint8_t prescaler )
 {
     clearTimer4();
 
-    // Set Timer4 prescale factor to 64
-    TCCR4B |= ( 1 << CS41 ) | ( 1 << CS40 );
+    // Put Timer4 in the selected pwm mode, and set its prescale factor
+    init16BitTimer( TCCR4A, TCCR4B, mode, clockSelect( prescaler ) );
+}
+
+
+uint16_t initPwmTimer4Frequency( uint32_t hz, bool fast )
+{
+    clearTimer4();
 
-    // Put Timer4 in 8-bit phase correct pwm mode
-    TCCR4A |= ( 1 << WGM40 );
+    // Put Timer4 in a pwm mode with TOP = ICR4, with the prescale factor and TOP for the frequency
+    return init16BitTimerFrequency( TCCR4A, TCCR4B, ICR4, hz, fast );
 }
 
 
@@ -165,15 +264,21 @@ void clearTimer5()
 }
 
 
-void initPwmTimer5()
+void initPwmTimer5( uint8_t mode, uint8_t prescaler )
 {
     clearTimer5();
 
-    // Set Timer5 prescale factor to 64
-    TCCR5B |= ( 1 << CS51 ) | ( 1 << CS50 );
+    // Put Timer5 in the selected pwm mode, and set its prescale factor
+    init16BitTimer( TCCR5A, TCCR5B, mode, clockSelect( prescaler ) );
+}
+
+
+uint16_t initPwmTimer5Frequency( uint32_t hz, bool fast )
+{
+    clearTimer5();
 
-    // Put Timer5 in 8-bit phase correct pwm mode
-    TCCR5A |= ( 1 << WGM50 );
+    // Put Timer5 in a pwm mode with TOP = ICR5, with the prescale factor and TOP for the frequency
+    return init16BitTimerFrequency( TCCR5A, TCCR5B, ICR5, hz, fast );
 }
 
 
@@ -63,6 +63,13 @@
  *    45          |      PL4      |   timer5
  *    46          |      PL3      |   timer5
  *
+ * By default the initPwmTimerN() functions set 8-bit phase-correct PWM with a prescaler of 64, which gives about
+ * 490 Hz at 16 MHz.  They also take a mode and a prescaler (see PwmModes and PwmPrescalers):  fast PWM doubles
+ * the frequency for the same resolution, and the 16-bit timers (1, and 3, 4, and 5 on the ATmega2560) also offer
+ * 9- and 10-bit resolution and a TOP set by the ICRn register.  For the 16-bit timers, initPwmTimerNFrequency()
+ * picks the prescaler and TOP for a given frequency, with as fine a resolution as the frequency allows.
+ * writeGpioPinPwm() takes duty cycles from 0 to the TOP of the timer's mode (255, 511, 1023, or ICRn).
+ *
  * \note Timer0 is also used by the system clock.  \e Do \e not \e initialize \e or \e clear \e timer0
  * if you are also using the system clock function from SystemClock.h.  If you are using
  * the system clock function, you can use timer0-based PWM functions \e without having
@@ -85,6 +92,85 @@
 
 
 
+
+/*!
+ * \brief This enum lists the PWM modes the initPwmTimerN() functions can set.  The 9-bit, 10-bit, and ICRn modes
+ * are only available on the 16-bit timers (timer1, and timer3, timer4, and timer5 on the ATmega2560); the 8-bit
+ * timers use the 8-bit mode of the same kind instead.
+ *
+ * Phase-correct modes count up and down, giving symmetric pulses at half the frequency of the fast
+ * modes, which count up only.
+ */
+
+enum PwmModes
+{
+    kPwmPhaseCorrect8Bit,       //!< Phase-correct PWM with a TOP of 255 (the default)
+    kPwmFast8Bit,               //!< Fast PWM with a TOP of 255
+    kPwmPhaseCorrect9Bit,       //!< Phase-correct PWM with a TOP of 511 (16-bit timers only)
+    kPwmFast9Bit,               //!< Fast PWM with a TOP of 511 (16-bit timers only)
+    kPwmPhaseCorrect10Bit,      //!< Phase-correct PWM with a TOP of 1023 (16-bit timers only)
+    kPwmFast10Bit,              //!< Fast PWM with a TOP of 1023 (16-bit timers only)
+    kPwmPhaseCorrectIcr,        //!< Phase-correct PWM with the TOP set by the ICRn register (16-bit timers only)
+    kPwmFastIcr                 //!< Fast PWM with the TOP set by the ICRn register (16-bit timers only)
+};
+
+
+
+/*!
+ * \brief This enum lists the prescalers the initPwmTimerN() functions can set.  The prescalers of 32 and 128
+ * are only available on timer2; the other timers use the next larger prescaler instead.
+ *
+ * The PWM frequency is F_CPU / ( prescaler * ( TOP + 1 ) ) in the fast modes and
+ * F_CPU / ( 2 * prescaler * TOP ) in the phase-correct modes.
+ */
+
+enum PwmPrescalers
+{
+    kPwmPrescaler1,             //!< Count at the CPU clock
+    kPwmPrescaler8,             //!< Count at the CPU clock / 8
+    kPwmPrescaler32,            //!< Count at the CPU clock / 32 (timer2 only)
+    kPwmPrescaler64,            //!< Count at the CPU clock / 64 (the default)
+    kPwmPrescaler128,           //!< Count at the CPU clock / 128 (timer2 only)
+    kPwmPrescaler256,           //!< Count at the CPU clock / 256
+    kPwmPrescaler1024           //!< Count at the CPU clock / 1024
+};
+
+
+
+/*!
+ * \brief Get the TOP of the PWM mode a timer is in, which is the duty cycle value for fully on.
+ * You don't normally need to call this; writeGpioPinPwm() uses it.
+ *
+ * \arg \c tccra a pointer to the TCCRnA register of the timer.
+ *
+ * \returns the TOP of the timer's PWM mode (255 for the 8-bit timers).
+ */
+
+inline uint16_t getPwmTimerTop( volatile uint8_t* tccra )
+{
+    if ( tccra == &TCCR0A || tccra == &TCCR2A )
+    {
+        return 255;
+    }
+
+    // On all the 16-bit timers TCCRnB follows TCCRnA, ICRn is 6 bytes after it, and OCRnA 8 bytes after it
+    uint8_t wgm = ( tccra[0] & 0x03 ) | ( ( tccra[1] >> 1 ) & 0x0C );
+    if ( wgm & 0x08 )
+    {
+        // Modes 9, 11, and 15 have TOP in OCRnA; the others in ICRn
+        return *reinterpret_cast<volatile uint16_t*>( tccra + ( ( wgm & 0x01 ) ? 8 : 6 ) );
+    }
+    else if ( wgm & 0x03 )
+    {
+        // The 8-, 9-, and 10-bit modes
+        return ( 0x80 << ( wgm & 0x03 ) ) - 1;
+    }
+    return 255;
+}
+
+
+
+
 #define _writeGpioPinPwm( ddr, port, pin, nbr, chl, ocr, com, tccr, value )                 \
                                         do                                                  \
                                         {                                                   \
@@ -93,7 +179,7 @@
                                                 tccr &= ~(1<<com);                          \
                                                 port &= ~(1<<nbr);                          \
                                             }                                               \
-                                            else if ( value >= 255 )                        \
+                                            else if ( value >= getPwmTimerTop( &tccr ) )    \
                                             {                                               \
                                                 tccr &= ~(1<<com);                          \
                                                 port |= (1<<nbr);                           \
@@ -123,7 +209,8 @@
  *
  * \arg \c pinName a pin name macro generated by GpioPinPwm().
  *
- * \arg \c value a value between 0 and 255.
+ * \arg \c value a value between 0 and the TOP of the timer's PWM mode (255 unless the timer was initialized
+ * in a 9-bit, 10-bit, or ICRn mode).
  *
  * \warning Timer0 is also used by the system clock.  \e Do \e not \e initialize \e or \e clear \e timer0
  * if you are also using the system clock function from SystemClock.h.  If you are using
@@ -157,7 +244,8 @@
  *
  * \arg \c pinVar a pin variable that has PWM capabilities (i.e., initialized with makeGpioVarFromGpioPinPwm()).
  *
- * \arg \c value a value between 0 and 255.
+ * \arg \c value a value between 0 and the TOP of the timer's PWM mode (255 unless the timer was initialized
+ * in a 9-bit, 10-bit, or ICRn mode).
  *
  * \warning Timer0 is also used by the system clock.  \e Do \e not \e initialize \e or \e clear \e timer0
  * if you are also using the system clock function from SystemClock.h.  If you are using
@@ -173,7 +261,7 @@
  *
  */
 
-inline void writeGpioPinPwmV( const GpioPinVariable& pinVar, uint8_t value )
+inline void writeGpioPinPwmV( const GpioPinVariable& pinVar, uint16_t value )
 {
     if ( value == 0 )
     {
@@ -181,7 +269,7 @@ inline void writeGpioPinPwmV( const GpioPinVariable& pinVar, uint8_t value )
         *(pinVar.port()) &= ~( 1 << pinVar.bitNbr() );
 
     }
-    else if ( value == 255 )
+    else if ( value >= getPwmTimerTop( pinVar.tccr() ) )
     {
         *(pinVar.tccr()) &= ~( 1 << pinVar.com() );
         *(pinVar.port()) |= ( 1 << pinVar.bitNbr() );
@@ -202,8 +290,8 @@ inline void writeGpioPinPwmV( const GpioPinVariable& pinVar, uint8_t value )
 /*!
  * \brief Initialize timer0 for PWM.
  *
- * This function sets timer0 for phase-correct PWM mode.  You must call
- * this function or initSystemClock() before calling writePinPwm() on a
+ * This function sets timer0 for PWM, by default in 8-bit phase-correct mode with a prescaler of 64.
+ * You must call this function or initSystemClock() before calling writePinPwm() on a
  * PWM pin associated with timer0.
  *
  * The PWM pins supported by timer0 are:
@@ -224,39 +312,66 @@ inline void writeGpioPinPwmV( const GpioPinVariable& pinVar, uint8_t value )
  *
  * \note To turn off PWM on pins associated with timer0 while also using the system clock, write a
  * zero to the pin by calling writePinPwm( pinName, 0 ).
+ *
+ * \arg \c mode the PWM mode (one of the PwmModes); the default is kPwmPhaseCorrect8Bit.
+ * \arg \c prescaler the prescaler (one of the PwmPrescalers); the default is kPwmPrescaler64.
  */
 
-void initPwmTimer0();
+void initPwmTimer0( uint8_t mode = kPwmPhaseCorrect8Bit, uint8_t prescaler = kPwmPrescaler64 );
 
 
 /*!
  * \brief Initialize timer1 for PWM.
  *
- * This function sets timer1 for phase-correct PWM mode.  You must call
- * this function before calling writePinPwm() on a PWM pin associated
+ * This function sets timer1 for PWM, by default in 8-bit phase-correct mode with a prescaler of 64.
+ * You must call this function before calling writePinPwm() on a PWM pin associated
  * with timer1.
  *
  * The PWM pins supported by timer1 are:
  * - Arduino Uno (ATmega328):   pin 9 (PB1), pin 10 (PB2)
  * - Arduino Mega (ATmega2560):  pin 11 (PB5), pin 12 (PB6)
+ *
+ * \arg \c mode the PWM mode (one of the PwmModes); the default is kPwmPhaseCorrect8Bit.
+ * \arg \c prescaler the prescaler (one of the PwmPrescalers); the default is kPwmPrescaler64.
+ */
+
+void initPwmTimer1( uint8_t mode = kPwmPhaseCorrect8Bit, uint8_t prescaler = kPwmPrescaler64 );
+
+
+
+/*!
+ * \brief Initialize timer1 for PWM at a given frequency.
+ *
+ * This function picks the smallest prescaler that can reach the frequency and puts timer1 in a mode with
+ * its TOP set by ICR1 (kPwmFastIcr or kPwmPhaseCorrectIcr), so the duty cycle has as fine a resolution as
+ * the frequency allows.  The value returned is the duty cycle for fully on in writeGpioPinPwm().
+ *
+ * \arg \c hz the PWM frequency (in Hz).
+ * \arg \c fast if true, use fast PWM; if false (the default), use phase-correct PWM.
+ *
+ * \returns the TOP of the PWM mode, or 0 if the frequency cannot be reached with at least 2 bits of
+ * resolution (the timer is then left cleared).
  */
 
-void initPwmTimer1();
+uint16_t initPwmTimer1Frequency( uint32_t hz, bool fast = false );
 
 
 /*!
  * \brief Initialize timer2 for PWM.
  *
- * This function sets timer2 for phase-correct PWM mode.  You must call
- * this function before calling writePinPwm() on a PWM pin associated
+ * This function sets timer2 for PWM, by default in 8-bit phase-correct mode with a prescaler of 64.
+ * You must call this function before calling writePinPwm() on a PWM pin associated
  * with timer2.
  *
  * The PWM pins supported by timer2 are:
  * - Arduino Uno (ATmega328):   pin 3 (PD3), pin 11 (PB3)
  * - Arduino Mega (ATmega2560):  pin 9 (PH6), pin 10 (PB4)
+ *
+ * \arg \c mode the PWM mode (one of the PwmModes); the default is kPwmPhaseCorrect8Bit.
+ * \arg \c prescaler the prescaler (one of the PwmPrescalers); the default is kPwmPrescaler64.
  */
 
-void initPwmTimer2();
+void initPwmTimer2( uint8_t mode = kPwmPhaseCorrect8Bit, uint8_t prescaler = kPwmPrescaler64 );
 
 
 /*!
@@ -302,50 +417,119 @@ void clearTimer2();
 /*!
  * \brief Initialize timer3 for PWM.
  *
- * This function sets timer3 for phase-correct PWM mode.  You must call
- * this function before calling writePinPwm() on a PWM pin associated
+ * This function sets timer3 for PWM, by default in 8-bit phase-correct mode with a prescaler of 64.
+ * You must call this function before calling writePinPwm() on a PWM pin associated
  * with timer3.
  *
  * The PWM pins supported by timer3 are:
  * - Arduino Mega (ATmega2560):  pin 2 (PE4), pin 3 (PE5)
  *
  * \note This function is only available on Arduino Mega (ATmega2560).
+ *
+ * \arg \c mode the PWM mode (one of the PwmModes); the default is kPwmPhaseCorrect8Bit.
+ * \arg \c prescaler the prescaler (one of the PwmPrescalers); the default is kPwmPrescaler64.
  */
 
-void initPwmTimer3();
+void initPwmTimer3( uint8_t mode = kPwmPhaseCorrect8Bit, uint8_t prescaler = kPwmPrescaler64 );
+
+
+
+/*!
+ * \brief Initialize timer3 for PWM at a given frequency.
+ *
+ * This function picks the smallest prescaler that can reach the frequency and puts timer3 in a mode with
+ * its TOP set by ICR3 (kPwmFastIcr or kPwmPhaseCorrectIcr), so the duty cycle has as fine a resolution as
+ * the frequency allows.  The value returned is the duty cycle for fully on in writeGpioPinPwm().
+ *
+ * \arg \c hz the PWM frequency (in Hz).
+ * \arg \c fast if true, use fast PWM; if false (the default), use phase-correct PWM.
+ *
+ * \returns the TOP of the PWM mode, or 0 if the frequency cannot be reached with at least 2 bits of
+ * resolution (the timer is then left cleared).
+ *
+ * \note This function is only available on Arduino Mega (ATmega2560).
+ */
+
+uint16_t initPwmTimer3Frequency( uint32_t hz, bool fast = false );
 
 
 /*!
  * \brief Initialize timer4 for PWM.
  *
- * This function sets timer4 for phase-correct PWM mode.  You must call
- * this function before calling writePinPwm() on a PWM pin associated
+ * This function sets timer4 for PWM, by default in 8-bit phase-correct mode with a prescaler of 64.
+ * You must call this function before calling writePinPwm() on a PWM pin associated
  * with timer4.
  *
  * The PWM pins supported by timer4 are:
  * - Arduino Mega (ATmega2560):  pin 6 (PH3), pin 7 (PH4), pin 8 (PH5)
  *
  * \note This function is only available on Arduino Mega (ATmega2560).
+ *
+ * \arg \c mode the PWM mode (one of the PwmModes); the default is kPwmPhaseCorrect8Bit.
+ * \arg \c prescaler the prescaler (one of the PwmPrescalers); the default is kPwmPrescaler64.
+ */
+
+void initPwmTimer4( uint8_t mode = kPwmPhaseCorrect8Bit, uint8_t prescaler = kPwmPrescaler64 );
+
+
+
+/*!
+ * \brief Initialize timer4 for PWM at a given frequency.
+ *
+ * This function picks the smallest prescaler that can reach the frequency and puts timer4 in a mode with
+ * its TOP set by ICR4 (kPwmFastIcr or kPwmPhaseCorrectIcr), so the duty cycle has as fine a resolution as
+ * the frequency allows.  The value returned is the duty cycle for fully on in writeGpioPinPwm().
+ *
+ * \arg \c hz the PWM frequency (in Hz).
+ * \arg \c fast if true, use fast PWM; if false (the default), use phase-correct PWM.
+ *
+ * \returns the TOP of the PWM mode, or 0 if the frequency cannot be reached with at least 2 bits of
+ * resolution (the timer is then left cleared).
+ *
+ * \note This function is only available on Arduino Mega (ATmega2560).
  */
 
-void initPwmTimer4();
+uint16_t initPwmTimer4Frequency( uint32_t hz, bool fast = false );
 
 
 
 /*!
  * \brief Initialize timer5 for PWM.
  *
- * This function sets timer5 for phase-correct PWM mode.  You must call
- * this function before calling writePinPwm() on a PWM pin associated
+ * This function sets timer5 for PWM, by default in 8-bit phase-correct mode with a prescaler of 64.
+ * You must call this function before calling writePinPwm() on a PWM pin associated
  * with timer5.
  *
  * The PWM pins supported by timer5 are:
  * - Arduino Mega (ATmega2560):  pin 44 (PL5), pin 45 (PL4), pin 46 (PL3)
  *
  * \note This function is only available on Arduino Mega (ATmega2560).
+ *
+ * \arg \c mode the PWM mode (one of the PwmModes); the default is kPwmPhaseCorrect8Bit.
+ * \arg \c prescaler the prescaler (one of the PwmPrescalers); the default is kPwmPrescaler64.
+ */
+
+void initPwmTimer5( uint8_t mode = kPwmPhaseCorrect8Bit, uint8_t prescaler = kPwmPrescaler64 );
+
+
+
+/*!
+ * \brief Initialize timer5 for PWM at a given frequency.
+ *
+ * This function picks the smallest prescaler that can reach the frequency and puts timer5 in a mode with
+ * its TOP set by ICR5 (kPwmFastIcr or kPwmPhaseCorrectIcr), so the duty cycle has as fine a resolution as
+ * the frequency allows.  The value returned is the duty cycle for fully on in writeGpioPinPwm().
+ *
+ * \arg \c hz the PWM frequency (in Hz).
+ * \arg \c fast if true, use fast PWM; if false (the default), use phase-correct PWM.
+ *
+ * \returns the TOP of the PWM mode, or 0 if the frequency cannot be reached with at least 2 bits of
+ * resolution (the timer is then left cleared).
+ *
+ * \note This function is only available on Arduino Mega (ATmega2560).
  */
 
-void initPwmTimer5();
+uint16_t initPwmTimer5Frequency( uint32_t hz, bool fast = false );
 
 
 
@@ -39,8 +39,6 @@
 #define DEFAULT_READER_TIMEOUT      1000        // milliseconds
 #endif
 
-#define NO_SKIP_CHAR  1     // Magic char not found in a valid ASCII numeric field
-
 
 
 
@@ -74,6 +72,25 @@ Reader::Reader()
 }
 
 
+
+
+size_t Reader::readAvailable( uint8_t* buffer, size_t length )
+{
+    size_t count = 0;
+    while ( count < length && available() )
+    {
+        int c = read();
+        if ( c < 0 )
+        {
+            break;
+        }
+        *buffer++ = static_cast<uint8_t>( c );
+        ++count;
+    }
+    return count;
+}
+
+
 int Reader::timedRead()
 {
 #ifndef USE_READER_WITHOUT_SYSTEM_CLOCK
@@ -126,27 +143,32 @@ int Reader::timedPeek()
 
 
 
-int Reader::peekNextDigit()
+bool Reader::timedParse( NumberParser& parser )
 {
     while ( 1 )
     {
         int c = timedPeek();
         if ( c < 0 )
         {
-            // timeout
-            return c;
+            // Time out; succeed if we got at least one digit
+            return parser.finish() == kParseDone;
         }
-        if ( c == '-' )
+
+        ParseStatus status = parser.feed( c );
+        if ( status == kParseNeedMore )
         {
-            return c;
+            // Consume the character we got with peek
+            read();
         }
-        if ( c >= '0' && c <= '9' )
+        else
         {
-            return c;
+            if ( status == kParseDone && c == SERIAL_INPUT_EOL )
+            {
+                // Consume the character we got with peek
+                read();
+            }
+            return status == kParseDone;
         }
-
-        // discard non-numeric
-        read();
     }
 }
 
@@ -162,44 +184,21 @@ bool Reader::findUntil( const char *tgt, const char *term )
 
 bool Reader::findUntil( const char *target, size_t targetLen, const char *terminator, size_t termLen )
 {
-    size_t index = 0;           // maximum target string length is 64k bytes!
-    size_t termIndex = 0;
-
     if( *target == 0 )
     {
         return true;
     }
 
+    TokenFinder finder( target, targetLen, terminator, termLen );
+
     int c;
     while( ( c = timedRead() ) > 0 )
     {
-
-        if ( c != target[ index ] )
-        {
-            // Reset index if any char does not match
-            index = 0;
-        }
-
-        if ( c == target[ index ] )
+        ParseStatus status = finder.feed( c );
+        if ( status != kParseNeedMore )
         {
-            if ( ++index >= targetLen )
-            {
-                // return true if all chars in the target match
-                return true;
-            }
-        }
-
-        if ( termLen > 0 && c == terminator[ termIndex ] )
-        {
-            if ( ++termIndex >= termLen )
-            {
-                // return false if terminate string found before target string
-                return false;
-            }
-        }
-        else
-        {
-            termIndex = 0;
+            // Found the target (true) or the terminator (false)
+            return status == kParseDone;
         }
     }
 
@@ -211,66 +210,20 @@ bool Reader::findUntil( const char *target, size_t targetLen, const char *termin
 
 bool Reader::readLong( long* result )
 {
-    return readLong( result, NO_SKIP_CHAR );
+    return readLong( result, NumberParser::kNoSkipChar );
 }
 
 
 
 bool Reader::readLong( long* result, char skipChar )
 {
-    bool isNegative = false;
-    bool noDigitsYet = true;
-    long value = 0;
-
-    // Ignore non-numeric leading characters
-    int c = peekNextDigit();
-
-    if ( c < 0 )
-    {
-        // Return false if time out without getting at least one digit
-        return noDigitsYet ? false : true;
-    }
-
-    do
-    {
-        if ( c == skipChar )
-        {
-            // Ignore this charactor
-        }
-        else if ( c == '-' )
-        {
-            isNegative = true;
-        }
-        else if( c >= '0' && c <= '9' )
-        {
-            value = value * 10 + c - '0';
-            noDigitsYet = false;
-        }
-
-        // Consume the character we got with peek
-        read();
-
-        c = timedPeek();
-        if ( c < 0 )
-        {
-            // Return false if time out without getting at least one digit
-            return noDigitsYet ? false : true;
-        }
-    }
-    while ( ( c >= '0' && c <= '9' ) || c == skipChar );
-
-    if ( c == SERIAL_INPUT_EOL )
+    NumberParser parser( false, skipChar );
+    if ( !timedParse( parser ) )
     {
-        // Consume the character we got with peek
-        read();
+        return false;
     }
 
-    if ( isNegative )
-    {
-        value = -value;
-    }
-    *result = value;
-
+    *result = parser.longValue();
     return true;
 }
 
@@ -279,85 +232,19 @@ bool Reader::readLong( long* result, char skipChar )
 
 bool Reader::readFloat( float* result )
 {
-    return readFloat( result, NO_SKIP_CHAR );
+    return readFloat( result, NumberParser::kNoSkipChar );
 }
 
 
 bool Reader::readFloat( float* result, char skipChar )
 {
-    bool isNegative = false;
-    bool isFraction = false;
-    long value = 0;
-    float fraction = 1.0;
-    bool noDigitsYet = true;
-
-    // Ignore non-numeric leading characters
-    int c = peekNextDigit();
-
-    if ( c < 0 )
-    {
-        // Return false if time out without getting at least one digit
-        return noDigitsYet ? false : true;
-    }
-
-    do
-    {
-        if( c == skipChar )
-        {
-            // Ignore
-        }
-        else if ( c == '-' )
-        {
-            isNegative = true;
-        }
-        else if ( c == '.' )
-        {
-            isFraction = true;
-        }
-        else if ( c >= '0' && c <= '9' )
-        {
-            // c is a digit
-            value = value * 10 + c - '0';
-            noDigitsYet = false;
-
-            if ( isFraction )
-            {
-                fraction *= 0.1;
-            }
-        }
-
-        // Consume the character we got with peek
-        read();
-
-        c = timedPeek();
-        if ( c < 0 )
-        {
-            // Return false if time out without getting at least one digit
-            return noDigitsYet ? false : true;
-        }
-    }
-    while ( ( c >= '0' && c <= '9' )  || c == '.' || c == skipChar );
-
-    if ( c == SERIAL_INPUT_EOL )
+    NumberParser parser( true, skipChar );
+    if ( !timedParse( parser ) )
     {
-        // Consume the character we got with peek
-        read();
-    }
-
-    if ( isNegative )
-    {
-        value = -value;
-    }
-
-    if ( isFraction )
-    {
-        *result = value * fraction;
-    }
-    else
-    {
-        *result = value;
+        return false;
     }
 
+    *result = parser.floatValue();
     return true;
 }
 
@@ -377,13 +264,22 @@ size_t Reader::readBytes( char *buffer, size_t length )
     size_t count = 0;
     while ( count < length )
     {
-        int c = timedRead();
-        if ( c < 0 )
+        // Take everything already waiting in one block...
+        size_t n = readAvailable( reinterpret_cast<uint8_t*>( buffer ), length - count );
+        buffer += n;
+        count += n;
+
+        if ( !n )
         {
-            break;
+            // ...and only wait (with timeout) when nothing is waiting
+            int c = timedRead();
+            if ( c < 0 )
+            {
+                break;
+            }
+            *buffer++ = static_cast<char>( c );
+            ++count;
         }
-        *buffer++ = static_cast<char>( c );
-        ++count;
     }
     return count;
 }
@@ -458,3 +354,193 @@ void Reader::consumeWhiteSpace()
         c = timedPeek();
     }
 }
+
+
+
+
+ParseStatus Reader::parseAvailable( NumberParser& parser )
+{
+    while ( available() )
+    {
+        int c = peek();
+        if ( c < 0 )
+        {
+            break;
+        }
+
+        ParseStatus status = parser.feed( c );
+        if ( status == kParseNeedMore )
+        {
+            // Consume the character we got with peek
+            read();
+        }
+        else
+        {
+            if ( status == kParseDone && c == SERIAL_INPUT_EOL )
+            {
+                // Consume the character we got with peek
+                read();
+            }
+            return status;
+        }
+    }
+
+    return kParseNeedMore;
+}
+
+
+
+
+ParseStatus Reader::parseAvailable( TokenFinder& finder )
+{
+    while ( available() )
+    {
+        int c = read();
+        if ( c < 0 )
+        {
+            break;
+        }
+
+        ParseStatus status = finder.feed( c );
+        if ( status != kParseNeedMore )
+        {
+            return status;
+        }
+    }
+
+    return kParseNeedMore;
+}
+
+
+
+
+void NumberParser::reset()
+{
+    mValue = 0;
+    mFraction = 1.0;
+    mInNumber = false;
+    mIsNegative = false;
+    mIsFraction = false;
+    mHaveDigits = false;
+}
+
+
+
+
+ParseStatus NumberParser::feed( char c )
+{
+    if ( c >= '0' && c <= '9' )
+    {
+        // c is a digit
+        mValue = mValue * 10 + c - '0';
+        mHaveDigits = true;
+        mInNumber = true;
+
+        if ( mIsFraction )
+        {
+            mFraction *= 0.1;
+        }
+        return kParseNeedMore;
+    }
+
+    if ( !mInNumber )
+    {
+        // Ignore non-numeric leading characters, except a minus sign, which starts the number
+        if ( c == '-' )
+        {
+            mIsNegative = true;
+            mInNumber = true;
+        }
+        return kParseNeedMore;
+    }
+
+    if ( c == mSkipChar )
+    {
+        // Ignore this character
+        return kParseNeedMore;
+    }
+
+    if ( c == '.' && mAllowFraction )
+    {
+        mIsFraction = true;
+        return kParseNeedMore;
+    }
+
+    // Anything else ends the number
+    return mHaveDigits ? kParseDone : kParseError;
+}
+
+
+
+
+long NumberParser::longValue() const
+{
+    return mIsNegative ? -mValue : mValue;
+}
+
+
+
+
+float NumberParser::floatValue() const
+{
+    long value = longValue();
+    if ( mIsFraction )
+    {
+        return value * mFraction;
+    }
+    else
+    {
+        return value;
+    }
+}
+
+
+
+
+TokenFinder::TokenFinder( const char* target, const char* terminator )
+: mTarget( target ), mTerminator( terminator ),
+mTargetLen( target ? strlen( target ) : 0 ), mTermLen( terminator ? strlen( terminator ) : 0 )
+{
+    reset();
+}
+
+
+
+
+ParseStatus TokenFinder::feed( char c )
+{
+    if ( !mTargetLen )
+    {
+        return kParseDone;
+    }
+
+    if ( c != mTarget[ mIndex ] )
+    {
+        // Reset index if any char does not match
+        mIndex = 0;
+    }
+
+    if ( c == mTarget[ mIndex ] )
+    {
+        if ( ++mIndex >= mTargetLen )
+        {
+            // All chars in the target match
+            return kParseDone;
+        }
+    }
+
+    if ( mTermLen > 0 && c == mTerminator[ mTermIndex ] )
+    {
+        if ( ++mTermIndex >= mTermLen )
+        {
+            // Terminate string found before target string
+            return kParseError;
+        }
+    }
+    else
+    {
+        mTermIndex = 0;
+    }
+
+    return kParseNeedMore;
+}
@@ -42,6 +42,177 @@
 #endif
 
 
+
+/*!
+ * \brief This enum lists the results of feeding a character to an incremental parser (NumberParser or TokenFinder).
+ */
+
+enum ParseStatus
+{
+    kParseNeedMore      = 0,        //!< The character was used; the parser needs more input.
+    kParseDone          = 1,        //!< The parser has finished and its result is ready.
+    kParseError         = -1        //!< The parser has failed (or, for TokenFinder, found the terminator).
+};
+
+
+
+/*!
+ * \brief This class parses an integer or floating point number one character at a time, so that input
+ * can be processed as it arrives without ever waiting (see Reader::parseAvailable()).  Reader::readLong()
+ * and Reader::readFloat() use the same parser, so the results are identical.
+ *
+ * Initial characters that are not digits (or the minus sign) are skipped; the number ends at the first
+ * character that is not a digit (or, for floats, the decimal point) and is not the skip character.
+ * That character is not part of the number:  feed() returns kParseDone without using it, and it remains
+ * for the caller to handle.  A minus sign not followed by a digit is an error.
+ *
+ * Once the parser returns kParseDone or kParseError, call reset() before parsing another number.
+ */
+
+class NumberParser
+{
+
+public:
+
+    /*!
+     * \brief Constructor.
+     *
+     * \arg \c allowFraction true to parse a floating point number; false to parse an integer.
+     * \arg \c skipChar a character to be ignored within the number (typically a comma), or kNoSkipChar.
+     */
+    NumberParser( bool allowFraction = false, char skipChar = kNoSkipChar )
+    : mSkipChar( skipChar ), mAllowFraction( allowFraction )
+    { reset(); }
+
+
+    /*!
+     * \brief Discard any partial result and prepare to parse a new number.
+     */
+    void reset();
+
+
+    /*!
+     * \brief Process the next input character.
+     *
+     * \arg \c c the next character.
+     *
+     * \returns kParseNeedMore if the character was used (or skipped); kParseDone if the character ended the
+     * number (the character is not used); or kParseError if the character followed a minus sign with no
+     * digits (the character is not used).
+     */
+    ParseStatus feed( char c );
+
+
+    /*!
+     * \brief Tell the parser the input has ended (for example, after a timeout) and end the number
+     * at the last character fed.
+     *
+     * \returns kParseDone if at least one digit was received, kParseError otherwise.
+     */
+    ParseStatus finish()
+    { return mHaveDigits ? kParseDone : kParseError; }
+
+
+    /*!
+     * \brief Get the result as an integer (only valid after kParseDone).
+     *
+     * \returns the number parsed, with any fractional part discarded.
+     */
+    long longValue() const;
+
+
+    /*!
+     * \brief Get the result as a floating point number (only valid after kParseDone).
+     *
+     * \returns the number parsed.
+     */
+    float floatValue() const;
+
+
+    /*!
+     * \brief A skip character that cannot occur in a valid ASCII numeric field.
+     */
+    static const char kNoSkipChar = 1;
+
+
+private:
+
+    long    mValue;
+    float   mFraction;
+    char    mSkipChar;
+    bool    mAllowFraction;
+    bool    mInNumber;
+    bool    mIsNegative;
+    bool    mIsFraction;
+    bool    mHaveDigits;
+};
+
+
+
+/*!
+ * \brief This class searches for a target string (and optionally a terminator string) one character
+ * at a time, so that input can be processed as it arrives without ever waiting (see Reader::parseAvailable()).
+ * Reader::find() and Reader::findUntil() use the same search, so the results are identical.
+ *
+ * The strings are not copied; they must remain valid while the search is in progress.
+ */
+
+class TokenFinder
+{
+
+public:
+
+    /*!
+     * \brief Constructor.
+     *
+     * \arg \c target the string to seek.
+     * \arg \c terminator the string that ends the search if it is found first (or null for none).
+     */
+    TokenFinder( const char* target, const char* terminator = 0 );
+
+
+    /*!
+     * \brief Constructor.
+     *
+     * \arg \c target the string to seek.
+     * \arg \c targetLen the number of characters of target to seek.
+     * \arg \c terminator the string that ends the search if it is found first (or null for none).
+     * \arg \c termLen the number of characters of the terminator to seek.
+     */
+    TokenFinder( const char* target, size_t targetLen, const char* terminator, size_t termLen )
+    : mTarget( target ), mTerminator( terminator ), mTargetLen( targetLen ), mTermLen( termLen )
+    { reset(); }
+
+
+    /*!
+     * \brief Restart the search from the beginning.
+     */
+    void reset()
+    { mIndex = 0; mTermIndex = 0; }
+
+
+    /*!
+     * \brief Process the next input character.  The character is always used.
+     *
+     * \arg \c c the next character.
+     *
+     * \returns kParseDone if the character completes the target; kParseError if it completes the
+     * terminator; otherwise kParseNeedMore.
+     */
+    ParseStatus feed( char c );
+
+
+private:
+
+    const char* mTarget;
+    const char* mTerminator;
+    size_t      mTargetLen;
+    size_t      mTermLen;
+    size_t      mIndex;
+    size_t      mTermIndex;
+};
+
+
 /*!
  * \brief This is an abstract class defining a generic interface to read numbers and strings from a sequential
  * stream of bytes (such as a serial device).
@@ -105,6 +276,22 @@ public:
     virtual bool available() = 0;
 
 
+    /*!
+     * \brief Read and remove the bytes already waiting in the input stream, without waiting
+     * for more to arrive.
+     *
+     * The default implementation calls read() once per byte; derived classes with a buffered
+     * input stream can override it to move the bytes in a single block.  readBytes() uses this
+     * function.
+     *
+     * \arg \c buffer a pointer to where the bytes read will be stored.
+     * \arg \c length the maximum number of bytes to read.
+     *
+     * \returns the number of bytes placed in the buffer (possibly 0).
+     */
+    virtual size_t readAvailable( uint8_t* buffer, size_t length );
+
+
 
 
     // Parsing methods
@@ -314,6 +501,35 @@ public:
     void consumeWhiteSpace();
 
 
+    /*!
+     * \brief Feed the characters already waiting in the input stream to a number parser, without waiting.
+     * Call it again (for example, each time through the main loop) until it returns something other
+     * than kParseNeedMore.
+     *
+     * The character that ends the number is left in the input stream, except that an EOL (SERIAL_INPUT_EOL)
+     * is consumed, as readLong() and readFloat() do.
+     *
+     * \arg \c parser the parser to feed.
+     *
+     * \returns kParseDone when the number is complete (read it from the parser), kParseError if the
+     * input is not a valid number, or kParseNeedMore if the input waiting ran out first.
+     */
+    ParseStatus parseAvailable( NumberParser& parser );
+
+
+    /*!
+     * \brief Feed the characters already waiting in the input stream to a token finder, without waiting.
+     * Call it again (for example, each time through the main loop) until it returns something other
+     * than kParseNeedMore.  Characters up to and including the target (or terminator) are consumed.
+     *
+     * \arg \c finder the token finder to feed.
+     *
+     * \returns kParseDone when the target is found, kParseError if the terminator is found first,
+     * or kParseNeedMore if the input waiting ran out first.
+     */
+    ParseStatus parseAvailable( TokenFinder& finder );
+
+
 private:
 
     // Number of milliseconds to wait for the next char before aborting timed read
@@ -321,7 +537,7 @@ private:
 
     int timedRead();            // private method to read stream with timeout
     int timedPeek();            // private method to peek stream with timeout
-    int peekNextDigit();        // returns the next numeric digit in the stream or -1 if timeout
+    bool timedParse( NumberParser& parser );    // feeds parser until done, error, or timeout
 };
 
 
@@ -23,6 +23,8 @@
 
 #include "RingBuffer.h"
 
+#include <string.h>
+
 #include <util/atomic.h>
 
 
@@ -83,6 +85,141 @@ bool RingBuffer::push( unsigned char element )
 }
 
 
+unsigned short RingBuffer::pushBulk( const unsigned char* elements, unsigned short nbrElements )
+{
+    unsigned short count = 0;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( nbrElements > mSize - mLength )
+        {
+            nbrElements = mSize - mLength;
+        }
+        unsigned short back = mIndex + mLength;
+        if ( back >= mSize )
+        {
+            back -= mSize;
+        }
+        while ( count < nbrElements )
+        {
+            // Copy up to the end of the storage, then wrap around to the beginning
+            unsigned short chunk = mSize - back;
+            if ( chunk > nbrElements - count )
+            {
+                chunk = nbrElements - count;
+            }
+            memcpy( mBuffer + back, elements + count, chunk );
+            count += chunk;
+            back = 0;
+        }
+        mLength += count;
+    }
+    return count;
+}
+
+
+unsigned short RingBuffer::pullBulk( unsigned char* elements, unsigned short nbrElements )
+{
+    unsigned short count = 0;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( nbrElements > mLength )
+        {
+            nbrElements = mLength;
+        }
+        while ( count < nbrElements )
+        {
+            // Copy up to the end of the storage, then wrap around to the beginning
+            unsigned short chunk = mSize - mIndex;
+            if ( chunk > nbrElements - count )
+            {
+                chunk = nbrElements - count;
+            }
+            memcpy( elements + count, mBuffer + mIndex, chunk );
+            count += chunk;
+            mIndex += chunk;
+            if ( mIndex >= mSize )
+            {
+                mIndex -= mSize;
+            }
+        }
+        mLength -= count;
+    }
+    return count;
+}
+
+
+unsigned short RingBuffer::getReadableSpan( unsigned char** start )
+{
+    unsigned short len;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        *start = mBuffer + mIndex;
+        len = mSize - mIndex;
+        if ( len > mLength )
+        {
+            len = mLength;
+        }
+    }
+    return len;
+}
+
+
+void RingBuffer::discardFromFront( unsigned short nbrElements )
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( nbrElements < mLength )
+        {
+            mIndex += nbrElements;
+            if ( mIndex >= mSize )
+            {
+                mIndex -= mSize;
+            }
+            mLength -= nbrElements;
+        }
+        else
+        {
+            // flush the whole buffer
+            mLength = 0;
+        }
+    }
+}
+
+
+unsigned short RingBuffer::getWritableSpan( unsigned char** start )
+{
+    unsigned short len;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        unsigned short back = mIndex + mLength;
+        if ( back >= mSize )
+        {
+            back -= mSize;
+        }
+        *start = mBuffer + back;
+        len = mSize - back;
+        if ( len > mSize - mLength )
+        {
+            len = mSize - mLength;
+        }
+    }
+    return len;
+}
+
+
+void RingBuffer::commitToBack( unsigned short nbrElements )
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( nbrElements > mSize - mLength )
+        {
+            nbrElements = mSize - mLength;
+        }
+        mLength += nbrElements;
+    }
+}
+
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wreturn-type"
 
@@ -55,6 +55,10 @@
  * The template-based RingBufferT class provides a more flexible ring buffer implementation that
  * can store a variety of data types.  However, this comes at the cost of replicating code for each
  * template instantiation of RingBufferT.
+ *
+ * When a ring buffer has a single producer and a single consumer (for example, an interrupt function
+ * filling it and ordinary code emptying it) and its size is a power of 2, consider the lock-free
+ * RingBufferSpsc instead; it offers the same interface without disabling interrupts.
  */
 
 class RingBuffer
@@ -97,6 +101,76 @@ public:
     bool push( unsigned char element );
 
 
+    /*!
+     * \brief Push a block of bytes into the ring buffer.  The bytes are appended to the back
+     * of the buffer, as many as fit.  This is done inside a single atomic section, so it is much
+     * faster than pushing the bytes one by one.
+     *
+     * \arg \c elements points to the bytes to append to the ring buffer.
+     * \arg \c nbrElements is the number of bytes to append.
+     *
+     * \returns the number of bytes actually appended (less than nbrElements if the buffer fills).
+     */
+    unsigned short pushBulk( const unsigned char* elements, unsigned short nbrElements );
+
+    /*!
+     * \brief Extract a block of bytes from the front of the ring buffer.  This is done inside a single
+     * atomic section, so it is much faster than pulling the bytes one by one.
+     *
+     * \arg \c elements points to where the bytes extracted will be stored.
+     * \arg \c nbrElements is the maximum number of bytes to extract.
+     *
+     * \returns the number of bytes actually extracted (less than nbrElements if the buffer empties).
+     */
+    unsigned short pullBulk( unsigned char* elements, unsigned short nbrElements );
+
+
+    /*!
+     * \brief Get the contiguous region of storage holding the bytes at the front of the buffer,
+     * so the caller can consume them in place.  When done, call discardFromFront() to remove those consumed.
+     *
+     * Because the data may wrap around the end of the storage, the region may hold fewer
+     * bytes than the buffer contains; call this again after discardFromFront() to get the rest.
+     *
+     * \note The region remains valid only as long as nothing else removes bytes from the buffer.
+     *
+     * \arg \c start is where a pointer to the start of the region is returned.
+     *
+     * \returns the number of bytes in the region (0 if the buffer is empty).
+     */
+    unsigned short getReadableSpan( unsigned char** start );
+
+    /*!
+     * \brief Discard a number of bytes from the front of the ring buffer.
+     *
+     * \arg \c nbrElements the number of bytes to discard.
+     */
+    void discardFromFront( unsigned short nbrElements );
+
+    /*!
+     * \brief Get the contiguous region of free storage at the back of the buffer, so the caller
+     * can fill it in place.  When done, call commitToBack() to append the bytes written to the buffer.
+     *
+     * Because the free storage may wrap around the end of the storage, the region may be smaller
+     * than the free space in the buffer; call this again after commitToBack() to get the rest.
+     *
+     * \note The region remains valid only as long as nothing else pushes bytes into the buffer.
+     *
+     * \arg \c start is where a pointer to the start of the region is returned.
+     *
+     * \returns the number of bytes that can be written to the region (0 if the buffer is full).
+     */
+    unsigned short getWritableSpan( unsigned char** start );
+
+    /*!
+     * \brief Append bytes previously written into the region returned by getWritableSpan() to the
+     * back of the ring buffer.
+     *
+     * \arg \c nbrElements the number of bytes written; must not exceed the size of the region.
+     */
+    void commitToBack( unsigned short nbrElements );
+
+
     /*!
      * \brief Determine if the buffer is full and cannot accept more bytes.
      *
@@ -0,0 +1,472 @@
+/*
+    RingBufferSpsc.h - Lock-free single-producer/single-consumer ring buffers
+    for AVR processors.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides lock-free ring buffers for the common case of a single producer
+ * and a single consumer (typically an interrupt function on one side and ordinary code on the other).
+ *
+ * RingBuffer and RingBufferT make every operation atomic by turning interrupts off, and they
+ * index their storage with a modulo operation (a software division on AVR processors).  The ring buffers
+ * in this file instead use separate head and tail indices and a size that is a power of 2 fixed
+ * at compile time, so neither side ever disables interrupts and indexing is a simple mask.
+ */
+
+
+#ifndef RingBufferSpsc_h
+#define RingBufferSpsc_h
+
+
+#include <stdint.h>
+
+
+
+/*!
+ * \brief Helper that selects the index type used by RingBufferSpscT.  A uint8_t is used whenever
+ * the buffer is small enough, because reading or writing a single byte is naturally atomic on AVR processors.
+ *
+ * \tparam SMALL true if the ring buffer holds 128 elements or less.
+ */
+
+template< bool SMALL > struct RingBufferSpscIndex
+{
+    /*!
+     * \brief The index type.
+     */
+    typedef uint16_t Type;
+};
+
+/*!
+ * \brief Specialization of RingBufferSpscIndex for small ring buffers.
+ */
+
+template<> struct RingBufferSpscIndex< true >
+{
+    /*!
+     * \brief The index type.
+     */
+    typedef uint8_t Type;
+};
+
+
+
+
+/*!
+ * \brief A lock-free, template-based ring buffer for a single producer and a single consumer.
+ *
+ * RingBufferSpscT provides the same interface as RingBufferT, but it never disables interrupts and never
+ * performs a division.  The price for this is a restriction on how the ring buffer is used:
+ * exactly one context (e.g., an interrupt function) may add elements with push(), and exactly one
+ * context (e.g., your main loop) may remove elements with pull(), discardFromFront(), or clear().
+ * The query functions may be called from either side.
+ *
+ * The head and tail indices are free-running counters, each written only by one side.  For SIZE of 128 or less they
+ * are bytes and so are read and written atomically by the hardware.  For larger SIZE a two-byte index is used; it is
+ * read repeatedly until two consecutive reads agree, so that a read interrupted
+ * by an update of the other side cannot return a torn value.
+ *
+ * \tparam T is the type of object that will be stored in the RingBufferSpscT instantiation.
+ * \tparam SIZE is the size of the RingBufferSpscT instantiation; it must be a power of 2 and no larger than 32768.
+ */
+
+template< typename T, unsigned int SIZE > class RingBufferSpscT
+{
+    static_assert( SIZE >= 2 && ( SIZE & ( SIZE - 1 ) ) == 0, "RingBufferSpscT SIZE must be a power of 2" );
+    static_assert( SIZE <= 32768, "RingBufferSpscT SIZE exceeds 32768" );
+
+public:
+
+    /*!
+     * \brief The integer type used to index the elements of this RingBufferSpscT.
+     */
+    typedef typename RingBufferSpscIndex< ( SIZE <= 128 ) >::Type IndexType;
+
+
+    /*!
+     * \brief Construct an empty ring buffer.
+     */
+    RingBufferSpscT()
+        : mHead( 0 ), mTail( 0 )
+        {}
+
+
+    /*!
+     * \brief Extract the next (first) element from the ring buffer.  Only call this from the consumer side.
+     *
+     * \note There is no
+     * general purpose safe value to return to indicate an empty buffer, so before
+     * calling pull() be sure to check the ring buffer is not empty.
+     *
+     * \returns the next element.
+     */
+    T pull()
+    {
+        T element = 0;
+        IndexType tail = mTail;
+        if ( tail != readIndex( mHead ) )
+        {
+            memoryBarrier();
+            element = mBuffer[ tail & kMask ];
+            // The element must be copied out before the slot is handed back to the producer
+            memoryBarrier();
+            mTail = tail + 1;
+        }
+        return element;
+    }
+
+
+    /*!
+     * \brief Examine an element in the ring buffer.  Only call this from the consumer side.
+     *
+     * \arg \c index the element to examine; 0 means the first (= next) element in the buffer.
+     * The default if the argument is omitted is to return the first element.
+     *
+     * \note There is no
+     * general purpose safe value to return to indicate an empty element, so before
+     * calling peek() be sure the element exists.
+     *
+     * \returns the next element.
+     */
+    T peek( IndexType index = 0 )
+    {
+        memoryBarrier();
+        return mBuffer[ ( mTail + index ) & kMask ];
+    }
+
+
+    /*!
+     * \brief Push an element into the ring buffer.  The element is appended to the back
+     * of the buffer.  Only call this from the producer side.
+     *
+     * \arg \c element is the item to append to the ring buffer.
+     *
+     * \returns 0 (false) if it succeeds; 1 (true) if it fails because the buffer is full.
+     */
+    bool push( T element )
+    {
+        IndexType head = mHead;
+        if ( static_cast<IndexType>( head - readIndex( mTail ) ) < SIZE )
+        {
+            mBuffer[ head & kMask ] = element;
+            // The element must be stored before the producer publishes it
+            memoryBarrier();
+            mHead = head + 1;
+            return 0;
+        }
+        // True = failure
+        return 1;
+    }
+
+
+    /*!
+     * \brief Push a block of elements into the ring buffer, as many as fit.  The elements are appended to the back
+     * of the buffer and become visible to the consumer all at once.  Only call this from the producer side.
+     *
+     * \arg \c elements points to the items to append to the ring buffer.
+     * \arg \c nbrElements is the number of items to append.
+     *
+     * \returns the number of elements actually appended (less than nbrElements if the buffer fills).
+     */
+    unsigned int pushBulk( const T* elements, unsigned int nbrElements )
+    {
+        IndexType head = mHead;
+        unsigned int room = SIZE - static_cast<IndexType>( head - readIndex( mTail ) );
+        if ( nbrElements > room )
+        {
+            nbrElements = room;
+        }
+        for ( unsigned int i = 0; i < nbrElements; ++i )
+        {
+            mBuffer[ ( head + i ) & kMask ] = elements[ i ];
+        }
+        memoryBarrier();
+        mHead = head + nbrElements;
+        return nbrElements;
+    }
+
+
+    /*!
+     * \brief Extract a block of elements from the front of the ring buffer.  Only call this from the consumer side.
+     *
+     * \arg \c elements points to where the items extracted will be stored.
+     * \arg \c nbrElements is the maximum number of items to extract.
+     *
+     * \returns the number of elements actually extracted (less than nbrElements if the buffer empties).
+     */
+    unsigned int pullBulk( T* elements, unsigned int nbrElements )
+    {
+        IndexType tail = mTail;
+        unsigned int len = static_cast<IndexType>( readIndex( mHead ) - tail );
+        if ( nbrElements > len )
+        {
+            nbrElements = len;
+        }
+        memoryBarrier();
+        for ( unsigned int i = 0; i < nbrElements; ++i )
+        {
+            elements[ i ] = mBuffer[ ( tail + i ) & kMask ];
+        }
+        memoryBarrier();
+        mTail = tail + nbrElements;
+        return nbrElements;
+    }
+
+
+    /*!
+     * \brief Get the contiguous region of storage holding the elements at the front of the buffer,
+     * so the consumer can use them in place.  When done, call discardFromFront() to remove those consumed.
+     * Only call this from the consumer side.
+     *
+     * Because the data may wrap around the end of the storage, the region may hold fewer
+     * elements than the buffer contains; call this again after discardFromFront() to get the rest.
+     *
+     * \arg \c start is where a pointer to the start of the region is returned.
+     *
+     * \returns the number of elements in the region (0 if the buffer is empty).
+     */
+    unsigned int getReadableSpan( T** start )
+    {
+        IndexType tail = mTail;
+        unsigned int len = static_cast<IndexType>( readIndex( mHead ) - tail );
+        unsigned int toEnd = SIZE - ( tail & kMask );
+        memoryBarrier();
+        *start = mBuffer + ( tail & kMask );
+        return ( len < toEnd ) ? len : toEnd;
+    }
+
+
+    /*!
+     * \brief Get the contiguous region of free storage at the back of the buffer, so the producer
+     * can fill it in place.  When done, call commitToBack() to publish the elements written.
+     * Only call this from the producer side.
+     *
+     * Because the free storage may wrap around the end of the storage, the region may be smaller
+     * than the free space in the buffer; call this again after commitToBack() to get the rest.
+     *
+     * \arg \c start is where a pointer to the start of the region is returned.
+     *
+     * \returns the number of elements that can be written to the region (0 if the buffer is full).
+     */
+    unsigned int getWritableSpan( T** start )
+    {
+        IndexType head = mHead;
+        unsigned int room = SIZE - static_cast<IndexType>( head - readIndex( mTail ) );
+        unsigned int toEnd = SIZE - ( head & kMask );
+        *start = mBuffer + ( head & kMask );
+        return ( room < toEnd ) ? room : toEnd;
+    }
+
+
+    /*!
+     * \brief Publish elements previously written into the region returned by getWritableSpan() by
+     * appending them to the back of the ring buffer.  Only call this from the producer side.
+     *
+     * \arg \c nbrElements the number of elements written; must not exceed the size of the region.
+     */
+    void commitToBack( unsigned int nbrElements )
+    {
+        IndexType head = mHead;
+        memoryBarrier();
+        mHead = head + nbrElements;
+    }
+
+
+    /*!
+     * \brief Determine the number of elements in the ring buffer.
+     *
+     * \returns the number of elements currently in the ring buffer.
+     */
+    IndexType length()
+    {
+        IndexType tail = readIndex( mTail );
+        return static_cast<IndexType>( readIndex( mHead ) - tail );
+    }
+
+
+    /*!
+     * \brief Determine if the buffer is empty.
+     *
+     * \returns true if the buffer is empty; false if not.
+     */
+    bool isEmpty()
+    {
+        return readIndex( mHead ) == readIndex( mTail );
+    }
+
+
+    /*!
+     * \brief Determine if the buffer is not empty.
+     *
+     * \returns true if the buffer is not empty; false if it is empty.
+     */
+    bool isNotEmpty()
+    {
+        return !isEmpty();
+    }
+
+
+    /*!
+     * \brief Determine if the buffer is full and cannot accept more elements.
+     *
+     * \returns true if the buffer is full; false if not.
+     */
+    bool isFull()
+    {
+        return length() >= SIZE;
+    }
+
+
+    /*!
+     * \brief Determine if the buffer is not full and can accept more elements.
+     *
+     * \returns true if the buffer is not full; false if it is full.
+     */
+    bool isNotFull()
+    {
+        return length() < SIZE;
+    }
+
+
+    /*!
+     * \brief discard a number of elements from the front of the ring buffer.  Only call this from the consumer side.
+     *
+     * \arg \c nbrElements the number of elements to discard.
+     */
+    void discardFromFront( unsigned int nbrElements )
+    {
+        IndexType tail = mTail;
+        unsigned int len = static_cast<IndexType>( readIndex( mHead ) - tail );
+        if ( nbrElements > len )
+        {
+            // flush the whole buffer
+            nbrElements = len;
+        }
+        mTail = tail + nbrElements;
+    }
+
+
+    /*!
+     * \brief Clear the ring buffer, leaving it empty.  Only call this from the consumer side.
+     */
+    void clear()
+    {
+        mTail = readIndex( mHead );
+    }
+
+
+
+private:
+
+    static const IndexType kMask = SIZE - 1;
+
+    static IndexType readIndex( const volatile IndexType& index )
+    {
+        IndexType i = index;
+        if ( sizeof( IndexType ) > 1 )
+        {
+            // A multi-byte index updated by an interrupt can change between the reads of its bytes,
+            // so read until two consecutive reads agree
+            IndexType j;
+            while ( ( j = index ) != i )
+            {
+                i = j;
+            }
+        }
+        return i;
+    }
+
+    static void memoryBarrier()
+    {
+        // Prevent the compiler from moving buffer accesses across index updates
+        __asm__ __volatile__ ( "" ::: "memory" );
+    }
+
+    T mBuffer[ SIZE ];
+    volatile IndexType mHead;
+    volatile IndexType mTail;
+
+};
+
+
+
+
+/*!
+ * \brief A lock-free ring buffer of bytes for a single producer and a single consumer.
+ *
+ * RingBufferSpsc provides the same interface as RingBuffer (pull() and peek() return -1 when there
+ * is no such element), so it can be substituted for a RingBuffer whenever the buffer
+ * has one producer and one consumer and its size is a power of 2.  The restrictions that apply to
+ * RingBufferSpscT apply to RingBufferSpsc as well.
+ *
+ * \tparam SIZE is the size of the ring buffer in bytes; it must be a power of 2 and no larger than 32768.
+ */
+
+template< unsigned int SIZE > class RingBufferSpsc : public RingBufferSpscT< unsigned char, SIZE >
+{
+
+public:
+
+    /*!
+     * \brief The integer type used to index the elements of this RingBufferSpsc.
+     */
+    typedef typename RingBufferSpscT< unsigned char, SIZE >::IndexType IndexType;
+
+
+    /*!
+     * \brief Extract the next (first) byte from the ring buffer.  Only call this from the consumer side.
+     *
+     * \returns the next byte, or -1 if the ring buffer is empty.
+     */
+    int pull()
+    {
+        if ( this->isEmpty() )
+        {
+            return -1;
+        }
+        return RingBufferSpscT< unsigned char, SIZE >::pull();
+    }
+
+
+    /*!
+     * \brief Examine an element in the ring buffer.  Only call this from the consumer side.
+     *
+     * \arg \c index the element to examine; 0 means the first (= next) element in the buffer.
+     * The default if the argument is omitted is to return the first element.
+     *
+     * \returns the next element or -1 if there is no such element.
+     */
+    int peek( IndexType index = 0 )
+    {
+        if ( index >= this->length() )
+        {
+            return -1;
+        }
+        return RingBufferSpscT< unsigned char, SIZE >::peek( index );
+    }
+
+};
+
+
+#endif
@@ -39,6 +39,55 @@
 #include <util/atomic.h>
 
 
+
+/*!
+ * \brief Helper that maps a logical position onto a slot of a RingBufferT of size SIZE.
+ * The general case wraps with a comparison and a subtraction.
+ *
+ * \tparam SIZE is the size of the ring buffer.
+ * \tparam POWER_OF_2 true if SIZE is a power of 2 (determined automatically).
+ */
+
+template< unsigned int SIZE, bool POWER_OF_2 = ( ( SIZE & ( SIZE - 1 ) ) == 0 ) > struct RingBufferTIndexing
+{
+    /*!
+     * \brief Map a position onto the corresponding buffer slot.
+     *
+     * \arg \c position is a position that is less than twice SIZE.
+     *
+     * \returns the slot in the range [0, SIZE).
+     */
+    static unsigned int wrap( unsigned int position )
+    { return ( position >= SIZE ) ? position - SIZE : position; }
+};
+
+
+/*!
+ * \brief Specialization of RingBufferTIndexing used when SIZE is a power of 2.  It maps positions onto
+ * slots with a compile-time mask, which is cheaper than a comparison and a branch.
+ */
+
+template< unsigned int SIZE > struct RingBufferTIndexing< SIZE, true >
+{
+    /*!
+     * \brief The mask that maps positions onto slots.
+     */
+    static const unsigned int kMask = SIZE - 1;
+
+    /*!
+     * \brief Map a position onto the corresponding buffer slot.
+     *
+     * \arg \c position is a position.
+     *
+     * \returns the slot in the range [0, SIZE).
+     */
+    static unsigned int wrap( unsigned int position )
+    { return position & kMask; }
+};
+
+
+
+
 /*!
  * \brief a template-based ring buffer class that can store different kinds of objects in
  * buffers of whatever size is needed.
@@ -51,6 +100,12 @@
  * result in replicated code for each instantiation, even when they could logically share code.  For
  * a more efficient ring buffer that avoids such code bloat but can only store bytes, use RingBuffer.
  *
+ * The size is a compile-time constant.  When SIZE is a power of 2, elements are located with a mask rather than
+ * a comparison and subtraction, and neither case requires a modulo operation (which on AVR processors is a call to
+ * a software division routine).
+ *
+ * For a lock-free ring buffer with a single producer and a single consumer, use RingBufferSpscT.
+ *
  * \tparam T is the type of object that will be stored in the RingBufferT instantiation.
  * \tparam N is the integer type that will be used to index the RingBufferT elements.
  * \tparam SIZE is an integer indicating the size of the RingBufferT instantiation.
@@ -59,6 +114,9 @@
 
 template< typename T, typename N, unsigned int SIZE > class RingBufferT
 {
+    static_assert( SIZE > 0, "RingBufferT SIZE must be positive" );
+    static_assert( static_cast<unsigned long>( static_cast<N>( SIZE ) ) == SIZE,
+                   "RingBufferT index type N is too small for SIZE" );
 
 public:
 
@@ -67,7 +125,7 @@ public:
      * integer type N, with size SIZE.  All of these are passed as template parameters.     *
      */
     RingBufferT()
-        : mSize( SIZE ), mLength( 0 ), mIndex( 0 )
+        : mLength( 0 ), mIndex( 0 )
         {}
 
 
@@ -82,17 +140,13 @@ public:
      */
     T pull()
     {
-        T element = 0;
+        T element = T();
         ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
         {
             if ( mLength )
             {
                 element = mBuffer[ mIndex ];
-                mIndex++;
-                if ( mIndex >= mSize )
-                {
-                    mIndex -= mSize;
-                }
+                mIndex = RingBufferTIndexing< SIZE >::wrap( mIndex + 1 );
                 --mLength;
             }
         }
@@ -117,7 +171,7 @@ public:
         T element;
         ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
         {
-            element = mBuffer[ ( mIndex + index ) % mSize ];
+            element = mBuffer[ RingBufferTIndexing< SIZE >::wrap( mIndex + index ) ];
         }
         return element;
     }
@@ -135,9 +189,9 @@ public:
     {
         ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
         {
-            if ( mLength < mSize )
+            if ( mLength < static_cast<N>( SIZE ) )
             {
-                mBuffer[ ( mIndex + mLength ) % mSize ] = element;
+                mBuffer[ RingBufferTIndexing< SIZE >::wrap( mIndex + mLength ) ] = element;
                 ++mLength;
                 return 0;
             }
@@ -178,7 +232,7 @@ public:
     {
         ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
         {
-            return ( mSize - mLength ) <= 0;
+            return mLength >= static_cast<N>( SIZE );
         }
     }
 
@@ -192,7 +246,7 @@ public:
     {
         ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
         {
-            return ( mSize - mLength ) > 0;
+            return mLength < static_cast<N>( SIZE );
         }
     }
 
@@ -208,11 +262,7 @@ public:
         {
             if ( nbrElements < mLength )
             {
-                mIndex += nbrElements;
-                if( mIndex >= mSize )
-                {
-                    mIndex -= mSize;
-                }
+                mIndex = RingBufferTIndexing< SIZE >::wrap( mIndex + nbrElements );
                 mLength -= nbrElements;
             }
             else
@@ -240,7 +290,6 @@ public:
 private:
 
     T mBuffer[ SIZE ] ;
-    volatile N mSize;
     volatile N mLength;
     volatile N mIndex;
 
@@ -29,12 +29,151 @@
 #include <stddef.h>
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/atomic.h>
 
 #include "ArduinoPins.h"
 
 
 
+namespace
+{
+
+    struct SpiAsyncTransfer
+    {
+        SpiAsyncTransfer*       mNext;
+        const uint8_t*          mTxData;
+        uint8_t*                mRxData;
+        size_t                  mCount;
+        size_t                  mIndex;
+        volatile uint8_t*       mStatus;
+        SPI::SpiCallback        mCallback;
+        void*                   mContext;
+        Gpio8Ptr                mCsPort;
+        uint8_t                 mCsMask;
+        uint8_t                 mSpcr;
+        uint8_t                 mSpsr;
+    };
+
+    SpiAsyncTransfer            gSpiTransfers[ SPI_MAX_ASYNC_TRANSFERS ];
+
+    // Queue of pending transfers (the head is the one in progress) and the list of free slots
+    SpiAsyncTransfer* volatile  gSpiHead;
+    SpiAsyncTransfer* volatile  gSpiTail;
+    SpiAsyncTransfer* volatile  gSpiFree;
+    bool                        gSpiInitialized;
+
+
+    // Call with interrupts disabled
+    void startTransfer( SpiAsyncTransfer* t )
+    {
+        SPCR = t->mSpcr | _BV( SPIE );
+        SPSR = t->mSpsr;
+
+        if ( t->mCsPort )
+        {
+            *(t->mCsPort) &= ~t->mCsMask;
+        }
+
+        if ( t->mStatus )
+        {
+            *(t->mStatus) = SPI::kSpiInProgress;
+        }
+
+        t->mIndex = 0;
+        SPDR = t->mTxData ? t->mTxData[0] : 0xFF;
+    }
+
+
+    // Call with interrupts disabled
+    SpiAsyncTransfer* allocateTransfer()
+    {
+        if ( !gSpiInitialized )
+        {
+            for ( uint8_t i = 0; i < SPI_MAX_ASYNC_TRANSFERS; ++i )
+            {
+                gSpiTransfers[i].mNext = ( i + 1 < SPI_MAX_ASYNC_TRANSFERS ) ? &gSpiTransfers[i + 1] : 0;
+            }
+            gSpiFree = &gSpiTransfers[0];
+            gSpiInitialized = true;
+        }
+
+        SpiAsyncTransfer* t = gSpiFree;
+        if ( t )
+        {
+            gSpiFree = t->mNext;
+        }
+        return t;
+    }
+
+
+    uint8_t queueTransfer( const SPI::SPISettings& settings, const GpioPinVariable& chipSelect,
+                            const uint8_t* txData, uint8_t* rxData, size_t count,
+                            volatile uint8_t* status, SPI::SpiCallback callback, void* context )
+    {
+        if ( !count )
+        {
+            return SPI::kSpiErrNoData;
+        }
+
+        SpiAsyncTransfer* t;
+        while ( 1 )
+        {
+            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+            {
+                t = allocateTransfer();
+            }
+            if ( t )
+            {
+                break;
+            }
+
+            if ( !( SREG & (1 << SREG_I) ) )
+            {
+                // Called with interrupts off (e.g., from a callback), so waiting won't free a slot
+                return SPI::kSpiErrQueueFull;
+            }
+        }
+
+        // The slot belongs to us until we queue it, so fill it in without blocking interrupts
+        t->mNext = 0;
+        t->mTxData = txData;
+        t->mRxData = rxData;
+        t->mCount = count;
+        t->mStatus = status;
+        t->mCallback = callback;
+        t->mContext = context;
+        t->mCsPort = chipSelect.port();
+        t->mCsMask = t->mCsPort ? ( 1 << chipSelect.bitNbr() ) : 0;
+        t->mSpcr = settings.getSpcr();
+        t->mSpsr = settings.getSpsr();
+
+        if ( status )
+        {
+            *status = SPI::kSpiNotStarted;
+        }
+
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            if ( gSpiHead )
+            {
+                gSpiTail->mNext = t;
+                gSpiTail = t;
+            }
+            else
+            {
+                gSpiHead = gSpiTail = t;
+                startTransfer( t );
+            }
+        }
+
+        return SPI::kSpiNoError;
+    }
+
+};
+
+
+
 void SPI::enable()
 {
     ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
@@ -161,3 +300,91 @@ uint32_t SPI::transmit32( uint32_t data )
 
 
 
+
+uint8_t SPI::transmitAsync( const SPISettings& settings, const GpioPinVariable& chipSelect,
+                            const uint8_t* txData, uint8_t* rxData, size_t count, volatile uint8_t* status )
+{
+    if ( !status )
+    {
+        return kSpiErrNullStatusPtr;
+    }
+
+    return queueTransfer( settings, chipSelect, txData, rxData, count, status, 0, 0 );
+}
+
+
+
+
+uint8_t SPI::transmitAsync( const SPISettings& settings, const GpioPinVariable& chipSelect,
+                            const uint8_t* txData, uint8_t* rxData, size_t count,
+                            SpiCallback callback, void* context )
+{
+    return queueTransfer( settings, chipSelect, txData, rxData, count, 0, callback, context );
+}
+
+
+
+
+bool SPI::asyncBusy()
+{
+    return gSpiHead;
+}
+
+
+
+
+ISR( SPI_STC_vect )
+{
+    SpiAsyncTransfer* t = gSpiHead;
+
+    uint8_t in = SPDR;
+    size_t index = t->mIndex;
+    if ( t->mRxData )
+    {
+        t->mRxData[ index ] = in;
+    }
+
+    if ( ++index < t->mCount )
+    {
+        // Keep the bus busy:  send the next byte right away
+        SPDR = t->mTxData ? t->mTxData[ index ] : 0xFF;
+        t->mIndex = index;
+        return;
+    }
+
+    // This transfer is done
+    if ( t->mCsPort )
+    {
+        *(t->mCsPort) |= t->mCsMask;
+    }
+
+    if ( t->mStatus )
+    {
+        *(t->mStatus) = SPI::kSpiCompletedOk;
+    }
+
+    SPI::SpiCallback callback = t->mCallback;
+    void* context = t->mContext;
+
+    // Free the slot before the callback so it can queue another transfer
+    SpiAsyncTransfer* next = t->mNext;
+    gSpiHead = next;
+    t->mNext = gSpiFree;
+    gSpiFree = t;
+
+    if ( callback )
+    {
+        callback( context );
+    }
+
+    if ( next )
+    {
+        startTransfer( next );
+    }
+    else if ( !gSpiHead )
+    {
+        // Back to polled operation
+        SPCR &= ~_BV( SPIE );
+    }
+    // Otherwise the callback queued a transfer into the empty queue, which started it
+}
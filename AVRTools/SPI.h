@@ -40,6 +40,19 @@
 #include <stddef.h>
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "GpioPinMacros.h"
+
+
+
+#ifndef SPI_MAX_ASYNC_TRANSFERS
+#define SPI_MAX_ASYNC_TRANSFERS     4
+#endif
+
+#if SPI_MAX_ASYNC_TRANSFERS < 1 || SPI_MAX_ASYNC_TRANSFERS > 255
+#error "SPI_MAX_ASYNC_TRANSFERS must be between 1 and 255"
+#endif
 
 
 /*!
@@ -57,6 +70,14 @@
  * byte sent.  When the CPU is calling interrupts that often, the overhead of calling the interrupt function dominates,
  * and is greater than the overhead of a simple polling loop.
  *
+ * Nevertheless, polling leaves the CPU unable to do anything else during a large transfer (e.g., to an SD card or
+ * a display), particularly at slower %SPI clock speeds.  So this module also provides an asynchronous, interrupt-driven
+ * interface, transmitAsync(), that queues transfers and carries them out byte-by-byte in the %SPI serial transfer
+ * complete interrupt.  Each queued transfer has its own SPISettings and chip-select pin, which the interrupt applies
+ * and toggles when the transfer starts and finishes.  Up to 4 transfers can be queued; you can change this by defining
+ * the macro \c SPI_MAX_ASYNC_TRANSFERS prior to including SPI.h (best done with a compiler option, e.g.,
+ * \c -DSPI_MAX_ASYNC_TRANSFERS=8).  Do not use the synchronous functions while asynchronous transfers are pending.
+ *
  * The AVRTools implementation is based in part on the Arduino Library %SPI module.  In particular, the
  * SPISettings class from the Arduino library is very cleverly and efficiently coded and has been adopted here.
  * The lessons learned by the Arduino library %SPI authors in correctly initializing the %SPI subsystem have
@@ -430,6 +451,185 @@ namespace SPI
     }
 
 
+
+
+    /*!
+     * \brief This class bundles a chip-select pin and an SPISettings object into a handle for one device on
+     * the %SPI bus, and manages %SPI "transactions" with that device.
+     *
+     * A transaction is bracketed by beginTransaction() and endTransaction().  beginTransaction() (optionally)
+     * disables interrupts, reconfigures the %SPI subsystem only if the current configuration differs from the
+     * device's settings, and pulls the chip-select pin low.  endTransaction() raises the chip-select pin and
+     * restores the interrupt state.  With several devices at different settings on one bus, this places all the
+     * chip-select handling in one spot and skips the register writes whenever consecutive transactions target
+     * devices with the same settings.
+     *
+     * The check compares the device settings against the %SPI control registers themselves rather than
+     * against a cached copy, so it stays correct even if other code calls configure() directly.
+     *
+     * The SPITransaction class provides a scope-based alternative that guarantees endTransaction() is called.
+     *
+     * ~~~{.cpp}
+     * SPI::SPIDevice display( makeGpioVarFromGpioPin( pPin10 ), SPISettings( 8000000, SPI::kMsbFirst, SPI::kSpiMode0 ) );
+     * SPI::SPIDevice sensor( makeGpioVarFromGpioPin( pPin09 ), SPISettings( 1000000, SPI::kMsbFirst, SPI::kSpiMode3 ) );
+     *
+     * display.init();
+     * sensor.init();
+     *
+     * sensor.beginTransaction();
+     * uint16_t reading = SPI::transmit16( 0x0000 );
+     * sensor.endTransaction();
+     * ~~~
+     *
+     * \note Do not begin a transaction while asynchronous transfers queued with transmitAsync() are pending.
+     */
+
+    class SPIDevice
+    {
+    public:
+
+        /*!
+         * \brief Construct a device handle.  This does not touch the hardware; call init() before the first
+         * transaction.
+         *
+         * \arg \c chipSelect the chip-select pin of the device, as a GpioPinVariable (obtain one with
+         * makeGpioVarFromGpioPin()).  The chip-select pin is active low.
+         * \arg \c settings the %SPI settings to use when communicating with the device.
+         * \arg \c disableInterrupts if true (the default), interrupts are disabled from beginTransaction()
+         * to endTransaction(), so interrupt code that also uses %SPI cannot interleave with the transaction.
+         * Pass false if no interrupt code uses %SPI, or if you suppress the relevant interrupts yourself
+         * (for example with the classes in InterruptUtils).
+         */
+
+        SPIDevice( const GpioPinVariable& chipSelect, SPISettings settings, bool disableInterrupts = true )
+        : mCs( chipSelect ), mSpcr( settings.getSpcr() ), mSpsr( settings.getSpsr() ),
+        mDisableInterrupts( disableInterrupts ), mSreg( 0 )
+        {}
+
+
+        /*!
+         * \brief Configure the chip-select pin as an output and set it high (deselecting the device).
+         */
+
+        void init()
+        {
+            setGpioPinHighV( mCs );
+            setGpioPinModeOutputV( mCs );
+        }
+
+
+        /*!
+         * \brief Begin a transaction with this device: disable interrupts (if requested at construction),
+         * configure the %SPI subsystem if necessary, and pull the chip-select pin low.
+         */
+
+        void beginTransaction()
+        {
+            if ( mDisableInterrupts )
+            {
+                mSreg = SREG;
+                cli();
+            }
+
+            if ( SPCR != mSpcr || ( SPSR & _BV(SPI2X) ) != mSpsr )
+            {
+                SPCR = mSpcr;
+                SPSR = mSpsr;
+            }
+
+            setGpioPinLowV( mCs );
+        }
+
+
+        /*!
+         * \brief End a transaction with this device: raise the chip-select pin and restore the interrupt
+         * state as it was when beginTransaction() was called.
+         */
+
+        void endTransaction()
+        {
+            setGpioPinHighV( mCs );
+
+            // Turn on global interrupt, only if it was already on.  Leave other bits alone.
+            if ( mDisableInterrupts && ( mSreg & static_cast<uint8_t>(1 << SREG_I) ) )
+            {
+                sei();
+            }
+        }
+
+
+        /*!
+         * \brief Change the %SPI settings used for this device.  The new settings take effect at the next
+         * beginTransaction().
+         *
+         * \arg \c settings the new %SPI settings.
+         */
+
+        void setSettings( SPISettings settings )
+        {
+            mSpcr = settings.getSpcr();
+            mSpsr = settings.getSpsr();
+        }
+
+
+    private:
+
+        GpioPinVariable mCs;
+        uint8_t         mSpcr;
+        uint8_t         mSpsr;
+        bool            mDisableInterrupts;
+        uint8_t         mSreg;
+    };
+
+
+
+
+    /*!
+     * \brief This class defines an object that holds a transaction open with an SPIDevice during its
+     * lifetime.  The constructor calls SPIDevice::beginTransaction() and the destructor calls
+     * SPIDevice::endTransaction() when the object goes out of scope.
+     *
+     * ~~~{.cpp}
+     * {
+     *   SPI::SPITransaction transaction( display );
+     *   SPI::send( frameBuffer, sizeof( frameBuffer ) );
+     * }
+     * ~~~
+     */
+
+    class SPITransaction
+    {
+    public:
+
+        /*!
+         * \brief Begin a transaction with the device.
+         *
+         * \arg \c device the device to communicate with.
+         */
+
+        SPITransaction( SPIDevice& device )
+        : mDevice( device )
+        {
+            mDevice.beginTransaction();
+        }
+
+
+        /*!
+         * \brief End the transaction with the device.
+         */
+
+        ~SPITransaction()
+        {
+            mDevice.endTransaction();
+        }
+
+
+    private:
+
+        SPIDevice&  mDevice;
+    };
+
+
     /*!
      * \brief Transmit a single byte using the %SPI subsystem.
      *
@@ -560,6 +760,216 @@ namespace SPI
     }
 
 
+
+    /*!
+     * \brief Transmit an array of bytes using the %SPI subsystem, storing the received bytes in a
+     * separate array.  The bytes are transmitted in array order.
+     *
+     * \arg \c txBuffer the array of bytes to transmit; it is not modified.  If this is a null pointer, 0xFF
+     * is transmitted for each byte (useful for clocking in data from devices that ignore their input).
+     * \arg \c rxBuffer the array in which to store the received bytes; it must be able to hold \c count
+     * bytes.  If this is a null pointer, the received bytes are discarded.
+     * \arg \c count the number of bytes to transmit.
+     *
+     * \returns nothing, but the received stream of bytes is loaded into \c rxBuffer.
+     */
+
+    inline void transmit( const uint8_t* txBuffer, uint8_t* rxBuffer, size_t count )
+    {
+        if ( count )
+        {
+            SPDR = txBuffer ? *txBuffer++ : 0xFF;
+
+            while ( --count > 0 )
+            {
+                uint8_t out = txBuffer ? *txBuffer++ : 0xFF;
+                while ( !( SPSR & _BV(SPIF) ) )
+                    ;
+                uint8_t in = SPDR;
+                SPDR = out;
+                if ( rxBuffer )
+                {
+                    *rxBuffer++ = in;
+                }
+            }
+
+            while ( !(SPSR & _BV(SPIF) ) )
+                ;
+            uint8_t in = SPDR;
+            if ( rxBuffer )
+            {
+                *rxBuffer = in;
+            }
+        }
+    }
+
+
+
+    /*!
+     * \brief Transmit an array of bytes using the %SPI subsystem, discarding any data received.  The bytes
+     * are transmitted in array order.
+     *
+     * This is the fastest way to push a buffer out to a write-only device (such as a display).  The next byte
+     * is fetched before waiting for the current one to finish, and the data register is never read, so
+     * the only work between successive writes to the data register is polling the transfer complete flag.
+     *
+     * \arg \c buffer the array of bytes to transmit; it is not modified.
+     * \arg \c count the number of bytes to transmit.
+     */
+
+    inline void send( const uint8_t* buffer, size_t count )
+    {
+        if ( count )
+        {
+            SPDR = *buffer++;
+
+            while ( --count > 0 )
+            {
+                uint8_t out = *buffer++;
+                asm volatile( "nop" );              // See transmit( uint8_t ) function
+                while ( !( SPSR & _BV(SPIF) ) )
+                    ;
+                SPDR = out;
+            }
+
+            while ( !(SPSR & _BV(SPIF) ) )
+                ;
+            // Access SPDR to clear the SPIF flag
+            (void) SPDR;
+        }
+    }
+
+
+
+    /*!
+     * \brief Transmit the same byte repeatedly using the %SPI subsystem, discarding any data received.
+     *
+     * This is useful for clearing displays or memory devices.  Like send(), it never reads the data
+     * register, so the only work between successive bytes is polling the transfer complete flag.
+     *
+     * \arg \c value the byte to transmit.
+     * \arg \c count the number of times to transmit \c value.
+     */
+
+    inline void fill( uint8_t value, size_t count )
+    {
+        if ( count )
+        {
+            SPDR = value;
+
+            while ( --count > 0 )
+            {
+                asm volatile( "nop" );              // See transmit( uint8_t ) function
+                while ( !( SPSR & _BV(SPIF) ) )
+                    ;
+                SPDR = value;
+            }
+
+            while ( !(SPSR & _BV(SPIF) ) )
+                ;
+            // Access SPDR to clear the SPIF flag
+            (void) SPDR;
+        }
+    }
+
+
+
+
+
+    /*!
+     * \brief An enumeration that defines the status values reported for asynchronous transfers.
+     */
+    enum SpiStatusCodes
+    {
+        kSpiCompletedOk     = 0x00,     //!< The transfer completed.
+        kSpiNotStarted      = 0x02,     //!< The transfer is queued, but not yet started.
+        kSpiInProgress      = 0x04      //!< The transfer is in progress.
+    };
+
+
+    /*!
+     * \brief An enumeration that defines the error codes returned when queuing asynchronous transfers.
+     */
+    enum SpiAsyncErrorCodes
+    {
+        kSpiNoError             = 0,    //!< No error
+        kSpiErrQueueFull        = 1,    //!< The transfer queue is full (try again later)
+        kSpiErrNoData           = 2,    //!< Nothing to transfer (the count is zero)
+        kSpiErrNullStatusPtr    = 3     //!< The pointer to the status variable is null (need to provide a valid pointer)
+    };
+
+
+    /*!
+     * \brief The type of a completion callback for an asynchronous transfer.
+     *
+     * The callback is invoked from the %SPI interrupt after the transfer completes (and the chip-select pin has been
+     * released), so it must be short.  It may queue further transfers; the slot used by the transfer that just
+     * finished is already available for reuse.
+     *
+     * \arg \c context the context pointer that was passed when the transfer was queued.
+     */
+    typedef void (*SpiCallback)( void* context );
+
+
+    /*!
+     * \brief Queue an asynchronous %SPI transfer.  This function queues the transfer and returns immediately; the
+     * transfer is carried out by the %SPI interrupt.  Eventual status of the transfer can be monitored via the
+     * designated status variable (passed as a pointer to this function).
+     *
+     * When the transfer starts, the %SPI hardware is configured with \c settings and the chip-select pin is set low;
+     * when the transfer completes, the chip-select pin is set high.
+     *
+     * If the queue is full, this function blocks until room is available (unless interrupts are disabled,
+     * in which case it returns kSpiErrQueueFull).
+     *
+     * \arg \c settings the %SPI configuration to use for this transfer.
+     * \arg \c chipSelect the chip-select pin of the device, created with makeGpioVarFromGpioPin(); the pin must
+     * already be configured as an output.  Pass a default-constructed GpioPinVariable() if you manage chip-select yourself.
+     * \arg \c txData the bytes to transmit.  If null, 0xFF is transmitted for every byte (as when reading
+     * from an SD card).  The data are read by the interrupt and must remain valid until the transfer completes.
+     * \arg \c rxData where to store the bytes received.  If null, the bytes received are discarded.  This may be the
+     * same as txData.
+     * \arg \c count the number of bytes to transfer.
+     * \arg \c status a pointer to a byte-size location in which the status of this transfer will be
+     * reported (volatile because the value will be updated asynchronously after the function returns by the
+     * %SPI interrupt); values correspond to SpiStatusCodes.
+     *
+     * \returns error codes corresponding to SpiAsyncErrorCodes (0 means no error)
+     */
+
+    uint8_t transmitAsync( const SPISettings& settings, const GpioPinVariable& chipSelect,
+                            const uint8_t* txData, uint8_t* rxData, size_t count, volatile uint8_t* status );
+
+
+    /*!
+     * \brief Queue an asynchronous %SPI transfer, with a callback on completion.  This function works the same way
+     * as the version that reports status via a status variable, except that it invokes \c callback from the %SPI
+     * interrupt when the transfer completes.
+     *
+     * \arg \c settings the %SPI configuration to use for this transfer.
+     * \arg \c chipSelect the chip-select pin of the device, or a default-constructed GpioPinVariable() for none.
+     * \arg \c txData the bytes to transmit, or null to transmit 0xFF for every byte.
+     * \arg \c rxData where to store the bytes received, or null to discard them.
+     * \arg \c count the number of bytes to transfer.
+     * \arg \c callback the function to call when the transfer completes (it may be null).
+     * \arg \c context an arbitrary pointer passed to the callback.
+     *
+     * \returns error codes corresponding to SpiAsyncErrorCodes (0 means no error)
+     */
+
+    uint8_t transmitAsync( const SPISettings& settings, const GpioPinVariable& chipSelect,
+                            const uint8_t* txData, uint8_t* rxData, size_t count,
+                            SpiCallback callback, void* context );
+
+
+    /*!
+     * \brief Determine if any asynchronous transfers are queued or in progress.
+     *
+     * \returns true if the asynchronous transfer queue is busy.
+     */
+
+    bool asyncBusy();
+
 }   // End namespace
 
 #endif
@@ -0,0 +1,340 @@
+/*
+    SerialPort.h - A template class providing a Serial0-like interface
+    to a USART with application-sized buffers.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides SerialPort, a template class that offers the same interface as Serial0
+ * (or Serial1, Serial2, Serial3) on top of a UsartEngine with receive and
+ * transmit buffers sized by your application.
+ *
+ * Serial0 and the other SerialN classes use buffer sizes that are fixed when USART0.cpp (etc.) is compiled.
+ * When your application needs different sizes -- larger receive buffers for a fast link, or tiny buffers to
+ * save SRAM -- do not link against USART0.cpp.  Instead, in exactly one of your source files, name the
+ * engine you want with a typedef, define its interrupt functions, and use a SerialPort
+ * (which is header-only):
+ *
+ * ~~~C
+ * #include "AVRTools/SerialPort.h"
+ *
+ * typedef UsartEngine< 0, 128, 16 > MyUsart0;      // 128 byte RX buffer, 16 byte TX buffer
+ * DEFINE_USART0_INTERRUPTS( MyUsart0 )
+ *
+ * SerialPort< MyUsart0 > serial;
+ *
+ * ...
+ *     serial.start( 115200 );
+ *     serial.println( "Hello" );
+ * ~~~
+ *
+ * Buffer sizes must be powers of 2.  Other source files may use the same SerialPort type, as long as
+ * the interrupt functions are defined only once.  Each port can be sized independently, and the
+ * minimal USART modules (USART0Minimal.h, etc.) are not affected.
+ */
+
+
+
+#ifndef SerialPort_h
+#define SerialPort_h
+
+#include "Writer.h"
+#include "Reader.h"
+#include "USARTEngine.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#ifndef USART_SERIAL_CONFIG
+#define USART_SERIAL_CONFIG
+
+/*!
+ * \brief This enum lists serial configuration in terms of data bits, parity, and stop bits.
+ *
+ * The format is kSerial_XYZ where
+ * - X = the number of data bits
+ * - Y = N, E, or O; where N = none, E = even, and O = odd
+ * - Z = the number of stop bits
+ *
+ * \hideinitializer
+ */
+enum UsartSerialConfiguration
+{
+    kSerial_5N1 = 0x00,     //!< 5 data bits, no parity, 1 stop bit  \hideinitializer
+    kSerial_6N1 = 0x02,     //!< 6 data bits, no parity, 1 stop bit  \hideinitializer
+    kSerial_7N1 = 0x04,     //!< 7 data bits, no parity, 1 stop bit  \hideinitializer
+    kSerial_8N1 = 0x06,     //!< 8 data bits, no parity, 1 stop bit  \hideinitializer
+    kSerial_5N2 = 0x08,     //!< 5 data bits, no parity, 2 stop bits  \hideinitializer
+    kSerial_6N2 = 0x0A,     //!< 6 data bits, no parity, 2 stop bits  \hideinitializer
+    kSerial_7N2 = 0x0C,     //!< 7 data bits, no parity, 2 stop bits  \hideinitializer
+    kSerial_8N2 = 0x0E,     //!< 8 data bits, no parity, 2 stop bits  \hideinitializer
+    kSerial_5E1 = 0x20,     //!< 5 data bits, even parity, 1 stop bit  \hideinitializer
+    kSerial_6E1 = 0x22,     //!< 6 data bits, even parity, 1 stop bit  \hideinitializer
+    kSerial_7E1 = 0x24,     //!< 7 data bits, even parity, 1 stop bit  \hideinitializer
+    kSerial_8E1 = 0x26,     //!< 8 data bits, even parity, 1 stop bit  \hideinitializer
+    kSerial_5E2 = 0x28,     //!< 5 data bits, even parity, 2 stop bits  \hideinitializer
+    kSerial_6E2 = 0x2A,     //!< 6 data bits, even parity, 2 stop bits  \hideinitializer
+    kSerial_7E2 = 0x2C,     //!< 7 data bits, even parity, 2 stop bits  \hideinitializer
+    kSerial_8E2 = 0x2E,     //!< 8 data bits, even parity, 2 stop bits  \hideinitializer
+    kSerial_5O1 = 0x30,     //!< 5 data bits, odd parity, 1 stop bit  \hideinitializer
+    kSerial_6O1 = 0x32,     //!< 6 data bits, odd parity, 1 stop bit  \hideinitializer
+    kSerial_7O1 = 0x34,     //!< 7 data bits, odd parity, 1 stop bit  \hideinitializer
+    kSerial_8O1 = 0x36,     //!< 8 data bits, odd parity, 1 stop bit  \hideinitializer
+    kSerial_5O2 = 0x38,     //!< 5 data bits, odd parity, 2 stop bits  \hideinitializer
+    kSerial_6O2 = 0x3A,     //!< 6 data bits, odd parity, 2 stop bits  \hideinitializer
+    kSerial_7O2 = 0x3C,     //!< 7 data bits, odd parity, 2 stop bits  \hideinitializer
+    kSerial_8O2 = 0x3E      //!< 8 data bits, odd parity, 2 stop bits  \hideinitializer
+};
+
+#endif
+
+
+
+
+/*!
+ * \brief Provides the same interface as Serial0 for a UsartEngine instantiation chosen by the
+ * application.
+ *
+ * \tparam ENGINE the UsartEngine instantiation (port and buffer sizes) this SerialPort uses.
+ */
+
+template< class ENGINE > class SerialPort : public Writer, public Reader
+{
+public:
+
+    /*!
+     * \brief Configure the hardware for two-way serial communications, including turning on associated
+     * interrupts.  You must call this function before reading from or writing to the SerialPort.
+     *
+     * \arg \c baudRate the baud rate for the communications.
+     *
+     * \arg \c config sets the configuration in term of data bits, parity, and stop bits.
+     * If omitted, the default is 8 data bits, no parity, and 1 stop bit.
+     */
+    void start( unsigned long baudRate, UsartSerialConfiguration config = kSerial_8N1 )
+    { ENGINE::start( baudRate, static_cast<uint8_t>( config ) ); }
+
+
+    /*!
+     * \brief Stops buffered serial communications by deconfiguring
+     * the hardware and turning off interrupts.
+     */
+    void stop()
+    { ENGINE::stop(); }
+
+
+
+    /*!
+     * \brief Write a single character to the output stream.  This implements the pure virtual function
+     * Writer::write( char c ).
+     *
+     * \arg \c c the character to be written.
+     *
+     * \returns the number of bytes written.
+     */
+    virtual size_t write( char c )
+    { return ENGINE::write( c ); }
+
+    /*!
+     * \brief Write a null-terminated string to the output stream.  This implements the pure virtual function
+     * Writer::write( char* str ).
+     *
+     * \arg \c str the string to be written.
+     *
+     * \returns the number of bytes written.
+     */
+    virtual size_t write( const char* str )
+    { return ENGINE::write( str ); }
+
+    /*!
+     * \brief Write a given number of characters from a buffer to the output stream.  This implements the pure virtual function
+     * Writer::write( const char* buffer, size_t size ).
+     *
+     * \arg \c buffer the buffer of characters to write.
+     * \arg \c size the number of characters to write
+     *
+     * \returns the number of bytes written.
+     */
+    virtual size_t write( const char* buffer, size_t size )
+    { return ENGINE::write( reinterpret_cast< const uint8_t*>( buffer ), size ); }
+
+    /*!
+     * \brief Write a given number of bytes from a buffer to the output stream.  This implements the pure virtual function
+     * Writer::write( const uint8_t* buffer, size_t size ).
+     *
+     * \arg \c buffer the buffer of bytes to write.
+     * \arg \c size the number of bytes to write
+     *
+     * \returns the number of bytes written.
+     */
+    virtual size_t write( const uint8_t* buffer, size_t size )
+    { return ENGINE::write( buffer, size ); }
+
+    /*!
+     * \brief Transmit a byte array asynchronously, directly from the caller's memory, without copying it into
+     * the transmit buffer.  The function returns immediately; when the status variable reports kUsartCompletedOk
+     * the array may be reused.  See UsartEngine::writeNoCopy() for details.
+     *
+     * \arg \c data the byte array to transmit.
+     * \arg \c n the number of bytes to transmit.
+     * \arg \c status a pointer to a byte-size location in which the status of the transmission will be
+     * reported (values correspond to UsartTxStatusCodes); may be null.
+     */
+    void writeNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status )
+    { ENGINE::writeNoCopy( data, n, status ); }
+
+    /*!
+     * \brief Like writeNoCopy(), but transmits a byte array stored in flash (PROGMEM).
+     *
+     * \arg \c data the byte array in flash to transmit.
+     * \arg \c n the number of bytes to transmit.
+     * \arg \c status a pointer to a byte-size location in which the status of the transmission will be
+     * reported (values correspond to UsartTxStatusCodes); may be null.
+     */
+    void writeNoCopy_P( const uint8_t* data, size_t n, volatile uint8_t* status )
+    { ENGINE::writeNoCopy_P( data, n, status ); }
+
+
+    /*!
+     * \brief Flush the output stream.  When this function returns, all previously
+     * written data will have been transmitted through the underlying output stream.
+     * This implements the pure virtual function Writer::flush().
+     */
+    virtual void flush()
+    { ENGINE::flush(); }
+
+
+
+    /*!
+     * \brief Turn on detection of line (or frame) terminators as bytes arrive.  See UsartEngine::enableLineDetection().
+     *
+     * \arg \c terminator the character that ends a line or frame.  If omitted, the default is SERIAL_INPUT_EOL.
+     */
+    void enableLineDetection( char terminator = SERIAL_INPUT_EOL )
+    { ENGINE::enableLineDetection( terminator ); }
+
+    /*!
+     * \brief Turn off detection of line terminators as bytes arrive.
+     */
+    void disableLineDetection()
+    { ENGINE::disableLineDetection(); }
+
+    /*!
+     * \brief Get the number of complete lines waiting in the input stream (a constant-time check).
+     * Requires line detection to be on.
+     *
+     * \returns the number of complete lines waiting (0 if line detection is off).
+     */
+    uint8_t completedLines()
+    { return ENGINE::completedLines(); }
+
+    /*!
+     * \brief Extract the next complete line from the input stream without waiting; the result is null-terminated
+     * and does not include the terminator.  Unlike Reader::readLine(), this never blocks.
+     * Requires line detection to be on.
+     *
+     * \arg \c buffer the array where the line will be stored.
+     * \arg \c length the size of the array (including room for the null terminator).
+     *
+     * \returns the number of characters stored (not including the null terminator), or -1 if no complete
+     * line is waiting.
+     */
+    int readCompletedLine( char* buffer, size_t length )
+    { return ENGINE::readCompletedLine( buffer, length ); }
+
+
+    /*!
+     * \brief Turn on RTS (ready to send) flow control.  See UsartEngine::enableRtsFlowControl().
+     *
+     * \arg \c rts the GPIO pin variable used as the RTS output.
+     * \arg \c highWaterMark the number of bytes in the receive buffer at which RTS is deasserted.  If omitted,
+     * the default is three-quarters of the receive buffer.
+     */
+    void enableRtsFlowControl( const GpioPinVariable& rts, size_t highWaterMark = ENGINE::kDefaultRtsHighWaterMark )
+    { ENGINE::enableRtsFlowControl( rts, highWaterMark ); }
+
+    /*!
+     * \brief Turn on CTS (clear to send) flow control.  See UsartEngine::enableCtsFlowControl().
+     *
+     * \arg \c cts the GPIO pin variable used as the CTS input.
+     */
+    void enableCtsFlowControl( const GpioPinVariable& cts )
+    { ENGINE::enableCtsFlowControl( cts ); }
+
+    /*!
+     * \brief Turn off RTS and CTS flow control.
+     */
+    void disableFlowControl()
+    { ENGINE::disableFlowControl(); }
+
+    /*!
+     * \brief Resume transmission if it was paused by CTS flow control and CTS is now asserted.
+     */
+    void serviceFlowControl()
+    { ENGINE::serviceFlowControl(); }
+
+
+    // Virtual functions from Reader
+
+    /*!
+     * \brief Read and remove the next byte from the input stream.  This implements the pure virtual function
+     * Reader::read().
+     *
+     * \returns the next byte, or -1 if there is nothing to read in the input stream.
+     */
+    virtual int read()
+    { return ENGINE::read(); }
+
+    /*!
+     * \brief Examine the next byte from the input stream, without removing it.  This implements the pure
+     * virtual function Reader::peek().
+     *
+     * \returns the next byte, or -1 if there is nothing to read in the input stream.
+     */
+    virtual int peek()
+    { return ENGINE::peek(); }
+
+    /*!
+     * \brief Determine if data is available in the input stream.  This implements the pure
+     * virtual function Reader::available().
+     *
+     * \returns True if data is available in the stream; false if not.
+     */
+    virtual bool available()
+    { return ENGINE::available(); }
+
+    /*!
+     * \brief Read and remove the bytes already waiting in the input stream in a single block, without waiting
+     * for more to arrive.  This overrides the virtual function Reader::readAvailable().
+     *
+     * \arg \c buffer a pointer to where the bytes read will be stored.
+     * \arg \c length the maximum number of bytes to read.
+     *
+     * \returns the number of bytes placed in the buffer (possibly 0).
+     */
+    virtual size_t readAvailable( uint8_t* buffer, size_t length )
+    { return ENGINE::read( buffer, length ); }
+};
+
+
+#endif
@@ -0,0 +1,113 @@
+/*
+    SleepUtils.h - Utilities for sleeping (instead of spinning) while
+    waiting for an interrupt to signal that something has happened.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides utilities for putting the CPU to sleep while waiting for an interrupt.
+ *
+ * If the macro \c LOW_POWER_WAITS is defined when the library is compiled, the library's blocking waits go to
+ * sleep between interrupts instead of spinning:  delayMilliseconds() sleeps between timer0 overflows, the
+ * synchronous I2cMaster functions sleep between TWI interrupts, and readA2D() sleeps until the ADC conversion
+ * complete interrupt.  The functions behave exactly as before; only the power drawn while waiting changes.
+ * If \c LOW_POWER_WAITS is not defined, these utilities reduce to plain busy-wait loops.
+ *
+ * The CPU only sleeps if interrupts are enabled when the wait begins (otherwise nothing could wake it);
+ * with interrupts disabled, the waits spin as before.
+ *
+ * If \c LOW_POWER_A2D_NOISE_REDUCTION is also defined, readA2D() uses ADC noise reduction mode rather than
+ * idle mode.  That mode improves accuracy, but it halts the I/O clock (and so timer0 and the system clock)
+ * for the duration of each conversion, so millis() and micros() fall behind by about 100 us per reading.
+ */
+
+
+
+#ifndef SleepUtils_h
+#define SleepUtils_h
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+
+
+/*!
+ * \brief Sleep until the next interrupt, but only if the wait condition still holds.
+ *
+ * The condition is tested with interrupts disabled, and interrupts are re-enabled by the instruction
+ * immediately before the sleep instruction (which always executes before any pending interrupt is
+ * serviced), so an interrupt that ends the wait cannot slip in between the test and the sleep.
+ *
+ * If \c LOW_POWER_WAITS is not defined, or if interrupts are disabled, this returns immediately.
+ *
+ * \arg \c busy a function or function object returning true while the wait should continue.
+ * \arg \c sleepMode the sleep mode to use (for example, SLEEP_MODE_IDLE).
+ */
+
+template< typename PREDICATE > inline void sleepUntilInterruptIf( PREDICATE busy, uint8_t sleepMode )
+{
+#ifdef LOW_POWER_WAITS
+    if ( SREG & ( 1 << SREG_I ) )
+    {
+        set_sleep_mode( sleepMode );
+        cli();
+        if ( busy() )
+        {
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+    }
+#else
+    (void) busy;
+    (void) sleepMode;
+#endif
+}
+
+
+
+/*!
+ * \brief Wait as long as a condition holds, sleeping between interrupts.
+ *
+ * With \c LOW_POWER_WAITS defined (and interrupts enabled) the CPU sleeps until an interrupt and then tests the
+ * condition again; otherwise this is a busy-wait loop.  Some interrupt must end the wait, or at least occur
+ * periodically (the timer0 overflow interrupt of the system clock does).
+ *
+ * \arg \c busy a function or function object returning true while the wait should continue.
+ * \arg \c sleepMode the sleep mode to use (for example, SLEEP_MODE_IDLE).
+ */
+
+template< typename PREDICATE > inline void sleepWhile( PREDICATE busy, uint8_t sleepMode )
+{
+    while ( busy() )
+    {
+        sleepUntilInterruptIf( busy, sleepMode );
+    }
+}
+
+
+
+#endif
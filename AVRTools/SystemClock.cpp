@@ -31,6 +31,8 @@
 #include <avr/interrupt.h>
 #include <util/atomic.h>
 
+#include "Profiler.h"
+#include "SleepUtils.h"
 
 
 namespace
@@ -54,6 +56,111 @@ namespace
     volatile unsigned long      timer0_millis;
     uint8_t                     timer0_fract;
 
+
+
+#ifdef SYSTEM_CLOCK_SLEEP
+
+    // Timer2 measures the time timer0 spends stopped.  Rates are kept as fractions so they stay exact.
+#ifdef SYSTEM_CLOCK_SLEEP_ASYNC
+
+    // Timer2 runs from a 32.768 kHz crystal with a prescaler of 32, so it ticks 1024 times a second
+    const uint8_t  kTimer2Prescale = ( 1 << CS21 ) | ( 1 << CS20 );
+    const uint8_t  kSleepMode = SLEEP_MODE_PWR_SAVE;
+
+    const uint32_t kTimer2TicksPerMsNum = 128;
+    const uint32_t kTimer2TicksPerMsDen = 125;
+
+    const uint32_t kTimer0TicksPerTimer2Num = F_CPU / 64;
+    const uint32_t kTimer0TicksPerTimer2Den = 1024;
+
+    // Writes to the asynchronous timer take a couple of crystal cycles, so leave some margin
+    const uint8_t  kMinSleepTicks = 3;
+
+#else
+
+    // Timer2 runs from the CPU clock with a prescaler of 1024 (so 16 timer0 ticks per timer2 tick)
+    const uint8_t  kTimer2Prescale = ( 1 << CS22 ) | ( 1 << CS21 ) | ( 1 << CS20 );
+    const uint8_t  kSleepMode = SLEEP_MODE_IDLE;
+
+    const uint32_t kTimer2TicksPerMsNum = F_CPU / 1000;
+    const uint32_t kTimer2TicksPerMsDen = 1024;
+
+    const uint32_t kTimer0TicksPerTimer2Num = 16;
+    const uint32_t kTimer0TicksPerTimer2Den = 1;
+
+    const uint8_t  kMinSleepTicks = 2;
+
+#endif
+
+    // Each sleep must end well before timer2 wraps, or the elapsed time would be ambiguous
+    const uint8_t  kMaxSleepTicks = 192;
+
+    uint16_t                    timer0_carry;
+    bool                        timer2_started;
+    volatile bool               timer2_matched;
+
+
+
+    // Call with interrupts disabled
+    void startTimer2()
+    {
+        TIMSK2 = 0;
+#ifdef SYSTEM_CLOCK_SLEEP_ASYNC
+        ASSR = ( 1 << AS2 );
+#else
+        ASSR = 0;
+#endif
+        TCNT2 = 0;
+        OCR2A = 0;
+        TCCR2A = 0;
+        TCCR2B = kTimer2Prescale;
+
+#ifdef SYSTEM_CLOCK_SLEEP_ASYNC
+        // The new settings reach the asynchronous timer after a couple of crystal cycles
+        while ( ASSR & ( ( 1 << TCN2UB ) | ( 1 << OCR2AUB ) | ( 1 << TCR2AUB ) | ( 1 << TCR2BUB ) ) )
+            ;
+#endif
+
+        TIFR2 = ( 1 << OCF2A ) | ( 1 << OCF2B ) | ( 1 << TOV2 );
+        timer2_started = true;
+    }
+
+
+
+    // Call with interrupts disabled
+    uint8_t readTimer2()
+    {
+#ifdef SYSTEM_CLOCK_SLEEP_ASYNC
+        // Just after waking from power-save TCNT2 may not have been updated yet; a write to
+        // TCCR2A completes only after a crystal cycle, which makes the following read valid
+        TCCR2A = 0;
+        while ( ASSR & ( 1 << TCR2AUB ) )
+            ;
+#endif
+        return TCNT2;
+    }
+
+
+
+    // Call with interrupts disabled and timer0 stopped.  Adds the time measured by timer2 to the system clock.
+    void advanceSystemClock( uint8_t timer2Ticks )
+    {
+        uint32_t n = static_cast<uint32_t>( timer2Ticks ) * kTimer0TicksPerTimer2Num + timer0_carry;
+        timer0_carry = n % kTimer0TicksPerTimer2Den;
+
+        uint32_t t = TCNT0 + n / kTimer0TicksPerTimer2Den;
+        uint32_t overflows = t >> 8;
+        TCNT0 = t;
+
+        // Same arithmetic as the overflow interrupt, done all at once
+        uint32_t f = timer0_fract + overflows * kFractInc;
+        timer0_millis += overflows * kMillisInc + f / kFractMax;
+        timer0_fract = f % kFractMax;
+        timer0_overflow_count += overflows;
+    }
+
+#endif
+
 };
 
 
@@ -61,6 +168,8 @@ namespace
 
 ISR( TIMER0_OVF_vect )
 {
+    PROFILE_PROBE( kProfileSystemClock );
+
     // Copy these to local variables so they can be stored in registers
     // (volatile variables must be read from memory on every access)
     unsigned long m = timer0_millis;
@@ -81,6 +190,18 @@ ISR( TIMER0_OVF_vect )
 
 
 
+#ifdef SYSTEM_CLOCK_SLEEP
+
+ISR( TIMER2_COMPA_vect )
+{
+    // Only here to wake the CPU from sleepMilliseconds()
+    timer2_matched = true;
+}
+
+#endif
+
+
+
 unsigned long millis()
 {
     // Disable interrupts while we read timer0_millis or we might get an
@@ -132,12 +253,111 @@ void delayMilliseconds( unsigned long ms )
             ms--;
             start += 1000;
         }
+        else if ( ms > kMillisInc + 1 )
+        {
+            // More than one timer0 overflow to go, so the overflow interrupt will wake us in time
+            sleepUntilInterruptIf( []{ return true; }, SLEEP_MODE_IDLE );
+        }
     }
 }
 
 
 
 
+#ifdef SYSTEM_CLOCK_SLEEP
+
+unsigned long sleepMilliseconds( unsigned long ms, bool stopOnInterrupt )
+{
+    // Round up, so we never sleep short
+    uint32_t target = ( static_cast<uint64_t>( ms ) * kTimer2TicksPerMsNum + kTimer2TicksPerMsDen - 1 ) / kTimer2TicksPerMsDen;
+    uint32_t slept = 0;
+    bool canSleep = SREG & ( 1 << SREG_I );
+    uint8_t last;
+    uint8_t tccr0b;
+
+    cli();
+
+    if ( !timer2_started )
+    {
+        startTimer2();
+    }
+
+    // Stop timer0; from here on timer2 keeps time
+    tccr0b = TCCR0B;
+    TCCR0B = tccr0b & ~( ( 1 << CS02 ) | ( 1 << CS01 ) | ( 1 << CS00 ) );
+    last = readTimer2();
+
+    while ( true )
+    {
+        // Interrupts are disabled here
+        uint8_t now = readTimer2();
+        uint8_t elapsed = now - last;
+        last = now;
+        slept += elapsed;
+        advanceSystemClock( elapsed );
+
+        if ( slept >= target )
+        {
+            break;
+        }
+
+        uint32_t remaining = target - slept;
+        if ( canSleep && remaining >= kMinSleepTicks )
+        {
+            OCR2A = now + ( remaining > kMaxSleepTicks ? kMaxSleepTicks : remaining );
+#ifdef SYSTEM_CLOCK_SLEEP_ASYNC
+            while ( ASSR & ( 1 << OCR2AUB ) )
+                ;
+#endif
+            TIFR2 = ( 1 << OCF2A );
+            TIMSK2 = ( 1 << OCIE2A );
+            timer2_matched = false;
+
+            // Interrupts are enabled by the instruction just before sleep, so the match cannot be missed
+            set_sleep_mode( kSleepMode );
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+
+            cli();
+            TIMSK2 = 0;
+
+            if ( stopOnInterrupt && !timer2_matched )
+            {
+                now = readTimer2();
+                elapsed = now - last;
+                slept += elapsed;
+                advanceSystemClock( elapsed );
+                break;
+            }
+        }
+
+        // Let any pending interrupts run before checking the time again (an interrupt
+        // is only serviced after the instruction following sei() has executed)
+        if ( canSleep )
+        {
+            sei();
+            __asm__ __volatile__ ( "nop" );
+            cli();
+        }
+    }
+
+    TCCR0B = tccr0b;
+
+    if ( canSleep )
+    {
+        sei();
+    }
+
+    return static_cast<uint64_t>( slept ) * kTimer2TicksPerMsDen / kTimer2TicksPerMsNum;
+}
+
+#endif
+
+
+
+
 // Delay for the given number of microseconds.  Assumes an 8 MHz, 12 MHz, or 16 MHz clock.
 void delayMicroseconds( unsigned int us )
 {
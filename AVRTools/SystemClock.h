@@ -35,6 +35,17 @@
  * routine is installed regardless of whether the system clock is actually initialized or not.
  * If you have other uses for timer0, do not use SystemClock functions and do not link against SystemClock.cpp.
  *
+ * If the macro \c SYSTEM_CLOCK_SLEEP is defined when SystemClock.cpp is compiled, sleepMilliseconds() is also
+ * available.  It stops timer0 and sleeps with timer2 set to wake the CPU at the deadline, so the CPU is not woken
+ * every millisecond by the timer0 overflow interrupt; millis() and micros() are corrected on each wake.  By default
+ * timer2 runs from the CPU clock and the CPU sleeps in idle mode.  If \c SYSTEM_CLOCK_SLEEP_ASYNC is also
+ * defined, timer2 runs asynchronously from a 32.768 kHz watch crystal on the TOSC1/TOSC2 pins and the CPU sleeps
+ * in power-save mode, which draws far less current.  (The standard Arduino Uno cannot do this, because on the
+ * ATmega328P the TOSC pins are the main crystal pins; the ATmega2560 has separate TOSC pins.)
+ *
+ * \note With \c SYSTEM_CLOCK_SLEEP defined, SystemClock.cpp also takes over timer2 and installs an interrupt
+ * function for timer2 compare match A, so you cannot use timer2 (including PWM on its pins) for anything else.
+ *
  */
 
 
@@ -124,4 +135,38 @@ unsigned long millis();
 
 
 
+#ifdef SYSTEM_CLOCK_SLEEP
+
+/*!
+ * \brief Sleep for a certain number of milliseconds without waking every millisecond for the system clock.
+ *
+ * Timer0 stops while the CPU sleeps, and timer2 (which keeps running) wakes the CPU at the deadline.
+ * Each time the CPU wakes, the time measured by timer2 is added to the system clock, so millis() and micros()
+ * stay correct (each call loses or gains at most one timer2 tick:  64 us at 16 MHz, or about a millisecond with
+ * \c SYSTEM_CLOCK_SLEEP_ASYNC).
+ * Other interrupts can still wake the CPU; they are serviced as usual and, unless \c stopOnInterrupt is true,
+ * the CPU goes back to sleep until the deadline.
+ *
+ * Sleep only happens if interrupts are enabled when this function is called; any final fraction of the delay too
+ * short to sleep through is spent in a busy wait.  PWM outputs on timer0 pins freeze while timer0 is stopped.
+ * With \c SYSTEM_CLOCK_SLEEP_ASYNC defined, the first call starts the watch crystal oscillator, which can take up
+ * to a second to stabilize (so make a short first call during start up), and the CPU sleeps in power-save mode,
+ * in which only timer2, the TWI address match, the watchdog, and the external and pin change interrupts can wake it.
+ *
+ * \arg \c ms the number of milliseconds to sleep.
+ * \arg \c stopOnInterrupt if true, return as soon as any other interrupt wakes the CPU.
+ *
+ * \returns the number of milliseconds actually slept (less than \c ms only if \c stopOnInterrupt is true).
+ *
+ * \note This function is only available if the macro \c SYSTEM_CLOCK_SLEEP is defined when SystemClock.cpp
+ * is compiled (and when your code includes SystemClock.h).
+ *
+ */
+
+unsigned long sleepMilliseconds( unsigned long ms, bool stopOnInterrupt = false );
+
+#endif
+
+
+
 #endif
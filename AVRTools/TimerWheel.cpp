@@ -0,0 +1,476 @@
+/*
+    TimerWheel.cpp - A timer wheel of periodic and one-shot callbacks
+    driven by the system clock (timer0).
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "TimerWheel.h"
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "SystemClock.h"
+
+
+
+namespace
+{
+    // Timer0 ticks every 64 clock cycles and the wheel advances every 256 ticks (same as the system clock)
+    const uint16_t kTickUs = clockCyclesToMicroseconds( 64 * 256 );
+
+    const uint8_t kNone = 0xFF;
+    const uint8_t kSlotMask = TIMER_WHEEL_SLOTS - 1;
+
+    enum
+    {
+        kActive         = 0x01,
+        kRepeat         = 0x02,
+        kDeferred       = 0x04,
+        kZombie         = 0x80      // Removed during a tick; freed when the tick ends
+    };
+
+    struct TimerTask
+    {
+        TimerTaskCallback   mCallback;
+        void*               mContext;
+        uint32_t            mPeriod;        // In microseconds
+        uint16_t            mRemainder;     // Microseconds carried over between expiries
+        uint16_t            mRounds;        // Further passes of the wheel before expiry
+        uint8_t             mNext;
+        uint8_t             mSlot;
+        uint8_t             mFlags;
+        volatile uint8_t    mPending;       // Deferred expiries not yet run
+    };
+
+    TimerTask           gTasks[ TIMER_WHEEL_MAX_TASKS ];
+    uint8_t             gSlots[ TIMER_WHEEL_SLOTS ];
+    uint8_t             gCursor;
+    bool                gInitialized;
+    bool                gInTick;
+    bool                gZombies;
+
+#ifdef SYSTEM_CLOCK_SLEEP
+    uint8_t             gTickCount;
+#endif
+
+
+
+    // Call with interrupts disabled
+    void initWheel()
+    {
+        for ( uint8_t i = 0; i < TIMER_WHEEL_SLOTS; ++i )
+        {
+            gSlots[i] = kNone;
+        }
+        gInitialized = true;
+    }
+
+
+
+    // Call with interrupts disabled.  Files the task for its next expiry, one period from the current tick.
+    void scheduleTask( uint8_t index )
+    {
+        TimerTask* t = &gTasks[ index ];
+
+        uint32_t total = t->mRemainder + t->mPeriod;
+        uint32_t delay = total / kTickUs;
+        t->mRemainder = total % kTickUs;
+        if ( !delay )
+        {
+            delay = 1;
+            t->mRemainder = 0;
+        }
+
+        t->mRounds = ( delay - 1 ) / TIMER_WHEEL_SLOTS;
+        t->mSlot = ( gCursor + delay ) & kSlotMask;
+        t->mNext = gSlots[ t->mSlot ];
+        gSlots[ t->mSlot ] = index;
+    }
+
+
+
+    // Call with interrupts disabled
+    void unlinkTask( uint8_t index )
+    {
+        TimerTask* t = &gTasks[ index ];
+
+        if ( t->mSlot != kNone )
+        {
+            uint8_t* link = &gSlots[ t->mSlot ];
+            while ( *link != index )
+            {
+                link = &gTasks[ *link ].mNext;
+            }
+            *link = t->mNext;
+            t->mSlot = kNone;
+        }
+    }
+
+
+
+#ifdef SYSTEM_CLOCK_SLEEP
+
+    // Call with interrupts disabled.  The number of ticks until a filed task expires (at least 1).
+    uint32_t ticksToExpiry( const TimerTask* t )
+    {
+        return ( ( t->mSlot - gCursor - 1 ) & kSlotMask ) + 1 + static_cast<uint32_t>( t->mRounds ) * TIMER_WHEEL_SLOTS;
+    }
+
+
+
+    // Call with interrupts disabled.  Moves the wheel forward by ticks that the interrupt never saw.
+    void skipTicks( uint32_t nbrTicks )
+    {
+        uint8_t overdue[ TIMER_WHEEL_MAX_TASKS ];
+        uint8_t nbrOverdue = 0;
+
+        for ( uint8_t i = 0; i < TIMER_WHEEL_MAX_TASKS; ++i )
+        {
+            TimerTask* t = &gTasks[i];
+
+            if ( ( t->mFlags & kActive ) && t->mSlot != kNone )
+            {
+                uint32_t d = ticksToExpiry( t );
+                if ( d > nbrTicks )
+                {
+                    // Same slot, fewer passes of the wheel
+                    t->mRounds = ( d - nbrTicks - 1 ) / TIMER_WHEEL_SLOTS;
+                }
+                else
+                {
+                    unlinkTask( i );
+                    overdue[ nbrOverdue++ ] = i;
+                }
+            }
+        }
+
+        gCursor = ( gCursor + nbrTicks ) & kSlotMask;
+
+        // Anything that should already have expired does so on the next tick
+        for ( uint8_t k = 0; k < nbrOverdue; ++k )
+        {
+            TimerTask* t = &gTasks[ overdue[k] ];
+            t->mRounds = 0;
+            t->mSlot = ( gCursor + 1 ) & kSlotMask;
+            t->mNext = gSlots[ t->mSlot ];
+            gSlots[ t->mSlot ] = overdue[k];
+        }
+    }
+
+#endif
+
+}
+
+
+
+
+ISR( TIMER0_COMPB_vect )
+{
+    uint8_t fired[ TIMER_WHEEL_MAX_TASKS ];
+    uint8_t nbrFired = 0;
+
+    gInTick = true;
+    gCursor = ( gCursor + 1 ) & kSlotMask;
+#ifdef SYSTEM_CLOCK_SLEEP
+    ++gTickCount;
+#endif
+
+    // Take expired tasks off the current slot; they are rescheduled once the walk is done,
+    // so a task that is refiled in this same slot is not visited again
+    uint8_t* link = &gSlots[ gCursor ];
+    while ( *link != kNone )
+    {
+        uint8_t i = *link;
+        TimerTask* t = &gTasks[ i ];
+
+        if ( t->mRounds )
+        {
+            --t->mRounds;
+            link = &t->mNext;
+        }
+        else
+        {
+            *link = t->mNext;
+            t->mSlot = kNone;
+            fired[ nbrFired++ ] = i;
+        }
+    }
+
+    for ( uint8_t k = 0; k < nbrFired; ++k )
+    {
+        TimerTask* t = &gTasks[ fired[k] ];
+
+        if ( t->mFlags & kRepeat )
+        {
+            scheduleTask( fired[k] );
+        }
+
+        if ( ( t->mFlags & kDeferred ) && t->mPending < 0xFF )
+        {
+            ++t->mPending;
+        }
+    }
+
+    // Callbacks run last; one may remove tasks that expired in this same tick
+    for ( uint8_t k = 0; k < nbrFired; ++k )
+    {
+        TimerTask* t = &gTasks[ fired[k] ];
+
+        if ( ( t->mFlags & ( kActive | kDeferred ) ) == kActive )
+        {
+            if ( !( t->mFlags & kRepeat ) )
+            {
+                t->mFlags = kZombie;
+                gZombies = true;
+            }
+            t->mCallback( t->mContext );
+        }
+    }
+
+    if ( gZombies )
+    {
+        for ( uint8_t i = 0; i < TIMER_WHEEL_MAX_TASKS; ++i )
+        {
+            if ( gTasks[i].mFlags == kZombie )
+            {
+                gTasks[i].mFlags = 0;
+            }
+        }
+        gZombies = false;
+    }
+
+    gInTick = false;
+}
+
+
+
+
+int8_t addTimerTaskMicroseconds( TimerTaskCallback callback, void* context, uint32_t periodUs,
+                                 TimerTaskMode mode, bool repeat )
+{
+    if ( !callback )
+    {
+        return kTimerErrBadCallback;
+    }
+
+    if ( !periodUs || periodUs > 0xFFFFFFFFUL - kTickUs
+            || periodUs / kTickUs >= 65536UL * TIMER_WHEEL_SLOTS )
+    {
+        return kTimerErrBadPeriod;
+    }
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        if ( !gInitialized )
+        {
+            initWheel();
+        }
+
+        for ( uint8_t i = 0; i < TIMER_WHEEL_MAX_TASKS; ++i )
+        {
+            TimerTask* t = &gTasks[i];
+
+            if ( !t->mFlags )
+            {
+                t->mCallback = callback;
+                t->mContext = context;
+                t->mPeriod = periodUs;
+                t->mRemainder = 0;
+                t->mPending = 0;
+                t->mFlags = kActive
+                            | ( repeat ? kRepeat : 0 )
+                            | ( ( mode == kTimerDeferred ) ? kDeferred : 0 );
+                scheduleTask( i );
+
+                // Start the wheel (timer0 compare match B fires once per timer0 period)
+                TIMSK0 |= ( 1 << OCIE0B );
+
+                return i;
+            }
+        }
+    }
+
+    return kTimerErrNoFreeTask;
+}
+
+
+
+
+bool removeTimerTask( int8_t handle )
+{
+    if ( handle < 0 || handle >= TIMER_WHEEL_MAX_TASKS )
+    {
+        return false;
+    }
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        TimerTask* t = &gTasks[ handle ];
+
+        if ( !( t->mFlags & kActive ) )
+        {
+            return false;
+        }
+
+        unlinkTask( handle );
+        t->mPending = 0;
+
+        if ( gInTick )
+        {
+            // The tick interrupt may still be holding on to this task
+            t->mFlags = kZombie;
+            gZombies = true;
+        }
+        else
+        {
+            t->mFlags = 0;
+        }
+    }
+
+    return true;
+}
+
+
+
+
+uint8_t runTimerTasks()
+{
+    uint8_t nbrRun = 0;
+
+    for ( uint8_t i = 0; i < TIMER_WHEEL_MAX_TASKS; ++i )
+    {
+        TimerTask* t = &gTasks[i];
+
+        while ( true )
+        {
+            TimerTaskCallback callback = 0;
+            void* context = 0;
+
+            ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+            {
+                if ( ( t->mFlags & ( kActive | kDeferred ) ) == ( kActive | kDeferred ) && t->mPending )
+                {
+                    --t->mPending;
+                    callback = t->mCallback;
+                    context = t->mContext;
+
+                    // An expired one-shot task is no longer on the wheel; release it before the callback runs
+                    if ( !( t->mFlags & kRepeat ) && !t->mPending )
+                    {
+                        t->mFlags = 0;
+                    }
+                }
+            }
+
+            if ( !callback )
+            {
+                break;
+            }
+
+            callback( context );
+            ++nbrRun;
+        }
+    }
+
+    return nbrRun;
+}
+
+
+
+
+#ifdef SYSTEM_CLOCK_SLEEP
+
+unsigned long sleepUntilNextTimerTask( unsigned long maxMs, bool stopOnInterrupt )
+{
+    // Microseconds per timer0 count, as in micros()
+    const uint8_t kUsPerCount = 64 / clockCyclesPerMicrosecond();
+
+    uint32_t nextTicks = 0xFFFFFFFFUL;
+    uint32_t startUs;
+    uint8_t startTicks;
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        for ( uint8_t i = 0; i < TIMER_WHEEL_MAX_TASKS; ++i )
+        {
+            TimerTask* t = &gTasks[i];
+
+            if ( t->mFlags & kActive )
+            {
+                if ( t->mPending )
+                {
+                    return 0;
+                }
+
+                if ( t->mSlot != kNone )
+                {
+                    uint32_t d = ticksToExpiry( t );
+                    if ( d < nextTicks )
+                    {
+                        nextTicks = d;
+                    }
+                }
+            }
+        }
+
+        // A tick whose interrupt is still pending counts as already seen
+        startUs = micros();
+        startTicks = gTickCount + ( ( TIFR0 & ( 1 << OCF0B ) ) ? 1 : 0 );
+    }
+
+    if ( nextTicks != 0xFFFFFFFFUL )
+    {
+        // Wake at least one tick early, so the wheel itself expires the task
+        uint32_t limit = ( nextTicks - 1 ) * kTickUs / 1000;
+        if ( limit < maxMs )
+        {
+            maxMs = limit;
+        }
+    }
+
+    if ( !maxMs )
+    {
+        return 0;
+    }
+
+    unsigned long slept = sleepMilliseconds( maxMs, stopOnInterrupt );
+
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        // Count the compare matches timer0 would have made had it not been stopped (it went
+        // from its count at startUs to its count now), less the ticks the interrupt did see
+        uint32_t counts = ( micros() - startUs ) / kUsPerCount;
+        uint8_t phase = startUs / kUsPerCount - OCR0B;
+        uint32_t matches = ( phase + counts ) >> 8;
+        uint8_t seen = gTickCount + ( ( TIFR0 & ( 1 << OCF0B ) ) ? 1 : 0 ) - startTicks;
+
+        if ( matches > seen )
+        {
+            skipTicks( matches - seen );
+        }
+    }
+
+    return slept;
+}
+
+#endif
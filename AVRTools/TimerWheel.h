@@ -0,0 +1,222 @@
+/*
+    TimerWheel.h - A timer wheel of periodic and one-shot callbacks
+    driven by the system clock (timer0).
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief Include this file to run callbacks periodically (or once, after a delay) without polling millis().
+ *
+ * The timer wheel is a lightweight, cooperative scheduler.  Tasks are kept in a hashed timer wheel of
+ * \c TIMER_WHEEL_SLOTS slots that advances once per system clock tick (one timer0 overflow, 1.024 ms at
+ * 16 MHz), so the work done on each tick depends only on the tasks filed in the current slot, not on the
+ * total number of tasks.
+ *
+ * Each task runs in one of two modes:
+ * - kTimerRunInIsr: the callback is called directly from the tick interrupt.  Jitter is bounded by
+ * interrupt latency, but the callback must be short and must observe the usual restrictions on interrupt code.
+ * - kTimerDeferred: the tick interrupt only records that the task is due; the callback is called from
+ * runTimerTasks(), which you call from the main loop.  Each expiry results in one call (up to 255 pending).
+ *
+ * Periods are given in microseconds (or milliseconds) and are tracked to the microsecond, so a periodic task does not
+ * drift even when its period is not a whole number of ticks; individual expiries fall on tick boundaries.
+ * Periods shorter than one tick run once per tick.
+ *
+ * To use these functions, include TimerWheel.h in your source code and link against TimerWheel.cpp and
+ * SystemClock.cpp.  Call initSystemClock() before adding tasks.
+ *
+ * \note The timer wheel uses the timer0 compare match B interrupt, which fires once per timer0 period alongside
+ * the overflow interrupt that drives the system clock.  It does not interfere with PWM output on OC0B, but
+ * changing OCR0B moves the tick instant (once) by less than one tick.
+ *
+ * \note The maximum number of tasks is set at compile time by the macro \c TIMER_WHEEL_MAX_TASKS (default 8),
+ * and the number of wheel slots by \c TIMER_WHEEL_SLOTS (default 16, a power of 2).  Each task uses 16 bytes of RAM.
+ *
+ * If the macro \c SYSTEM_CLOCK_SLEEP is defined (see SystemClock.h), sleepUntilNextTimerTask() lets the main loop
+ * sleep between task expiries without waking on every tick.
+ */
+
+
+
+#ifndef TimerWheel_h
+#define TimerWheel_h
+
+#include <stdint.h>
+
+
+
+#ifndef TIMER_WHEEL_MAX_TASKS
+#define TIMER_WHEEL_MAX_TASKS       8
+#endif
+
+#if TIMER_WHEEL_MAX_TASKS < 1 || TIMER_WHEEL_MAX_TASKS > 64
+#error "TIMER_WHEEL_MAX_TASKS must be between 1 and 64"
+#endif
+
+
+#ifndef TIMER_WHEEL_SLOTS
+#define TIMER_WHEEL_SLOTS           16
+#endif
+
+#if TIMER_WHEEL_SLOTS < 2 || TIMER_WHEEL_SLOTS > 128 || ( TIMER_WHEEL_SLOTS & ( TIMER_WHEEL_SLOTS - 1 ) )
+#error "TIMER_WHEEL_SLOTS must be a power of 2 between 2 and 128"
+#endif
+
+
+
+
+/*!
+ * \brief The type of the callback functions run by the timer wheel.  The argument is the context pointer
+ * passed when the task was added.
+ */
+
+typedef void (*TimerTaskCallback)( void* context );
+
+
+
+/*!
+ * \brief This enum lists the modes in which a task's callback can be run.
+ */
+
+enum TimerTaskMode
+{
+    kTimerRunInIsr,         //!< Call the callback directly from the tick interrupt.
+    kTimerDeferred          //!< Call the callback from runTimerTasks().
+};
+
+
+
+/*!
+ * \brief This enum lists the error codes returned by addTimerTaskMicroseconds() and addTimerTaskMilliseconds().
+ */
+
+enum TimerTaskErrorCodes
+{
+    kTimerErrNoFreeTask     = -1,   //!< All TIMER_WHEEL_MAX_TASKS tasks are in use.
+    kTimerErrBadCallback    = -2,   //!< The callback is a null pointer.
+    kTimerErrBadPeriod      = -3    //!< The period is zero or too long for the wheel.
+};
+
+
+
+
+/*!
+ * \brief Add a task to the timer wheel.  The first expiry is one period from now.
+ *
+ * \arg \c callback the function to call.
+ * \arg \c context an arbitrary pointer passed to the callback.
+ * \arg \c periodUs the period (or, for one-shot tasks, the delay) in microseconds.  The limit is
+ * 65536 * TIMER_WHEEL_SLOTS ticks (about 18 minutes with 16 slots at 16 MHz).
+ * \arg \c mode whether the callback runs in the tick interrupt (kTimerRunInIsr) or from runTimerTasks()
+ * (kTimerDeferred).
+ * \arg \c repeat if true (the default), the task repeats every period until removed; if false, the task runs once
+ * and is then removed automatically.
+ *
+ * \returns a handle (0 or greater) that identifies the task in removeTimerTask(), or a negative
+ * TimerTaskErrorCodes value if the task cannot be added.
+ */
+
+int8_t addTimerTaskMicroseconds( TimerTaskCallback callback, void* context, uint32_t periodUs,
+                                 TimerTaskMode mode, bool repeat = true );
+
+
+
+/*!
+ * \brief Add a task to the timer wheel, with the period given in milliseconds.  The first expiry is one
+ * period from now.
+ *
+ * This is otherwise identical to addTimerTaskMicroseconds().
+ *
+ * \arg \c callback the function to call.
+ * \arg \c context an arbitrary pointer passed to the callback.
+ * \arg \c periodMs the period (or, for one-shot tasks, the delay) in milliseconds.
+ * \arg \c mode whether the callback runs in the tick interrupt (kTimerRunInIsr) or from runTimerTasks()
+ * (kTimerDeferred).
+ * \arg \c repeat if true (the default), the task repeats every period until removed; if false, the task runs once.
+ *
+ * \returns a handle (0 or greater), or a negative TimerTaskErrorCodes value if the task cannot be added.
+ */
+
+inline int8_t addTimerTaskMilliseconds( TimerTaskCallback callback, void* context, uint32_t periodMs,
+                                        TimerTaskMode mode, bool repeat = true )
+{
+    if ( periodMs > 0xFFFFFFFFUL / 1000 )
+    {
+        return kTimerErrBadPeriod;
+    }
+    return addTimerTaskMicroseconds( callback, context, periodMs * 1000, mode, repeat );
+}
+
+
+
+/*!
+ * \brief Remove a task from the timer wheel.  The callback is not called again (any deferred expiries not yet
+ * run by runTimerTasks() are discarded).
+ *
+ * This function can be called from anywhere, including from the task's own callback.
+ *
+ * \arg \c handle the handle returned when the task was added.
+ *
+ * \returns true if the task was removed; false if there was no such task (for example, a one-shot task that
+ * has already run).
+ */
+
+bool removeTimerTask( int8_t handle );
+
+
+
+/*!
+ * \brief Run the callbacks of deferred (kTimerDeferred) tasks that have expired.  Call this frequently from your
+ * main loop.
+ *
+ * \returns the number of callbacks run.
+ */
+
+uint8_t runTimerTasks();
+
+
+
+#ifdef SYSTEM_CLOCK_SLEEP
+
+/*!
+ * \brief Sleep with sleepMilliseconds() until just before the next task expires, then bring the wheel up to date
+ * so the task (and every later one) expires on time.  This does not sleep if a deferred task is waiting for
+ * runTimerTasks().
+ *
+ * A typical low-power main loop calls runTimerTasks() and then sleepUntilNextTimerTask().
+ *
+ * \arg \c maxMs the longest time to sleep, in milliseconds (whether or not any task is scheduled).
+ * \arg \c stopOnInterrupt if true, return as soon as any other interrupt wakes the CPU.
+ *
+ * \returns the number of milliseconds slept.
+ *
+ * \note This function is only available if the macro \c SYSTEM_CLOCK_SLEEP is defined when SystemClock.cpp and
+ * TimerWheel.cpp are compiled (and when your code includes TimerWheel.h).
+ */
+
+unsigned long sleepUntilNextTimerTask( unsigned long maxMs = 0xFFFFFFFFUL, bool stopOnInterrupt = false );
+
+#endif
+
+
+
+#endif
@@ -0,0 +1,149 @@
+/*
+    Trace.cpp - A compile-time optional, low-overhead binary event recorder
+    for AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "Trace.h"
+
+#ifdef EVENT_TRACING
+
+#include <stdint.h>
+
+#include <util/atomic.h>
+
+#include "RingBufferT.h"
+#include "Writer.h"
+
+
+#ifndef TRACE_TIMESTAMP
+#include "HighResClock.h"
+#define TRACE_TIMESTAMP()       highResTicks32()
+#endif
+
+
+
+namespace
+{
+
+    const uint8_t kTraceSync = 0xA5;
+
+    RingBufferT< TraceRecord, uint16_t, TRACE_BUFFER_SIZE >     gTraceRecords;
+
+    volatile uint8_t    gTraceDropped;
+
+
+    void sendRecord( Writer& out, const TraceRecord& r )
+    {
+        uint8_t frame[10];
+
+        frame[0] = kTraceSync;
+        frame[1] = r.timestamp;
+        frame[2] = r.timestamp >> 8;
+        frame[3] = r.timestamp >> 16;
+        frame[4] = r.timestamp >> 24;
+        frame[5] = r.source;
+        frame[6] = r.event;
+        frame[7] = r.data;
+        frame[8] = r.status;
+
+        uint8_t sum = 0;
+        for ( uint8_t i = 1; i < 9; ++i )
+        {
+            sum += frame[i];
+        }
+        frame[9] = -sum;
+
+        out.write( frame, sizeof( frame ) );
+    }
+
+};
+
+
+
+
+void traceEvent( uint8_t source, uint8_t event, uint8_t data, uint8_t status )
+{
+    TraceRecord r;
+    r.timestamp = TRACE_TIMESTAMP();
+    r.source = source;
+    r.event = event;
+    r.data = data;
+    r.status = status;
+
+    if ( gTraceRecords.push( r ) )
+    {
+        // Full; saturate the count rather than wrap
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            if ( gTraceDropped < 0xFF )
+            {
+                ++gTraceDropped;
+            }
+        }
+    }
+}
+
+
+
+
+uint8_t streamTrace( Writer& out, uint8_t maxRecords )
+{
+    uint8_t dropped;
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        dropped = gTraceDropped;
+        gTraceDropped = 0;
+    }
+
+    if ( dropped )
+    {
+        TraceRecord r;
+        r.timestamp = TRACE_TIMESTAMP();
+        r.source = kTraceDropped;
+        r.event = 0;
+        r.data = dropped;
+        r.status = 0;
+        sendRecord( out, r );
+    }
+
+    uint8_t n = 0;
+    while ( n < maxRecords && gTraceRecords.isNotEmpty() )
+    {
+        sendRecord( out, gTraceRecords.pull() );
+        ++n;
+    }
+
+    return n;
+}
+
+
+
+
+void clearTrace()
+{
+    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+    {
+        gTraceRecords.clear();
+        gTraceDropped = 0;
+    }
+}
+
+
+#endif
@@ -0,0 +1,159 @@
+/*
+    Trace.h - A compile-time optional, low-overhead binary event recorder
+    for AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides a shared event recorder for debugging interrupt-driven code.
+ *
+ * If the macro \c EVENT_TRACING is defined when the library is compiled, I2cMaster and I2cSlave record each step
+ * of their TWI state machines with TRACE_EVENT().  Each event is a fixed-size, 8-byte TraceRecord (a timestamp,
+ * the source module, an event code, a data byte, and the TWI status) stored in a single ring buffer of
+ * \c TRACE_BUFFER_SIZE records (default 32).  Recording an event takes a timestamp and copies 8 bytes;
+ * nothing is formatted on the target.
+ *
+ * Calling streamTrace() from the main loop sends recorded events in a compact binary form (10 bytes per event) through any
+ * Writer, such as Serial0.  The host script tools/decode_trace.py turns the stream back into readable text.  Events
+ * recorded while the buffer is full are dropped and counted; the count is reported in the stream.
+ *
+ * Each record on the wire is a sync byte (0xA5), the 8 bytes of the TraceRecord (timestamp least significant byte
+ * first, then source, event, data, and status), and a checksum byte equal to the two's complement of the sum of the
+ * 8 record bytes.
+ *
+ * Timestamps come from TRACE_TIMESTAMP(), which defaults to highResTicks32() (HighResClock.h); link against
+ * HighResClock.cpp and call initHighResClock(), or define \c TRACE_TIMESTAMP() as some other 32-bit time source
+ * (for example, micros()) when compiling Trace.cpp.
+ *
+ * If \c EVENT_TRACING is not defined, TRACE_EVENT() compiles to nothing.  Like \c USART_COLLECT_STATISTICS, the
+ * macro must be defined the same way for the library and your code.  Your code can record its own events with
+ * source kTraceUser (or any value from kTraceUser up to 0xFE).
+ */
+
+
+
+#ifndef Trace_h
+#define Trace_h
+
+#include <stdint.h>
+
+
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE           32
+#endif
+
+#if TRACE_BUFFER_SIZE < 2 || TRACE_BUFFER_SIZE > 255
+#error "TRACE_BUFFER_SIZE must be between 2 and 255"
+#endif
+
+
+
+/*!
+ * \brief This enum lists the sources of trace events.
+ */
+
+enum TraceSources
+{
+    kTraceI2cMaster     = 0x01,     //!< Events from the TWI interrupt function of I2cMaster
+    kTraceI2cSlave      = 0x02,     //!< Events from the TWI interrupt function of I2cSlave
+    kTraceUser          = 0x40,     //!< The first source code available for your code
+    kTraceDropped       = 0xFF      //!< (Stream only) the data byte holds the number of events dropped (up to 255)
+};
+
+
+
+/*!
+ * \brief The fixed-size record holding one trace event.
+ */
+
+struct TraceRecord
+{
+    uint32_t    timestamp;          //!< When the event was recorded, from TRACE_TIMESTAMP()
+    uint8_t     source;             //!< Which module recorded the event (one of TraceSources)
+    uint8_t     event;              //!< The event code (defined by the source)
+    uint8_t     data;               //!< A data byte associated with the event
+    uint8_t     status;             //!< A status byte (for example, the TWI status register)
+};
+
+
+
+#ifdef EVENT_TRACING
+
+class Writer;
+
+
+
+/*!
+ * \brief Record an event.  You don't normally call this directly; use TRACE_EVENT().  It may be called from
+ * interrupt functions and from the main thread.
+ *
+ * \arg \c source which module is recording the event (one of TraceSources).
+ * \arg \c event the event code.
+ * \arg \c data a data byte associated with the event.
+ * \arg \c status a status byte.
+ */
+
+void traceEvent( uint8_t source, uint8_t event, uint8_t data, uint8_t status );
+
+
+
+/*!
+ * \brief Send recorded events (and a report of any dropped events) in binary form, removing them from the buffer.
+ *
+ * \arg \c out where to send the events (for example, Serial0).
+ * \arg \c maxRecords the maximum number of events to send in this call (the default, 255, sends
+ * everything).  Use a small value to limit how long the call takes.
+ *
+ * \returns the number of events sent.
+ */
+
+uint8_t streamTrace( Writer& out, uint8_t maxRecords = 0xFF );
+
+
+
+/*!
+ * \brief Discard all recorded events and reset the dropped event count.
+ */
+
+void clearTrace();
+
+
+
+/*!
+ * \def TRACE_EVENT( source, event, data, status )
+ *
+ * \brief Record an event with traceEvent().  When \c EVENT_TRACING is not defined, this expands to nothing.
+ *
+ * \hideinitializer
+ */
+
+#define TRACE_EVENT( source, event, data, status )     traceEvent( source, event, data, status )
+
+#else
+
+#define TRACE_EVENT( source, event, data, status )
+
+#endif
+
+
+
+#endif
@@ -28,9 +28,8 @@
 #include <stdint.h>
 
 #include <avr/io.h>
-#include <util/atomic.h>
 
-#include "RingBuffer.h"
+#include "USARTEngine.h"
 
 
 #ifndef USART0_RX_BUFFER_SIZE
@@ -42,12 +41,12 @@
 #endif
 
 
-#if USART0_RX_BUFFER_SIZE > 255
-#error "USART0_RX_BUFFER_SIZE exceeds size of a uint8_t"
+#if USART0_RX_BUFFER_SIZE & ( USART0_RX_BUFFER_SIZE - 1 )
+#error "USART0_RX_BUFFER_SIZE must be a power of 2"
 #endif
 
-#if USART0_TX_BUFFER_SIZE > 255
-#error "USART0_TX_BUFFER_SIZE exceeds size of a uint8_t"
+#if USART0_TX_BUFFER_SIZE & ( USART0_TX_BUFFER_SIZE - 1 )
+#error "USART0_TX_BUFFER_SIZE must be a power of 2"
 #endif
 
 
@@ -56,233 +55,179 @@
 namespace
 {
 
-    unsigned char rxStorage[ USART0_RX_BUFFER_SIZE ];
-    RingBuffer rxBuffer( rxStorage, USART0_RX_BUFFER_SIZE );
-
-    unsigned char txStorage[ USART0_TX_BUFFER_SIZE ];
-    RingBuffer txBuffer( txStorage, USART0_TX_BUFFER_SIZE );
+    typedef UsartEngine< 0, USART0_RX_BUFFER_SIZE, USART0_TX_BUFFER_SIZE > Usart0Engine;
 
 };
 
 
 
+DEFINE_USART0_INTERRUPTS( Usart0Engine )
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
 
-#if defined(__AVR_ATmega2560__)
-ISR( USART0_RX_vect )
-#else
-ISR( USART_RX_vect )
-#endif
+
+
+
+void USART0::start( unsigned long baudRate, UsartSerialConfiguration config )
 {
-    // If no parity error, put it in the rx buffer
-    // Eitherway, we need to read UDR register to clear the interrupt
-    if ( !( UCSR0A & (1<<UPE0) ) )
-    {
-        unsigned char c = UDR0;
-        rxBuffer.push( c );
-    }
-    else
-    {
-        unsigned char c = UDR0;
-    }
+    Usart0Engine::start( baudRate, static_cast<uint8_t>( config ) );
 }
 
-#pragma GCC diagnostic pop
 
 
+void USART0::stop()
+{
+    Usart0Engine::stop();
+}
+
 
 
-#if defined(__AVR_ATmega2560__)
-ISR( USART0_UDRE_vect )
-#else
-ISR( USART_UDRE_vect )
-#endif
+void USART0::flush()
 {
-    if ( txBuffer.isNotEmpty() )
-    {
-        // Send the next byte
-        UDR0 = txBuffer.pull();
-    }
-    else
-    {
-        // Nothing more to transmit so disable UDRE interrupts
-        UCSR0B &= ~( 1 << UDRIE0 );
-    }
+    Usart0Engine::flush();
 }
 
 
 
+int USART0::peek()
+{
+    return Usart0Engine::peek();
+}
 
 
-void USART0::start( unsigned long baudRate, UsartSerialConfiguration config )
+
+int USART0::read()
 {
-    bool use2x = true;
-    uint16_t baudSetting = (F_CPU + baudRate * 4L) / ( 8L * baudRate ) - 1;
-    if ( baudSetting > 4095 || baudRate == 57600)
-    {
-        use2x = false;
-        baudSetting = (F_CPU + baudRate * 8L) / (baudRate * 16L) - 1;
-    }
+    return Usart0Engine::read();
+}
+
 
-    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-    {
-        // Asynchronous mode, with everything else off
-        UCSR0A &= ~( (1<<U2X0) | (1<<MPCM0) );
-        UCSR0B &= ~( (1<<RXCIE0) | (1<<TXCIE0) | (1<<UDRIE0) | (1<<RXEN0) | (1<<TXEN0)
-                        | (1<< UCSZ02) | (1<<TXB80) );
 
-        // Set data bits, stop bits, and parity
-        UCSR0C = static_cast<uint8_t>( config );
+size_t USART0::read( uint8_t* buffer, size_t n )
+{
+    return Usart0Engine::read( buffer, n );
+}
 
-        // Set baud rate
-        UBRR0H = baudSetting >> 8;
-        UBRR0L = baudSetting;
-        if ( use2x )
-        {
-            UCSR0A |= ( 1 << U2X0 );
-        }
-        else
-        {
-            UCSR0A &= ~( 1 << U2X0 );
-        }
 
-        // Turn on TX and RX
-        UCSR0B |= ( 1 << RXEN0 ) | ( 1 << TXEN0 );
 
-        // Configure interrupts
-        UCSR0B |= ( 1 << RXCIE0 ) | ( 1 << UDRIE0 );
-    }
+size_t USART0::write( char c )
+{
+    return Usart0Engine::write( c );
 }
 
 
 
-void USART0::stop()
+size_t USART0::write( const char* c )
 {
-    flush();
+    return Usart0Engine::write( c );
+}
+
 
-    // Turn off TX, RX, and interrupts
-    UCSR0B &= ~( (1<<RXCIE0) | (1<<TXCIE0) | (1<<UDRIE0) | (1<<RXEN0) | (1<<TXEN0) );
 
-    // Clear the receive buffer
-    rxBuffer.clear();
+size_t USART0::write( const char* c, size_t n )
+{
+    return Usart0Engine::write( reinterpret_cast< const uint8_t*>( c ) , n );
 }
 
 
 
-void USART0::flush()
+size_t USART0::write( const uint8_t* c, size_t n )
 {
-  // UDRE interrupt keeps transmitting until transmit buffer is empty.
-  // Just wait for the bit that tells us transmission done and nothing else to send (UDR empty).
-  while ( txBuffer.isNotEmpty() && !( UCSR0A & (1<<TXC0) ) )
-      ;
+    return Usart0Engine::write( c, n );
+}
+
+
 
-  // Clear TXCO by writing a 1 (not a typo)
-  UCSR0A |= ( 1 << TXC0 );
+void USART0::writeNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status )
+{
+    Usart0Engine::writeNoCopy( data, n, status );
 }
 
 
 
-int USART0::peek()
+void USART0::writeNoCopy_P( const uint8_t* data, size_t n, volatile uint8_t* status )
 {
-    return rxBuffer.peek();
+    Usart0Engine::writeNoCopy_P( data, n, status );
 }
 
 
 
-int USART0::read()
+void USART0::enableLineDetection( char terminator )
 {
-    return rxBuffer.pull();
+    Usart0Engine::enableLineDetection( terminator );
 }
 
 
 
-size_t USART0::write( char c )
+void USART0::disableLineDetection()
 {
-    // If buffer is full, wait...
-    while ( txBuffer.isFull() )
-        ;
-    txBuffer.push( static_cast<unsigned char>( c ) );
+    Usart0Engine::disableLineDetection();
+}
 
-    // Set UDRE interrupt
-    UCSR0B |= ( 1 << UDRIE0 );
 
-    // Clear TXC flag by writing a 1 (*not* a typo)
-    UCSR0A |= ( 1 << TXC0 );
 
-    return 1;
+uint8_t USART0::completedLines()
+{
+    return Usart0Engine::completedLines();
 }
 
 
 
-size_t USART0::write( const char* c )
+int USART0::readCompletedLine( char* buffer, size_t length )
 {
-    unsigned short cnt = 0;
-    if ( c )
-    {
-        while ( *c )
-        {
-            // If buffer is full, wait...
-            while ( txBuffer.isFull() )
-                ;
+    return Usart0Engine::readCompletedLine( buffer, length );
+}
 
-            txBuffer.push( static_cast<unsigned char>( *c++ ) );
-            ++cnt;
 
-            // Set UDRE interrupt (each time in case interrupt fires and clears in between)
-            UCSR0B |= ( 1 << UDRIE0 );
-        }
 
-        // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
-        UCSR0A |= ( 1 << TXC0 );
-    }
+void USART0::enableRtsFlowControl( const GpioPinVariable& rts, size_t highWaterMark )
+{
+    Usart0Engine::enableRtsFlowControl( rts, highWaterMark );
+}
+
+
 
-    return cnt;
+void USART0::enableCtsFlowControl( const GpioPinVariable& cts )
+{
+    Usart0Engine::enableCtsFlowControl( cts );
 }
 
 
 
+void USART0::disableFlowControl()
+{
+    Usart0Engine::disableFlowControl();
+}
 
-size_t USART0::write( const char* c, size_t n )
+
+
+void USART0::serviceFlowControl()
 {
-    return write( reinterpret_cast< const uint8_t*>( c ) , n );
+    Usart0Engine::serviceFlowControl();
 }
 
 
 
+#ifdef USART_COLLECT_STATISTICS
 
-size_t USART0::write( const uint8_t* c, size_t n )
+void USART0::getStatistics( UsartStatistics* stats )
 {
-    size_t cnt = 0;
-    if ( c )
-    {
-        while ( n-- )
-        {
-            // If buffer is full, wait...
-            while ( txBuffer.isFull() )
-                ;
-
-            txBuffer.push( *c++ );
-            ++cnt;
+    Usart0Engine::getStatistics( stats );
+}
 
-            // Set UDRE interrupt (each time in case interrupt fires and clears in between)
-            UCSR0B |= ( 1 << UDRIE0 );
-        }
 
-        // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
-        UCSR0A |= ( 1 << TXC0 );
-    }
 
-    return cnt;
+void USART0::clearStatistics()
+{
+    Usart0Engine::clearStatistics();
 }
 
+#endif
 
 
 
 bool USART0::available()
 {
-    return !rxBuffer.isEmpty();
+    return Usart0Engine::available();
 }
 
 
@@ -332,3 +277,9 @@ bool Serial0::available()
 {
     return USART0::available();
 }
+
+
+size_t Serial0::readAvailable( uint8_t* buffer, size_t length )
+{
+    return USART0::read( buffer, length );
+}
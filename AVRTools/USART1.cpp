@@ -32,9 +32,8 @@
 #include <stdint.h>
 
 #include <avr/io.h>
-#include <util/atomic.h>
 
-#include "RingBuffer.h"
+#include "USARTEngine.h"
 
 
 #ifndef USART1_RX_BUFFER_SIZE
@@ -46,12 +45,12 @@
 #endif
 
 
-#if USART1_RX_BUFFER_SIZE > 255
-#error "USART1_RX_BUFFER_SIZE exceeds size of a uint8_t"
+#if USART1_RX_BUFFER_SIZE & ( USART1_RX_BUFFER_SIZE - 1 )
+#error "USART1_RX_BUFFER_SIZE must be a power of 2"
 #endif
 
-#if USART1_TX_BUFFER_SIZE > 255
-#error "USART1_TX_BUFFER_SIZE exceeds size of a uint8_t"
+#if USART1_TX_BUFFER_SIZE & ( USART1_TX_BUFFER_SIZE - 1 )
+#error "USART1_TX_BUFFER_SIZE must be a power of 2"
 #endif
 
 
@@ -60,224 +59,179 @@
 namespace
 {
 
-    unsigned char rxStorage[ USART1_RX_BUFFER_SIZE ];
-    RingBuffer rxBuffer( rxStorage, USART1_RX_BUFFER_SIZE );
-
-    unsigned char txStorage[ USART1_TX_BUFFER_SIZE ];
-    RingBuffer txBuffer( txStorage, USART1_TX_BUFFER_SIZE );
+    typedef UsartEngine< 1, USART1_RX_BUFFER_SIZE, USART1_TX_BUFFER_SIZE > Usart1Engine;
 
 };
 
 
 
+DEFINE_USART1_INTERRUPTS( Usart1Engine )
+
+
+
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
 
-ISR( USART1_RX_vect )
+void USART1::start( unsigned long baudRate, UsartSerialConfiguration config )
 {
-    // If no parity error, put it in the rx buffer
-    // Eitherway, we need to read UDR register to clear the interrupt
-    if ( !( UCSR1A & (1<<UPE1) ) )
-    {
-        unsigned char c = UDR1;
-        rxBuffer.push( c );
-    }
-    else
-    {
-        unsigned char c = UDR1;
-    }
+    Usart1Engine::start( baudRate, static_cast<uint8_t>( config ) );
 }
 
-#pragma GCC diagnostic pop
+
+
+void USART1::stop()
+{
+    Usart1Engine::stop();
+}
 
 
 
-ISR( USART1_UDRE_vect )
+void USART1::flush()
 {
-    if ( txBuffer.isNotEmpty() )
-    {
-        // Send the next byte
-        UDR1 = txBuffer.pull();
-    }
-    else
-    {
-        // Nothing more to transmit so disable UDRE interrupts
-        UCSR1B &= ~( 1 << UDRIE1 );
-    }
+    Usart1Engine::flush();
 }
 
 
 
+int USART1::peek()
+{
+    return Usart1Engine::peek();
+}
+
 
 
-void USART1::start( unsigned long baudRate, UsartSerialConfiguration config )
+int USART1::read()
 {
-    bool use2x = true;
-    uint16_t baudSetting = (F_CPU + baudRate * 4L) / ( 8L * baudRate ) - 1;
-    if ( baudSetting > 4095 || baudRate == 57600)
-    {
-        use2x = false;
-        baudSetting = (F_CPU + baudRate * 8L) / (baudRate * 16L) - 1;
-    }
+    return Usart1Engine::read();
+}
 
-    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-    {
-        // Asynchronous mode, with everything else off
-        UCSR1A &= ~( (1<<U2X1) | (1<<MPCM1) );
-        UCSR1B &= ~( (1<<RXCIE1) | (1<<TXCIE1) | (1<<UDRIE1) | (1<<RXEN1) | (1<<TXEN1)
-                        | (1<< UCSZ12) | (1<<TXB81) );
 
-        // Set data bits, stop bits, and parity
-        UCSR1C = static_cast<uint8_t>( config );
 
-        // Set baud rate
-        UBRR1H = baudSetting >> 8;
-        UBRR1L = baudSetting;
-        if ( use2x )
-        {
-            UCSR1A |= ( 1 << U2X1 );
-        }
-        else
-        {
-            UCSR1A &= ~( 1 << U2X1 );
-        }
+size_t USART1::read( uint8_t* buffer, size_t n )
+{
+    return Usart1Engine::read( buffer, n );
+}
+
 
-        // Turn on TX and RX
-        UCSR1B |= ( 1 << RXEN1 ) | ( 1 << TXEN1 );
 
-        // Configure interrupts
-        UCSR1B |= ( 1 << RXCIE1 ) | ( 1 << UDRIE1 );
-    }
+size_t USART1::write( char c )
+{
+    return Usart1Engine::write( c );
 }
 
 
 
-void USART1::stop()
+size_t USART1::write( const char* c )
 {
-    flush();
+    return Usart1Engine::write( c );
+}
 
-    // Turn off TX, RX, and interrupts
-    UCSR1B &= ~( (1<<RXCIE1) | (1<<TXCIE1) | (1<<UDRIE1) | (1<<RXEN1) | (1<<TXEN1) );
 
-    // Clear the receive buffer
-    rxBuffer.clear();
+
+size_t USART1::write( const char* c, size_t n )
+{
+    return Usart1Engine::write( reinterpret_cast< const uint8_t*>( c ) , n );
 }
 
 
 
-void USART1::flush()
+size_t USART1::write( const uint8_t* c, size_t n )
 {
-  // UDRE interrupt keeps transmitting until transmit buffer is empty.
-  // Just wait for the bit that tells us transmission done and nothing else to send (UDR empty).
-  while ( txBuffer.isNotEmpty() && !( UCSR1A & (1<<TXC1) ) )
-      ;
+    return Usart1Engine::write( c, n );
+}
+
 
-  // Clear TXCO by writing a 1 (not a typo)
-  UCSR1A |= ( 1 << TXC1 );
+
+void USART1::writeNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status )
+{
+    Usart1Engine::writeNoCopy( data, n, status );
 }
 
 
 
-int USART1::peek()
+void USART1::writeNoCopy_P( const uint8_t* data, size_t n, volatile uint8_t* status )
 {
-    return rxBuffer.peek();
+    Usart1Engine::writeNoCopy_P( data, n, status );
 }
 
 
 
-int USART1::read()
+void USART1::enableLineDetection( char terminator )
 {
-    return rxBuffer.pull();
+    Usart1Engine::enableLineDetection( terminator );
 }
 
 
 
-size_t USART1::write( char c )
+void USART1::disableLineDetection()
 {
-    // If buffer is full, wait...
-    while ( txBuffer.isFull() )
-        ;
-    txBuffer.push( static_cast<unsigned char>( c ) );
+    Usart1Engine::disableLineDetection();
+}
 
-    // Set UDRE interrupt
-    UCSR1B |= ( 1 << UDRIE1 );
 
-    // Clear TXC flag by writing a 1 (*not* a typo)
-    UCSR1A |= ( 1 << TXC1 );
 
-    return 1;
+uint8_t USART1::completedLines()
+{
+    return Usart1Engine::completedLines();
 }
 
 
 
-size_t USART1::write( const char* c )
+int USART1::readCompletedLine( char* buffer, size_t length )
 {
-    unsigned short cnt = 0;
-    if ( c )
-    {
-        while ( *c )
-        {
-            // If buffer is full, wait...
-            while ( txBuffer.isFull() )
-                ;
+    return Usart1Engine::readCompletedLine( buffer, length );
+}
+
 
-            txBuffer.push( static_cast<unsigned char>( *c++ ) );
-            ++cnt;
 
-            // Set UDRE interrupt (each time in case interrupt fires and clears in between)
-            UCSR1B |= ( 1 << UDRIE1 );
-        }
+void USART1::enableRtsFlowControl( const GpioPinVariable& rts, size_t highWaterMark )
+{
+    Usart1Engine::enableRtsFlowControl( rts, highWaterMark );
+}
+
 
-        // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
-        UCSR1A |= ( 1 << TXC1 );
-    }
 
-    return cnt;
+void USART1::enableCtsFlowControl( const GpioPinVariable& cts )
+{
+    Usart1Engine::enableCtsFlowControl( cts );
 }
 
 
 
+void USART1::disableFlowControl()
+{
+    Usart1Engine::disableFlowControl();
+}
 
-size_t USART1::write( const char* c, size_t n )
+
+
+void USART1::serviceFlowControl()
 {
-    return write( reinterpret_cast< const uint8_t*>( c ) , n );
+    Usart1Engine::serviceFlowControl();
 }
 
 
 
+#ifdef USART_COLLECT_STATISTICS
 
-size_t USART1::write( const uint8_t* c, size_t n )
+void USART1::getStatistics( UsartStatistics* stats )
 {
-    size_t cnt = 0;
-    if ( c )
-    {
-        while ( n-- )
-        {
-            // If buffer is full, wait...
-            while ( txBuffer.isFull() )
-                ;
-
-            txBuffer.push( *c++ );
-            ++cnt;
+    Usart1Engine::getStatistics( stats );
+}
 
-            // Set UDRE interrupt (each time in case interrupt fires and clears in between)
-            UCSR1B |= ( 1 << UDRIE1 );
-        }
 
-        // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
-        UCSR1A |= ( 1 << TXC1 );
-    }
 
-    return cnt;
+void USART1::clearStatistics()
+{
+    Usart1Engine::clearStatistics();
 }
 
+#endif
 
 
 
 bool USART1::available()
 {
-    return !rxBuffer.isEmpty();
+    return Usart1Engine::available();
 }
 
 
@@ -327,3 +281,9 @@ bool Serial1::available()
 {
     return USART1::available();
 }
+
+
+size_t Serial1::readAvailable( uint8_t* buffer, size_t length )
+{
+    return USART1::read( buffer, length );
+}
@@ -32,9 +32,8 @@
 #include <stdint.h>
 
 #include <avr/io.h>
-#include <util/atomic.h>
 
-#include "RingBuffer.h"
+#include "USARTEngine.h"
 
 
 #ifndef USART2_RX_BUFFER_SIZE
@@ -46,12 +45,12 @@
 #endif
 
 
-#if USART2_RX_BUFFER_SIZE > 255
-#error "USART2_RX_BUFFER_SIZE exceeds size of a uint8_t"
+#if USART2_RX_BUFFER_SIZE & ( USART2_RX_BUFFER_SIZE - 1 )
+#error "USART2_RX_BUFFER_SIZE must be a power of 2"
 #endif
 
-#if USART2_TX_BUFFER_SIZE > 255
-#error "USART2_TX_BUFFER_SIZE exceeds size of a uint8_t"
+#if USART2_TX_BUFFER_SIZE & ( USART2_TX_BUFFER_SIZE - 1 )
+#error "USART2_TX_BUFFER_SIZE must be a power of 2"
 #endif
 
 
@@ -60,224 +59,179 @@
 namespace
 {
 
-    unsigned char rxStorage[ USART2_RX_BUFFER_SIZE ];
-    RingBuffer rxBuffer( rxStorage, USART2_RX_BUFFER_SIZE );
-
-    unsigned char txStorage[ USART2_TX_BUFFER_SIZE ];
-    RingBuffer txBuffer( txStorage, USART2_TX_BUFFER_SIZE );
+    typedef UsartEngine< 2, USART2_RX_BUFFER_SIZE, USART2_TX_BUFFER_SIZE > Usart2Engine;
 
 };
 
 
 
+DEFINE_USART2_INTERRUPTS( Usart2Engine )
+
 
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
 
-ISR( USART2_RX_vect )
+
+void USART2::start( unsigned long baudRate, UsartSerialConfiguration config )
 {
-    // If no parity error, put it in the rx buffer
-    // Eitherway, we need to read UDR register to clear the interrupt
-    if ( !( UCSR2A & (1<<UPE2) ) )
-    {
-        unsigned char c = UDR2;
-        rxBuffer.push( c );
-    }
-    else
-    {
-        unsigned char c = UDR2;
-    }
+    Usart2Engine::start( baudRate, static_cast<uint8_t>( config ) );
 }
 
-#pragma GCC diagnostic pop
 
 
-ISR( USART2_UDRE_vect )
+void USART2::stop()
 {
-    if ( txBuffer.isNotEmpty() )
-    {
-        // Send the next byte
-        UDR2 = txBuffer.pull();
-    }
-    else
-    {
-        // Nothing more to transmit so disable UDRE interrupts
-        UCSR2B &= ~( 1 << UDRIE2 );
-    }
+    Usart2Engine::stop();
 }
 
 
 
+void USART2::flush()
+{
+    Usart2Engine::flush();
+}
+
 
 
-void USART2::start( unsigned long baudRate, UsartSerialConfiguration config )
+int USART2::peek()
 {
-    bool use2x = true;
-    uint16_t baudSetting = (F_CPU + baudRate * 4L) / ( 8L * baudRate ) - 1;
-    if ( baudSetting > 4095 || baudRate == 57600)
-    {
-        use2x = false;
-        baudSetting = (F_CPU + baudRate * 8L) / (baudRate * 16L) - 1;
-    }
+    return Usart2Engine::peek();
+}
 
-    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-    {
-        // Asynchronous mode, with everything else off
-        UCSR2A &= ~( (1<<U2X2) | (1<<MPCM2) );
-        UCSR2B &= ~( (1<<RXCIE2) | (1<<TXCIE2) | (1<<UDRIE2) | (1<<RXEN2) | (1<<TXEN2)
-                        | (1<< UCSZ22) | (1<<TXB82) );
 
-        // Set data bits, stop bits, and parity
-        UCSR2C = static_cast<uint8_t>( config );
 
-        // Set baud rate
-        UBRR2H = baudSetting >> 8;
-        UBRR2L = baudSetting;
-        if ( use2x )
-        {
-            UCSR2A |= ( 1 << U2X2 );
-        }
-        else
-        {
-            UCSR2A &= ~( 1 << U2X2 );
-        }
+int USART2::read()
+{
+    return Usart2Engine::read();
+}
+
 
-        // Turn on TX and RX
-        UCSR2B |= ( 1 << RXEN2 ) | ( 1 << TXEN2 );
 
-        // Configure interrupts
-        UCSR2B |= ( 1 << RXCIE2 ) | ( 1 << UDRIE2 );
-    }
+size_t USART2::read( uint8_t* buffer, size_t n )
+{
+    return Usart2Engine::read( buffer, n );
 }
 
 
 
-void USART2::stop()
+size_t USART2::write( char c )
 {
-    flush();
+    return Usart2Engine::write( c );
+}
 
-    // Turn off TX, RX, and interrupts
-    UCSR2B &= ~( (1<<RXCIE2) | (1<<TXCIE2) | (1<<UDRIE2) | (1<<RXEN2) | (1<<TXEN2) );
 
-    // Clear the receive buffer
-    rxBuffer.clear();
+
+size_t USART2::write( const char* c )
+{
+    return Usart2Engine::write( c );
 }
 
 
 
-void USART2::flush()
+size_t USART2::write( const char* c, size_t n )
 {
-  // UDRE interrupt keeps transmitting until transmit buffer is empty.
-  // Just wait for the bit that tells us transmission done and nothing else to send (UDR empty).
-  while ( txBuffer.isNotEmpty() && !( UCSR2A & (1<<TXC2) ) )
-      ;
-
-  // Clear TXCO by writing a 1 (not a typo)
-  UCSR2A |= ( 1 << TXC2 );
+    return Usart2Engine::write( reinterpret_cast< const uint8_t*>( c ) , n );
 }
 
 
 
-int USART2::peek()
+size_t USART2::write( const uint8_t* c, size_t n )
 {
-    return rxBuffer.peek();
+    return Usart2Engine::write( c, n );
 }
 
 
 
-int USART2::read()
+void USART2::writeNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status )
 {
-    return rxBuffer.pull();
+    Usart2Engine::writeNoCopy( data, n, status );
 }
 
 
 
-size_t USART2::write( char c )
+void USART2::writeNoCopy_P( const uint8_t* data, size_t n, volatile uint8_t* status )
 {
-    // If buffer is full, wait...
-    while ( txBuffer.isFull() )
-        ;
-    txBuffer.push( static_cast<unsigned char>( c ) );
+    Usart2Engine::writeNoCopy_P( data, n, status );
+}
 
-    // Set UDRE interrupt
-    UCSR2B |= ( 1 << UDRIE2 );
 
-    // Clear TXC flag by writing a 1 (*not* a typo)
-    UCSR2A |= ( 1 << TXC2 );
 
-    return 1;
+void USART2::enableLineDetection( char terminator )
+{
+    Usart2Engine::enableLineDetection( terminator );
 }
 
 
 
-size_t USART2::write( const char* c )
+void USART2::disableLineDetection()
 {
-    unsigned short cnt = 0;
-    if ( c )
-    {
-        while ( *c )
-        {
-            // If buffer is full, wait...
-            while ( txBuffer.isFull() )
-                ;
+    Usart2Engine::disableLineDetection();
+}
+
 
-            txBuffer.push( static_cast<unsigned char>( *c++ ) );
-            ++cnt;
 
-            // Set UDRE interrupt (each time in case interrupt fires and clears in between)
-            UCSR2B |= ( 1 << UDRIE2 );
-        }
+uint8_t USART2::completedLines()
+{
+    return Usart2Engine::completedLines();
+}
 
-        // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
-        UCSR2A |= ( 1 << TXC2 );
-    }
 
-    return cnt;
+
+int USART2::readCompletedLine( char* buffer, size_t length )
+{
+    return Usart2Engine::readCompletedLine( buffer, length );
 }
 
 
 
+void USART2::enableRtsFlowControl( const GpioPinVariable& rts, size_t highWaterMark )
+{
+    Usart2Engine::enableRtsFlowControl( rts, highWaterMark );
+}
 
-size_t USART2::write( const char* c, size_t n )
+
+
+void USART2::enableCtsFlowControl( const GpioPinVariable& cts )
 {
-    return write( reinterpret_cast< const uint8_t*>( c ) , n );
+    Usart2Engine::enableCtsFlowControl( cts );
 }
 
 
 
+void USART2::disableFlowControl()
+{
+    Usart2Engine::disableFlowControl();
+}
+
+
 
-size_t USART2::write( const uint8_t* c, size_t n )
+void USART2::serviceFlowControl()
 {
-    size_t cnt = 0;
-    if ( c )
-    {
-        while ( n-- )
-        {
-            // If buffer is full, wait...
-            while ( txBuffer.isFull() )
-                ;
+    Usart2Engine::serviceFlowControl();
+}
 
-            txBuffer.push( *c++ );
-            ++cnt;
 
-            // Set UDRE interrupt (each time in case interrupt fires and clears in between)
-            UCSR2B |= ( 1 << UDRIE2 );
-        }
 
-        // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
-        UCSR2A |= ( 1 << TXC2 );
-    }
+#ifdef USART_COLLECT_STATISTICS
 
-    return cnt;
+void USART2::getStatistics( UsartStatistics* stats )
+{
+    Usart2Engine::getStatistics( stats );
 }
 
 
 
+void USART2::clearStatistics()
+{
+    Usart2Engine::clearStatistics();
+}
+
+#endif
+
+
 
 bool USART2::available()
 {
-    return !rxBuffer.isEmpty();
+    return Usart2Engine::available();
 }
 
 
@@ -327,3 +281,9 @@ bool Serial2::available()
 {
     return USART2::available();
 }
+
+
+size_t Serial2::readAvailable( uint8_t* buffer, size_t length )
+{
+    return USART2::read( buffer, length );
+}
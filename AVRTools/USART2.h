@@ -47,8 +47,9 @@
  * The sizes of the transmit and receive buffers can be set at compile time via macro constants.  The default
  * sizes are 32 bytes for the receive buffer and 64 bytes for the transmit buffer.  To change these,
  * define the macros \c USART2_RX_BUFFER_SIZE (for the receive buffer) and \c USART2_TX_BUFFER_SIZE
- * (for the transmit buffer) to whatever sizes you need.  You need to make these define these macros prior
- * to compiling the file USART2.cpp.
+ * (for the transmit buffer) to whatever sizes you need; each must be a power of 2.  You need to make these define
+ * these macros prior to compiling the file USART2.cpp.  Alternatively, to size the buffers from your own code
+ * (without linking against USART2.cpp), use a SerialPort as described in SerialPort.h.
  *
  * Two interfaces are provided.  USART2 is a functional interface that makes use of the buffering and
  * asynchronous transmit and receive capabilities of the microcontrollers.  However, USART2 is limited to
@@ -76,6 +77,8 @@
 
 #include "Writer.h"
 #include "Reader.h"
+#include "GpioPinMacros.h"
+#include "USARTStatus.h"
 
 #include <stdint.h>
 #include <stddef.h>
@@ -237,6 +240,43 @@ namespace USART2
     size_t write( const uint8_t* c, size_t n );
 
 
+    /*!
+    * \brief Transmit a byte array asynchronously, directly from the caller's memory, without copying it into
+    * the transmit buffer.  This function returns immediately and the data are transmitted via %USART2-related
+    * interrupts, after anything already queued in the transmit buffer.  Data written with the other write functions
+    * while the transmission is in progress are transmitted afterwards.
+    *
+    * Only one zero-copy transmission can be in progress at a time; if one is already in progress,
+    * this function blocks until it finishes.
+    *
+    * \note The array must remain unchanged until the status variable reports kUsartCompletedOk.
+    *
+    * \arg \c data the byte array to transmit.
+    *
+    * \arg \c n the number of bytes to transmit.
+    *
+    * \arg \c status a pointer to a byte-size location in which the status of the transmission will be
+    * reported (volatile because the value will be updated asynchronously after the function returns); values
+    * correspond to UsartTxStatusCodes.  May be null if not needed.
+    */
+
+    void writeNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status );
+
+
+    /*!
+    * \brief Like writeNoCopy(), but transmits a byte array stored in flash (PROGMEM).
+    *
+    * \arg \c data the byte array in flash to transmit.
+    *
+    * \arg \c n the number of bytes to transmit.
+    *
+    * \arg \c status a pointer to a byte-size location in which the status of the transmission will be
+    * reported; values correspond to UsartTxStatusCodes.  May be null if not needed.
+    */
+
+    void writeNoCopy_P( const uint8_t* data, size_t n, volatile uint8_t* status );
+
+
     /*!
     * \brief Flush transmit buffer.
     *
@@ -268,6 +308,130 @@ namespace USART2
     int read();
 
 
+    /*!
+    * \brief Move the characters waiting in the receive buffer into an array, removing them from the
+    * receive buffer.  This function does not wait for data to arrive.
+    *
+    * \arg \c buffer the array where the characters will be stored.
+    *
+    * \arg \c n the maximum number of characters to move into the array.
+    *
+    * \returns the number of characters moved into the array (0 if the receive buffer is empty).
+    */
+
+    size_t read( uint8_t* buffer, size_t n );
+
+
+    /*!
+    * \brief Turn on detection of line (or frame) terminators by the %USART2 receive interrupt.  While detection
+    * is on, the interrupt counts complete lines as they arrive, so completedLines() and readCompletedLine()
+    * become constant-time checks that neither scan the receive buffer nor wait for data.
+    *
+    * \arg \c terminator the character that ends a line or frame.  If omitted, the default is SERIAL_INPUT_EOL.
+    */
+
+    void enableLineDetection( char terminator = SERIAL_INPUT_EOL );
+
+
+    /*!
+    * \brief Turn off detection of line terminators by the %USART2 receive interrupt.
+    */
+
+    void disableLineDetection();
+
+
+    /*!
+    * \brief Get the number of complete lines waiting in the receive buffer.  Requires line
+    * detection to be on (see enableLineDetection()).
+    *
+    * \returns the number of complete lines in the receive buffer (0 if line detection is off).
+    */
+
+    uint8_t completedLines();
+
+
+    /*!
+    * \brief Extract the next complete line from the receive buffer, without waiting.  The terminator
+    * is removed from the receive buffer but not stored; the result is null-terminated.  If the line does
+    * not fit in the array, the first part is returned and the rest remains in the receive buffer.
+    * Requires line detection to be on (see enableLineDetection()).
+    *
+    * \arg \c buffer the array where the line will be stored.
+    *
+    * \arg \c length the size of the array (including room for the null terminator).
+    *
+    * \returns the number of characters stored (not including the null terminator), or -1 if no complete
+    * line is waiting in the receive buffer.
+    */
+
+    int readCompletedLine( char* buffer, size_t length );
+
+
+    /*!
+    * \brief Turn on RTS (ready to send) flow control on %USART2.  The RTS output is active low: it is deasserted (high)
+    * by the receive interrupt when the receive buffer fills to the high-water mark, and asserted (low) again once
+    * reading has drained the buffer to half the high-water mark.
+    *
+    * \arg \c rts the GPIO pin variable used as the RTS output (e.g., makeGpioVarFromGpioPin( pPin08 )).
+    *
+    * \arg \c highWaterMark the number of bytes in the receive buffer at which RTS is deasserted; leave room
+    * above it for the bytes the remote sender may transmit before it reacts.
+    */
+
+    void enableRtsFlowControl( const GpioPinVariable& rts, size_t highWaterMark );
+
+
+    /*!
+    * \brief Turn on CTS (clear to send) flow control on %USART2.  The CTS input is active low: while it is high,
+    * transmission pauses.  Transmission resumes with the next write, or when serviceFlowControl() is called;
+    * if your application may stop writing while CTS is deasserted, call serviceFlowControl() regularly.
+    *
+    * \arg \c cts the GPIO pin variable used as the CTS input (e.g., makeGpioVarFromGpioPin( pPin09 )).
+    */
+
+    void enableCtsFlowControl( const GpioPinVariable& cts );
+
+
+    /*!
+    * \brief Turn off RTS and CTS flow control on %USART2.  The RTS output, if any, is left asserted (low).
+    */
+
+    void disableFlowControl();
+
+
+    /*!
+    * \brief Resume transmission if it was paused by CTS flow control and CTS is now asserted.
+    */
+
+    void serviceFlowControl();
+
+
+#ifdef USART_COLLECT_STATISTICS
+
+    /*!
+    * \brief Get a consistent snapshot of the statistics collected for %USART2: bytes in and out, bytes dropped
+    * because the receive buffer was full, parity, framing, and overrun errors, and the receive buffer high-water mark.
+    *
+    * This function only exists if USART2.cpp (and your code) is compiled with the macro
+    * \c USART_COLLECT_STATISTICS defined; otherwise the statistics are not collected and cost nothing.
+    *
+    * \arg \c stats a pointer to where the statistics will be copied.
+    */
+
+    void getStatistics( UsartStatistics* stats );
+
+
+    /*!
+    * \brief Reset all statistics collected for %USART2 to zero.
+    *
+    * This function only exists if the macro \c USART_COLLECT_STATISTICS is defined.
+    */
+
+    void clearStatistics();
+
+#endif
+
+
     /*!
     * \brief Determine if there is data in the receive buffer..
     *
@@ -377,6 +541,31 @@ public:
      */
     virtual size_t write( const uint8_t* buffer, size_t size );
 
+    /*!
+     * \brief Transmit a byte array asynchronously, directly from the caller's memory, without copying it into
+     * the transmit buffer.  The function returns immediately; when the status variable reports kUsartCompletedOk
+     * the array may be reused.  See USART2::writeNoCopy() for details.
+     *
+     * \arg \c data the byte array to transmit.
+     * \arg \c n the number of bytes to transmit.
+     * \arg \c status a pointer to a byte-size location in which the status of the transmission will be
+     * reported (values correspond to UsartTxStatusCodes); may be null.
+     */
+    void writeNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status )
+    { USART2::writeNoCopy( data, n, status ); }
+
+    /*!
+     * \brief Like writeNoCopy(), but transmits a byte array stored in flash (PROGMEM).
+     *
+     * \arg \c data the byte array in flash to transmit.
+     * \arg \c n the number of bytes to transmit.
+     * \arg \c status a pointer to a byte-size location in which the status of the transmission will be
+     * reported (values correspond to UsartTxStatusCodes); may be null.
+     */
+    void writeNoCopy_P( const uint8_t* data, size_t n, volatile uint8_t* status )
+    { USART2::writeNoCopy_P( data, n, status ); }
+
+
     /*!
      * \brief Flush the output stream.  When this function returns, all previously
      * written data will have been transmitted through the underlying output stream.
@@ -386,6 +575,74 @@ public:
 
 
 
+    /*!
+     * \brief Turn on detection of line (or frame) terminators as bytes arrive.  See USART2::enableLineDetection().
+     *
+     * \arg \c terminator the character that ends a line or frame.  If omitted, the default is SERIAL_INPUT_EOL.
+     */
+    void enableLineDetection( char terminator = SERIAL_INPUT_EOL )
+    { USART2::enableLineDetection( terminator ); }
+
+    /*!
+     * \brief Turn off detection of line terminators as bytes arrive.
+     */
+    void disableLineDetection()
+    { USART2::disableLineDetection(); }
+
+    /*!
+     * \brief Get the number of complete lines waiting in the input stream (a constant-time check).
+     * Requires line detection to be on.
+     *
+     * \returns the number of complete lines waiting (0 if line detection is off).
+     */
+    uint8_t completedLines()
+    { return USART2::completedLines(); }
+
+    /*!
+     * \brief Extract the next complete line from the input stream without waiting; the result is null-terminated
+     * and does not include the terminator.  Unlike Reader::readLine(), this never blocks.
+     * Requires line detection to be on.
+     *
+     * \arg \c buffer the array where the line will be stored.
+     * \arg \c length the size of the array (including room for the null terminator).
+     *
+     * \returns the number of characters stored (not including the null terminator), or -1 if no complete
+     * line is waiting.
+     */
+    int readCompletedLine( char* buffer, size_t length )
+    { return USART2::readCompletedLine( buffer, length ); }
+
+
+    /*!
+     * \brief Turn on RTS (ready to send) flow control.  See USART2::enableRtsFlowControl().
+     *
+     * \arg \c rts the GPIO pin variable used as the RTS output.
+     * \arg \c highWaterMark the number of bytes in the receive buffer at which RTS is deasserted.
+     */
+    void enableRtsFlowControl( const GpioPinVariable& rts, size_t highWaterMark )
+    { USART2::enableRtsFlowControl( rts, highWaterMark ); }
+
+    /*!
+     * \brief Turn on CTS (clear to send) flow control.  See USART2::enableCtsFlowControl().
+     *
+     * \arg \c cts the GPIO pin variable used as the CTS input.
+     */
+    void enableCtsFlowControl( const GpioPinVariable& cts )
+    { USART2::enableCtsFlowControl( cts ); }
+
+    /*!
+     * \brief Turn off RTS and CTS flow control.
+     */
+    void disableFlowControl()
+    { USART2::disableFlowControl(); }
+
+    /*!
+     * \brief Resume transmission if it was paused by CTS flow control and CTS is now asserted.
+     */
+    void serviceFlowControl()
+    { USART2::serviceFlowControl(); }
+
+
     // Virtual functions from Reader
 
     /*!
@@ -415,6 +672,18 @@ public:
      * \returns True if data is available in the stream; false if not.
      */
     virtual bool available();
+
+
+    /*!
+     * \brief Read and remove the bytes already waiting in the input stream in a single block, without waiting
+     * for more to arrive.  This overrides the virtual function Reader::readAvailable().
+     *
+     * \arg \c buffer a pointer to where the bytes read will be stored.
+     * \arg \c length the maximum number of bytes to read.
+     *
+     * \returns the number of bytes placed in the buffer (possibly 0).
+     */
+    virtual size_t readAvailable( uint8_t* buffer, size_t length );
 };
 
 
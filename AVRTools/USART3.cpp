@@ -32,9 +32,8 @@
 #include <stdint.h>
 
 #include <avr/io.h>
-#include <util/atomic.h>
 
-#include "RingBuffer.h"
+#include "USARTEngine.h"
 
 
 #ifndef USART3_RX_BUFFER_SIZE
@@ -46,12 +45,12 @@
 #endif
 
 
-#if USART3_RX_BUFFER_SIZE > 255
-#error "USART3_RX_BUFFER_SIZE exceeds size of a uint8_t"
+#if USART3_RX_BUFFER_SIZE & ( USART3_RX_BUFFER_SIZE - 1 )
+#error "USART3_RX_BUFFER_SIZE must be a power of 2"
 #endif
 
-#if USART3_TX_BUFFER_SIZE > 255
-#error "USART3_TX_BUFFER_SIZE exceeds size of a uint8_t"
+#if USART3_TX_BUFFER_SIZE & ( USART3_TX_BUFFER_SIZE - 1 )
+#error "USART3_TX_BUFFER_SIZE must be a power of 2"
 #endif
 
 
@@ -60,225 +59,179 @@
 namespace
 {
 
-    unsigned char rxStorage[ USART3_RX_BUFFER_SIZE ];
-    RingBuffer rxBuffer( rxStorage, USART3_RX_BUFFER_SIZE );
-
-    unsigned char txStorage[ USART3_TX_BUFFER_SIZE ];
-    RingBuffer txBuffer( txStorage, USART3_TX_BUFFER_SIZE );
+    typedef UsartEngine< 3, USART3_RX_BUFFER_SIZE, USART3_TX_BUFFER_SIZE > Usart3Engine;
 
 };
 
 
 
+DEFINE_USART3_INTERRUPTS( Usart3Engine )
+
 
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
 
-ISR( USART3_RX_vect )
+
+void USART3::start( unsigned long baudRate, UsartSerialConfiguration config )
 {
-    // If no parity error, put it in the rx buffer
-    // Eitherway, we need to read UDR register to clear the interrupt
-    if ( !( UCSR3A & (1<<UPE3) ) )
-    {
-        unsigned char c = UDR3;
-        rxBuffer.push( c );
-    }
-    else
-    {
-        unsigned char c = UDR3;
-    }
+    Usart3Engine::start( baudRate, static_cast<uint8_t>( config ) );
 }
 
-#pragma GCC diagnostic pop
 
 
+void USART3::stop()
+{
+    Usart3Engine::stop();
+}
+
 
-ISR( USART3_UDRE_vect )
+
+void USART3::flush()
 {
-    if ( txBuffer.isNotEmpty() )
-    {
-        // Send the next byte
-        UDR3 = txBuffer.pull();
-    }
-    else
-    {
-        // Nothing more to transmit so disable UDRE interrupts
-        UCSR3B &= ~( 1 << UDRIE3 );
-    }
+    Usart3Engine::flush();
 }
 
 
 
+int USART3::peek()
+{
+    return Usart3Engine::peek();
+}
 
 
-void USART3::start( unsigned long baudRate, UsartSerialConfiguration config )
+
+int USART3::read()
 {
-    bool use2x = true;
-    uint16_t baudSetting = (F_CPU + baudRate * 4L) / ( 8L * baudRate ) - 1;
-    if ( baudSetting > 4095 || baudRate == 57600)
-    {
-        use2x = false;
-        baudSetting = (F_CPU + baudRate * 8L) / (baudRate * 16L) - 1;
-    }
+    return Usart3Engine::read();
+}
 
-    ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
-    {
-        // Asynchronous mode, with everything else off
-        UCSR3A &= ~( (1<<U2X3) | (1<<MPCM3) );
-        UCSR3B &= ~( (1<<RXCIE3) | (1<<TXCIE3) | (1<<UDRIE3) | (1<<RXEN3) | (1<<TXEN3)
-                        | (1<< UCSZ32) | (1<<TXB83) );
 
-        // Set data bits, stop bits, and parity
-        UCSR3C = static_cast<uint8_t>( config );
 
-        // Set baud rate
-        UBRR3H = baudSetting >> 8;
-        UBRR3L = baudSetting;
-        if ( use2x )
-        {
-            UCSR3A |= ( 1 << U2X3 );
-        }
-        else
-        {
-            UCSR3A &= ~( 1 << U2X3 );
-        }
+size_t USART3::read( uint8_t* buffer, size_t n )
+{
+    return Usart3Engine::read( buffer, n );
+}
+
 
-        // Turn on TX and RX
-        UCSR3B |= ( 1 << RXEN3 ) | ( 1 << TXEN3 );
 
-        // Configure interrupts
-        UCSR3B |= ( 1 << RXCIE3 ) | ( 1 << UDRIE3 );
-    }
+size_t USART3::write( char c )
+{
+    return Usart3Engine::write( c );
 }
 
 
 
-void USART3::stop()
+size_t USART3::write( const char* c )
 {
-    flush();
+    return Usart3Engine::write( c );
+}
 
-    // Turn off TX, RX, and interrupts
-    UCSR3B &= ~( (1<<RXCIE3) | (1<<TXCIE3) | (1<<UDRIE3) | (1<<RXEN3) | (1<<TXEN3) );
 
-    // Clear the receive buffer
-    rxBuffer.clear();
+
+size_t USART3::write( const char* c, size_t n )
+{
+    return Usart3Engine::write( reinterpret_cast< const uint8_t*>( c ) , n );
 }
 
 
 
-void USART3::flush()
+size_t USART3::write( const uint8_t* c, size_t n )
 {
-  // UDRE interrupt keeps transmitting until transmit buffer is empty.
-  // Just wait for the bit that tells us transmission done and nothing else to send (UDR empty).
-  while ( txBuffer.isNotEmpty() && !( UCSR3A & (1<<TXC3) ) )
-      ;
+    return Usart3Engine::write( c, n );
+}
+
 
-  // Clear TXCO by writing a 1 (not a typo)
-  UCSR3A |= ( 1 << TXC3 );
+
+void USART3::writeNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status )
+{
+    Usart3Engine::writeNoCopy( data, n, status );
 }
 
 
 
-int USART3::peek()
+void USART3::writeNoCopy_P( const uint8_t* data, size_t n, volatile uint8_t* status )
 {
-    return rxBuffer.peek();
+    Usart3Engine::writeNoCopy_P( data, n, status );
 }
 
 
 
-int USART3::read()
+void USART3::enableLineDetection( char terminator )
 {
-    return rxBuffer.pull();
+    Usart3Engine::enableLineDetection( terminator );
 }
 
 
 
-size_t USART3::write( char c )
+void USART3::disableLineDetection()
 {
-    // If buffer is full, wait...
-    while ( txBuffer.isFull() )
-        ;
-    txBuffer.push( static_cast<unsigned char>( c ) );
+    Usart3Engine::disableLineDetection();
+}
 
-    // Set UDRE interrupt
-    UCSR3B |= ( 1 << UDRIE3 );
 
-    // Clear TXC flag by writing a 1 (*not* a typo)
-    UCSR3A |= ( 1 << TXC3 );
 
-    return 1;
+uint8_t USART3::completedLines()
+{
+    return Usart3Engine::completedLines();
 }
 
 
 
-size_t USART3::write( const char* c )
+int USART3::readCompletedLine( char* buffer, size_t length )
 {
-    unsigned short cnt = 0;
-    if ( c )
-    {
-        while ( *c )
-        {
-            // If buffer is full, wait...
-            while ( txBuffer.isFull() )
-                ;
+    return Usart3Engine::readCompletedLine( buffer, length );
+}
+
 
-            txBuffer.push( static_cast<unsigned char>( *c++ ) );
-            ++cnt;
 
-            // Set UDRE interrupt (each time in case interrupt fires and clears in between)
-            UCSR3B |= ( 1 << UDRIE3 );
-        }
+void USART3::enableRtsFlowControl( const GpioPinVariable& rts, size_t highWaterMark )
+{
+    Usart3Engine::enableRtsFlowControl( rts, highWaterMark );
+}
+
 
-        // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
-        UCSR3A |= ( 1 << TXC3 );
-    }
 
-    return cnt;
+void USART3::enableCtsFlowControl( const GpioPinVariable& cts )
+{
+    Usart3Engine::enableCtsFlowControl( cts );
 }
 
 
 
+void USART3::disableFlowControl()
+{
+    Usart3Engine::disableFlowControl();
+}
 
-size_t USART3::write( const char* c, size_t n )
+
+
+void USART3::serviceFlowControl()
 {
-    return write( reinterpret_cast< const uint8_t*>( c ) , n );
+    Usart3Engine::serviceFlowControl();
 }
 
 
 
+#ifdef USART_COLLECT_STATISTICS
 
-size_t USART3::write( const uint8_t* c, size_t n )
+void USART3::getStatistics( UsartStatistics* stats )
 {
-    size_t cnt = 0;
-    if ( c )
-    {
-        while ( n-- )
-        {
-            // If buffer is full, wait...
-            while ( txBuffer.isFull() )
-                ;
-
-            txBuffer.push( *c++ );
-            ++cnt;
+    Usart3Engine::getStatistics( stats );
+}
 
-            // Set UDRE interrupt (each time in case interrupt fires and clears in between)
-            UCSR3B |= ( 1 << UDRIE3 );
-        }
 
-        // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
-        UCSR3A |= ( 1 << TXC3 );
-    }
 
-    return cnt;
+void USART3::clearStatistics()
+{
+    Usart3Engine::clearStatistics();
 }
 
+#endif
 
 
 
 bool USART3::available()
 {
-    return !rxBuffer.isEmpty();
+    return Usart3Engine::available();
 }
 
 
@@ -328,3 +281,9 @@ bool Serial3::available()
 {
     return USART3::available();
 }
+
+
+size_t Serial3::readAvailable( uint8_t* buffer, size_t length )
+{
+    return USART3::read( buffer, length );
+}
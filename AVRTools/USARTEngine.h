@@ -0,0 +1,989 @@
+/*
+    USARTEngine.h - A template engine for buffered, interrupt-driven
+    serial I/O on any of the USARTs of AVR systems.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides the template engine that implements buffered, interrupt-driven serial
+ * communications on %USART0 (and, on the ATmega2560, on %USART1, %USART2, and %USART3).
+ *
+ * The modules USART0, USART1, USART2, and USART3 (and the corresponding classes Serial0, Serial1,
+ * Serial2, and Serial3) are all thin layers over a UsartEngine
+ * instantiation, so the code implementing them exists only once.  The registers of each
+ * %USART are selected at compile time through UsartRegisters, so the resulting code is as efficient as if it
+ * were written for a specific %USART, and only the ports actually used are instantiated.
+ *
+ * You normally don't need to use this file directly; include USART0.h (or USART1.h, etc.)
+ * instead.  If you need receive or transmit buffers of different sizes than those compiled into
+ * USART0.cpp (or USART1.cpp, etc.), you can instantiate your own UsartEngine and its
+ * interrupt functions in your own code and wrap it in a SerialPort (see SerialPort.h).
+ */
+
+
+
+#ifndef USARTEngine_h
+#define USARTEngine_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "RingBufferSpsc.h"
+#include "Reader.h"
+#include "GpioPinMacros.h"
+#include "Profiler.h"
+#include "USARTStatus.h"
+
+
+
+/*!
+ * \brief This template provides compile-time access to the registers of a given %USART.  It is only
+ * defined (via specializations) for the USARTs that exist on the target microcontroller.
+ *
+ * The bit positions within the control and status registers are identical for all USARTs, so
+ * UsartEngine uses the %USART0 bit names (e.g., RXCIE0, UDRIE0) for all of them.
+ *
+ * \tparam PORT the number of the %USART (0 to 3).
+ */
+
+template< uint8_t PORT > struct UsartRegisters;
+
+
+/*!
+ * \brief Registers of %USART0.
+ */
+
+template<> struct UsartRegisters< 0 >
+{
+    //! Control and status register A
+    static volatile uint8_t& ucsrA() { return UCSR0A; }
+    //! Control and status register B
+    static volatile uint8_t& ucsrB() { return UCSR0B; }
+    //! Control and status register C
+    static volatile uint8_t& ucsrC() { return UCSR0C; }
+    //! Baud rate register (high byte)
+    static volatile uint8_t& ubrrH() { return UBRR0H; }
+    //! Baud rate register (low byte)
+    static volatile uint8_t& ubrrL() { return UBRR0L; }
+    //! Data register
+    static volatile uint8_t& udr() { return UDR0; }
+};
+
+
+#if defined(__AVR_ATmega2560__)
+
+/*!
+ * \brief Registers of %USART1.
+ */
+
+template<> struct UsartRegisters< 1 >
+{
+    //! Control and status register A
+    static volatile uint8_t& ucsrA() { return UCSR1A; }
+    //! Control and status register B
+    static volatile uint8_t& ucsrB() { return UCSR1B; }
+    //! Control and status register C
+    static volatile uint8_t& ucsrC() { return UCSR1C; }
+    //! Baud rate register (high byte)
+    static volatile uint8_t& ubrrH() { return UBRR1H; }
+    //! Baud rate register (low byte)
+    static volatile uint8_t& ubrrL() { return UBRR1L; }
+    //! Data register
+    static volatile uint8_t& udr() { return UDR1; }
+};
+
+
+/*!
+ * \brief Registers of %USART2.
+ */
+
+template<> struct UsartRegisters< 2 >
+{
+    //! Control and status register A
+    static volatile uint8_t& ucsrA() { return UCSR2A; }
+    //! Control and status register B
+    static volatile uint8_t& ucsrB() { return UCSR2B; }
+    //! Control and status register C
+    static volatile uint8_t& ucsrC() { return UCSR2C; }
+    //! Baud rate register (high byte)
+    static volatile uint8_t& ubrrH() { return UBRR2H; }
+    //! Baud rate register (low byte)
+    static volatile uint8_t& ubrrL() { return UBRR2L; }
+    //! Data register
+    static volatile uint8_t& udr() { return UDR2; }
+};
+
+
+/*!
+ * \brief Registers of %USART3.
+ */
+
+template<> struct UsartRegisters< 3 >
+{
+    //! Control and status register A
+    static volatile uint8_t& ucsrA() { return UCSR3A; }
+    //! Control and status register B
+    static volatile uint8_t& ucsrB() { return UCSR3B; }
+    //! Control and status register C
+    static volatile uint8_t& ucsrC() { return UCSR3C; }
+    //! Baud rate register (high byte)
+    static volatile uint8_t& ubrrH() { return UBRR3H; }
+    //! Baud rate register (low byte)
+    static volatile uint8_t& ubrrL() { return UBRR3L; }
+    //! Data register
+    static volatile uint8_t& udr() { return UDR3; }
+};
+
+#endif
+
+
+
+
+/*!
+ * \brief This template class implements buffered, asynchronous serial communications using interrupts
+ * on a given %USART.
+ *
+ * All members are static: an instantiation represents the %USART hardware itself, together with its
+ * receive and transmit buffers.  The interrupt service routines for the %USART must call handleRxInterrupt()
+ * and handleUdreInterrupt().
+ *
+ * The receive and transmit buffers are lock-free RingBufferSpsc objects, so their sizes must be powers of 2.
+ *
+ * If the macro \c USART_COLLECT_STATISTICS is defined, the interrupt functions also maintain
+ * the counters reported by getStatistics().  Otherwise the counters are not compiled in and cost nothing.
+ *
+ * \tparam PORT the number of the %USART (0 to 3).
+ * \tparam RX_SIZE the size of the receive buffer.
+ * \tparam TX_SIZE the size of the transmit buffer.
+ */
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE > class UsartEngine
+{
+    typedef UsartRegisters< PORT > Reg;
+
+public:
+
+    //! The high-water mark used by enableRtsFlowControl() if none is given (three-quarters of the receive buffer).
+    static const size_t kDefaultRtsHighWaterMark = ( RX_SIZE * 3 ) / 4;
+
+
+    /*!
+    * \brief Initialize the %USART for buffered, asynchronous serial communications using interrupts.
+    *
+    * \arg \c baudRate the baud rate for the communications.
+    * \arg \c config the configuration in term of data bits, parity, and stop bits
+    * (one of the UsartSerialConfiguration values).
+    */
+    static void start( unsigned long baudRate, uint8_t config )
+    {
+        bool use2x = true;
+        uint16_t baudSetting = (F_CPU + baudRate * 4L) / ( 8L * baudRate ) - 1;
+        if ( baudSetting > 4095 || baudRate == 57600)
+        {
+            use2x = false;
+            baudSetting = (F_CPU + baudRate * 8L) / (baudRate * 16L) - 1;
+        }
+
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            // Asynchronous mode, with everything else off
+            Reg::ucsrA() &= ~( (1<<U2X0) | (1<<MPCM0) );
+            Reg::ucsrB() &= ~( (1<<RXCIE0) | (1<<TXCIE0) | (1<<UDRIE0) | (1<<RXEN0) | (1<<TXEN0)
+                            | (1<< UCSZ02) | (1<<TXB80) );
+
+            // Set data bits, stop bits, and parity
+            Reg::ucsrC() = config;
+
+            // Set baud rate
+            Reg::ubrrH() = baudSetting >> 8;
+            Reg::ubrrL() = baudSetting;
+            if ( use2x )
+            {
+                Reg::ucsrA() |= ( 1 << U2X0 );
+            }
+            else
+            {
+                Reg::ucsrA() &= ~( 1 << U2X0 );
+            }
+
+            // Turn on TX and RX
+            Reg::ucsrB() |= ( 1 << RXEN0 ) | ( 1 << TXEN0 );
+
+            // Configure interrupts
+            Reg::ucsrB() |= ( 1 << RXCIE0 ) | ( 1 << UDRIE0 );
+        }
+    }
+
+
+    /*!
+    * \brief Stop buffered serial communications on the %USART, after transmitting anything
+    * remaining in the transmit buffer.
+    */
+    static void stop()
+    {
+        flush();
+
+        // Turn off TX, RX, and interrupts
+        Reg::ucsrB() &= ~( (1<<RXCIE0) | (1<<TXCIE0) | (1<<UDRIE0) | (1<<RXEN0) | (1<<TXEN0) );
+
+        // Clear the receive buffer
+        sRxBuffer.clear();
+        sLinesOut = sLinesIn;
+    }
+
+
+    /*!
+    * \brief Block until the transmit buffer is empty and the last byte has been transmitted.
+    */
+    static void flush()
+    {
+        // UDRE interrupt keeps transmitting until transmit buffer is empty.
+        // Just wait for the bit that tells us transmission done and nothing else to send (UDR empty).
+        // With CTS flow control transmission may pause, so only an empty buffer means we are done.
+        while ( ( sTxBuffer.isNotEmpty() || sNoCopyActive ) && ( !( Reg::ucsrA() & (1<<TXC0) ) || sCtsEnabled ) )
+        {
+            serviceFlowControl();
+        }
+
+        // Clear TXCO by writing a 1 (not a typo)
+        Reg::ucsrA() |= ( 1 << TXC0 );
+    }
+
+
+    /*!
+    * \brief Examine the next character in the receive buffer without removing it from the buffer.
+    *
+    * \returns the value (a number between 0 and 255), or -1 if the receive buffer is empty.
+    */
+    static int peek()
+    {
+        return sRxBuffer.peek();
+    }
+
+
+    /*!
+    * \brief Return the next character in the receive buffer, removing it from the buffer.
+    *
+    * \returns the value (a number between 0 and 255), or -1 if the receive buffer is empty.
+    */
+    static int read()
+    {
+        int c = sRxBuffer.pull();
+        if ( sLineDetection && c == sTerminator )
+        {
+            ++sLinesOut;
+        }
+        checkRts();
+        return c;
+    }
+
+
+    /*!
+    * \brief Move the characters waiting in the receive buffer into an array, without waiting for
+    * data to arrive.
+    *
+    * \arg \c buffer the array where the characters will be stored.
+    * \arg \c n the maximum number of characters to move into the array.
+    *
+    * \returns the number of characters moved into the array.
+    */
+    static size_t read( uint8_t* buffer, size_t n )
+    {
+        if ( !buffer )
+        {
+            return 0;
+        }
+        size_t cnt = sRxBuffer.pullBulk( buffer, n );
+        if ( sLineDetection )
+        {
+            for ( size_t i = 0; i < cnt; ++i )
+            {
+                if ( buffer[i] == sTerminator )
+                {
+                    ++sLinesOut;
+                }
+            }
+        }
+        checkRts();
+        return cnt;
+    }
+
+
+    /*!
+    * \brief Turn on detection of line (or frame) terminators by the receive interrupt.  While detection is
+    * on, the interrupt counts complete lines as they arrive, so completedLines() and readCompletedLine()
+    * can report and extract lines without scanning the receive buffer or waiting.
+    *
+    * \arg \c terminator the character that ends a line or frame.  If omitted, the default is SERIAL_INPUT_EOL.
+    */
+    static void enableLineDetection( char terminator = SERIAL_INPUT_EOL )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            sTerminator = static_cast<uint8_t>( terminator );
+
+            // Account for any lines already sitting in the receive buffer
+            uint8_t lines = 0;
+            for ( unsigned int i = 0; i < sRxBuffer.length(); ++i )
+            {
+                if ( sRxBuffer.peek( i ) == sTerminator )
+                {
+                    ++lines;
+                }
+            }
+            sLinesIn = sLinesOut + lines;
+            sLineDetection = true;
+        }
+    }
+
+
+    /*!
+    * \brief Turn off detection of line terminators by the receive interrupt.
+    */
+    static void disableLineDetection()
+    {
+        sLineDetection = false;
+    }
+
+
+    /*!
+    * \brief Get the number of complete lines (i.e., terminators) in the receive buffer.  This is
+    * a constant-time check that requires line detection to be on (see enableLineDetection()).
+    *
+    * \returns the number of complete lines waiting in the receive buffer (0 if line detection is off).
+    */
+    static uint8_t completedLines()
+    {
+        return sLineDetection ? static_cast<uint8_t>( sLinesIn - sLinesOut ) : 0;
+    }
+
+
+    /*!
+    * \brief Extract the next complete line from the receive buffer, without waiting.  The terminator
+    * is removed from the receive buffer but not stored; the result is null-terminated.  If the line does
+    * not fit in the array, the first part is returned and the rest remains in the receive buffer.
+    * Requires line detection to be on (see enableLineDetection()).
+    *
+    * \arg \c buffer the array where the line will be stored.
+    * \arg \c length the size of the array (including room for the null terminator).
+    *
+    * \returns the number of characters stored (not including the null terminator), or -1 if no complete
+    * line is waiting in the receive buffer.
+    */
+    static int readCompletedLine( char* buffer, size_t length )
+    {
+        if ( !buffer || !length || !completedLines() )
+        {
+            return -1;
+        }
+
+        size_t index = 0;
+        while ( index < length - 1 )
+        {
+            // Can't run dry: there is a terminator in the buffer
+            int c = sRxBuffer.pull();
+            if ( c == sTerminator )
+            {
+                ++sLinesOut;
+                break;
+            }
+            buffer[ index++ ] = static_cast<char>( c );
+        }
+        buffer[ index ] = 0;
+        checkRts();
+        return index;
+    }
+
+
+    /*!
+    * \brief Turn on RTS (ready to send) flow control.  The RTS output is active low: it is asserted (low) while
+    * the receive buffer has room, deasserted (high) by the receive interrupt when the receive buffer fills
+    * to the high-water mark, and asserted again once reading has drained the buffer to half the high-water mark.
+    *
+    * \arg \c rts the GPIO pin used as the RTS output (configured as an output by this function).
+    * \arg \c highWaterMark the number of bytes in the receive buffer at which RTS is deasserted; leave room
+    * above it for the bytes the remote sender may transmit before it reacts.  If omitted, the default
+    * is three-quarters of the receive buffer.
+    */
+    static void enableRtsFlowControl( const GpioPinVariable& rts, size_t highWaterMark = kDefaultRtsHighWaterMark )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            sRts = rts;
+            sRtsHighWaterMark = highWaterMark;
+            sRtsDeasserted = ( sRxBuffer.length() >= highWaterMark );
+            writeGpioPinDigitalV( sRts, sRtsDeasserted );
+            setGpioPinModeOutputV( sRts );
+            sRtsEnabled = true;
+        }
+    }
+
+
+    /*!
+    * \brief Turn on CTS (clear to send) flow control.  The CTS input is active low: while it is high, the data
+    * register empty interrupt stops feeding the %USART and transmission pauses.
+    *
+    * Transmission resumes with the next write, or when serviceFlowControl() is called.  If your application
+    * may stop writing while CTS is deasserted, call serviceFlowControl() regularly (for instance from your main
+    * loop or from a pin change interrupt on the CTS pin).
+    *
+    * \arg \c cts the GPIO pin used as the CTS input (configured as an input by this function).
+    */
+    static void enableCtsFlowControl( const GpioPinVariable& cts )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            sCts = cts;
+            setGpioPinModeInputV( sCts );
+            sCtsEnabled = true;
+        }
+    }
+
+
+    /*!
+    * \brief Turn off RTS and CTS flow control.  The RTS output, if any, is left asserted (low).
+    */
+    static void disableFlowControl()
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            if ( sRtsEnabled )
+            {
+                setGpioPinLowV( sRts );
+            }
+            sRtsEnabled = false;
+            sRtsDeasserted = false;
+            sCtsEnabled = false;
+        }
+        serviceFlowControl();
+    }
+
+
+    /*!
+    * \brief Resume transmission if it was paused by CTS flow control and CTS is now asserted.
+    * Call this regularly when using CTS flow control (it is cheap when there is nothing to do).
+    */
+    static void serviceFlowControl()
+    {
+        if ( ( sTxBuffer.isNotEmpty() || sNoCopyActive ) && !( sCtsEnabled && readGpioPinDigitalV( sCts ) ) )
+        {
+            // Set UDRE interrupt
+            Reg::ucsrB() |= ( 1 << UDRIE0 );
+        }
+    }
+
+
+    /*!
+    * \brief Write a single byte to the transmit buffer, blocking if the buffer is full.
+    *
+    * \arg \c c the char (byte) to write into the transmit buffer
+    *
+    * \returns the number of bytes written into the output buffer.
+    */
+    static size_t write( char c )
+    {
+        // If buffer is full, wait...
+        while ( sTxBuffer.isFull() )
+            ;
+        sTxBuffer.push( static_cast<unsigned char>( c ) );
+
+        // Set UDRE interrupt
+        Reg::ucsrB() |= ( 1 << UDRIE0 );
+
+        // Clear TXC flag by writing a 1 (*not* a typo)
+        Reg::ucsrA() |= ( 1 << TXC0 );
+
+        return 1;
+    }
+
+
+    /*!
+    * \brief Write a null-terminated string to the transmit buffer, blocking whenever the buffer is full.
+    *
+    * \arg \c c the null-terminated string to write into the transmit buffer.
+    *
+    * \returns the number of bytes written into the output buffer.
+    */
+    static size_t write( const char* c )
+    {
+        if ( !c )
+        {
+            return 0;
+        }
+        return write( reinterpret_cast< const uint8_t*>( c ), strlen( c ) );
+    }
+
+
+    /*!
+    * \brief Write a byte array of given size to the transmit buffer, blocking whenever the buffer is full.
+    *
+    * \arg \c c the byte array to write into the transmit buffer.
+    * \arg \c n the number of elements from the array to write into the transmit buffer.
+    *
+    * \returns the number of bytes written into the output buffer.
+    */
+    static size_t write( const uint8_t* c, size_t n )
+    {
+        size_t cnt = 0;
+        if ( c )
+        {
+            while ( cnt < n )
+            {
+                // Queue as much as fits in one block; if buffer is full, wait...
+                cnt += sTxBuffer.pushBulk( c + cnt, n - cnt );
+
+                // Set UDRE interrupt (each time in case interrupt fires and clears in between)
+                Reg::ucsrB() |= ( 1 << UDRIE0 );
+            }
+
+            // Clear TXC flag by writing a 1 (*not* a typo); suffices to do this at the end
+            Reg::ucsrA() |= ( 1 << TXC0 );
+        }
+
+        return cnt;
+    }
+
+
+    /*!
+    * \brief Transmit a byte array asynchronously, directly from the caller's memory, without copying it into
+    * the transmit buffer.  This function returns immediately; the data are
+    * transmitted by the data register empty interrupt after anything already queued in the transmit buffer.
+    * Data written with the other write functions while the transmission is in progress are
+    * transmitted afterwards.
+    *
+    * Only one zero-copy transmission can be in progress at a time; if one is already in progress,
+    * this function blocks until it finishes.
+    *
+    * \note The array must remain unchanged until the status variable reports kUsartCompletedOk.
+    *
+    * \arg \c data the byte array to transmit.
+    * \arg \c n the number of bytes to transmit.
+    * \arg \c status a pointer to a byte-size location in which the status of the transmission
+    * will be reported (values correspond to UsartTxStatusCodes); may be null if not needed.
+    */
+    static void writeNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status )
+    {
+        startNoCopy( data, n, status, false );
+    }
+
+
+    /*!
+    * \brief Like writeNoCopy(), but transmits a byte array stored in flash (PROGMEM).
+    *
+    * \arg \c data the byte array in flash to transmit.
+    * \arg \c n the number of bytes to transmit.
+    * \arg \c status a pointer to a byte-size location in which the status of the transmission
+    * will be reported (values correspond to UsartTxStatusCodes); may be null if not needed.
+    */
+    static void writeNoCopy_P( const uint8_t* data, size_t n, volatile uint8_t* status )
+    {
+        startNoCopy( data, n, status, true );
+    }
+
+
+    /*!
+    * \brief Determine if there is data in the receive buffer.
+    *
+    * \returns true if the receive buffer contains data; false if it is empty.
+    */
+    static bool available()
+    {
+        return sRxBuffer.isNotEmpty();
+    }
+
+
+#ifdef USART_COLLECT_STATISTICS
+
+    /*!
+    * \brief Get a consistent snapshot of the statistics collected for this %USART.
+    *
+    * \arg \c stats a pointer to where the statistics will be copied.
+    */
+    static void getStatistics( UsartStatistics* stats )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            *stats = sStatistics;
+        }
+    }
+
+
+    /*!
+    * \brief Reset all statistics collected for this %USART to zero.
+    */
+    static void clearStatistics()
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            memset( &sStatistics, 0, sizeof( sStatistics ) );
+        }
+    }
+
+#endif
+
+
+    /*!
+    * \brief The body of the receive complete interrupt service routine.  Only call this from the
+    * receive complete ISR of the %USART.
+    */
+    static void handleRxInterrupt()
+    {
+        // If no parity error, put it in the rx buffer
+        // Eitherway, we need to read UDR register to clear the interrupt
+        // (status flags must be read before UDR)
+        uint8_t status = Reg::ucsrA();
+        bool parityError = status & (1<<UPE0);
+        unsigned char c = Reg::udr();
+
+#ifdef USART_COLLECT_STATISTICS
+        ++sStatistics.bytesIn;
+        if ( parityError )
+        {
+            ++sStatistics.parityErrors;
+        }
+        if ( status & (1<<FE0) )
+        {
+            ++sStatistics.framingErrors;
+        }
+        if ( status & (1<<DOR0) )
+        {
+            ++sStatistics.overrunErrors;
+        }
+#endif
+
+        if ( !parityError )
+        {
+            if ( sRxBuffer.push( c ) )
+            {
+#ifdef USART_COLLECT_STATISTICS
+                ++sStatistics.droppedOnFull;
+#endif
+            }
+            else if ( sLineDetection && c == sTerminator )
+            {
+                ++sLinesIn;
+            }
+
+#ifdef USART_COLLECT_STATISTICS
+            if ( sRxBuffer.length() > sStatistics.rxHighWaterMark )
+            {
+                sStatistics.rxHighWaterMark = sRxBuffer.length();
+            }
+#endif
+
+            // Tell the sender to pause when the buffer reaches the high-water mark
+            if ( sRtsEnabled && !sRtsDeasserted && sRxBuffer.length() >= sRtsHighWaterMark )
+            {
+                setGpioPinHighV( sRts );
+                sRtsDeasserted = true;
+            }
+        }
+    }
+
+
+    /*!
+    * \brief The body of the data register empty interrupt service routine.  Only call this from the
+    * data register empty ISR of the %USART.
+    */
+    static void handleUdreInterrupt()
+    {
+        if ( sCtsEnabled && readGpioPinDigitalV( sCts ) )
+        {
+            // CTS deasserted, so pause until serviceFlowControl() or the next write resumes us
+            Reg::ucsrB() &= ~( 1 << UDRIE0 );
+        }
+        else if ( sNoCopyActive && !sBytesBeforeNoCopy )
+        {
+            // Send the next byte straight from the caller's memory
+            Reg::udr() = sNoCopyInFlash ? pgm_read_byte( sNoCopyData ) : *sNoCopyData;
+#ifdef USART_COLLECT_STATISTICS
+            ++sStatistics.bytesOut;
+#endif
+            ++sNoCopyData;
+            if ( !--sNoCopyRemaining )
+            {
+                sNoCopyActive = false;
+                if ( sNoCopyStatus )
+                {
+                    *sNoCopyStatus = kUsartCompletedOk;
+                }
+            }
+        }
+        else if ( sTxBuffer.isNotEmpty() )
+        {
+            // Send the next byte
+            if ( sBytesBeforeNoCopy )
+            {
+                --sBytesBeforeNoCopy;
+            }
+            Reg::udr() = sTxBuffer.pull();
+#ifdef USART_COLLECT_STATISTICS
+            ++sStatistics.bytesOut;
+#endif
+        }
+        else
+        {
+            // Nothing more to transmit so disable UDRE interrupts
+            Reg::ucsrB() &= ~( 1 << UDRIE0 );
+        }
+    }
+
+
+private:
+
+    static void checkRts()
+    {
+        // Only the owner of the receive buffer (us) reasserts RTS, so if it isn't deasserted now there's nothing
+        // to do; this keeps the common case (no flow control, or a sender that is keeping up) free of cli/sei
+        if ( !sRtsDeasserted )
+        {
+            return;
+        }
+
+        // Once reading has drained the buffer to half the high-water mark, tell the sender to resume;
+        // re-test with interrupts off, so the receive interrupt can't deassert RTS between the test and the update
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            if ( sRtsDeasserted && sRxBuffer.length() <= sRtsHighWaterMark / 2 )
+            {
+                setGpioPinLowV( sRts );
+                sRtsDeasserted = false;
+            }
+        }
+    }
+
+    static void startNoCopy( const uint8_t* data, size_t n, volatile uint8_t* status, bool inFlash )
+    {
+        // Only one zero-copy transmission at a time, so wait for any previous one to finish
+        while ( sNoCopyActive )
+            ;
+
+        if ( !data || !n )
+        {
+            if ( status )
+            {
+                *status = kUsartCompletedOk;
+            }
+            return;
+        }
+
+        if ( status )
+        {
+            *status = kUsartInProgress;
+        }
+
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            sNoCopyData = data;
+            sNoCopyRemaining = n;
+            sNoCopyStatus = status;
+            sNoCopyInFlash = inFlash;
+            // Whatever is already queued in the transmit buffer goes out first
+            sBytesBeforeNoCopy = sTxBuffer.length();
+            sNoCopyActive = true;
+
+            // Set UDRE interrupt
+            Reg::ucsrB() |= ( 1 << UDRIE0 );
+        }
+
+        // Clear TXC flag by writing a 1 (*not* a typo)
+        Reg::ucsrA() |= ( 1 << TXC0 );
+    }
+
+    static RingBufferSpsc< RX_SIZE > sRxBuffer;
+    static RingBufferSpsc< TX_SIZE > sTxBuffer;
+
+    static const uint8_t* volatile sNoCopyData;
+    static volatile size_t sNoCopyRemaining;
+    static volatile uint8_t* volatile sNoCopyStatus;
+    static volatile size_t sBytesBeforeNoCopy;
+    static volatile bool sNoCopyInFlash;
+    static volatile bool sNoCopyActive;
+
+    static volatile bool sLineDetection;
+    static volatile uint8_t sTerminator;
+    static volatile uint8_t sLinesIn;
+    static volatile uint8_t sLinesOut;
+
+    static GpioPinVariable sRts;
+    static GpioPinVariable sCts;
+    static volatile size_t sRtsHighWaterMark;
+    static volatile bool sRtsEnabled;
+    static volatile bool sRtsDeasserted;
+    static volatile bool sCtsEnabled;
+
+#ifdef USART_COLLECT_STATISTICS
+    static UsartStatistics sStatistics;
+#endif
+
+};
+
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+RingBufferSpsc< RX_SIZE > UsartEngine< PORT, RX_SIZE, TX_SIZE >::sRxBuffer;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+RingBufferSpsc< TX_SIZE > UsartEngine< PORT, RX_SIZE, TX_SIZE >::sTxBuffer;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+const uint8_t* volatile UsartEngine< PORT, RX_SIZE, TX_SIZE >::sNoCopyData;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile size_t UsartEngine< PORT, RX_SIZE, TX_SIZE >::sNoCopyRemaining;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile uint8_t* volatile UsartEngine< PORT, RX_SIZE, TX_SIZE >::sNoCopyStatus;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile size_t UsartEngine< PORT, RX_SIZE, TX_SIZE >::sBytesBeforeNoCopy;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile bool UsartEngine< PORT, RX_SIZE, TX_SIZE >::sNoCopyInFlash;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile bool UsartEngine< PORT, RX_SIZE, TX_SIZE >::sNoCopyActive;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile bool UsartEngine< PORT, RX_SIZE, TX_SIZE >::sLineDetection;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile uint8_t UsartEngine< PORT, RX_SIZE, TX_SIZE >::sTerminator;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile uint8_t UsartEngine< PORT, RX_SIZE, TX_SIZE >::sLinesIn;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile uint8_t UsartEngine< PORT, RX_SIZE, TX_SIZE >::sLinesOut;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+GpioPinVariable UsartEngine< PORT, RX_SIZE, TX_SIZE >::sRts;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+GpioPinVariable UsartEngine< PORT, RX_SIZE, TX_SIZE >::sCts;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile size_t UsartEngine< PORT, RX_SIZE, TX_SIZE >::sRtsHighWaterMark;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile bool UsartEngine< PORT, RX_SIZE, TX_SIZE >::sRtsEnabled;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile bool UsartEngine< PORT, RX_SIZE, TX_SIZE >::sRtsDeasserted;
+
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+volatile bool UsartEngine< PORT, RX_SIZE, TX_SIZE >::sCtsEnabled;
+
+#ifdef USART_COLLECT_STATISTICS
+template< uint8_t PORT, size_t RX_SIZE, size_t TX_SIZE >
+UsartStatistics UsartEngine< PORT, RX_SIZE, TX_SIZE >::sStatistics;
+#endif
+
+
+
+
+/*!
+ * \def DEFINE_USART0_INTERRUPTS( ENGINE )
+ *
+ * \brief Define the interrupt service routines for %USART0 so they drive the UsartEngine \c ENGINE.
+ * Use this macro in exactly one source file, and only if you don't link against USART0.cpp
+ * (which already defines these for its own engine).
+ *
+ * \arg \c ENGINE a UsartEngine instantiation for port 0.  Because macro arguments cannot contain
+ * unprotected commas, first give the instantiation a name with a typedef.
+ *
+ * \hideinitializer
+ */
+
+#if defined(__AVR_ATmega2560__)
+
+#define DEFINE_USART0_INTERRUPTS( ENGINE )                          \
+    ISR( USART0_RX_vect )   { PROFILE_PROBE( kProfileUsart0Rx ); ENGINE::handleRxInterrupt(); }     \
+    ISR( USART0_UDRE_vect ) { PROFILE_PROBE( kProfileUsart0Udre ); ENGINE::handleUdreInterrupt(); }
+
+#else
+
+#define DEFINE_USART0_INTERRUPTS( ENGINE )                          \
+    ISR( USART_RX_vect )    { PROFILE_PROBE( kProfileUsart0Rx ); ENGINE::handleRxInterrupt(); }     \
+    ISR( USART_UDRE_vect )  { PROFILE_PROBE( kProfileUsart0Udre ); ENGINE::handleUdreInterrupt(); }
+
+#endif
+
+
+#if defined(__AVR_ATmega2560__)
+
+/*!
+ * \def DEFINE_USART1_INTERRUPTS( ENGINE )
+ *
+ * \brief Define the interrupt service routines for %USART1 so they drive the UsartEngine \c ENGINE.
+ * Use this macro in exactly one source file, and only if you don't link against USART1.cpp.
+ *
+ * \arg \c ENGINE a UsartEngine instantiation for port 1 (named with a typedef).
+ *
+ * \hideinitializer
+ */
+
+#define DEFINE_USART1_INTERRUPTS( ENGINE )                          \
+    ISR( USART1_RX_vect )   { PROFILE_PROBE( kProfileUsart1Rx ); ENGINE::handleRxInterrupt(); }     \
+    ISR( USART1_UDRE_vect ) { PROFILE_PROBE( kProfileUsart1Udre ); ENGINE::handleUdreInterrupt(); }
+
+
+/*!
+ * \def DEFINE_USART2_INTERRUPTS( ENGINE )
+ *
+ * \brief Define the interrupt service routines for %USART2 so they drive the UsartEngine \c ENGINE.
+ * Use this macro in exactly one source file, and only if you don't link against USART2.cpp.
+ *
+ * \arg \c ENGINE a UsartEngine instantiation for port 2 (named with a typedef).
+ *
+ * \hideinitializer
+ */
+
+#define DEFINE_USART2_INTERRUPTS( ENGINE )                          \
+    ISR( USART2_RX_vect )   { PROFILE_PROBE( kProfileUsart2Rx ); ENGINE::handleRxInterrupt(); }     \
+    ISR( USART2_UDRE_vect ) { PROFILE_PROBE( kProfileUsart2Udre ); ENGINE::handleUdreInterrupt(); }
+
+
+/*!
+ * \def DEFINE_USART3_INTERRUPTS( ENGINE )
+ *
+ * \brief Define the interrupt service routines for %USART3 so they drive the UsartEngine \c ENGINE.
+ * Use this macro in exactly one source file, and only if you don't link against USART3.cpp.
+ *
+ * \arg \c ENGINE a UsartEngine instantiation for port 3 (named with a typedef).
+ *
+ * \hideinitializer
+ */
+
+#define DEFINE_USART3_INTERRUPTS( ENGINE )                          \
+    ISR( USART3_RX_vect )   { PROFILE_PROBE( kProfileUsart3Rx ); ENGINE::handleRxInterrupt(); }     \
+    ISR( USART3_UDRE_vect ) { PROFILE_PROBE( kProfileUsart3Udre ); ENGINE::handleUdreInterrupt(); }
+
+#endif
+
+
+#endif
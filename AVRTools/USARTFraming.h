@@ -0,0 +1,582 @@
+/*
+    USARTFraming.h - An interrupt-driven engine that sends and receives
+    binary frames (SLIP framing with a CRC-16) on any of the USARTs.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides an interrupt-driven engine that sends and receives binary frames on a %USART,
+ * rather than streams of characters.
+ *
+ * Each frame is a block of bytes followed by a CRC-16 (CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF,
+ * most significant byte first), and the whole is framed with SLIP (RFC 1055):  the frame starts and ends with an
+ * END byte (0xC0); END and ESC (0xDB) bytes inside the frame are sent as ESC followed by 0xDC or 0xDD respectively.
+ * SLIP can be encoded and decoded one byte at a time without looking ahead, so the work is done entirely in the
+ * interrupt functions:  the data register empty interrupt encodes (and computes the CRC of) a frame directly from
+ * the caller's memory, and the receive interrupt decodes and checks incoming frames into a small queue of frame
+ * slots.  The main program only ever handles complete, verified frames.
+ *
+ * Sending binary values in frames is typically 3 to 5 times more compact than printing them as text, and needs no
+ * formatting or parsing.  The script tools/framing.py implements the host side of the protocol.
+ *
+ * A FramedUsart replaces the UsartEngine of the same port, so don't link against the corresponding USART0.cpp
+ * (or USART1.cpp, etc.).  Instead, instantiate the template and its interrupt functions in one of your source files:
+ *
+ * ~~~C
+ * typedef FramedUsart< 0, 64, 2 > Link;        // Frames of up to 64 bytes; room for 2 received frames
+ * DEFINE_USART0_INTERRUPTS( Link )
+ * ~~~
+ */
+
+
+
+#ifndef USARTFraming_h
+#define USARTFraming_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+#include "USARTEngine.h"
+
+
+
+/*!
+ * \brief This struct holds the error counts collected by a FramedUsart.  All counts wrap around.
+ */
+
+struct FramingStatistics
+{
+    uint16_t    framesIn;               //!< Frames received intact (including any dropped for lack of space)
+    uint16_t    framesOut;              //!< Frames sent
+    uint16_t    crcErrors;              //!< Frames received with a bad CRC (or too short to hold one)
+    uint16_t    framingErrors;          //!< Frames discarded for bad escapes, parity errors, or being too long
+    uint16_t    droppedOnFull;          //!< Intact frames discarded because every frame slot was full
+};
+
+
+
+/*!
+ * \brief This template class sends and receives binary frames on a %USART, encoding and decoding them in
+ * the interrupt functions.
+ *
+ * All members are static:  an instantiation represents the %USART hardware itself.
+ *
+ * \arg \c PORT the %USART to use (0 through 3 on the ATmega2560, only 0 on the ATmega328P).
+ * \arg \c MAX_FRAME the largest frame (not counting the CRC or SLIP bytes) that can be received, from 1 to 253.
+ * \arg \c RX_FRAMES the number of received frames that can wait to be read (each takes \c MAX_FRAME + 3 bytes of RAM);
+ * it must be a power of 2 from 1 to 16.
+ */
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES > class FramedUsart
+{
+    static_assert( MAX_FRAME >= 1 && MAX_FRAME <= 253, "MAX_FRAME must be between 1 and 253" );
+    // The frame counters run freely through 256 values, so RX_FRAMES must divide 256 for them to map onto the slots
+    static_assert( RX_FRAMES >= 1 && RX_FRAMES <= 16 && ( RX_FRAMES & ( RX_FRAMES - 1 ) ) == 0,
+                   "RX_FRAMES must be a power of 2 between 1 and 16" );
+
+    typedef UsartRegisters< PORT > Reg;
+
+    enum
+    {
+        kEnd            = 0xC0,
+        kEsc            = 0xDB,
+        kEscEnd         = 0xDC,
+        kEscEsc         = 0xDD
+    };
+
+    enum
+    {
+        kTxIdle,
+        kTxStart,
+        kTxData,
+        kTxCrcHigh,
+        kTxCrcLow,
+        kTxEnd
+    };
+
+public:
+
+    /*!
+    * \brief Initialize the %USART for sending and receiving frames.
+    *
+    * \arg \c baudRate the baud rate for the communications.
+    * \arg \c config the configuration in term of data bits, parity, and stop bits
+    * (one of the UsartSerialConfiguration values; frames need 8 data bits).
+    */
+    static void start( unsigned long baudRate, uint8_t config )
+    {
+        bool use2x = true;
+        uint16_t baudSetting = (F_CPU + baudRate * 4L) / ( 8L * baudRate ) - 1;
+        if ( baudSetting > 4095 || baudRate == 57600)
+        {
+            use2x = false;
+            baudSetting = (F_CPU + baudRate * 8L) / (baudRate * 16L) - 1;
+        }
+
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            sRxIn = 0;
+            sRxOut = 0;
+            sRxLength = 0;
+            sRxCrc = 0xFFFF;
+            sRxEscaped = false;
+            sRxBad = false;
+
+            // Asynchronous mode, with everything else off
+            Reg::ucsrA() &= ~( (1<<U2X0) | (1<<MPCM0) );
+            Reg::ucsrB() &= ~( (1<<RXCIE0) | (1<<TXCIE0) | (1<<UDRIE0) | (1<<RXEN0) | (1<<TXEN0)
+                            | (1<< UCSZ02) | (1<<TXB80) );
+
+            // Set data bits, stop bits, and parity
+            Reg::ucsrC() = config;
+
+            // Set baud rate
+            Reg::ubrrH() = baudSetting >> 8;
+            Reg::ubrrL() = baudSetting;
+            if ( use2x )
+            {
+                Reg::ucsrA() |= ( 1 << U2X0 );
+            }
+
+            // Turn on TX and RX, and the receive interrupt (the transmit interrupt is turned on per frame)
+            Reg::ucsrB() |= ( 1 << RXEN0 ) | ( 1 << TXEN0 ) | ( 1 << RXCIE0 );
+        }
+    }
+
+
+    /*!
+    * \brief Stop the %USART, after sending any frame in progress.  Received frames not yet read are discarded.
+    */
+    static void stop()
+    {
+        flush();
+
+        // Turn off TX, RX, and interrupts
+        Reg::ucsrB() &= ~( (1<<RXCIE0) | (1<<TXCIE0) | (1<<UDRIE0) | (1<<RXEN0) | (1<<TXEN0) );
+    }
+
+
+    /*!
+    * \brief Block until any frame in progress has been sent and the last byte has left the %USART.
+    */
+    static void flush()
+    {
+        while ( sTxState != kTxIdle )
+            ;
+
+        // Only wait for the last byte if we sent anything since TXC was cleared
+        if ( sTxSent )
+        {
+            while ( !( Reg::ucsrA() & ( 1 << TXC0 ) ) )
+                ;
+        }
+    }
+
+
+    /*!
+    * \brief Send a frame, directly from the caller's memory.  This function returns immediately; the data
+    * register empty interrupt encodes and sends the frame, and reports completion through the status variable.
+    *
+    * Only one frame can be in progress at a time; if one is already in progress, this function blocks
+    * until it finishes.
+    *
+    * \note The array must remain unchanged until the status variable reports kUsartCompletedOk.
+    *
+    * \arg \c data the bytes to send.
+    * \arg \c n the number of bytes to send (these need not fit in \c MAX_FRAME, which only limits received frames).
+    * \arg \c status a pointer to a byte-size location in which the status of the transmission
+    * will be reported (values correspond to UsartTxStatusCodes); may be null if not needed.
+    */
+    static void sendFrame( const uint8_t* data, size_t n, volatile uint8_t* status = 0 )
+    {
+        while ( sTxState != kTxIdle )
+            ;
+
+        if ( status )
+        {
+            *status = kUsartInProgress;
+        }
+
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            sTxData = data;
+            sTxRemaining = n;
+            sTxStatus = status;
+            sTxCrc = 0xFFFF;
+            sTxPending = 0;
+            sTxState = kTxStart;
+            sTxSent = true;
+
+            // Clear TXC flag by writing a 1 (*not* a typo)
+            Reg::ucsrA() |= ( 1 << TXC0 );
+
+            // Set UDRE interrupt
+            Reg::ucsrB() |= ( 1 << UDRIE0 );
+        }
+    }
+
+
+    /*!
+    * \brief Determine if a frame is being sent.
+    *
+    * \returns true if a frame is in progress; false if a new frame can be sent without waiting.
+    */
+    static bool isSending()
+    {
+        return sTxState != kTxIdle;
+    }
+
+
+    /*!
+    * \brief Get the number of complete, verified frames waiting to be read.
+    *
+    * \returns the number of frames waiting.
+    */
+    static uint8_t framesAvailable()
+    {
+        uint8_t n;
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            n = sRxIn - sRxOut;
+        }
+        return n;
+    }
+
+
+    /*!
+    * \brief Copy the next received frame (without its CRC) into a buffer, without waiting.  If the frame
+    * does not fit, the rest of it is discarded.
+    *
+    * \arg \c buffer the array where the frame will be stored.
+    * \arg \c length the size of the array.
+    *
+    * \returns the length of the frame (which may be more than the number of bytes stored, if the frame was
+    * truncated), or -1 if no frame is waiting.
+    */
+    static int readFrame( uint8_t* buffer, size_t length )
+    {
+        if ( !framesAvailable() )
+        {
+            return -1;
+        }
+
+        // The receive interrupt doesn't touch a completed slot until we release it
+        uint8_t slot = sRxOut & ( RX_FRAMES - 1 );
+        uint8_t n = sRxLengths[ slot ];
+        memcpy( buffer, sRxFrames[ slot ], n < length ? n : length );
+
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            ++sRxOut;
+        }
+
+        return n;
+    }
+
+
+    /*!
+    * \brief Get a consistent snapshot of the frame counts.
+    *
+    * \arg \c stats a pointer to where the statistics will be copied.
+    */
+    static void getStatistics( FramingStatistics* stats )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            *stats = sStatistics;
+        }
+    }
+
+
+    /*!
+    * \brief Reset all frame counts to zero.
+    */
+    static void clearStatistics()
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            memset( &sStatistics, 0, sizeof( sStatistics ) );
+        }
+    }
+
+
+    /*!
+    * \brief The body of the receive complete interrupt service routine.  Only call this from the
+    * receive complete ISR of the %USART.
+    */
+    static void handleRxInterrupt()
+    {
+        // Status flags must be read before UDR
+        uint8_t status = Reg::ucsrA();
+        uint8_t c = Reg::udr();
+
+        if ( c == kEnd )
+        {
+            endRxFrame();
+            return;
+        }
+
+        if ( status & ( (1<<UPE0) | (1<<FE0) | (1<<DOR0) ) )
+        {
+            // Lost or damaged byte; skip to the next END
+            sRxBad = true;
+        }
+
+        if ( sRxBad )
+        {
+            return;
+        }
+
+        if ( sRxEscaped )
+        {
+            sRxEscaped = false;
+            if ( c == kEscEnd )
+            {
+                c = kEnd;
+            }
+            else if ( c == kEscEsc )
+            {
+                c = kEsc;
+            }
+            else
+            {
+                sRxBad = true;
+                return;
+            }
+        }
+        else if ( c == kEsc )
+        {
+            sRxEscaped = true;
+            return;
+        }
+
+        if ( sRxLength >= MAX_FRAME + 2 || static_cast<uint8_t>( sRxIn - sRxOut ) >= RX_FRAMES )
+        {
+            // Too long, or nowhere to put it (told apart when the END arrives)
+            sRxOverflow = true;
+            return;
+        }
+
+        sRxFrames[ sRxIn & ( RX_FRAMES - 1 ) ][ sRxLength++ ] = c;
+        sRxCrc = _crc_xmodem_update( sRxCrc, c );
+    }
+
+
+    /*!
+    * \brief The body of the data register empty interrupt service routine.  Only call this from the
+    * data register empty ISR of the %USART.
+    */
+    static void handleUdreInterrupt()
+    {
+        if ( sTxPending )
+        {
+            // Second byte of an escape
+            Reg::udr() = sTxPending;
+            sTxPending = 0;
+            return;
+        }
+
+        uint8_t c;
+        switch ( sTxState )
+        {
+            case kTxStart:
+                // A leading END flushes out any line noise the receiver may have picked up
+                Reg::udr() = kEnd;
+                sTxState = sTxRemaining ? kTxData : kTxCrcHigh;
+                return;
+
+            case kTxData:
+                c = *sTxData++;
+                sTxCrc = _crc_xmodem_update( sTxCrc, c );
+                if ( !--sTxRemaining )
+                {
+                    sTxState = kTxCrcHigh;
+                }
+                break;
+
+            case kTxCrcHigh:
+                c = sTxCrc >> 8;
+                sTxState = kTxCrcLow;
+                break;
+
+            case kTxCrcLow:
+                c = sTxCrc;
+                sTxState = kTxEnd;
+                break;
+
+            case kTxEnd:
+                Reg::udr() = kEnd;
+                sTxState = kTxIdle;
+                ++sStatistics.framesOut;
+                if ( sTxStatus )
+                {
+                    *sTxStatus = kUsartCompletedOk;
+                }
+                return;
+
+            default:
+                // Nothing more to transmit so disable UDRE interrupts
+                Reg::ucsrB() &= ~( 1 << UDRIE0 );
+                return;
+        }
+
+        if ( c == kEnd )
+        {
+            Reg::udr() = kEsc;
+            sTxPending = kEscEnd;
+        }
+        else if ( c == kEsc )
+        {
+            Reg::udr() = kEsc;
+            sTxPending = kEscEsc;
+        }
+        else
+        {
+            Reg::udr() = c;
+        }
+    }
+
+
+private:
+
+    static void endRxFrame()
+    {
+        if ( sRxBad )
+        {
+            ++sStatistics.framingErrors;
+        }
+        else if ( sRxOverflow )
+        {
+            if ( sRxLength >= MAX_FRAME + 2 )
+            {
+                ++sStatistics.framingErrors;
+            }
+            else
+            {
+                ++sStatistics.droppedOnFull;
+            }
+        }
+        else if ( sRxLength )
+        {
+            // Running the CRC over the data and its (big-endian) CRC leaves zero
+            if ( sRxLength < 2 || sRxCrc )
+            {
+                ++sStatistics.crcErrors;
+            }
+            else
+            {
+                ++sStatistics.framesIn;
+                sRxLengths[ sRxIn & ( RX_FRAMES - 1 ) ] = sRxLength - 2;
+                ++sRxIn;
+            }
+        }
+
+        // Back-to-back ENDs (empty frames) are simply ignored
+        sRxLength = 0;
+        sRxCrc = 0xFFFF;
+        sRxEscaped = false;
+        sRxBad = false;
+        sRxOverflow = false;
+    }
+
+    static uint8_t sRxFrames[ RX_FRAMES ][ MAX_FRAME + 2 ];
+    static uint8_t sRxLengths[ RX_FRAMES ];
+    static volatile uint8_t sRxIn;
+    static volatile uint8_t sRxOut;
+    static uint8_t sRxLength;
+    static uint16_t sRxCrc;
+    static bool sRxEscaped;
+    static bool sRxBad;
+    static bool sRxOverflow;
+
+    static const uint8_t* volatile sTxData;
+    static volatile size_t sTxRemaining;
+    static volatile uint8_t* volatile sTxStatus;
+    static uint16_t sTxCrc;
+    static uint8_t sTxPending;
+    static volatile uint8_t sTxState;
+    static bool sTxSent;
+
+    static FramingStatistics sStatistics;
+};
+
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+uint8_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxFrames[ RX_FRAMES ][ MAX_FRAME + 2 ];
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+uint8_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxLengths[ RX_FRAMES ];
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+volatile uint8_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxIn;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+volatile uint8_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxOut;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+uint8_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxLength;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+uint16_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxCrc;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+bool FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxEscaped;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+bool FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxBad;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+bool FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sRxOverflow;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+const uint8_t* volatile FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sTxData;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+volatile size_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sTxRemaining;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+volatile uint8_t* volatile FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sTxStatus;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+uint16_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sTxCrc;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+uint8_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sTxPending;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+volatile uint8_t FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sTxState;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+bool FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sTxSent;
+
+template< uint8_t PORT, uint8_t MAX_FRAME, uint8_t RX_FRAMES >
+FramingStatistics FramedUsart< PORT, MAX_FRAME, RX_FRAMES >::sStatistics;
+
+
+
+#endif
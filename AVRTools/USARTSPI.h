@@ -0,0 +1,443 @@
+/*
+    USARTSPI.h - An SPI master interface built on the Master SPI Mode (MSPIM)
+    of the USARTs of AVR systems.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides an %SPI master interface on %USART0 (and, on the ATmega2560, on %USART1,
+ * %USART2, and %USART3), using the Master %SPI Mode (MSPIM) of the %USART hardware.
+ *
+ * Each %USART in MSPIM mode is an additional %SPI bus: TXDn is MOSI, RXDn is MISO, and XCKn is the clock.
+ * Unlike the main %SPI subsystem, the %USART transmitter is double-buffered, so the next byte can be loaded
+ * while the current one is being shifted out, and sustained transfers run back-to-back without gaps.
+ * The interface mirrors the primitives in SPI.h:  transmit(), transmit16(), transmit32(), buffer transmit(),
+ * send(), and fill().  The settings take the same bit order and data mode constants as SPISettings.
+ *
+ * The %SPI clock is F_CPU / ( 2 * ( UBRRn + 1 ) ), so in contrast to the main %SPI subsystem speeds are
+ * not restricted to powers of 2; the fastest clock no greater than the requested speed is used.
+ *
+ * A %USART in MSPIM mode cannot also be used for asynchronous serial communications, so do not use the
+ * USART0 (USART1, etc.) module or Serial0 (Serial1, etc.) on a %USART used here.  On the Arduino Uno the only
+ * %USART is connected to the USB interface.
+ *
+ * \note There is no SS pin in MSPIM mode; chip-select must be handled by the caller with any GPIO pin.
+ */
+
+
+
+#ifndef USARTSPI_h
+#define USARTSPI_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "SPI.h"
+#include "USARTEngine.h"
+
+
+
+
+
+/*!
+ * \brief This template provides compile-time access to the XCK (clock) pin of a given %USART, which must be
+ * set as an output for the %USART to act as an %SPI master.  It is only defined for the %USARTs that exist on
+ * the target processor.
+ *
+ * \tparam PORT the number of the %USART (0 to 3).
+ */
+
+template< uint8_t PORT > struct UsartSpiClockPin;
+
+
+#if defined(__AVR_ATmega328P__)
+
+/*!
+ * \brief The XCK pin of %USART0 (PD4).
+ */
+
+template<> struct UsartSpiClockPin< 0 >
+{
+    //! Data direction register of the XCK pin
+    static volatile uint8_t& ddr() { return DDRD; }
+    //! Bit number of the XCK pin
+    static const uint8_t kBit = 4;
+};
+
+#elif defined(__AVR_ATmega2560__)
+
+/*!
+ * \brief The XCK pin of %USART0 (PE2).
+ */
+
+template<> struct UsartSpiClockPin< 0 >
+{
+    //! Data direction register of the XCK pin
+    static volatile uint8_t& ddr() { return DDRE; }
+    //! Bit number of the XCK pin
+    static const uint8_t kBit = 2;
+};
+
+
+/*!
+ * \brief The XCK pin of %USART1 (PD5).
+ */
+
+template<> struct UsartSpiClockPin< 1 >
+{
+    //! Data direction register of the XCK pin
+    static volatile uint8_t& ddr() { return DDRD; }
+    //! Bit number of the XCK pin
+    static const uint8_t kBit = 5;
+};
+
+
+/*!
+ * \brief The XCK pin of %USART2 (PH2).
+ */
+
+template<> struct UsartSpiClockPin< 2 >
+{
+    //! Data direction register of the XCK pin
+    static volatile uint8_t& ddr() { return DDRH; }
+    //! Bit number of the XCK pin
+    static const uint8_t kBit = 2;
+};
+
+
+/*!
+ * \brief The XCK pin of %USART3 (PJ2).
+ */
+
+template<> struct UsartSpiClockPin< 3 >
+{
+    //! Data direction register of the XCK pin
+    static volatile uint8_t& ddr() { return DDRJ; }
+    //! Bit number of the XCK pin
+    static const uint8_t kBit = 2;
+};
+
+#else
+
+#error "Undefined AVR processor type"
+
+#endif
+
+
+
+
+/*!
+ * \brief This template class implements a polled %SPI master on a given %USART in MSPIM mode.
+ *
+ * All members are static: an instantiation represents the %USART hardware itself.  Use the typedefs
+ * UsartSpi0 (and, on the ATmega2560, UsartSpi1, UsartSpi2, and UsartSpi3).
+ *
+ * ~~~{.cpp}
+ * UsartSpi1::enable( 1000000, SPI::kMsbFirst, SPI::kSpiMode0 );
+ *
+ * setGpioPinLow( pSensorCsPin );
+ * uint16_t reading = UsartSpi1::transmit16( 0x0000 );
+ * setGpioPinHigh( pSensorCsPin );
+ * ~~~
+ *
+ * \tparam PORT the number of the %USART (0 to 3).
+ */
+
+template< uint8_t PORT > class UsartSpi
+{
+    typedef UsartRegisters< PORT > Reg;
+    typedef UsartSpiClockPin< PORT > Xck;
+
+    // MSPIM bits in UCSRnC (UDORDn and UCPHAn share positions with UCSZn1 and UCSZn0)
+    static const uint8_t kUmselMspim    = ( 1 << UMSEL01 ) | ( 1 << UMSEL00 );
+    static const uint8_t kUdord         = ( 1 << UCSZ01 );
+    static const uint8_t kUcpha         = ( 1 << UCSZ00 );
+    static const uint8_t kUcpol         = ( 1 << UCPOL0 );
+
+public:
+
+    /*!
+     * \brief Enable the %USART as an %SPI master.
+     *
+     * This configures XCKn as an output and takes over TXDn and RXDn.
+     *
+     * \arg \c maxSpeed the maximum speed of transmission, in herz (Hz).  The fastest speed is F_CPU / 2.
+     * \arg \c bitOrder whether least significant or most significant bit is first.
+     * Pass either SPI::kMsbFirst or SPI::kLsbFirst.
+     * \arg \c dataMode sets the data mode (phase and polarity) for %SPI communications.
+     * Pass one of SPI::kSpiMode0, SPI::kSpiMode1, SPI::kSpiMode2, or SPI::kSpiMode3.
+     */
+
+    static void enable( uint32_t maxSpeed, uint8_t bitOrder, uint8_t dataMode )
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            // The baud rate must be zero while the transmitter is enabled (datasheet, USART in SPI mode)
+            Reg::ubrrH() = 0;
+            Reg::ubrrL() = 0;
+
+            Xck::ddr() |= ( 1 << Xck::kBit );
+
+            Reg::ucsrB() = 0;
+            Reg::ucsrC() = kUmselMspim
+                            | ( ( bitOrder == SPI::kLsbFirst ) ? kUdord : 0 )
+                            | ( ( dataMode & SPI::kSpiMode1 ) ? kUcpha : 0 )
+                            | ( ( dataMode & SPI::kSpiMode2 ) ? kUcpol : 0 );
+            Reg::ucsrB() = ( 1 << RXEN0 ) | ( 1 << TXEN0 );
+
+            uint16_t ubrr = baudSetting( maxSpeed );
+            Reg::ubrrH() = ubrr >> 8;
+            Reg::ubrrL() = ubrr;
+        }
+    }
+
+
+    /*!
+     * \brief Disable the %USART, releasing TXDn and RXDn.  The XCKn pin is returned to input mode.
+     */
+
+    static void disable()
+    {
+        ATOMIC_BLOCK( ATOMIC_RESTORESTATE )
+        {
+            Reg::ucsrB() = 0;
+            Reg::ucsrC() = 0;
+            Xck::ddr() &= ~( 1 << Xck::kBit );
+        }
+    }
+
+
+    /*!
+     * \brief Transmit a single byte.
+     *
+     * \arg \c data the byte to be transmitted.
+     *
+     * \returns the byte received.
+     */
+
+    static uint8_t transmit( uint8_t data )
+    {
+        while ( !( Reg::ucsrA() & ( 1 << UDRE0 ) ) )
+            ;
+        Reg::udr() = data;
+        while ( !( Reg::ucsrA() & ( 1 << RXC0 ) ) )
+            ;
+        return Reg::udr();
+    }
+
+
+    /*!
+     * \brief Transmit a word-sized integer (two bytes).  The order in which the bytes are sent is determined
+     * by the bit order set in enable().
+     *
+     * \arg \c data the word-sized integer (two bytes) to be transmitted.
+     *
+     * \returns the word-sized integer (two bytes) received, with byte order determined by the bit order
+     * set in enable().
+     */
+
+    static uint16_t transmit16( uint16_t data )
+    {
+        uint8_t buffer[2];
+        if ( Reg::ucsrC() & kUdord )
+        {
+            buffer[0] = data;
+            buffer[1] = data >> 8;
+            transmit( buffer, 2 );
+            return ( static_cast<uint16_t>( buffer[1] ) << 8 ) | buffer[0];
+        }
+        else
+        {
+            buffer[0] = data >> 8;
+            buffer[1] = data;
+            transmit( buffer, 2 );
+            return ( static_cast<uint16_t>( buffer[0] ) << 8 ) | buffer[1];
+        }
+    }
+
+
+    /*!
+     * \brief Transmit a long-word-sized integer (four bytes).  The order in which the bytes are sent is
+     * determined by the bit order set in enable().
+     *
+     * \arg \c data the long-word-sized integer (four bytes) to be transmitted.
+     *
+     * \returns the long-word-sized integer (four bytes) received, with byte order determined by the bit order
+     * set in enable().
+     */
+
+    static uint32_t transmit32( uint32_t data )
+    {
+        uint8_t buffer[4];
+        bool lsbFirst = Reg::ucsrC() & kUdord;
+        for ( uint8_t i = 0; i < 4; ++i )
+        {
+            buffer[ lsbFirst ? i : 3 - i ] = data;
+            data >>= 8;
+        }
+        transmit( buffer, 4 );
+        uint32_t result = 0;
+        for ( uint8_t i = 0; i < 4; ++i )
+        {
+            result = ( result << 8 ) | buffer[ lsbFirst ? 3 - i : i ];
+        }
+        return result;
+    }
+
+
+    /*!
+     * \brief Transmit an array of bytes.  The bytes are transmitted in array order.
+     *
+     * \arg \c buffer the array of bytes to transmit.  Incoming bytes are also stored here, replacing
+     * the outgoing data, byte-for-byte.
+     * \arg \c count the number of bytes to transmit.
+     */
+
+    static void transmit( uint8_t* buffer, size_t count )
+    {
+        transfer( buffer, buffer, count, 0xFF );
+    }
+
+
+    /*!
+     * \brief Transmit an array of bytes, storing the received bytes in a separate array.  The bytes are
+     * transmitted in array order.
+     *
+     * \arg \c txBuffer the array of bytes to transmit; it is not modified.  If this is a null pointer, 0xFF
+     * is transmitted for each byte.
+     * \arg \c rxBuffer the array in which to store the received bytes.  If this is a null pointer, the
+     * received bytes are discarded.
+     * \arg \c count the number of bytes to transmit.
+     */
+
+    static void transmit( const uint8_t* txBuffer, uint8_t* rxBuffer, size_t count )
+    {
+        transfer( txBuffer, rxBuffer, count, 0xFF );
+    }
+
+
+    /*!
+     * \brief Transmit an array of bytes, discarding any data received.  The bytes are transmitted in array
+     * order.
+     *
+     * \arg \c buffer the array of bytes to transmit; it is not modified.
+     * \arg \c count the number of bytes to transmit.
+     */
+
+    static void send( const uint8_t* buffer, size_t count )
+    {
+        transfer( buffer, 0, count, 0xFF );
+    }
+
+
+    /*!
+     * \brief Transmit the same byte repeatedly, discarding any data received.
+     *
+     * \arg \c value the byte to transmit.
+     * \arg \c count the number of times to transmit \c value.
+     */
+
+    static void fill( uint8_t value, size_t count )
+    {
+        transfer( 0, 0, count, value );
+    }
+
+
+private:
+
+    static uint16_t baudSetting( uint32_t maxSpeed )
+    {
+        if ( maxSpeed >= F_CPU / 2 )
+        {
+            return 0;
+        }
+        // Round the divisor up so the clock never exceeds maxSpeed
+        uint32_t ubrr = ( F_CPU + 2 * maxSpeed - 1 ) / ( 2 * maxSpeed ) - 1;
+        return ( ubrr > 4095 ) ? 4095 : ubrr;
+    }
+
+
+    // Keep at most two bytes in flight:  one in the transmit buffer and one in the shift register.
+    // More than that could overrun the receiver before the received bytes are read.
+    static void transfer( const uint8_t* txBuffer, uint8_t* rxBuffer, size_t count, uint8_t fill )
+    {
+        size_t txLeft = count;
+        size_t rxLeft = count;
+
+        while ( rxLeft )
+        {
+            uint8_t status = Reg::ucsrA();
+
+            if ( txLeft && ( status & ( 1 << UDRE0 ) ) && ( rxLeft - txLeft ) < 2 )
+            {
+                Reg::udr() = txBuffer ? *txBuffer++ : fill;
+                --txLeft;
+            }
+
+            if ( status & ( 1 << RXC0 ) )
+            {
+                uint8_t in = Reg::udr();
+                if ( rxBuffer )
+                {
+                    *rxBuffer++ = in;
+                }
+                --rxLeft;
+            }
+        }
+    }
+};
+
+
+
+/*!
+ * \brief %SPI master on %USART0.
+ */
+
+typedef UsartSpi< 0 > UsartSpi0;
+
+#if defined(__AVR_ATmega2560__)
+
+/*!
+ * \brief %SPI master on %USART1 (ATmega2560 only).
+ */
+
+typedef UsartSpi< 1 > UsartSpi1;
+
+/*!
+ * \brief %SPI master on %USART2 (ATmega2560 only).
+ */
+
+typedef UsartSpi< 2 > UsartSpi2;
+
+/*!
+ * \brief %SPI master on %USART3 (ATmega2560 only).
+ */
+
+typedef UsartSpi< 3 > UsartSpi3;
+
+#endif
+
+
+#endif
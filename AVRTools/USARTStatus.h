@@ -0,0 +1,73 @@
+/*
+    USARTStatus.h - Status codes and statistics shared by the buffered
+    USART interfaces of AVR systems.
+    For AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*!
+ * \file
+ *
+ * \brief This file provides the status codes and statistics shared by all the buffered %USART interfaces
+ * (USART0.h to USART3.h, USARTEngine.h, and USARTFraming.h).
+ *
+ * You normally don't need to include this file directly; it is included by the %USART headers.
+ */
+
+
+
+#ifndef USARTStatus_h
+#define USARTStatus_h
+
+#include <stdint.h>
+
+
+
+/*!
+ * \brief This enum lists the status codes reported by the zero-copy transmit functions (writeNoCopy()
+ * and writeNoCopy_P()).
+ *
+ * \hideinitializer
+ */
+enum UsartTxStatusCodes
+{
+    kUsartCompletedOk   = 0x00,     //!< All the data has been handed to the %USART hardware; the source may be reused.  \hideinitializer
+    kUsartInProgress    = 0x04      //!< Transmission of the data is still in progress.  \hideinitializer
+};
+
+
+
+/*!
+ * \brief This struct holds the statistics a %USART collects when the library is compiled with the macro
+ * \c USART_COLLECT_STATISTICS defined.
+ */
+struct UsartStatistics
+{
+    uint32_t    bytesIn;            //!< Bytes received (including those with errors).
+    uint32_t    bytesOut;           //!< Bytes handed to the %USART hardware for transmission.
+    uint16_t    droppedOnFull;      //!< Bytes dropped because the receive buffer was full.
+    uint16_t    parityErrors;       //!< Bytes received with a parity error (these are dropped).
+    uint16_t    framingErrors;      //!< Bytes received with a framing error.
+    uint16_t    overrunErrors;      //!< Data overruns (one or more bytes lost because the receive interrupt was late).
+    uint16_t    rxHighWaterMark;    //!< The largest number of bytes ever held in the receive buffer.
+};
+
+
+
+#endif
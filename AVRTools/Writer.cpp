@@ -26,6 +26,8 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
 #include <math.h>
 
 #include <avr/pgmspace.h>
@@ -106,83 +108,50 @@ size_t Writer::print( char c, bool addLn )
 
 size_t Writer::print( int8_t n, int base, bool addLn )
 {
-    uint8_t tmp = 0;
-    if ( base == kDec && n < 0 )
-    {
-        tmp += print( '-' );
-        n = -n;
-    }
+    bool negative = ( base == kDec && n < 0 );
 
-    tmp += printNumber( static_cast<unsigned int8_t>( n ), base );      // cast essential to correctly display 2's complement negatives
-    if ( addLn )
-    {
-        tmp += println();
-    }
-    return tmp;
+    // Cast essential to correctly display 2's complement negatives in other bases
+    return printNumber( static_cast<unsigned int>( static_cast<uint8_t>( negative ? -n : n ) ), base, negative, addLn );
 }
 
 
 
 size_t Writer::print( int n, int base, bool addLn )
 {
-    uint8_t tmp = 0;
-    if ( base == kDec && n < 0 )
-    {
-        tmp += print( '-' );
-        n = -n;
-    }
+    bool negative = ( base == kDec && n < 0 );
 
-    tmp += printNumber( static_cast<unsigned int>( n ), base );         // cast essential to correctly display 2's complement negatives
-    if ( addLn )
-    {
-        tmp += println();
-    }
-    return tmp;
+    // Cast essential to correctly display 2's complement negatives in other bases
+    return printNumber( static_cast<unsigned int>( negative ? -n : n ), base, negative, addLn );
+}
+
+
+
+size_t Writer::print( unsigned int n, int base, bool addLn )
+{
+    return printNumber( n, base, false, addLn );
 }
 
 
 
 size_t Writer::print( long n, int base, bool addLn )
 {
-    uint8_t tmp = 0;
-    if ( base == kDec && n < 0 )
-    {
-        tmp += print( '-' );
-        n = -n;
-    }
+    bool negative = ( base == kDec && n < 0 );
 
-    tmp += printNumber( static_cast<unsigned long>( n ), base );
-    if ( addLn )
-    {
-        tmp += println();
-    }
-    return tmp;
+    return printNumber( static_cast<unsigned long>( negative ? -n : n ), base, negative, addLn );
 }
 
 
 
 size_t Writer::print( unsigned long n, int base, bool addLn )
 {
-    uint8_t tmp = 0;
-
-    tmp = printNumber( n, base );
-    if ( addLn )
-    {
-        tmp += println();
-    }
-    return tmp;
+    return printNumber( n, base, false, addLn );
 }
 
 
 
 size_t Writer::print( double d, int digits, bool addLn )
 {
-    uint8_t n = printFloat( d, digits );
-    if ( addLn )
-    {
-        n += println();
-    }
-    return n;
+    return printFloat( d, digits, addLn );
 }
 
 
@@ -197,137 +166,641 @@ size_t Writer::println()
 
 
 
-size_t Writer::printNumber( unsigned long n, uint8_t base )
+namespace
 {
-    char buf[ 8 * sizeof(long) + 1 + 2 ];     // Assumes 8-bit chars plus zero byte plus optional 2-char base designator
-    char* str = &buf[ sizeof(buf) - 1 ];
+    // These functions generate digits backwards from the end of a buffer and return a pointer to the first
 
-    *str = 0;
+    char* toDecimal( uint16_t n, char* str )
+    {
+        while ( n > 0xFF )
+        {
+            // n / 10 by reciprocal multiplication (exact for all 16-bit values)
+            uint16_t q = ( static_cast<uint32_t>( n ) * 0xCCCD ) >> 19;
+            *--str = n - q * 10 + '0';
+            n = q;
+        }
+
+        uint8_t m = n;
+        do
+        {
+            // Same, in 8 bits (exact for all 8-bit values)
+            uint8_t q = ( static_cast<uint16_t>( m ) * 0xCD ) >> 11;
+            *--str = m - q * 10 + '0';
+            m = q;
+        }
+        while ( m );
+
+        return str;
+    }
 
-    // prevent crash if called with base == 1
-    if ( base < 2 )
+
+    char* toDecimal( uint32_t n, char* str )
     {
-        base = 10;
+        // One 32-bit division peels off four digits, which are then converted in 16 bits
+        while ( n > 0xFFFF )
+        {
+            uint32_t q = n / 10000;
+            char* group = str - 4;
+            str = toDecimal( static_cast<uint16_t>( n - q * 10000 ), str );
+            while ( str > group )
+            {
+                *--str = '0';
+            }
+            n = q;
+        }
+
+        return toDecimal( static_cast<uint16_t>( n ), str );
     }
 
-    do
+
+    template< typename T > char* toPowerOfTwoBase( T n, uint8_t shift, char* str )
     {
-        unsigned long m = n;
-        n /= base;
-        char c = m - base * n;
-        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+        uint8_t mask = ( 1 << shift ) - 1;
+        do
+        {
+            uint8_t c = static_cast<uint8_t>( n ) & mask;
+            *--str = c < 10 ? c + '0' : c + 'A' - 10;
+            n >>= shift;
+        }
+        while ( n );
+
+        return str;
     }
-    while( n );
 
-    switch ( base )
+
+    template< typename T > char* toAnyBase( T n, uint8_t base, char* str )
     {
-        case kBin:
-            *--str = 'b';
-            *--str = '0';
-            break;
-
-        case kOct:
-            *--str = 'o';           // Slightly non-standard, but more visible, way to represent octal numbers
-            *--str = '0';
-            break;
-
-        case kDec:
-            break;
-
-        case kHex:
-            *--str = 'x';
-            *--str = '0';
-            break;
-
-        default:
-            *--str = '?';           // Used to indicate a non-decimal, non-standard base
-            *--str = '0';
+        do
+        {
+            T m = n;
+            n /= base;
+            char c = m - base * n;
+            *--str = c < 10 ? c + '0' : c + 'A' - 10;
+        }
+        while ( n );
+
+        return str;
     }
 
-    return write( str );
-}
+
+    template< typename T > char* formatNumber( T n, uint8_t base, char* str )
+    {
+        switch ( base )
+        {
+            case Writer::kBin:
+                str = toPowerOfTwoBase( n, 1, str );
+                *--str = 'b';
+                *--str = '0';
+                break;
+
+            case Writer::kOct:
+                str = toPowerOfTwoBase( n, 3, str );
+                *--str = 'o';           // Slightly non-standard, but more visible, way to represent octal numbers
+                *--str = '0';
+                break;
+
+            case Writer::kDec:
+                str = toDecimal( n, str );
+                break;
+
+            case Writer::kHex:
+                str = toPowerOfTwoBase( n, 4, str );
+                *--str = 'x';
+                *--str = '0';
+                break;
+
+            default:
+                // prevent crash if called with base == 1
+                if ( base < 2 )
+                {
+                    str = toDecimal( n, str );
+                    break;
+                }
+                str = toAnyBase( n, base, str );
+                *--str = '?';           // Used to indicate a non-decimal, non-standard base
+                *--str = '0';
+        }
+
+        return str;
+    }
 
 
 
-namespace
-{
     const PROGMEM char sNan[]   = "Nan";
     const PROGMEM char sInf[]   = "Inf";
     const PROGMEM char sOvf[]   = "Ovf";
+
+    const uint8_t kMaxFloatDigits = 9;
+
+    const PROGMEM uint32_t sPowersOf10[ kMaxFloatDigits + 1 ] =
+    {
+        1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL, 1000000000UL
+    };
+
+
+    // Returns the text (in PROGMEM) to print in place of a number too big or too strange to format, or 0
+    const char* floatException( double number )
+    {
+        if ( isnan( number ) )
+        {
+            return sNan;
+        }
+        if ( isinf( number ) )
+        {
+            return sInf;
+        }
+        if ( number >  4294967040.0 || number < -4294967040.0 )   // constants determined empirically
+        {
+            return sOvf;
+        }
+        return 0;
+    }
+
+
+    // Formats a number that passed floatException() with up to kMaxFloatDigits decimal digits, using
+    // at most 21 characters (sign, ten integer digits, the decimal point, and nine decimal digits)
+    char* formatFloat( double number, uint8_t fracDigits, char* str )
+    {
+        char* end = str;
+
+        bool negative = ( number < 0.0 );
+        if ( negative )
+        {
+            number = -number;
+        }
+
+        // Split the number once, then scale and round the fraction in a single step so that print( 1.999, 2 )
+        // prints as "2.00"; everything after this is integer arithmetic
+        uint32_t scale = pgm_read_dword( &sPowersOf10[ fracDigits ] );
+        uint32_t intPart = static_cast<uint32_t>( number );
+        uint32_t fracPart = static_cast<uint32_t>( ( number - intPart ) * scale + 0.5 );
+        if ( fracPart >= scale )
+        {
+            fracPart -= scale;
+            ++intPart;
+        }
+
+        if ( fracDigits )
+        {
+            str = toDecimal( fracPart, str );
+            while ( end - str < fracDigits )
+            {
+                *--str = '0';
+            }
+            *--str = '.';
+        }
+
+        str = toDecimal( intPart, str );
+
+        if ( negative )
+        {
+            *--str = '-';
+        }
+
+        return str;
+    }
+
+
+
+    // Collects formatted output in a small buffer and passes it to the Writer in chunks
+    class FormatBuffer
+    {
+    public:
+
+        FormatBuffer( Writer& out )
+        : mOut( out ), mCount( 0 ), mLen( 0 )
+        {}
+
+        void put( char c )
+        {
+            if ( mLen == sizeof( mBuffer ) )
+            {
+                flush();
+            }
+            mBuffer[ mLen++ ] = c;
+        }
+
+        void put( const char* str, uint8_t n )
+        {
+            while ( n-- )
+            {
+                put( *str++ );
+            }
+        }
+
+        void pad( char c, int n )
+        {
+            while ( n-- > 0 )
+            {
+                put( c );
+            }
+        }
+
+        size_t finish()
+        {
+            flush();
+            return mCount;
+        }
+
+    private:
+
+        void flush()
+        {
+            if ( mLen )
+            {
+                mCount += mOut.write( mBuffer, mLen );
+                mLen = 0;
+            }
+        }
+
+        Writer&     mOut;
+        size_t      mCount;
+        uint8_t     mLen;
+        char        mBuffer[ 32 ];
+    };
+
+
+
+    char readFormat( const char* format, bool inFlash )
+    {
+        return inFlash ? pgm_read_byte( format ) : *format;
+    }
+
+
+
+    size_t formatToWriter( Writer& writer, const char* format, bool inFlash, va_list args )
+    {
+        FormatBuffer out( writer );
+
+        char c;
+        while ( ( c = readFormat( format++, inFlash ) ) )
+        {
+            if ( c != '%' )
+            {
+                out.put( c );
+                continue;
+            }
+
+            bool leftJustify = false;
+            bool zeroPad = false;
+            while ( true )
+            {
+                c = readFormat( format, inFlash );
+                if ( c == '-' )
+                {
+                    leftJustify = true;
+                }
+                else if ( c == '0' )
+                {
+                    zeroPad = true;
+                }
+                else
+                {
+                    break;
+                }
+                ++format;
+            }
+
+            int width = 0;
+            while ( ( c = readFormat( format, inFlash ) ) >= '0' && c <= '9' )
+            {
+                width = width * 10 + ( c - '0' );
+                ++format;
+            }
+
+            int precision = -1;
+            if ( c == '.' )
+            {
+                precision = 0;
+                ++format;
+                while ( ( c = readFormat( format, inFlash ) ) >= '0' && c <= '9' )
+                {
+                    precision = precision * 10 + ( c - '0' );
+                    ++format;
+                }
+            }
+
+            bool isLong = false;
+            if ( c == 'l' )
+            {
+                isLong = true;
+                c = readFormat( ++format, inFlash );
+            }
+
+            if ( !c )
+            {
+                break;
+            }
+            ++format;
+
+            // 32 binary digits is the longest conversion; 21 characters is the longest float
+            char buf[ 8 * sizeof(long) ];
+            char* end = &buf[ sizeof(buf) ];
+            char* str = end;
+            bool negative = false;
+            int trailingZeros = 0;
+
+            switch ( c )
+            {
+                case 'd':
+                case 'i':
+                    if ( isLong )
+                    {
+                        long n = va_arg( args, long );
+                        negative = ( n < 0 );
+                        str = toDecimal( static_cast<uint32_t>( negative ? -n : n ), end );
+                    }
+                    else
+                    {
+                        int n = va_arg( args, int );
+                        negative = ( n < 0 );
+                        str = toDecimal( static_cast<uint16_t>( negative ? -n : n ), end );
+                    }
+                    break;
+
+                case 'u':
+                case 'x':
+                case 'X':
+                case 'o':
+                case 'b':
+                {
+                    uint8_t shift = ( c == 'u' ) ? 0 : ( c == 'o' ) ? 3 : ( c == 'b' ) ? 1 : 4;
+                    if ( isLong )
+                    {
+                        uint32_t n = va_arg( args, unsigned long );
+                        str = shift ? toPowerOfTwoBase( n, shift, end ) : toDecimal( n, end );
+                    }
+                    else
+                    {
+                        uint16_t n = va_arg( args, unsigned int );
+                        str = shift ? toPowerOfTwoBase( n, shift, end ) : toDecimal( n, end );
+                    }
+                    if ( c == 'x' )
+                    {
+                        for ( char* p = str; p < end; ++p )
+                        {
+                            if ( *p >= 'A' )
+                            {
+                                *p += 'a' - 'A';
+                            }
+                        }
+                    }
+                    break;
+                }
+
+                case 'f':
+                {
+                    double d = va_arg( args, double );
+                    const char* e = floatException( d );
+                    if ( e )
+                    {
+                        str = end - 3;
+                        memcpy_P( str, e, 3 );
+                    }
+                    else
+                    {
+                        if ( precision < 0 )
+                        {
+                            precision = 6;
+                        }
+                        uint8_t fracDigits = precision > kMaxFloatDigits ? kMaxFloatDigits : precision;
+                        trailingZeros = precision - fracDigits;
+                        str = formatFloat( d, fracDigits, end );
+                        if ( *str == '-' )
+                        {
+                            negative = true;
+                            ++str;
+                        }
+                    }
+                    break;
+                }
+
+                case 'c':
+                    *--str = va_arg( args, int );
+                    break;
+
+                case 's':
+                case 'S':
+                {
+                    // Strings are copied straight through rather than into buf
+                    const char* s = va_arg( args, const char* );
+                    if ( !s )
+                    {
+                        break;
+                    }
+                    int len = ( c == 'S' ) ? strlen_P( s ) : strlen( s );
+                    if ( precision >= 0 && precision < len )
+                    {
+                        len = precision;
+                    }
+                    if ( !leftJustify )
+                    {
+                        out.pad( ' ', width - len );
+                    }
+                    for ( int k = 0; k < len; ++k )
+                    {
+                        out.put( ( c == 'S' ) ? pgm_read_byte( s + k ) : s[k] );
+                    }
+                    if ( leftJustify )
+                    {
+                        out.pad( ' ', width - len );
+                    }
+                    continue;
+                }
+
+                default:
+                    // Includes %%
+                    *--str = c;
+                    break;
+            }
+
+            int len = ( end - str ) + ( negative ? 1 : 0 ) + trailingZeros;
+            if ( !leftJustify && !zeroPad )
+            {
+                out.pad( ' ', width - len );
+            }
+            if ( negative )
+            {
+                out.put( '-' );
+            }
+            if ( !leftJustify && zeroPad )
+            {
+                out.pad( '0', width - len );
+            }
+            out.put( str, end - str );
+            out.pad( '0', trailingZeros );
+            if ( leftJustify )
+            {
+                out.pad( ' ', width - len );
+            }
+        }
+
+        return out.finish();
+    }
+
 }
 
-size_t Writer::printFloat( double number, uint8_t digits )
+
+
+// The number routines below format into a buffer with one spare byte at the end for the new line, so each
+// call ends in a single write()
+
+size_t Writer::printNumber( unsigned long n, uint8_t base, bool negative, bool addLn )
 {
-    size_t n = 0;
+    // Assumes 8-bit chars plus optional 2-char base designator or sign, plus new line
+    char buf[ 8 * sizeof(long) + 2 + 1 ];
+    char* end = &buf[ sizeof(buf) - 1 ];
 
-    if ( isnan( number ) )
+    char* str = formatNumber( static_cast<uint32_t>( n ), base, end );
+    if ( negative )
     {
-        char tmp[4];
-        strncpy_P( tmp, sNan, 3 );
-        // Ensure null-terminated
-        tmp[3] = 0;
+        *--str = '-';
+    }
+
+    return writeLine( str, end, addLn );
+}
+
 
-        return print( tmp );
+
+size_t Writer::printNumber( unsigned int n, uint8_t base, bool negative, bool addLn )
+{
+    // 16-bit arithmetic throughout; much faster than widening to long
+    char buf[ 8 * sizeof(int) + 2 + 1 ];
+    char* end = &buf[ sizeof(buf) - 1 ];
+
+    char* str = formatNumber( static_cast<uint16_t>( n ), base, end );
+    if ( negative )
+    {
+        *--str = '-';
     }
-    if ( isinf( number ) )
+
+    return writeLine( str, end, addLn );
+}
+
+
+
+size_t Writer::printFixed( int32_t value, uint8_t decimals, bool addLn )
+{
+    // Sign, ten digits (the most an int32_t needs) plus a leading zero, the decimal point, and new line
+    char buf[ 14 ];
+    char* end = &buf[ sizeof(buf) - 1 ];
+
+    uint32_t u = value < 0 ? -static_cast<uint32_t>( value ) : value;
+    char* str = toDecimal( u, end );
+
+    size_t n = 0;
+    bool negative = ( value < 0 );
+    uint8_t nbrDigits = decimals;
+    if ( decimals >= 11 )
     {
-        char tmp[4];
-        strncpy_P( tmp, sInf, 3 );
-        // Ensure null-terminated
-        tmp[3] = 0;
+        // More leading zeros than fit in the buffer; send them separately
+        n += write( negative ? "-0." : "0." );
+        negative = false;
+        for ( uint8_t i = 10; i < decimals; ++i )
+        {
+            n += write( '0' );
+        }
+        nbrDigits = 10;
+        decimals = 0;
+    }
 
-        return print( tmp );
+    // Pad with zeros so there are enough digits (and one before the decimal point)
+    while ( end - str < nbrDigits + ( decimals ? 1 : 0 ) )
+    {
+        *--str = '0';
     }
-    if ( number >  4294967040.0 || number < -4294967040.0 )   // constants determined empirically
+
+    if ( decimals )
+    {
+        // Move the integer part down to make room for the decimal point
+        uint8_t intDigits = end - str - decimals;
+        for ( uint8_t i = 0; i < intDigits; ++i )
+        {
+            str[ i - 1 ] = str[i];
+        }
+        --str;
+        str[ intDigits ] = '.';
+    }
+
+    if ( negative )
+    {
+        *--str = '-';
+    }
+
+    return n + writeLine( str, end, addLn );
+}
+
+
+
+size_t Writer::printFloat( double number, uint8_t digits, bool addLn )
+{
+    const char* e = floatException( number );
+    if ( e )
     {
         char tmp[4];
-        strncpy_P( tmp, sOvf, 3 );
+        strncpy_P( tmp, e, 3 );
         // Ensure null-terminated
         tmp[3] = 0;
 
-        return print( tmp );
+        return print( tmp, addLn );
     }
 
-    // Handle negative numbers
-    if ( number < 0.0 )
+    // No more than nine decimal digits are computed (a float carries only about seven significant digits
+    // anyway); any more are printed as zeros
+    uint8_t fracDigits = digits > kMaxFloatDigits ? kMaxFloatDigits : digits;
+
+    char buf[ 21 + 1 ];
+    char* end = &buf[ sizeof(buf) - 1 ];
+    char* str = formatFloat( number, fracDigits, end );
+
+    if ( digits == fracDigits )
     {
-        n += print( '-' );
-        number = -number;
+        return writeLine( str, end, addLn );
     }
 
-    // Round correctly so that print( 1.999, 2 ) prints as "2.00"
-    double rounding = 0.5;
-    for ( uint8_t i = 0; i < digits; ++i )
+    size_t n = write( str, end - str );
+    while ( digits-- > fracDigits )
     {
-        rounding /= 10.0;
+        n += write( '0' );
+    }
+    if ( addLn )
+    {
+        n += println();
     }
+    return n;
+}
 
-    number += rounding;
 
-    // Extract the integer part of the number and print it
-    unsigned long int_part = static_cast<unsigned long>( number );
-    double remainder = number - static_cast<double>( int_part );
-    n += print( int_part );
 
-    // Print the decimal point, but only if there are digits beyond
-    if ( digits > 0 )
+size_t Writer::writeLine( char* str, char* end, bool addLn )
+{
+    if ( addLn )
     {
-        n += print( '.' );
+        // There is always room for this
+        *end++ = SERIAL_OUTPUT_EOL;
     }
+    return write( str, end - str );
+}
 
-    // Extract digits from the remainder one at a time
-    while ( digits-- > 0 )
-    {
-        remainder *= 10.0;
-        int toPrint = static_cast<int>( remainder );
-        n += print( toPrint );
-        remainder -= toPrint;
-    }
 
-    return n;
-}
 
 
+size_t Writer::printf( const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    size_t n = formatToWriter( *this, format, false, args );
+    va_end( args );
+    return n;
+}
 
 
 
+size_t Writer::printf_P( const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    size_t n = formatToWriter( *this, format, true, args );
+    va_end( args );
+    return n;
+}
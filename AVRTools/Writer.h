@@ -204,7 +204,7 @@ public:
      * \hideinitializer
      */
     size_t print( uint8_t n, int base = kDec, bool addLn = false )
-    { return print( static_cast<unsigned long>( n ), base, addLn ); }
+    { return print( static_cast<unsigned int>( n ), base, addLn ); }
 
     /*!
      * \brief Print an integer to the output stream, with or without adding
@@ -235,8 +235,7 @@ public:
      *
      * \hideinitializer
      */
-    size_t print( unsigned int n, int base = kDec, bool addLn = false )
-    { return print( static_cast<unsigned long>( n ), base, addLn ); }
+    size_t print( unsigned int n, int base = kDec, bool addLn = false );
 
 
     /*!
@@ -286,6 +285,24 @@ public:
     size_t print( double d, int digits = 2, bool addLn = false );
 
 
+    /*!
+     * \brief Print a fixed-point number (an integer scaled by a power of 10) to the output stream, with or without
+     * adding a new line character at the end.  For example, printFixed( -1234, 2 ) prints -12.34.
+     *
+     * This uses only integer arithmetic, so it is much faster than printing a floating point number, and suits
+     * sensor readings that are already scaled (for example, temperatures in hundredths of a degree).
+     *
+     * \arg \c value is the scaled value to output.
+     * \arg \c decimals is the number of decimal digits in \c value (the power of 10 it is scaled by).
+     * \arg \c addLn if true, a new line character is added at the end of the output; the default is false.
+     *
+     * \returns the number of bytes sent to the output stream.
+     *
+     * \hideinitializer
+     */
+    size_t printFixed( int32_t value, uint8_t decimals, bool addLn = false );
+
+
     /*!
      * \brief Print a null-terminated string to the output stream, adding
      * a new line character at the end.
@@ -414,15 +431,65 @@ public:
      */
     size_t println( double d, int digits = 2 )              { return print( d, digits, true ); }
 
+    /*!
+     * \brief Print a fixed-point number (an integer scaled by a power of 10) to the output stream, adding
+     * a new line character at the end.
+     *
+     * \arg \c value is the scaled value to output.
+     * \arg \c decimals is the number of decimal digits in \c value (the power of 10 it is scaled by).
+     *
+     * \returns the number of bytes sent to the output stream.
+     */
+    size_t printlnFixed( int32_t value, uint8_t decimals )  { return printFixed( value, decimals, true ); }
+
     /*!
      * \brief Print a new line to the output stream.
      */
     size_t println();
 
+
+    /*!
+     * \brief Print formatted output, much like the standard printf() but far smaller and faster.
+     *
+     * The output is built in a small buffer on the stack and passed to the output stream in chunks of up to 32
+     * characters, rather than one character at a time.
+     *
+     * Conversions have the form %[flags][width][.precision][l]type.  The flags are \c - (left justify
+     * within the width) and \c 0 (pad numbers with zeros).  The types are:
+     * - \c d or \c i: a signed int (with \c l, a long), in decimal.
+     * - \c u, \c x, \c X, \c o, \c b: an unsigned int (with \c l, an unsigned long) in decimal, hexadecimal
+     * (lower or upper case), octal, or binary.  No base designator is added.
+     * - \c f: a double, with \c precision decimal digits (default 6; digits past the ninth are printed as zeros).
+     * - \c c: a character.
+     * - \c s: a null-terminated string (\c precision limits the number of characters printed).
+     * - \c S: a null-terminated string stored in PROGMEM.
+     * - \c %: a percent sign.
+     *
+     * \arg \c format the format string.
+     * \arg \c ... the values to format.
+     *
+     * \returns the number of bytes sent to the output stream.
+     */
+    size_t printf( const char* format, ... );
+
+
+    /*!
+     * \brief Print formatted output using a format string stored in PROGMEM (for example, with PSTR()).
+     * Otherwise the same as printf().
+     *
+     * \arg \c format the format string, in PROGMEM.
+     * \arg \c ... the values to format.
+     *
+     * \returns the number of bytes sent to the output stream.
+     */
+    size_t printf_P( const char* format, ... );
+
 private:
 
-    size_t printNumber( unsigned long n, uint8_t base );
-    size_t printFloat( double d, uint8_t digits );
+    size_t printNumber( unsigned long n, uint8_t base, bool negative, bool addLn );
+    size_t printNumber( unsigned int n, uint8_t base, bool negative, bool addLn );
+    size_t printFloat( double d, uint8_t digits, bool addLn );
+    size_t writeLine( char* str, char* end, bool addLn );
 };
 
 #endif
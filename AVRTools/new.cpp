@@ -27,13 +27,117 @@
 #include "new.h"
 
 
+
+#ifdef NEW_USES_MEMORY_POOLS
+
+#include "MemPool.h"
+#include "MemUtils.h"
+
+
+#ifndef NEW_POOL_8_BLOCKS
+#define NEW_POOL_8_BLOCKS       16
+#endif
+
+#ifndef NEW_POOL_16_BLOCKS
+#define NEW_POOL_16_BLOCKS      8
+#endif
+
+#ifndef NEW_POOL_32_BLOCKS
+#define NEW_POOL_32_BLOCKS      4
+#endif
+
+#if NEW_POOL_8_BLOCKS < 1 || NEW_POOL_8_BLOCKS > 255 || NEW_POOL_16_BLOCKS < 1 || NEW_POOL_16_BLOCKS > 255 \
+    || NEW_POOL_32_BLOCKS < 1 || NEW_POOL_32_BLOCKS > 255
+#error "NEW_POOL_8_BLOCKS, NEW_POOL_16_BLOCKS, and NEW_POOL_32_BLOCKS must be between 1 and 255"
+#endif
+
+
+
+namespace
+{
+
+    MemPoolT< 8, NEW_POOL_8_BLOCKS >        gNewPool8;
+    MemPoolT< 16, NEW_POOL_16_BLOCKS >      gNewPool16;
+    MemPoolT< 32, NEW_POOL_32_BLOCKS >      gNewPool32;
+
+    MemPool* const kNewPools[] = { &gNewPool8, &gNewPool16, &gNewPool32 };
+
+    const uint8_t kNbrNewPools = sizeof( kNewPools ) / sizeof( kNewPools[0] );
+
+
+    // Before the pools are constructed (if new is called by static initializers in other files)
+    // they are all zeros, so they fail every allocation and own nothing; everything goes to malloc()
+
+    void* allocateMemory( size_t size )
+    {
+        for ( uint8_t i = 0; i < kNbrNewPools; ++i )
+        {
+            if ( size <= kNewPools[i]->blockSize() )
+            {
+                void* ptr = kNewPools[i]->allocate();
+                if ( ptr )
+                {
+                    return ptr;
+                }
+                // Try the next larger size
+            }
+        }
+        return malloc( size );
+    }
+
+
+    void releaseMemory( void* ptr )
+    {
+        for ( uint8_t i = 0; i < kNbrNewPools; ++i )
+        {
+            if ( kNewPools[i]->owns( ptr ) )
+            {
+                kNewPools[i]->release( ptr );
+                return;
+            }
+        }
+        free( ptr );
+    }
+
+};
+
+
+
+bool MemUtils::getNewPoolStats( uint8_t sizeClass, MemPoolStatistics* stats )
+{
+    if ( sizeClass >= kNbrNewPools )
+    {
+        return false;
+    }
+    kNewPools[ sizeClass ]->getStatistics( stats );
+    return true;
+}
+
+
+#else
+
+namespace
+{
+
+    inline void* allocateMemory( size_t size )
+    { return malloc( size ); }
+
+    inline void releaseMemory( void* ptr )
+    { free( ptr ); }
+
+};
+
+#endif
+
+
+
 void* operator new( size_t size )
 {
     if ( size == 0 )
     {
         size = 1;
     }
-    return malloc( size );
+    return allocateMemory( size );
 }
 
 
@@ -43,7 +147,7 @@ void* operator new[]( size_t size )
     {
         size = 1;
     }
-    return malloc( size );
+    return allocateMemory( size );
 }
 
 
@@ -51,7 +155,7 @@ void operator delete( void* ptr )
 {
     if ( ptr )
     {
-        free( ptr );
+        releaseMemory( ptr );
     }
 }
 
@@ -60,7 +164,7 @@ void operator delete[]( void* ptr )
 {
     if ( ptr )
     {
-        free( ptr );
+        releaseMemory( ptr );
     }
 }
 
@@ -72,7 +176,7 @@ void operator delete( void* ptr, size_t sz )
 {
     if ( ptr )
     {
-        free( ptr );
+        releaseMemory( ptr );
     }
 }
 
@@ -81,7 +185,7 @@ void operator delete[]( void* ptr, size_t sz )
 {
     if ( ptr )
     {
-        free( ptr );
+        releaseMemory( ptr );
     }
 }
 
@@ -31,6 +31,14 @@
  * \note The AVRTools library does not itself make any use of heap storage
  * or the `new` or `delete` operators.
  *
+ * If the macro \c NEW_USES_MEMORY_POOLS is defined when new.cpp is compiled, requests of up to 32 bytes are
+ * served from fixed-size block pools (see MemPool.h) of 8, 16, and 32 byte blocks, which never fragment the
+ * heap; a request that doesn't fit, or finds its pool (and all larger pools) empty, goes to malloc() as usual.
+ * The number of blocks in each pool is set by the macros \c NEW_POOL_8_BLOCKS (default 16),
+ * \c NEW_POOL_16_BLOCKS (default 8), and \c NEW_POOL_32_BLOCKS (default 4).  The pools take their memory
+ * statically (384 bytes with the defaults), and MemUtils::getNewPoolStats() reports how they are used.
+ * You must then also link against MemPool.cpp.
+ *
  */
 
 
@@ -0,0 +1,359 @@
+/*
+    AVRToolsBenchmarks.cpp - Firmware that measures the hot paths of the AVRTools
+    library on AVR ATMega328p (Arduino Uno) and ATMega2560 (Arduino Mega).
+    This is part of the AVRTools library.
+    Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/*
+ * This firmware times the hot paths of the library with the high-resolution clock and reports the results
+ * over USART0 at 115200 baud, one comma-separated line per measurement:
+ *
+ *      bench,<mcu>,<name>,<iterations>,<cycles>,<cycles per op>,<ops per second>
+ *
+ * preceded by "info" lines (the processor, the serial interface used, F_CPU, and the cost of an empty loop) and
+ * followed by "done".  Cycles are CPU clock cycles, with the cost of an empty loop subtracted.  The timer0
+ * interrupt of the system clock keeps running, which adds about 0.5% to each result.
+ *
+ * Build it from the root of the repository with the library sources it uses, for example:
+ *
+ *      avr-g++ -std=gnu++11 -Os -mmcu=atmega328p -DF_CPU=16000000UL -DHIGH_RES_CLOCK_PRESCALER=1 -I. \
+ *          benchmarks/AVRToolsBenchmarks.cpp AVRTools/InitSystem.cpp AVRTools/SystemClock.cpp \
+ *          AVRTools/HighResClock.cpp AVRTools/RingBuffer.cpp AVRTools/Writer.cpp AVRTools/Reader.cpp \
+ *          AVRTools/USART0.cpp AVRTools/SPI.cpp AVRTools/I2cMaster.cpp AVRTools/Analog2Digital.cpp \
+ *          AVRTools/abi.cpp AVRTools/new.cpp -o benchmarks.elf
+ *
+ * (use -mmcu=atmega2560 for the Mega).  A prescaler of 1 for the high-resolution clock gives single-cycle
+ * resolution; with the default of 8 the results are multiples of 8 cycles.
+ *
+ * Define \c BENCH_USART0_MINIMAL and link against USART0Minimal.cpp instead of USART0.cpp to report through
+ * USART0Minimal and time its blocking transmission in place of Serial0's buffered one (the two cannot be linked
+ * together).  The I2C results are for a one-byte register read from the device at \c BENCH_I2C_ADDRESS
+ * (default 0x50); with no device there, they time the address being refused.  The A2D results are for channel 0.
+ */
+
+
+
+#include "AVRTools/InitSystem.h"
+#include "AVRTools/SystemClock.h"
+#include "AVRTools/HighResClock.h"
+#include "AVRTools/RingBuffer.h"
+#include "AVRTools/RingBufferT.h"
+#include "AVRTools/Writer.h"
+#include "AVRTools/SPI.h"
+#include "AVRTools/I2cMaster.h"
+#include "AVRTools/Analog2Digital.h"
+
+#ifdef BENCH_USART0_MINIMAL
+#include "AVRTools/USART0Minimal.h"
+#else
+#include "AVRTools/USART0.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+
+
+#ifndef BENCH_I2C_ADDRESS
+#define BENCH_I2C_ADDRESS       0x50
+#endif
+
+
+#if defined(__AVR_ATmega328P__)
+#define kBenchMcu               "ATmega328P"
+#elif defined(__AVR_ATmega2560__)
+#define kBenchMcu               "ATmega2560"
+#else
+#error "Undefined AVR processor type"
+#endif
+
+
+
+
+namespace
+{
+
+    // Discards everything, so Writer::print() can be timed without the cost of a serial port
+    class NullWriter : public Writer
+    {
+    public:
+
+        virtual size_t write( char )                                { return 1; }
+        virtual size_t write( const char* str )                     { return strlen( str ); }
+        virtual size_t write( const char*, size_t size )            { return size; }
+        virtual size_t write( const uint8_t*, size_t size )         { return size; }
+        virtual void flush()                                        {}
+    };
+
+
+#ifdef BENCH_USART0_MINIMAL
+
+    // Reports through USART0Minimal, which only transmits bytes and strings
+    class MinimalWriter : public Writer
+    {
+    public:
+
+        virtual size_t write( char c )
+        {
+            transmitUSART0( c );
+            return 1;
+        }
+
+        virtual size_t write( const char* str )
+        {
+            transmitUSART0( str );
+            return strlen( str );
+        }
+
+        virtual size_t write( const char* buffer, size_t size )
+        {
+            for ( size_t i = 0; i < size; ++i )
+            {
+                transmitUSART0( buffer[i] );
+            }
+            return size;
+        }
+
+        virtual size_t write( const uint8_t* buffer, size_t size )
+        {
+            return write( reinterpret_cast<const char*>( buffer ), size );
+        }
+
+        virtual void flush()
+        {
+            // Each transmission blocks until the byte is in the USART
+        }
+    };
+
+    MinimalWriter   gOut;
+
+#else
+
+    Serial0         gOut;
+
+#endif
+
+
+    NullWriter      gNullWriter;
+
+    const uint16_t  kIterations = 1000;
+
+    const char      kMessage32[] = "0123456789abcdefghijklmnopqrstu\n";   // 31 characters and a newline
+    const size_t    kMessage32Length = 32;
+
+    // Cycles per iteration of an empty loop, subtracted from the results
+    uint32_t        gLoopCycles;
+
+    // Results are stored here so the compiler can't discard the code being timed
+    volatile uint8_t    gSink8;
+    volatile uint16_t   gSink16;
+    volatile uint32_t   gSink32;
+
+
+
+    template< typename F > uint32_t timeLoop( uint16_t n, F f )
+    {
+        uint32_t start = highResTicks32();
+        for ( uint16_t i = 0; i < n; ++i )
+        {
+            f();
+        }
+        return ( highResTicks32() - start ) * highResClockCyclesPerTick();
+    }
+
+
+    void report( const char* name, uint16_t n, uint32_t cycles )
+    {
+        gOut.print( "bench," kBenchMcu "," );
+        gOut.print( name );
+        gOut.print( ',' );
+        gOut.print( static_cast<unsigned int>( n ) );
+        gOut.print( ',' );
+        gOut.print( static_cast<unsigned long>( cycles ) );
+        gOut.print( ',' );
+        gOut.print( static_cast<unsigned long>( ( cycles + n / 2 ) / n ) );
+        gOut.print( ',' );
+        gOut.println( static_cast<unsigned long>( cycles ? static_cast<double>( F_CPU ) * n / cycles + 0.5 : 0 ) );
+
+        // Don't let the transmission of this report interfere with the next measurement
+        gOut.flush();
+    }
+
+
+    // Subtracts the cost of an empty loop
+    uint32_t timeOps( uint16_t n, uint32_t cycles )
+    {
+        uint32_t overhead = gLoopCycles * n;
+        return ( cycles > overhead ) ? cycles - overhead : 0;
+    }
+
+
+    template< typename F > void bench( const char* name, uint16_t n, F f )
+    {
+        report( name, n, timeOps( n, timeLoop( n, f ) ) );
+    }
+
+
+
+    void benchSystemClock()
+    {
+        bench( "micros", kIterations, []{ gSink32 = micros(); } );
+        bench( "millis", kIterations, []{ gSink32 = millis(); } );
+        bench( "highResTicks32", kIterations, []{ gSink32 = highResTicks32(); } );
+    }
+
+
+    void benchRingBuffers()
+    {
+        static unsigned char storage[ 64 ];
+        static RingBuffer buf( storage, sizeof( storage ) );
+        static RingBufferT< uint8_t, uint8_t, 64 > bufT;
+
+        bench( "RingBuffer.push+pull", kIterations, []{ buf.push( 0x55 ); gSink16 = buf.pull(); } );
+        bench( "RingBufferT.push+pull", kIterations, []{ bufT.push( 0x55 ); gSink8 = bufT.pull(); } );
+    }
+
+
+    void benchWriter()
+    {
+        bench( "Writer.print(int8_t)", kIterations, []{ gNullWriter.print( static_cast<int8_t>( -123 ) ); } );
+        bench( "Writer.print(uint8_t)", kIterations, []{ gNullWriter.print( static_cast<uint8_t>( 234 ) ); } );
+        bench( "Writer.print(int)", kIterations, []{ gNullWriter.print( static_cast<int>( -12345 ) ); } );
+        bench( "Writer.print(unsigned)", kIterations,
+               []{ gNullWriter.print( static_cast<unsigned int>( 54321 ) ); } );
+        bench( "Writer.print(long)", kIterations, []{ gNullWriter.print( -1234567890L ); } );
+        bench( "Writer.print(unsigned long)", kIterations, []{ gNullWriter.print( 3456789012UL ); } );
+        bench( "Writer.print(unsigned,hex)", kIterations,
+               []{ gNullWriter.print( static_cast<unsigned int>( 0xBEEF ), Writer::kHex ); } );
+        bench( "Writer.print(double)", kIterations, []{ gNullWriter.print( 3.14159, 4 ); } );
+    }
+
+
+    void benchUsart()
+    {
+#ifdef BENCH_USART0_MINIMAL
+        bench( "USART0Minimal.transmit(32B)", 16, []{ transmitUSART0( kMessage32 ); } );
+#else
+        // The time to queue 32 bytes, then the time to queue and send them
+        bench( "Serial0.write(32B)", 1, []{ gOut.write( kMessage32, kMessage32Length ); } );
+        gOut.flush();
+        bench( "Serial0.write+flush(32B)", 16, []{ gOut.write( kMessage32, kMessage32Length ); gOut.flush(); } );
+#endif
+    }
+
+
+    void benchSpi()
+    {
+        static uint8_t buffer[ 64 ];
+
+        SPI::enable();
+        SPI::configure( SPI::SPISettings( 8000000, SPI::kMsbFirst, SPI::kSpiMode0 ) );
+
+        // One op is one byte, so the ops per second are the bytes per second
+        bench( "SPI.transmit(byte)", kIterations, []{ gSink8 = SPI::transmit( 0xA5 ); } );
+        report( "SPI.transmit(64B buffer)", 16 * sizeof( buffer ),
+                timeOps( 16, timeLoop( 16, []{ SPI::transmit( buffer, sizeof( buffer ) ); } ) ) );
+
+        SPI::disable();
+    }
+
+
+    void benchI2c()
+    {
+        static uint8_t data[ 1 ];
+        static volatile uint8_t asyncData[ 1 ];
+        static volatile uint8_t bytesRead;
+        static volatile uint8_t status;
+
+        I2cMaster::start( I2cMaster::kI2cBusFast );
+
+        bench( "I2cMaster.readSync", 16, []{ gSink16 = I2cMaster::readSync( BENCH_I2C_ADDRESS, 0, 1, data ); } );
+
+        // The time for the call to queue the transaction, then the time until it completes
+        bench( "I2cMaster.readAsync(queue)", 1,
+               []{ I2cMaster::readAsync( BENCH_I2C_ADDRESS, 0, 1, asyncData, &bytesRead, &status ); } );
+        while ( I2cMaster::busy() )
+            ;
+        bench( "I2cMaster.readAsync(complete)", 16,
+               []
+               {
+                   I2cMaster::readAsync( BENCH_I2C_ADDRESS, 0, 1, asyncData, &bytesRead, &status );
+                   while ( status == I2cMaster::kI2cNotStarted || status == I2cMaster::kI2cInProgress )
+                       ;
+               } );
+
+        I2cMaster::stop();
+    }
+
+
+    void benchA2D()
+    {
+        initA2D();
+
+        // The first conversion after turning on the ADC takes longer
+        gSink16 = readA2D( 0 );
+
+        bench( "readA2D", 100, []{ gSink16 = readA2D( 0 ); } );
+
+        turnOffA2D();
+    }
+
+};
+
+
+
+
+int main()
+{
+    initSystem();
+    initSystemClock();
+    initHighResClock();
+
+#ifdef BENCH_USART0_MINIMAL
+    initUSART0( 115200 );
+    gOut.println( "info," kBenchMcu ",USART0Minimal" );
+#else
+    gOut.start( 115200 );
+    gOut.println( "info," kBenchMcu ",Serial0" );
+#endif
+
+    gOut.print( "info,F_CPU," );
+    gOut.println( static_cast<unsigned long>( F_CPU ) );
+    gOut.flush();
+
+    // The cost of an empty loop (the asm statement keeps the compiler from removing it)
+    gLoopCycles = ( timeLoop( kIterations, []{ asm volatile( "" ); } ) + kIterations / 2 ) / kIterations;
+    gOut.print( "info,loop cycles," );
+    gOut.println( static_cast<unsigned long>( gLoopCycles ) );
+    gOut.flush();
+
+    benchSystemClock();
+    benchRingBuffers();
+    benchWriter();
+    benchUsart();
+    benchSpi();
+    benchI2c();
+    benchA2D();
+
+    gOut.println( "done" );
+    gOut.flush();
+
+    while ( 1 )
+        ;
+}
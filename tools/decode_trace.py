@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+#
+#   decode_trace.py - Decode the binary event stream produced by streamTrace()
+#   (see AVRTools/Trace.h) into readable text.
+#   This is part of the AVRTools library.
+#   Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU Lesser General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU Lesser General Public License for more details.
+#
+#   You should have received a copy of the GNU Lesser General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#
+#   Usage:
+#       decode_trace.py capture.bin
+#       decode_trace.py /dev/ttyACM0 --baud 115200      (requires pyserial)
+#       decode_trace.py - < capture.bin
+#
+#   Each record is 0xA5, an 8-byte TraceRecord (32-bit timestamp LSB first,
+#   source, event, data, status), and a checksum byte such that the 8 record
+#   bytes plus the checksum sum to 0 (mod 256).
+
+import argparse
+import os
+import stat
+import sys
+
+
+SYNC = 0xA5
+FRAME_SIZE = 10
+
+SOURCES = {
+    0x01: "I2cMaster",
+    0x02: "I2cSlave",
+    0xFF: "DROPPED",
+}
+
+EVENTS = {
+    0x01: {
+        1: "SendNextByte",
+        2: "SendRestartSameMsg",
+        3: "SendRestartNewMsg",
+        4: "Finished",
+        8: "SentAddressSendNextByte",
+        9: "SentAddressReadNextByte",
+        11: "GetNextByteAckAfterSLAR",
+        12: "GetNextByteNAckAfterSLAR",
+        13: "GetNextByteAck",
+        14: "GetNextByteNAck",
+        15: "RcvDoneRestart",
+        16: "RcvDoneStop",
+        17: "TryStartAgain",
+        18: "TryStartAgainError",
+        90: "ArbLostRestart",
+        91: "ErrorStop",
+        92: "ErrorStartStop",
+    },
+    0x02: {
+        1: "StartXmitData",
+        2: "StartXmitNoData",
+        3: "ContinueXmitData",
+        4: "ContinueXmitNoData",
+        8: "GotNackOkay",
+        9: "GotNackEarly",
+        11: "StartGcallRcv",
+        12: "StartRcv",
+        13: "DataRcv",
+        14: "DataRcvLastByte",
+        15: "StopWhileInProgress",
+        16: "StopOtherwise",
+        90: "ErrorStandby",
+    },
+}
+
+
+def frames(stream):
+    """Yield the 8 record bytes of each valid frame, resynchronizing on errors."""
+    buf = bytearray()
+    while True:
+        chunk = stream.read(64)
+        if not chunk:
+            return
+        buf.extend(chunk)
+        while len(buf) >= FRAME_SIZE:
+            if buf[0] != SYNC:
+                del buf[0]
+                continue
+            record = buf[1:9]
+            if (sum(record) + buf[9]) & 0xFF:
+                del buf[0]
+                continue
+            yield bytes(record)
+            del buf[:FRAME_SIZE]
+
+
+def decode(record, tick_us, last):
+    timestamp = int.from_bytes(record[0:4], "little")
+    source, event, data, status = record[4], record[5], record[6], record[7]
+
+    if source == 0xFF:
+        return "*** %d event(s) dropped (buffer full)" % data, last
+
+    delta = "" if last is None else "+%.1f us" % (((timestamp - last) & 0xFFFFFFFF) * tick_us)
+    name = SOURCES.get(source, "User%02X" % source if source >= 0x40 else "Src%02X" % source)
+    what = EVENTS.get(source, {}).get(event, "event %d" % event)
+    shown = chr(data) if 32 <= data < 127 else "."
+    line = "%12.1f us %-12s %-10s %-26s data 0x%02X '%s' status 0x%02X" % (
+        timestamp * tick_us, delta, name, what, data, shown, status)
+    return line, timestamp
+
+
+def open_input(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    if os.path.exists(path) and stat.S_ISCHR(os.stat(path).st_mode):
+        import serial
+        return serial.Serial(path, baud, timeout=None)
+    return open(path, "rb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode an AVRTools binary trace stream.")
+    parser.add_argument("input", help="capture file, serial device, or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200, help="baud rate for a serial device")
+    parser.add_argument("--tick-ns", type=float, default=500.0,
+                        help="nanoseconds per timestamp tick (default 500: highResTicks32() at /8 and 16 MHz)")
+    args = parser.parse_args()
+
+    tick_us = args.tick_ns / 1000.0
+    last = None
+    for record in frames(open_input(args.input, args.baud)):
+        line, last = decode(record, tick_us, last)
+        print(line, flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+#
+#   framing.py - The host side of the binary framing protocol of FramedUsart
+#   (see AVRTools/USARTFraming.h):  SLIP framing with a CRC-16.
+#   This is part of the AVRTools library.
+#   Copyright (c) 2016 Igor Mikolic-Torreira.  All right reserved.
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU Lesser General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU Lesser General Public License for more details.
+#
+#   You should have received a copy of the GNU Lesser General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#
+#   Usage:
+#       framing.py capture.bin                          (print each frame in hex)
+#       framing.py /dev/ttyACM0 --baud 115200           (requires pyserial)
+#       framing.py /dev/ttyACM0 --send 01020304         (send one frame, then print)
+#       framing.py - < capture.bin
+#
+#   Or import it and use encode() and Decoder in your own scripts.
+#
+#   Each frame is END (0xC0), the data and its CRC-16/CCITT-FALSE (MSB first)
+#   with END sent as ESC 0xDC and ESC (0xDB) sent as ESC 0xDD, then END.
+
+import argparse
+import os
+import stat
+import sys
+
+
+END = 0xC0
+ESC = 0xDB
+ESC_END = 0xDC
+ESC_ESC = 0xDD
+
+
+def crc16(data, crc=0xFFFF):
+    for c in data:
+        crc ^= c << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+        crc &= 0xFFFF
+    return crc
+
+
+def encode(data):
+    """Return the bytes to send for one frame."""
+    data = bytes(data)
+    crc = crc16(data)
+    out = bytearray([END])
+    for c in data + bytes([crc >> 8, crc & 0xFF]):
+        if c == END:
+            out += bytes([ESC, ESC_END])
+        elif c == ESC:
+            out += bytes([ESC, ESC_ESC])
+        else:
+            out.append(c)
+    out.append(END)
+    return bytes(out)
+
+
+class Decoder:
+    """Feed received bytes to feed(); it returns the list of intact frames completed."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.escaped = False
+        self.bad = False
+        self.crc_errors = 0
+        self.framing_errors = 0
+
+    def feed(self, chunk):
+        frames = []
+        for c in chunk:
+            if c == END:
+                if self.bad:
+                    self.framing_errors += 1
+                elif self.buf:
+                    if len(self.buf) < 2 or crc16(self.buf):
+                        self.crc_errors += 1
+                    else:
+                        frames.append(bytes(self.buf[:-2]))
+                self.buf.clear()
+                self.escaped = self.bad = False
+            elif self.bad:
+                pass
+            elif self.escaped:
+                self.escaped = False
+                if c == ESC_END:
+                    self.buf.append(END)
+                elif c == ESC_ESC:
+                    self.buf.append(ESC)
+                else:
+                    self.bad = True
+            elif c == ESC:
+                self.escaped = True
+            else:
+                self.buf.append(c)
+        return frames
+
+
+def open_port(path, baud):
+    if path == "-":
+        return sys.stdin.buffer, None
+    if os.path.exists(path) and stat.S_ISCHR(os.stat(path).st_mode):
+        import serial
+        port = serial.Serial(path, baud, timeout=None)
+        return port, port
+    return open(path, "rb"), None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Send and receive AVRTools FramedUsart frames.")
+    parser.add_argument("input", help="capture file, serial device, or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200, help="baud rate for a serial device")
+    parser.add_argument("--send", metavar="HEX", action="append", default=[],
+                        help="a frame to send (in hex) to a serial device before reading; may be repeated")
+    args = parser.parse_args()
+
+    stream, port = open_port(args.input, args.baud)
+    for frame in args.send:
+        if port is None:
+            parser.error("--send requires a serial device")
+        port.write(encode(bytes.fromhex(frame)))
+
+    decoder = Decoder()
+    while True:
+        chunk = stream.read(1 if port else 64)
+        if not chunk:
+            break
+        for frame in decoder.feed(chunk):
+            print("%3d: %s" % (len(frame), frame.hex(" ")), flush=True)
+
+    print("%d CRC error(s), %d framing error(s)" % (decoder.crc_errors, decoder.framing_errors), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()